@@ -0,0 +1,134 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+/*
+ * batch_bench: a brute force search, counting the bits of every value of
+ * a 16 bit key on 4096 lanes at a time, run by the scalar core and by the
+ * batch engine. Two versions of the routine are timed: one where lanes
+ * stay in lockstep and one where they branch apart on every bit.
+ * Reports lane-instructions per second.
+ */
+
+#include <stdio.h>
+#include <string.h>         // memcpy, memset
+#include <time.h>
+
+#include <batch.h>
+#include <bus.h>
+#include <cpu.h>
+#include <opcodes.h>
+
+#define LANES 4096
+
+/*
+ *     LD B, 16
+ * loop:
+ *     ADD HL, HL
+ *     ADC A, C
+ *     DJNZ loop
+ *     HALT
+ */
+static const byte lockstep_code[] = {
+    0x06, 0x10, 0x29, 0x89, 0x10, 0xFC, 0x76
+};
+
+/*
+ *     LD B, 16
+ * loop:
+ *     ADD HL, HL
+ *     JR NC, skip
+ *     INC A
+ * skip:
+ *     DJNZ loop
+ *     HALT
+ */
+static const byte branch_code[] = {
+    0x06, 0x10, 0x29, 0x30, 0x01, 0x3C, 0x10, 0xFA, 0x76
+};
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+bench(const char* name, const byte* code, size_t size)
+{
+    static byte ram[0x10000];
+    static struct bus_t bus;
+    struct z80_batch_t* batch = z80_batch_create(LANES);
+    struct cpu_t cpu;
+    unsigned long scalar_ops = 0, found = 0;
+    word stop = size - 1;
+    double scalar, vector;
+    long key;
+    int lane;
+
+    if (!batch) return;
+    memset(ram, 0, sizeof(ram));
+    memcpy(ram, code, size);
+    bus_init(&bus, ram);
+
+    scalar = now();
+    for (key = 0; key < 0x10000; key++) {
+        memset(&cpu, 0, sizeof(cpu));
+        cpu_init(&cpu, &bus);
+        REG_HL(cpu) = key;
+        while (PC(cpu) != stop) {
+            execute_opcode(&cpu);
+            scalar_ops++;
+        }
+        found += REG_A(cpu) == 8;
+    }
+    scalar = now() - scalar;
+
+    vector = now();
+    for (key = 0; key < 0x10000; key += LANES) {
+        for (lane = 0; lane < LANES; lane++) {
+            memset(&cpu, 0, sizeof(cpu));
+            cpu_init(&cpu, &bus);
+            REG_HL(cpu) = key + lane;
+            z80_batch_load(batch, lane, &cpu);
+        }
+        z80_batch_run(batch, stop, -1);
+        for (lane = 0; lane < LANES; lane++) {
+            found -= batch->reg[BATCH_A][lane] == 8;
+        }
+    }
+    vector = now() - vector;
+
+    printf("%s: scalar %.1f M ops/s, batch %.1f M ops/s, %.2fx%s\n", name,
+            scalar_ops / scalar / 1e6,
+            (batch->vector_ops + batch->scalar_ops) / vector / 1e6,
+            scalar / vector, found ? ", RESULTS DIFFER" : "");
+    z80_batch_free(batch);
+}
+
+int
+main(void)
+{
+    bench("lockstep", lockstep_code, sizeof(lockstep_code));
+    bench("branches", branch_code, sizeof(branch_code));
+    return 0;
+}
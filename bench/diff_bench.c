@@ -0,0 +1,74 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+/*
+ * diff_bench: time to compare two full machine states that differ in a
+ * handful of registers and bytes, the common case of a consistency check.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <bus.h>
+#include <cpu.h>
+#include <diff.h>
+
+#define ROUNDS 100000       // Diffs timed
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(void)
+{
+    static byte ram_a[0x10000], ram_b[0x10000];
+    static struct bus_t bus_a, bus_b;
+    static struct cpu_t a, b;
+    struct z80_diff_t diff;
+    unsigned long bytes = 0;
+    double start;
+    int i;
+
+    for (i = 0; i < 0x10000; i++) {
+        ram_a[i] = ram_b[i] = (byte) (i * 31 + (i >> 7));
+    }
+    ram_b[0x5C00] ^= 0xFF;
+    ram_b[0xFF00] ^= 0x01;
+    bus_init(&bus_a, ram_a);
+    bus_init(&bus_b, ram_b);
+    cpu_init(&a, &bus_a);
+    cpu_init(&b, &bus_b);
+    PC(b) = 0x1234;
+
+    start = now();
+    for (i = 0; i < ROUNDS; i++) {
+        z80_state_diff(&a, &b, &diff);
+        bytes += diff.bytes;
+    }
+    printf("%.2f us per diff, %lu bytes differ\n",
+            (now() - start) * 1e6 / ROUNDS, bytes / ROUNDS);
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+/*
+ * executor_bench: T-states per second for a fixed batch of machines run
+ * by 1, 2, 4... workers, up to one per core (or the count given as first
+ * argument), and the speedup over a single worker.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>         // atoi, malloc, free
+#include <string.h>         // memset
+#include <time.h>
+#include <unistd.h>         // sysconf
+
+#include <bus.h>
+#include <cpu.h>
+#include <executor.h>
+
+#include "machine.h"
+
+#define MACHINES 256        // Machines in the batch
+#define BUDGET 2000000      // T-states per machine
+#define SLICE 20000         // T-states per slice
+
+// INC A; LD (HL), A; INC L; JR -5, writes stay in 0x8000-0x80FF
+static const byte program[] = { 0x3C, 0x77, 0x2C, 0x18, 0xFB };
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+run(struct machine_t* machine, struct z80_task_t* task, int workers)
+{
+    struct z80_executor_t* executor = z80_executor_create(workers, SLICE);
+    double start;
+    int i;
+
+    for (i = 0; i < MACHINES; i++) {
+        machine_init(&machine[i], program, sizeof(program));
+        REG_HL(machine[i].cpu) = 0x8000;
+        memset(&task[i], 0, sizeof(struct z80_task_t));
+        task[i].cpu = &machine[i].cpu;
+        task[i].budget = BUDGET;
+    }
+    start = now();
+    for (i = 0; i < MACHINES; i++) {
+        z80_executor_submit(executor, &task[i]);
+    }
+    z80_executor_wait(executor);
+    start = now() - start;
+    z80_executor_destroy(executor);
+    return start;
+}
+
+int
+main(int argc, char** argv)
+{
+    struct machine_t* machine = malloc(MACHINES * sizeof(struct machine_t));
+    struct z80_task_t task[MACHINES];
+    long cores = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    double single = 0;
+    long workers;
+
+    if (!machine) return 1;
+    if (cores > EXECUTOR_MAX_WORKERS) cores = EXECUTOR_MAX_WORKERS;
+    for (workers = 1; workers <= cores; workers *= 2) {
+        double elapsed = run(machine, task, workers);
+        if (workers == 1) single = elapsed;
+        printf("%3ld workers: %.1f MT/s, %.2fx\n", workers,
+                (double) MACHINES * BUDGET / elapsed / 1e6,
+                single / elapsed);
+        if (workers < cores && workers * 2 > cores) workers = cores / 2;
+    }
+    free(machine);
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+/*
+ * pool_bench: instance create/destroy latency and memory per instance.
+ *
+ * Compares instances allocated one by one with z80_create against
+ * instances taken from a z80_pool, and measures how much resident memory
+ * an idle instance costs by watching the resident set size of the process
+ * while a batch of them is created.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pool.h>
+#include <z80.h>
+
+#define ROUNDS 1000000      // Create/destroy pairs per measurement
+#define BATCH 10000         // Idle instances for the memory measurement
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Resident set size of the process in bytes, 0 if it is not available.
+static long
+resident(void)
+{
+    long size, pages = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm) return 0;
+    if (fscanf(statm, "%ld %ld", &size, &pages) != 2) pages = 0;
+    fclose(statm);
+    return pages * 4096;
+}
+
+int
+main(void)
+{
+    static struct z80_t* batch[BATCH];
+    struct z80_pool_t* pool = z80_pool_create(BATCH);
+    struct z80_stats_t stats;
+    double start;
+    long before;
+    int i;
+
+    if (!pool) {
+        fprintf(stderr, "cannot create pool\n");
+        return 1;
+    }
+    printf("slot size: %lu bytes, arenas: %d (%d with huge pages)\n",
+            (unsigned long) pool->slot_size, pool->arenas, pool->huge_arenas);
+
+    start = now();
+    for (i = 0; i < ROUNDS; i++) {
+        z80_free(z80_create(NULL, 0, 0x00));
+    }
+    printf("z80_create + z80_free:   %6.1f ns\n",
+            (now() - start) * 1e9 / ROUNDS);
+
+    start = now();
+    for (i = 0; i < ROUNDS; i++) {
+        z80_free(z80_pool_get(pool, NULL, 0, 0x00));
+    }
+    printf("z80_pool_get + z80_free: %6.1f ns\n",
+            (now() - start) * 1e9 / ROUNDS);
+
+    before = resident();
+    for (i = 0; i < BATCH; i++) {
+        batch[i] = z80_pool_get(pool, NULL, 0, 0xFF);
+    }
+    z80_stats(batch[0], &stats);
+    printf("idle instance: %lu bytes (stats), %.0f bytes (RSS)\n",
+            (unsigned long) stats.resident,
+            (double) (resident() - before) / BATCH);
+
+    for (i = 0; i < BATCH; i++) {
+        z80_free(batch[i]);
+    }
+    z80_pool_destroy(pool);
+    return 0;
+}
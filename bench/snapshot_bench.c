@@ -0,0 +1,98 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+/*
+ * snapshot_bench: snapshots loaded and saved per second, for each format.
+ *
+ * The snapshot is kept in memory and read back through fmemopen, so the
+ * numbers are those of the parsers and decompressors, not of the disk.
+ * Memory is half code-like bytes and half runs, which is closer to real
+ * snapshots than random data.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <bus.h>
+#include <cpu.h>
+#include <snapshot.h>
+
+#define ROUNDS 20000        // Loads per format
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(void)
+{
+    static const char* names[] = { "SNA", "Z80", "SZX" };
+    static byte ram[0x10000];
+    static struct bus_t bus;
+    static struct cpu_t cpu;
+    double start;
+    int format, i;
+
+    for (i = 0; i < 0x10000; i++) {
+        ram[i] = (i & 0x100) ? 0x00 : (byte) (i * 31 + (i >> 7));
+    }
+    bus_init(&bus, ram);
+    cpu_init(&cpu, &bus);
+    SP(cpu) = 0xFF00;
+
+    for (format = SNAPSHOT_SNA; format <= SNAPSHOT_SZX; format++) {
+        char* data = NULL;
+        size_t size;
+        FILE* file;
+
+        start = now();
+        for (i = 0; i < ROUNDS; i++) {
+            free(data);
+            data = NULL;
+            file = open_memstream(&data, &size);
+            if (!file || snapshot_save(&cpu, format, file)) {
+                fprintf(stderr, "cannot save %s\n", names[format]);
+                return 1;
+            }
+            fclose(file);
+        }
+        printf("%s: %6lu bytes, %8.0f saves/s", names[format],
+                (unsigned long) size, ROUNDS / (now() - start));
+
+        start = now();
+        for (i = 0; i < ROUNDS; i++) {
+            file = fmemopen(data, size, "rb");
+            if (!file || snapshot_load(&cpu, format, file)) {
+                fprintf(stderr, "cannot load %s\n", names[format]);
+                return 1;
+            }
+            fclose(file);
+        }
+        printf(", %8.0f loads/s\n", ROUNDS / (now() - start));
+        free(data);
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+/*
+ * system_bench: T-states per second for a board of CPUs that mostly run
+ * on their own and now and then write to shared memory, one after the
+ * other and on a thread each, and the speedup of the threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>         // atoi, malloc, free
+#include <time.h>
+
+#include <bus.h>
+#include <cpu.h>
+#include <system.h>
+
+#include "machine.h"
+
+#define BUDGET 20000000     // T-states per CPU
+
+/*
+ * loop:
+ *     INC A
+ *     LD (HL), A
+ *     INC HL
+ *     DJNZ loop
+ *     LD (0x8000), A
+ *     JR loop
+ */
+static const byte program[] = {
+    0x3C, 0x77, 0x23, 0x10, 0xFB, 0x32, 0x00, 0x80, 0x18, 0xF6
+};
+
+static byte shared[MEM_PAGE_SIZE];
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+run(struct machine_t* machine, int cpus, int threaded)
+{
+    struct z80_system_t* system = z80_system_create(threaded, 256, 65536);
+    double start;
+    int i;
+
+    for (i = 0; i < cpus; i++) {
+        machine_init(&machine[i], program, sizeof(program));
+        REG_HL(machine[i].cpu) = 0x9000;
+        z80_system_add(system, &machine[i].cpu);
+        z80_system_share(system, i, 8, 1, shared);
+    }
+    start = now();
+    z80_system_run(system, BUDGET);
+    start = now() - start;
+    printf("%d CPUs, %s: %.1f MT/s, %lu quanta, %lu crossings\n", cpus,
+            threaded ? "threaded" : "single thread",
+            (double) cpus * BUDGET / start / 1e6, system->quanta,
+            system->handovers);
+    z80_system_free(system);
+    return start;
+}
+
+int
+main(int argc, char** argv)
+{
+    struct machine_t* machine = malloc(SYSTEM_MAX_CPUS
+            * sizeof(struct machine_t));
+    int cpus = argc > 1 ? atoi(argv[1]) : 2;
+    double single;
+
+    if (!machine) return 1;
+    if (cpus < 1 || cpus > SYSTEM_MAX_CPUS) cpus = 2;
+    single = run(machine, cpus, 0);
+    printf("speedup: %.2fx\n", single / run(machine, cpus, 1));
+    free(machine);
+    return 0;
+}
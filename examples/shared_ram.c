@@ -0,0 +1,118 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+/*
+ * shared_ram: shares the RAM of a CPU with a second process.
+ *
+ * Guest memory lives in a memfd instead of a buffer of this process. The
+ * CPU maps it read-write through bus_map_fd, and a child process maps the
+ * same memfd read-only and samples a counter the guest keeps incrementing,
+ * the way a monitor or a renderer would. Nothing is copied between them.
+ */
+
+#define _GNU_SOURCE         // memfd_create
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <bus.h>
+#include <cpu.h>
+#include <opcodes.h>
+
+#define COUNTER 0x8000      // Address of the counter
+#define SAMPLES 10          // Samples taken by the watcher
+
+static const byte program[] = {
+    0x21, 0x00, 0x80,       // LD HL, COUNTER
+    0x34,                   // loop: INC (HL)
+    0x18, 0xFD              // JR loop
+};
+
+// Child process: only reads guest memory.
+static int
+watch(int fd)
+{
+    const byte* ram = mmap(NULL, 0x10000, PROT_READ, MAP_SHARED, fd, 0);
+    int i;
+
+    if (ram == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    for (i = 0; i < SAMPLES; i++) {
+        usleep(20000);
+        printf("watcher: counter = 0x%02X\n", ram[COUNTER]);
+    }
+    munmap((void*) ram, 0x10000);
+    return 0;
+}
+
+int
+main(void)
+{
+    struct cpu_t cpu;
+    struct bus_t bus;
+    byte* ram;
+    pid_t watcher;
+    int fd = memfd_create("zeta80-ram", 0);
+
+    if (fd < 0 || ftruncate(fd, 0x10000) != 0) {
+        perror("memfd");
+        return 1;
+    }
+    bus_init(&bus, NULL);
+    ram = bus_map_fd(&bus, 0, MEM_PAGES, fd, 0);
+    if (!ram) {
+        perror("bus_map_fd");
+        return 1;
+    }
+
+    memset(&cpu, 0, sizeof(cpu));
+    cpu_init(&cpu, &bus);
+    bus_load(&bus, 0x0000, program, sizeof(program));
+
+    fflush(stdout);
+    watcher = fork();
+    if (watcher < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (watcher == 0) {
+        return watch(fd);
+    }
+
+    // Run the guest until the watcher is done.
+    while (waitpid(watcher, NULL, WNOHANG) == 0) {
+        int i;
+        for (i = 0; i < 10000; i++) {
+            execute_opcode(&cpu);
+        }
+    }
+    printf("cpu: %d T-states, counter = 0x%02X\n", cpu.tstates,
+            ram[COUNTER]);
+
+    bus_unmap_fd(&bus, ram, 0, MEM_PAGES);
+    close(fd);
+    return 0;
+}
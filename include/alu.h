@@ -0,0 +1,243 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef ALU_H_
+#define ALU_H_
+
+#include "cpu.h"
+
+/*
+ * Semantics of the instructions that compute on registers, shared by the
+ * interpreter in opcodes.c and the code generated by zeta80-aot. Operands
+ * are fetched and T-states counted by the caller.
+ *
+ * The macros only use bitwise and wrapping arithmetic on their operands,
+ * which are bytes or vectors of bytes, and keep the quirks of the
+ * interpreter: INC sets H when the low nibble of the operand is not zero,
+ * and ADC works out V with the carry added to the second operand.
+ */
+
+// Flags an 8 bit arithmetic operation writes.
+#define ALU_FLAGS8 (FLAG_S | FLAG_Z | FLAG_H | FLAG_P | FLAG_N | FLAG_C)
+
+// 0x80 where v is not zero, 0 where it is.
+#define ALU_NONZERO(v) (((v) | -(v)) & 0x80)
+
+// S and Z of a result.
+#define ALU_SZ(r) (((r) & FLAG_S) | ((ALU_NONZERO(r) ^ 0x80) >> 1))
+
+// H: carry or borrow into bit 4 of r = a + b or r = a - b.
+#define ALU_HALF(a, b, r) (((a) ^ (b) ^ (r)) & FLAG_H)
+
+// C: carry out of bit 7 of r = a + b (+ 1).
+#define ALU_CARRY_ADD(a, b, r) \
+    (((((a) & (b)) | (((a) | (b)) & ~(r))) >> 7) & FLAG_C)
+
+// C: borrow out of bit 7 of r = a - b.
+#define ALU_CARRY_SUB(a, b, r) \
+    (((~(a) & (b)) | ((~(a) | (b)) & (r))) >> 7 & FLAG_C)
+
+// V: the operands have the same sign and the result another one.
+#define ALU_OVERFLOW_ADD(a, b, r) ((~((a) ^ (b)) & ((r) ^ (a)) & 0x80) >> 5)
+
+// V: the operands have different signs and the result that of b.
+#define ALU_OVERFLOW_SUB(a, b, r) ((((a) ^ (b)) & ~((r) ^ (b)) & 0x80) >> 5)
+
+// a <- a + b + c, c being 0 or 1. ADD A, r and ADC A, r.
+#define ALU_ADD8(a, f, b, c) do { \
+        __typeof__(a) alu_a = (a), alu_b = (b), alu_r = alu_a + alu_b + (c); \
+        (f) = ((f) & (byte) ~ALU_FLAGS8) | ALU_SZ(alu_r) \
+            | ALU_HALF(alu_a, alu_b, alu_r) \
+            | ALU_OVERFLOW_ADD(alu_a, (__typeof__(a)) (alu_b + (c)), alu_r) \
+            | ALU_CARRY_ADD(alu_a, alu_b, alu_r); \
+        (a) = alu_r; \
+    } while (0)
+
+// a <- a - b. SUB r.
+#define ALU_SUB8(a, f, b) do { \
+        __typeof__(a) alu_a = (a), alu_b = (b), alu_r = alu_a - alu_b; \
+        (f) = ((f) & (byte) ~ALU_FLAGS8) | ALU_SZ(alu_r) \
+            | ALU_HALF(alu_a, alu_b, alu_r) | FLAG_N \
+            | ALU_OVERFLOW_SUB(alu_a, alu_b, alu_r) \
+            | ALU_CARRY_SUB(alu_a, alu_b, alu_r); \
+        (a) = alu_r; \
+    } while (0)
+
+// v <- v + 1. INC r, C is kept.
+#define ALU_INC8(v, f) do { \
+        __typeof__(v) alu_v = (v), alu_r = alu_v + 1; \
+        (f) = ((f) & (byte) ~(ALU_FLAGS8 & ~FLAG_C)) | ALU_SZ(alu_r) \
+            | ALU_NONZERO(alu_v << 4) >> 3 \
+            | ALU_OVERFLOW_ADD(alu_v, 1, alu_r); \
+        (v) = alu_r; \
+    } while (0)
+
+// v <- v - 1. DEC r, C is kept.
+#define ALU_DEC8(v, f) do { \
+        __typeof__(v) alu_v = (v), alu_r = alu_v - 1; \
+        (f) = ((f) & (byte) ~(ALU_FLAGS8 & ~FLAG_C)) | ALU_SZ(alu_r) \
+            | ALU_HALF(alu_v, 1, alu_r) | FLAG_N \
+            | ALU_OVERFLOW_SUB(alu_v, 1, alu_r); \
+        (v) = alu_r; \
+    } while (0)
+
+// hl <- hl + ss, one byte at a time. ADD HL, ss, H and C from bits 11, 15.
+#define ALU_ADD16(h, l, f, sh, sl) do { \
+        __typeof__(h) alu_h = (h), alu_l = (l), alu_sh = (sh), alu_sl = (sl); \
+        __typeof__(h) alu_rl = alu_l + alu_sl; \
+        __typeof__(h) alu_rh = alu_h + alu_sh \
+            + ALU_CARRY_ADD(alu_l, alu_sl, alu_rl); \
+        (f) = ((f) & (byte) ~(FLAG_H | FLAG_N | FLAG_C)) \
+            | ALU_HALF(alu_h, alu_sh, alu_rh) \
+            | ALU_CARRY_ADD(alu_h, alu_sh, alu_rh); \
+        (h) = alu_rh; \
+        (l) = alu_rl; \
+    } while (0)
+
+// Rotations of A. RLCA, RRCA, RLA and RRA.
+#define ALU_ROTATE(a, f, y) do { \
+        __typeof__(a) alu_a = (a), alu_c = (f) & FLAG_C; \
+        switch (y) { \
+            case 0: (a) = (alu_a << 1) | (alu_a >> 7); break; \
+            case 1: (a) = (alu_a >> 1) | (alu_a << 7); break; \
+            case 2: (a) = (alu_a << 1) | alu_c; break; \
+            default: (a) = (alu_a >> 1) | (alu_c << 7); break; \
+        } \
+        (f) = ((f) & (byte) ~(FLAG_H | FLAG_N | FLAG_C)) \
+            | ((y) & 1 ? alu_a & 1 : alu_a >> 7); \
+    } while (0)
+
+// CPL, SCF and CCF.
+#define ALU_CPL(a, f) ((a) = ~(a), (f) |= FLAG_H | FLAG_N)
+#define ALU_SCF(f) ((f) = ((f) & (byte) ~(FLAG_H | FLAG_N)) | FLAG_C)
+#define ALU_CCF(f) \
+    ((f) = ((f) & (byte) ~(FLAG_H | FLAG_N | FLAG_C)) \
+        | ((f) & FLAG_C) << 4 | (~(f) & FLAG_C))
+
+/**
+ * ADD A, value and ADC A, value.
+ *
+ * @param cpu CPU instance
+ * @param value second operand
+ * @param carry 1 to add the carry flag (ADC), 0 otherwise
+ */
+static inline void
+alu_add(struct cpu_t* cpu, byte value, int carry)
+{
+    byte c = carry ? REG_F(*cpu) & FLAG_C : 0;
+    ALU_ADD8(REG_A(*cpu), REG_F(*cpu), value, c);
+}
+
+/**
+ * SUB value.
+ *
+ * @param cpu CPU instance
+ * @param value second operand
+ */
+static inline void
+alu_sub(struct cpu_t* cpu, byte value)
+{
+    ALU_SUB8(REG_A(*cpu), REG_F(*cpu), value);
+}
+
+/**
+ * INC of an 8 bit operand.
+ *
+ * @param cpu CPU instance
+ * @param value operand
+ * @return value + 1, to be written back
+ */
+static inline byte
+alu_inc(struct cpu_t* cpu, byte value)
+{
+    ALU_INC8(value, REG_F(*cpu));
+    return value;
+}
+
+/**
+ * DEC of an 8 bit operand.
+ *
+ * @param cpu CPU instance
+ * @param value operand
+ * @return value - 1, to be written back
+ */
+static inline byte
+alu_dec(struct cpu_t* cpu, byte value)
+{
+    ALU_DEC8(value, REG_F(*cpu));
+    return value;
+}
+
+/**
+ * ADD HL, value.
+ *
+ * @param cpu CPU instance
+ * @param value second operand
+ */
+static inline void
+alu_add_hl(struct cpu_t* cpu, word value)
+{
+    ALU_ADD16(REG_H(*cpu), REG_L(*cpu), REG_F(*cpu),
+            (byte) (value >> 8), (byte) value);
+}
+
+/**
+ * RLCA, RRCA, RLA or RRA.
+ *
+ * @param cpu CPU instance
+ * @param y y field of the opcode, 0 to 3
+ */
+static inline void
+alu_rotate(struct cpu_t* cpu, int y)
+{
+    ALU_ROTATE(REG_A(*cpu), REG_F(*cpu), y);
+}
+
+/**
+ * CPL, SCF or CCF.
+ *
+ * @param cpu CPU instance
+ * @param y y field of the opcode, 5 to 7
+ */
+static inline void
+alu_flags(struct cpu_t* cpu, int y)
+{
+    switch (y) {
+        case 5: ALU_CPL(REG_A(*cpu), REG_F(*cpu)); break;
+        case 6: ALU_SCF(REG_F(*cpu)); break;
+        default: ALU_CCF(REG_F(*cpu)); break;
+    }
+}
+
+/**
+ * EX AF, AF'.
+ *
+ * @param cpu CPU instance
+ */
+static inline void
+alu_ex_af(struct cpu_t* cpu)
+{
+    word tmp = REG_AF(*cpu);
+    REG_AF(*cpu) = ALT_AF(*cpu);
+    ALT_AF(*cpu) = tmp;
+}
+
+#endif // ALU_H_
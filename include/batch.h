@@ -0,0 +1,74 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include "cpu.h"
+
+#define BATCH_CHUNK 32          // Lanes per vector, one AVX2 register
+
+/*
+ * Index of the 8 bit registers in z80_batch_t.reg: the same as the r table
+ * of the opcodes, B C D E H L - A, with F in the slot of (HL).
+ */
+#define BATCH_F 6
+#define BATCH_A 7
+
+/**
+ * Many machines that run the same program, stored as a structure of
+ * arrays. The 8 bit registers, PC and tstates of every lane are kept in
+ * one array each, so an instruction can be run on many lanes at once.
+ * The rest of the state of a lane, memory bus included, stays in a
+ * cpu_t of its own. Lanes whose memory differs are fine: every lane
+ * reads its code through its own bus.
+ */
+struct z80_batch_t
+{
+    int lanes;                  //< Number of lanes
+    int capacity;               //< Lanes allocated, a multiple of the chunk
+    byte* reg[8];               //< 8 bit registers, see BATCH_A and BATCH_F
+    word* pc;                   //< Program counter of every lane
+    int* tstates;               //< T-state counter of every lane
+    byte* active;               //< 0xFF for lanes that run, 0x00 otherwise
+    struct bus_t** bus;         //< Memory bus of every lane
+    struct cpu_t* cpu;          //< Rest of the state of every lane
+
+    byte* opcode;               //< Scratch: opcode each lane is about to run
+    byte* pending;              //< Scratch: lanes left in the current step
+    byte* sel;                  //< Scratch: lanes of the current pass
+
+    unsigned long vector_ops;   //< Instructions run by the vector kernels
+    unsigned long scalar_ops;   //< Instructions run by execute_opcode
+};
+
+struct z80_batch_t* z80_batch_create(int lanes);
+void z80_batch_free(struct z80_batch_t* batch);
+
+void z80_batch_load(struct z80_batch_t* batch, int lane,
+        const struct cpu_t* cpu);
+void z80_batch_store(const struct z80_batch_t* batch, int lane,
+        struct cpu_t* cpu);
+
+int z80_batch_step(struct z80_batch_t* batch);
+long z80_batch_run(struct z80_batch_t* batch, word stop, long max_steps);
+
+#endif // BATCH_H_
@@ -0,0 +1,230 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef BUS_H_
+#define BUS_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "types.h"
+
+/*
+ * The 64 KB logical address space is a table of sixteen 4 KB pages. Every
+ * page has a pointer for reads and a pointer for writes to the host memory
+ * that backs it, so banking is just a matter of swapping pointers. A NULL
+ * pointer sends the access to the handlers of the page instead: that is
+ * how memory mapped I/O works, and a page with a read pointer but no write
+ * pointer is read-only memory. Without handlers, reads from unmapped
+ * memory return 0xFF and writes are ignored.
+ */
+#define MEM_PAGE_SHIFT 12                           // Bits per page offset
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_SHIFT)         // 4 KB pages
+#define MEM_PAGE_MASK (MEM_PAGE_SIZE - 1)           // Page offset mask
+#define MEM_PAGES (0x10000 >> MEM_PAGE_SHIFT)       // 16 logical pages
+#define MEM_LINE_SHIFT 6                            // 64 byte lines
+#define MEM_LINES (MEM_PAGE_SIZE >> MEM_LINE_SHIFT) // 64 lines per page
+#define BUS_CLASSES 4                               // Contention classes
+
+/** Handler for a read that has no host memory behind it. */
+typedef byte (*mem_read_t)(void* ctx, word addr);
+
+/** Handler for a write that has no host memory behind it. */
+typedef void (*mem_write_t)(void* ctx, word addr, byte value);
+
+/**
+ * Logical page. The pointers point to the first byte of the page.
+ */
+struct page_t
+{
+    const byte* read;           //< Host memory for reads, NULL to trap
+    byte* write;                //< Host memory for writes, NULL to trap
+    const byte* source;         //< Read pointer given to bus_map
+    byte* mapped;               //< Write pointer given to bus_map
+    mem_read_t on_read;         //< Trapped read handler, may be NULL
+    mem_write_t on_write;       //< Trapped write handler, may be NULL
+    void* ctx;                  //< Context given to the handlers
+    byte contention;            //< Contention class, 0 if uncontended
+};
+
+/**
+ * Dirty memory tracker. Every client that wants to know which memory the
+ * guest has written attaches its own tracker, and reads and clears it at
+ * its own pace. Bits are set by the thread that runs the CPU and can be
+ * fetched from any thread.
+ */
+struct bus_dirty_t
+{
+    atomic_uint pages;                  //< One bit per page
+    _Atomic uint64_t lines[MEM_PAGES];  //< One bit per line, if enabled
+    int track_lines;                    //< Whether lines are tracked
+    struct bus_dirty_t* next;           //< Next tracker of the bus
+};
+
+/**
+ * Contention model: the wait states that every access adds depending on
+ * the class of the page or port and on the position in the frame of the
+ * T-state counter, such as the Spectrum ULA stealing cycles from the CPU
+ * while it draws the screen. Delays are looked up, never computed. Class 0
+ * means uncontended and has no table: while a model is attached, accesses
+ * to pages of any other class are trapped, so the fast path of bus_read
+ * and bus_write stays the same for the rest of memory. The clock must be
+ * at the M-cycle of the access, which the CPU ensures with mem_read_at.
+ */
+struct bus_contention_t
+{
+    int* clock;                 //< T-state counter, usually of the CPU
+    int frame;                  //< T-states per frame
+    const byte* delay[BUS_CLASSES]; //< Wait states per T-state, by class
+    byte io[256];               //< Class of each port, by high byte
+};
+
+/**
+ * Incremental hash of the memory seen through a bus. Every byte readable
+ * from host memory contributes bus_hash_key of its address and value,
+ * combined with XOR, so a write only has to remove the key of the old
+ * value and add the key of the new one. Keys are computed instead of
+ * looked up in a table of random numbers, which for 64 KB of memory would
+ * take 128 MB. While a hash is attached every write is trapped; buses
+ * without one are not slowed down at all.
+ */
+struct bus_hash_t
+{
+    uint64_t page[MEM_PAGES];   //< Hash of each page
+};
+
+/**
+ * Undo log: the previous value of every byte of memory written through
+ * the bus, in order, so that the writes can be undone backwards. While a
+ * log is attached every write is trapped.
+ */
+struct bus_undo_t
+{
+    struct bus_undo_entry_t
+    {
+        word addr;              //< Address written
+        byte value;             //< Value it had before
+        const byte* source;     //< Host page mapped at addr after the write
+    } *entry;                   //< Entries, oldest first
+    size_t count;               //< Entries used
+    size_t capacity;            //< Entries allocated
+    int failed;                 //< An entry could not be allocated
+};
+
+/**
+ * Memory bus. It is owned by the caller and referenced by the CPU, so the
+ * same bus can be switched between CPUs and the CPU structure only holds
+ * registers.
+ */
+struct bus_t
+{
+    struct page_t page[MEM_PAGES]; //< Page table
+    struct bus_dirty_t* dirty;  //< Attached dirty trackers, may be NULL
+    struct bus_contention_t* contention; //< Contention model, may be NULL
+    struct bus_hash_t* hash;    //< Memory hash, may be NULL
+    struct bus_undo_t* undo;    //< Undo log, may be NULL
+};
+
+void bus_init(struct bus_t* bus, byte* ram);
+void bus_map(struct bus_t* bus, int first, int count,
+        const byte* read, byte* write);
+void bus_handlers(struct bus_t* bus, int first, int count,
+        mem_read_t on_read, mem_write_t on_write, void* ctx);
+
+void bus_copy(struct bus_t* dst, const struct bus_t* src);
+
+byte bus_trap_read(const struct bus_t* bus, word addr);
+void bus_trap_write(struct bus_t* bus, word addr, byte value);
+
+byte* bus_map_fd(struct bus_t* bus, int first, int count, int fd,
+        off_t offset);
+void bus_unmap_fd(struct bus_t* bus, byte* host, int first, int count);
+
+void bus_load(struct bus_t* bus, word addr, const byte* data,
+        size_t size);
+void bus_dump(const struct bus_t* bus, word addr, byte* data,
+        size_t size);
+
+void bus_dirty_attach(struct bus_t* bus, struct bus_dirty_t* dirty,
+        int track_lines);
+void bus_dirty_detach(struct bus_t* bus, struct bus_dirty_t* dirty);
+unsigned bus_dirty_fetch_pages(struct bus_dirty_t* dirty);
+uint64_t bus_dirty_fetch_lines(struct bus_dirty_t* dirty, int page);
+void bus_dirty_mark_host(struct bus_t* bus, const byte* host, size_t size);
+
+void bus_contention_attach(struct bus_t* bus,
+        struct bus_contention_t* contention);
+void bus_contention_detach(struct bus_t* bus);
+void bus_contend(struct bus_t* bus, int first, int count, byte class);
+int bus_contend_io(const struct bus_t* bus, word port);
+void bus_contention_ula(byte* delay, int frame, int first, int line);
+
+void bus_hash_attach(struct bus_t* bus, struct bus_hash_t* hash);
+void bus_hash_detach(struct bus_t* bus);
+void bus_hash_refresh(struct bus_t* bus, int first, int count);
+uint64_t bus_hash(const struct bus_t* bus);
+
+void bus_undo_attach(struct bus_t* bus, struct bus_undo_t* undo);
+void bus_undo_detach(struct bus_t* bus);
+
+/**
+ * Hash key of a value stored in a slot: slots 0 to 0xFFFF are addresses,
+ * and the CPU uses the slots above for its registers. This is the
+ * finalizer of SplitMix64.
+ */
+static inline uint64_t
+bus_hash_key(uint32_t slot, byte value)
+{
+    uint64_t x = ((uint64_t) slot << 8 | value) + 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Reads a byte from the bus.
+ */
+static inline byte
+bus_read(const struct bus_t* bus, word addr)
+{
+    const struct page_t* page = &bus->page[addr >> MEM_PAGE_SHIFT];
+    if (page->read) {
+        return page->read[addr & MEM_PAGE_MASK];
+    }
+    return bus_trap_read(bus, addr);
+}
+
+/**
+ * Writes a byte to the bus.
+ */
+static inline void
+bus_write(struct bus_t* bus, word addr, byte value)
+{
+    const struct page_t* page = &bus->page[addr >> MEM_PAGE_SHIFT];
+    if (page->write) {
+        page->write[addr & MEM_PAGE_MASK] = value;
+    } else {
+        bus_trap_write(bus, addr, value);
+    }
+}
+
+#endif // BUS_H_
@@ -0,0 +1,66 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef CODECACHE_H_
+#define CODECACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "decode.h"
+
+/** Bump whenever the layout of cache files or of insn_t changes. */
+#define CODECACHE_VERSION 1
+
+/**
+ * A decoded code region. There is one insn_t for every byte of the region,
+ * decoded as if an instruction started there, so any PC inside the region
+ * can be looked up directly.
+ *
+ * Regions either live on the heap or are memory-mapped read-only from a
+ * cache file. In both cases they are immutable after being created.
+ */
+struct code_region_t
+{
+    word base;                  //< Address of the first byte
+    size_t size;                //< Number of bytes in the region
+    uint64_t hash;              //< Hash of the code bytes
+    const byte* bytes;          //< Code the region was decoded from
+    const struct insn_t* insns; //< Decoded instruction at each byte
+    int validated;              //< 1 once bytes have been checked
+
+    void* mapping;              //< Cache file mapping, NULL if on the heap
+    size_t mapping_size;        //< Size of the mapping
+};
+
+uint64_t code_hash(const byte* data, size_t size);
+
+int code_region_decode(struct code_region_t* region, const byte* bytes,
+        word base, size_t size);
+int code_region_validate(struct code_region_t* region,
+        struct cpu_t* cpu);
+void code_region_free(struct code_region_t* region);
+
+int code_cache_store(const char* dir, const struct code_region_t* region);
+int code_cache_load(const char* dir, struct code_region_t* region,
+        const byte* bytes, word base, size_t size);
+
+#endif // CODECACHE_H_
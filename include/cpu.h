@@ -23,6 +23,7 @@
 #define CPU_H_
 
 #include "types.h"
+#include "bus.h"
 
 /** Check whether a flag is set or reset. Deprecated. */
 #define GET_FLAG(f, flag) ((f & flag) != 0)
@@ -83,13 +84,13 @@ struct bank_t
     union register_t hl; //< HL register pair
 };
 
+struct z80_rom_image_t;
+
 /**
  * CPU structure.
  */
 struct cpu_t
 {
-    byte mem[0x10000];          //< Memory
-
     struct bank_t main;         //< Main Register Bank
     struct bank_t alternate;    //< Alternate Register Bank
 
@@ -99,8 +100,14 @@ struct cpu_t
     union register_t iy;        //< Index Y
     byte i;                     //< Interruptor Vector
     byte r;                     //< Memory Refresh
+    byte iff1;                  //< Interrupt flip-flop 1
+    byte iff2;                  //< Interrupt flip-flop 2
+    byte im;                    //< Interrupt mode
 
     int tstates;                //< T-State counter
+
+    const struct z80_rom_image_t* rom; //< Predecoded ROM, may be NULL
+    struct bus_t* bus;          //< Memory bus
 };
 
 /*
@@ -153,4 +160,79 @@ struct cpu_t
 #define IYH(cpu) ((cpu).iy.BYTES.H) // Expands to IYh
 #define IYL(cpu) ((cpu).iy.BYTES.L) // Expands to IYl
 
+/**
+ * Reads a byte from the memory bus of a CPU.
+ */
+static inline byte
+mem_read(struct cpu_t* cpu, word addr)
+{
+    return bus_read(cpu->bus, addr);
+}
+
+/**
+ * Writes a byte to the memory bus of a CPU.
+ */
+static inline void
+mem_write(struct cpu_t* cpu, word addr, byte value)
+{
+    bus_write(cpu->bus, addr, value);
+}
+
+/*
+ * Accesses in the M-cycle that starts at T-state `at` of the instruction
+ * being run. Handlers add the T-states of an instruction once it is over,
+ * so the counter is moved to the M-cycle for the access: a contention
+ * model clocked by cpu->tstates looks its wait states up there, and they
+ * stay added when the counter is moved back.
+ */
+
+/**
+ * Reads a byte from the memory bus of a CPU at T-state `at`.
+ */
+static inline byte
+mem_read_at(struct cpu_t* cpu, int at, word addr)
+{
+    byte value;
+    cpu->tstates += at;
+    value = bus_read(cpu->bus, addr);
+    cpu->tstates -= at;
+    return value;
+}
+
+/**
+ * Writes a byte to the memory bus of a CPU at T-state `at`.
+ */
+static inline void
+mem_write_at(struct cpu_t* cpu, int at, word addr, byte value)
+{
+    cpu->tstates += at;
+    bus_write(cpu->bus, addr, value);
+    cpu->tstates -= at;
+}
+
+/**
+ * Reads a little endian word from the memory bus of a CPU, low byte at
+ * T-state `at` and high byte in the next M-cycle.
+ */
+static inline word
+mem_read16(struct cpu_t* cpu, int at, word addr)
+{
+    byte lo = mem_read_at(cpu, at, addr);
+    return lo | (mem_read_at(cpu, at + 3, addr + 1) << 8);
+}
+
+/**
+ * Writes a little endian word to the memory bus of a CPU, low byte at
+ * T-state `at` and high byte in the next M-cycle.
+ */
+static inline void
+mem_write16(struct cpu_t* cpu, int at, word addr, word value)
+{
+    mem_write_at(cpu, at, addr, value & 0xFF);
+    mem_write_at(cpu, at + 3, addr + 1, value >> 8);
+}
+
+void cpu_init(struct cpu_t* cpu, struct bus_t* bus);
+uint64_t z80_state_hash(const struct cpu_t* cpu);
+
 #endif
@@ -0,0 +1,60 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef DECODE_H_
+#define DECODE_H_
+
+#include <stddef.h>
+#include "types.h"
+
+/**
+ * How an instruction changes the flow of the program.
+ */
+enum flow_t
+{
+    FLOW_NEXT,      //< Always continues with the next instruction
+    FLOW_JUMP,      //< Jumps to target (JP nn, JR d, conditional if cond)
+    FLOW_CALL,      //< Calls target (CALL nn, RST p, conditional if cond)
+    FLOW_RETURN,    //< Returns from a call (conditional if cond)
+    FLOW_INDIRECT,  //< Jumps to an address only known at runtime
+    FLOW_HALT       //< Waits for an interrupt (HALT)
+};
+
+/**
+ * Decoded instruction. It describes the instruction shape, not what it
+ * does: it is used to walk code without executing it.
+ */
+struct insn_t
+{
+    word addr;      //< Address of the first byte
+    byte length;    //< Length in bytes, including prefixes and operands
+    byte prefix;    //< 0x00, 0xCB, 0xDD, 0xED or 0xFD
+    byte opcode;    //< Opcode after the prefix
+    byte flow;      //< One of flow_t
+    byte cond;      //< Non-zero if the jump, call or return is conditional
+    byte tstates;   //< Base T-states (not taken), 0 if prefixed
+    word target;    //< Destination for FLOW_JUMP and FLOW_CALL
+};
+
+int decode_insn(const byte* code, size_t avail, word addr,
+        struct insn_t* insn);
+
+#endif // DECODE_H_
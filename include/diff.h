@@ -0,0 +1,83 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef DIFF_H_
+#define DIFF_H_
+
+#include <stdio.h>
+#include "cpu.h"
+
+#define DIFF_MAX_RANGES 64      // Address ranges kept per diff
+
+/**
+ * Registers, one bit each in the regs field of a diff.
+ */
+enum diff_reg_t
+{
+    DIFF_AF      = 1 << 0,      //< AF
+    DIFF_BC      = 1 << 1,      //< BC
+    DIFF_DE      = 1 << 2,      //< DE
+    DIFF_HL      = 1 << 3,      //< HL
+    DIFF_AF_ALT  = 1 << 4,      //< AF'
+    DIFF_BC_ALT  = 1 << 5,      //< BC'
+    DIFF_DE_ALT  = 1 << 6,      //< DE'
+    DIFF_HL_ALT  = 1 << 7,      //< HL'
+    DIFF_PC      = 1 << 8,      //< PC
+    DIFF_SP      = 1 << 9,      //< SP
+    DIFF_IX      = 1 << 10,     //< IX
+    DIFF_IY      = 1 << 11,     //< IY
+    DIFF_I       = 1 << 12,     //< I
+    DIFF_R       = 1 << 13,     //< R
+    DIFF_IFF     = 1 << 14,     //< IFF1 or IFF2
+    DIFF_IM      = 1 << 15,     //< Interrupt mode
+    DIFF_TSTATES = 1 << 16      //< T-state counter
+};
+
+/**
+ * Run of consecutive addresses whose contents differ.
+ */
+struct diff_range_t
+{
+    word addr;                  //< First address
+    unsigned size;              //< Number of bytes, up to 0x10000
+};
+
+/**
+ * Differences between the states of two CPUs. Memory is compared through
+ * the host memory behind their buses: pages without it on both sides,
+ * such as memory mapped I/O, are not compared, since reading them could
+ * have side effects.
+ */
+struct z80_diff_t
+{
+    unsigned regs;              //< Registers that differ, see diff_reg_t
+    unsigned long bytes;        //< Bytes of memory that differ
+    int count;                  //< Ranges stored
+    int truncated;              //< Ranges left out for lack of room
+    struct diff_range_t range[DIFF_MAX_RANGES]; //< Ranges, by address
+};
+
+int z80_state_diff(const struct cpu_t* a, const struct cpu_t* b,
+        struct z80_diff_t* out);
+void z80_diff_print(FILE* file, const struct z80_diff_t* diff,
+        const struct cpu_t* a, const struct cpu_t* b);
+
+#endif // DIFF_H_
@@ -0,0 +1,105 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef EXECUTOR_H_
+#define EXECUTOR_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "cpu.h"
+
+#define EXECUTOR_MAX_WORKERS 256    // Worker threads per executor
+
+struct z80_task_t;
+
+/** Called by a worker when a task has used up its budget. */
+typedef void (*z80_task_done_t)(struct z80_task_t* task);
+
+/**
+ * Machine to run, owned by the caller. A task is run by one worker at a
+ * time, so the CPU needs no locking, but it may move between workers from
+ * one slice to the next. The CPU must not be touched by anyone else until
+ * the task is done.
+ */
+struct z80_task_t
+{
+    struct cpu_t* cpu;          //< Machine to run
+    long budget;                //< T-states to run in total
+    long used;                  //< T-states run so far
+    z80_task_done_t done;       //< Completion callback, may be NULL
+    void* ctx;                  //< Free for the callback to use
+};
+
+/**
+ * Double ended queue of runnable tasks. Its worker takes tasks from the
+ * head and puts them back at the tail after every slice; other workers
+ * steal from the tail.
+ */
+struct executor_deque_t
+{
+    atomic_flag lock;           //< Protects everything below
+    struct z80_task_t** task;   //< Ring of tasks
+    size_t capacity;            //< Slots in the ring, a power of two
+    size_t head;                //< Index of the first task
+    size_t count;               //< Tasks in the ring
+};
+
+/**
+ * Worker thread with its own queue.
+ */
+struct executor_worker_t
+{
+    struct z80_executor_t* executor; //< Executor it belongs to
+    int index;                  //< Index of the worker
+    pthread_t thread;           //< Host thread
+    struct executor_deque_t deque; //< Runnable tasks
+    unsigned long slices;       //< Slices run
+    unsigned long steals;       //< Tasks stolen from other workers
+};
+
+/**
+ * Executor that runs many machines on a few host threads. Every worker is
+ * pinned to a core and runs the tasks of its queue for a slice of
+ * T-states each, round robin. Workers whose queue is empty steal tasks
+ * from the others, and sleep when there is nothing left to run.
+ */
+struct z80_executor_t
+{
+    int workers;                //< Number of workers
+    int slice;                  //< T-states per slice
+    atomic_uint next;           //< Worker that gets the next submission
+    atomic_long runnable;       //< Tasks waiting in the queues
+    atomic_long pending;        //< Tasks submitted and not done
+    atomic_int stop;            //< Workers have to exit
+    pthread_mutex_t mutex;      //< Guards sleeping and waking up
+    pthread_cond_t work;        //< Signalled when tasks are submitted
+    pthread_cond_t idle;        //< Signalled when no task is pending
+    struct executor_worker_t worker[EXECUTOR_MAX_WORKERS]; //< Workers
+};
+
+struct z80_executor_t* z80_executor_create(int workers, int slice);
+void z80_executor_destroy(struct z80_executor_t* executor);
+
+int z80_executor_submit(struct z80_executor_t* executor,
+        struct z80_task_t* task);
+void z80_executor_wait(struct z80_executor_t* executor);
+
+#endif // EXECUTOR_H_
@@ -0,0 +1,97 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef IDIOM_H_
+#define IDIOM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+
+#define IDIOM_MAX 32            // Idioms per map
+#define IDIOM_MAX_LENGTH 64     // Longest signature, in bytes
+#define IDIOM_MAX_RANGES 4      // Ranges in the footprint of an idiom
+
+/**
+ * Native implementation of a guest routine. It is called with PC at the
+ * entry of the routine and must leave registers, flags, memory, PC and
+ * tstates exactly as emulating the routine up to its exit would.
+ */
+typedef void (*idiom_native_t)(struct cpu_t* cpu);
+
+/**
+ * Range of memory written by a routine.
+ */
+struct idiom_range_t
+{
+    word addr;                  //< First address, ranges may wrap around
+    size_t size;                //< Number of bytes
+};
+
+/**
+ * Memory a routine may write when run with PC at its entry: destination
+ * buffers, and the stack for routines that push or call. It is what
+ * verification saves and compares, so it must cover every write. Returns
+ * the number of ranges, up to IDIOM_MAX_RANGES.
+ */
+typedef int (*idiom_footprint_t)(const struct cpu_t* cpu,
+        struct idiom_range_t* range);
+
+/**
+ * Guest routine recognised by the hash of its code bytes.
+ */
+struct idiom_t
+{
+    const char* name;           //< Name, for diagnostics
+    word length;                //< Signature length in bytes
+    word exit;                  //< Exit PC, relative to the entry
+    byte first;                 //< First byte, to discard candidates early
+    uint64_t hash;              //< code_hash of the signature
+    idiom_native_t native;      //< Native implementation
+    idiom_footprint_t footprint; //< Memory written, NULL if none
+};
+
+/**
+ * Idiom registry plus the entry points found in the memory of a CPU.
+ * Entry points are only hints: the code bytes are hashed again every time
+ * execution reaches one, so code that has changed is emulated normally.
+ */
+struct idiom_map_t
+{
+    struct idiom_t idiom[IDIOM_MAX]; //< Registered idioms
+    int count;                  //< Number of registered idioms
+    byte entry[0x10000];        //< Idiom index + 1 at each entry, 0 if none
+    int verify;                 //< Run native and emulated side by side
+    unsigned long hits;         //< Routines executed natively
+    unsigned long mismatches;   //< Routines where verification failed
+};
+
+void idiom_init(struct idiom_map_t* map);
+int idiom_register(struct idiom_map_t* map, const char* name,
+        const byte* signature, word length, word exit,
+        idiom_native_t native, idiom_footprint_t footprint);
+void idiom_register_builtins(struct idiom_map_t* map);
+int idiom_scan(struct idiom_map_t* map, struct cpu_t* cpu, word start,
+        size_t size);
+
+int idiom_execute_opcode(struct idiom_map_t* map, struct cpu_t* cpu);
+
+#endif // IDIOM_H_
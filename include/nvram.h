@@ -0,0 +1,54 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef NVRAM_H_
+#define NVRAM_H_
+
+#include "bus.h"
+
+/**
+ * Battery-backed RAM. A range of pages is mapped shared to a file, so guest
+ * writes go straight to the page cache and nothing has to be copied out to
+ * persist them: flushing is only a matter of calling msync. Flushes can be
+ * batched every few frames, and when tracking is enabled only the pages
+ * that were written since the last flush are synced.
+ */
+struct nvram_t
+{
+    struct bus_t* bus;          //< Bus the pages are mapped into
+    byte* host;                 //< Host address of the file mapping
+    int first;                  //< First page
+    int count;                  //< Number of pages
+    int frames;                 //< Frames between flushes, 0 for never
+    int elapsed;                //< Frames since the last flush
+    int tracked;                //< Whether written pages are tracked
+    struct bus_dirty_t dirty;   //< Tracker, if tracked is set
+    unsigned long syncs;        //< Number of msync calls made
+};
+
+int nvram_open(struct nvram_t* nvram, struct bus_t* bus, int first,
+        int count, const char* path, int frames, int track);
+int nvram_close(struct nvram_t* nvram);
+
+int nvram_flush(struct nvram_t* nvram);
+int nvram_frame(struct nvram_t* nvram);
+
+#endif // NVRAM_H_
@@ -0,0 +1,88 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef OBSERVER_H_
+#define OBSERVER_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "cpu.h"
+
+#define OBSERVER_RANGES 8           // Watched ranges per observer
+#define OBSERVER_BYTES 1024         // Watched bytes per observer
+
+// Words of a published copy: registers, then the watched bytes.
+#define OBSERVER_WORDS \
+    ((sizeof(struct cpu_t) + OBSERVER_BYTES + 7) / 8)
+
+/**
+ * Range of memory copied on every publication.
+ */
+struct observer_range_t
+{
+    word addr;                  //< First address
+    word size;                  //< Number of bytes
+};
+
+/**
+ * Publication point for other threads. The thread that runs the CPU
+ * copies the registers and the watched ranges of memory here at the
+ * boundaries it chooses, and any number of threads read the last copy
+ * without locks. The copy is guarded by a sequence counter that is odd
+ * while it is being written: readers copy it out and try again if the
+ * counter changed meanwhile. Pages also have a version counter, raised
+ * by a publication when the page was written since the previous one.
+ */
+struct observer_t
+{
+    struct cpu_t* cpu;          //< CPU being observed
+    int count;                  //< Watched ranges
+    size_t bytes;               //< Watched bytes
+    struct observer_range_t range[OBSERVER_RANGES]; //< Watched ranges
+    int tracking;               //< Whether page versions are kept
+    struct bus_dirty_t dirty;   //< Pages written since the publication
+
+    atomic_uint sequence;       //< Twice the publications, odd if writing
+    atomic_uint version[MEM_PAGES]; //< Version of every page
+    _Atomic uint64_t data[OBSERVER_WORDS]; //< Published copy
+};
+
+/**
+ * Copy of the state taken by a reader.
+ */
+struct observer_sample_t
+{
+    unsigned sequence;          //< Number of the publication
+    int retries;                //< Torn reads before this one
+    struct cpu_t regs;          //< Registers, the pointers are not valid
+    byte memory[OBSERVER_BYTES]; //< Watched ranges, one after the other
+    unsigned version[MEM_PAGES]; //< Version of every page
+};
+
+struct observer_t* observer_create(struct cpu_t* cpu, int track_pages);
+void observer_free(struct observer_t* observer);
+int observer_watch(struct observer_t* observer, word addr, word size);
+
+void observer_publish(struct observer_t* observer);
+int observer_read(const struct observer_t* observer,
+        struct observer_sample_t* sample);
+
+#endif // OBSERVER_H_
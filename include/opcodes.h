@@ -37,7 +37,18 @@ struct opcode_t
     char q; //< 0 0 0 0  1 0 0 0 - 0x08
 };
 
+/**
+ * Function that executes the opcodes of one of the four tables (x field).
+ * The opcode has already been fetched and decoded into the opcode struct.
+ */
+typedef void (*table_function)(struct cpu_t*, const struct opcode_t*);
+
 void extract_opcode(char opcode, struct opcode_t* opstruct);
+table_function opcode_table(byte opcode);
 
+void dispatch_opcode(struct cpu_t* cpu, byte opcode);
 void execute_opcode(struct cpu_t* cpu);
+
+int z80_irq(struct cpu_t* cpu, byte vector);
+void z80_nmi(struct cpu_t* cpu);
 #endif
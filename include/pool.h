@@ -0,0 +1,62 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "z80.h"
+
+/** Arenas are a multiple of this size, one huge page on most hosts. */
+#define POOL_ARENA_SIZE (2 << 20)
+
+struct pool_arena_t;
+
+/**
+ * Instance pool. Instance slots are carved out of big arenas, backed by
+ * huge pages when the host has them, and recycled through a free list, so
+ * getting and putting instances is O(1) and never calls malloc. Arena
+ * memory is only touched when a slot is first handed out. The pool can be
+ * used from several threads at once.
+ */
+struct z80_pool_t
+{
+    atomic_flag lock;           //< Protects everything below
+    struct z80_t* free;         //< Recycled slots
+    struct pool_arena_t* arena; //< Arenas, newest first
+    size_t unused;              //< Slots never used in the newest arena
+    size_t slot_size;           //< Bytes per slot, cache line aligned
+    size_t slots;               //< Slots in all the arenas
+    size_t in_use;              //< Slots handed out
+    int arenas;                 //< Number of arenas
+    int huge_arenas;            //< Arenas backed by explicit huge pages
+};
+
+struct z80_pool_t* z80_pool_create(size_t capacity);
+void z80_pool_destroy(struct z80_pool_t* pool);
+
+struct z80_t* z80_pool_get(struct z80_pool_t* pool,
+        const struct z80_rom_file_t* rom, word base, byte fill);
+struct z80_t* z80_pool_slot(struct z80_pool_t* pool);
+void z80_pool_put(struct z80_pool_t* pool, struct z80_t* z80);
+
+#endif // POOL_H_
@@ -0,0 +1,85 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdio.h>
+#include "cpu.h"
+
+/*
+ * Input log. Everything a machine gets from outside the CPU is written to
+ * a stream as it happens, stamped with the T-state counter: values read
+ * from memory mapped I/O handlers, interrupts, NMIs and writes done by the
+ * host. Starting from the same state, replaying the stream makes execution
+ * identical without calling any handler: reads are given back in order,
+ * trapped writes are dropped, and the other events are scheduled at their
+ * T-state.
+ */
+enum replay_event_t
+{
+    REPLAY_NONE,                //< No more events
+    REPLAY_READ,                //< Value of a trapped read
+    REPLAY_IRQ,                 //< Maskable interrupt, with its vector
+    REPLAY_NMI,                 //< Non maskable interrupt
+    REPLAY_POKE                 //< Write from the host
+};
+
+/**
+ * Event, as read from the stream.
+ */
+struct replay_entry_t
+{
+    int kind;                   //< Event type, see replay_event_t
+    unsigned stamp;             //< Value of the T-state counter
+    word addr;                  //< Address of reads and pokes
+    byte value;                 //< Value read or written, or vector
+};
+
+/**
+ * Recorder or replayer attached to a CPU. The handlers of the bus are
+ * replaced while it is attached.
+ */
+struct replay_t
+{
+    struct cpu_t* cpu;          //< CPU being recorded or replayed
+    FILE* file;                 //< Event stream
+    int recording;              //< Whether events are written or read
+    unsigned last;              //< Stamp of the previous event
+    struct replay_entry_t next; //< Next event to replay
+    int desync;                 //< Replay no longer matches the stream
+    unsigned long events;       //< Events written or replayed
+    mem_read_t on_read[MEM_PAGES]; //< Handlers replaced by the replay
+    mem_write_t on_write[MEM_PAGES]; //< Handlers replaced by the replay
+    void* ctx[MEM_PAGES];       //< Context of the replaced handlers
+};
+
+struct replay_t* replay_record(struct cpu_t* cpu, FILE* file);
+struct replay_t* replay_open(struct cpu_t* cpu, FILE* file);
+int replay_close(struct replay_t* replay);
+
+int replay_irq(struct replay_t* replay, byte vector);
+void replay_nmi(struct replay_t* replay);
+void replay_poke(struct replay_t* replay, word addr, byte value);
+
+int replay_run(struct replay_t* replay, int tstates);
+
+#endif // REPLAY_H_
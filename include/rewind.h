@@ -0,0 +1,61 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef REWIND_H_
+#define REWIND_H_
+
+#include <stddef.h>
+#include "cpu.h"
+
+/*
+ * Rewind buffer. Every captured frame stores the registers and the pages
+ * written since the previous frame, as the XOR against their previous
+ * contents with the runs of zeros left out. Every few frames a key frame
+ * stores every page instead, and seeking restores the last key frame
+ * before the target and replays the deltas up to it. Frames live in a
+ * ring of fixed size: the oldest key frame and its deltas are dropped
+ * together when the ring is full.
+ */
+struct rewind_t
+{
+    struct cpu_t* cpu;          //< CPU being recorded
+    byte* ring;                 //< Frame records
+    size_t capacity;            //< Ring size in bytes
+    size_t head;                //< Where the next record goes
+    size_t tail;                //< Oldest record
+    size_t wrap;                //< End of the records before head wrapped
+    int count;                  //< Records in the ring
+    int interval;               //< Frames between key frames
+    int since_key;              //< Deltas since the last key frame
+    unsigned long frame;        //< Number of the next frame
+    struct bus_dirty_t dirty;   //< Pages written since the last frame
+    byte shadow[MEM_PAGES][MEM_PAGE_SIZE]; //< Memory at the last frame
+};
+
+struct rewind_t* rewind_create(struct cpu_t* cpu, size_t capacity,
+        int interval);
+void rewind_free(struct rewind_t* rewind);
+
+int rewind_capture(struct rewind_t* rewind);
+int rewind_frames(const struct rewind_t* rewind);
+int rewind_seek(struct rewind_t* rewind, int back);
+
+#endif // REWIND_H_
@@ -0,0 +1,77 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef ROMIMAGE_H_
+#define ROMIMAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "opcodes.h"
+
+/**
+ * Predecoded instruction. Every byte of a ROM image has one, so the fetch
+ * path can jump straight to the handler whatever the value of PC is.
+ */
+struct rom_entry_t
+{
+    table_function handler;     //< Table function for the opcode
+    struct opcode_t op;         //< Opcode fields, already extracted
+};
+
+/**
+ * Predecoded read-only region. It is built once and never modified, so a
+ * single image can be shared without locking by any number of CPUs and
+ * threads that map the same ROM. Entries are only used while the bus
+ * still maps the host memory they were decoded from at the same address;
+ * after a bank switch or any other bus_map the fetch goes through the bus.
+ */
+struct z80_rom_image_t
+{
+    word base;                  //< Address of the first byte
+    size_t size;                //< Number of bytes
+    const byte* host;           //< Host memory the image was decoded from
+    const byte* bytes;          //< ROM contents, as they were decoded
+    const struct rom_entry_t* entry; //< One entry per byte
+};
+
+struct z80_rom_image_t* z80_rom_image_create(const byte* bytes, word base,
+        size_t size);
+void z80_rom_image_free(struct z80_rom_image_t* image);
+
+int z80_rom_image_map(struct cpu_t* cpu,
+        const struct z80_rom_image_t* image);
+
+/**
+ * Whether the bus of a CPU maps the host memory of an image at addr, for
+ * reads that are not trapped: fetches from pages with contention or other
+ * traps have to go through the bus.
+ */
+static inline int
+rom_image_mapped(const struct cpu_t* cpu,
+        const struct z80_rom_image_t* image, word addr, size_t offset)
+{
+    const byte* read = cpu->bus->page[addr >> MEM_PAGE_SHIFT].read;
+    return read && (uintptr_t) read + (addr & MEM_PAGE_MASK)
+        == (uintptr_t) (image->host + offset);
+}
+
+#endif // ROMIMAGE_H_
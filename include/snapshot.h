@@ -0,0 +1,44 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stdio.h>
+#include "cpu.h"
+
+/**
+ * Snapshot file formats. Only 48K Spectrum snapshots are supported: RAM
+ * goes from 0x4000 to 0xFFFF of the memory bus of the CPU.
+ */
+enum snapshot_format_t
+{
+    SNAPSHOT_SNA,               //< Raw registers and memory
+    SNAPSHOT_Z80,               //< .Z80 versions 1 to 3, RLE compressed
+    SNAPSHOT_SZX                //< zx-state blocks, zlib compressed
+};
+
+int snapshot_format(const char* path);
+
+int snapshot_load(struct cpu_t* cpu, int format, FILE* file);
+int snapshot_save(const struct cpu_t* cpu, int format, FILE* file);
+
+#endif // SNAPSHOT_H_
@@ -0,0 +1,118 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef STATE_H_
+#define STATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "z80.h"
+
+#define STATE_VERSION 1             // Bumped on incompatible changes
+#define STATE_BYTE_ORDER 0x01020304 // Written in host byte order
+
+/*
+ * Native state files. The layout is a fixed header, a register block, a
+ * directory with one entry per bus page and then the contents of the
+ * pages, each one aligned to MEM_PAGE_SIZE. Nothing is compressed or
+ * encoded, so a file can be mapped and resumed in place: the bus pages
+ * are simply pointed at the mapping. Files are written in host byte order,
+ * they are not meant to be copied between machines. New fields are added
+ * at the end of the blocks, which carry their own size, and readers
+ * ignore what they do not know.
+ */
+
+/** Kind of a page in the directory. */
+enum state_page_kind_t
+{
+    STATE_PAGE_NONE = 0,        //< No contents, trapped by handlers
+    STATE_PAGE_ROM = 1,         //< Read-only contents
+    STATE_PAGE_RAM = 2          //< Read-write contents
+};
+
+/**
+ * Header of a state file.
+ */
+struct state_header_t
+{
+    char magic[8];              //< "ZETA80ST"
+    uint32_t byte_order;        //< STATE_BYTE_ORDER
+    uint32_t version;           //< STATE_VERSION
+    uint32_t header_size;       //< Size of this header
+    uint32_t regs_offset;       //< Offset of the register block
+    uint32_t regs_size;         //< Size of the register block
+    uint32_t dir_offset;        //< Offset of the page directory
+    uint32_t dir_size;          //< Size of a directory entry
+    uint32_t dir_entries;       //< Number of pages, MEM_PAGES
+    uint64_t size;              //< File size
+};
+
+/**
+ * Register block: every field of struct cpu_t that is state. Interrupt
+ * state that the core does not model yet goes into the reserved bytes.
+ */
+struct state_regs_t
+{
+    uint16_t af, bc, de, hl;    //< Main bank
+    uint16_t af_alt, bc_alt, de_alt, hl_alt; //< Alternate bank
+    uint16_t pc, sp, ix, iy;    //< Other registers
+    uint8_t i, r;               //< Interrupt vector, memory refresh
+    uint8_t iff1, iff2, im;     //< Interrupt flip-flops and mode
+    uint8_t reserved[3];        //< Always zero
+    int64_t tstates;            //< T-state counter
+};
+
+/**
+ * Page directory entry: the memory map of the bus.
+ */
+struct state_page_t
+{
+    uint32_t kind;              //< One of state_page_kind_t
+    uint32_t contention;        //< Contention class
+    uint64_t offset;            //< Offset of the contents, 0 if none
+};
+
+/**
+ * State file mapped in memory.
+ */
+struct state_t
+{
+    void* mapping;              //< Whole file, private copy-on-write
+    size_t size;                //< Mapping size
+    const struct state_header_t* header;
+    const struct state_regs_t* regs;
+    const struct state_page_t* page;
+};
+
+struct z80_checkpoint_t;
+
+int state_save(const struct cpu_t* cpu, int fd);
+int state_write(const struct cpu_t* cpu, const char* path);
+
+struct state_t* state_map(const char* path);
+void state_unmap(struct state_t* state);
+void state_resume(const struct state_t* state, struct cpu_t* cpu);
+
+struct z80_checkpoint_t* z80_checkpoint(struct z80_t* z80, const char* path);
+int z80_checkpoint_wait(struct z80_checkpoint_t* checkpoint);
+
+#endif // STATE_H_
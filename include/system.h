@@ -0,0 +1,102 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef SYSTEM_H_
+#define SYSTEM_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "cpu.h"
+
+#define SYSTEM_MAX_CPUS 8           // CPUs per system
+#define SYSTEM_MAX_LATCHES 16       // Latches per system
+
+/**
+ * CPU of a system. Its clock is the system time at which the instruction
+ * being run started, which is also the timestamp of every shared access
+ * the instruction makes. Each instruction counts as at least one T-state,
+ * so the clock always moves forward.
+ */
+struct system_cpu_t
+{
+    struct z80_system_t* system; //< System it belongs to
+    int index;                  //< Index of the CPU, breaks timestamp ties
+    struct cpu_t* cpu;          //< CPU instance, owned by the caller
+    long clock;                 //< System time of the current instruction
+    atomic_long now;            //< Clock, as seen by the other threads
+    byte* shared[MEM_PAGES];    //< Shared host memory mapped at each page
+    struct
+    {
+        word addr;              //< Address of the latch in this CPU
+        int latch;              //< Latch number
+    } latch[SYSTEM_MAX_LATCHES]; //< Latches mapped in this CPU
+    int latches;                //< Number of latches mapped
+    pthread_t thread;           //< Host thread, in threaded mode
+    unsigned long waits;        //< Shared accesses that had to wait
+};
+
+/**
+ * Board with several CPUs, each with its own bus, that share memory pages
+ * or talk through latches. CPUs are run in quanta of T-states, one after
+ * the other or each on its own thread. Shared accesses are trapped and
+ * only go ahead once every other CPU is past their timestamp, so they are
+ * done in timestamp order (CPU index breaking ties) whatever the quantum
+ * and the threading: the result is the same as interleaving the CPUs one
+ * instruction at a time. The quantum is halved after every quantum in
+ * which a CPU touched shared state last touched by another CPU, and
+ * doubled after every quantum in which none did.
+ */
+struct z80_system_t
+{
+    int cpus;                   //< Number of CPUs
+    int threaded;               //< Run every CPU on its own thread
+    int min_quantum;            //< Shortest quantum, in T-states
+    int max_quantum;            //< Longest quantum, in T-states
+    int quantum;                //< Length of the next quantum
+    long time;                  //< System time, in T-states
+    long end;                   //< End of the running quantum, -1 to exit
+    int last;                   //< Last CPU to touch shared state, or -1
+    byte latch[SYSTEM_MAX_LATCHES]; //< Latch values
+    unsigned long crossings;    //< Crossings seen in the running quantum
+    unsigned long quanta;       //< Quanta run
+    unsigned long accesses;     //< Shared accesses done
+    unsigned long handovers;    //< Crossings seen so far
+    pthread_mutex_t mutex;      //< Guards the fields below, when threaded
+    pthread_cond_t start;       //< Signalled when a quantum starts
+    pthread_cond_t done;        //< Signalled when every CPU is done
+    unsigned long generation;   //< Quanta started in the running call
+    int running;                //< CPUs still running the quantum
+    struct system_cpu_t node[SYSTEM_MAX_CPUS]; //< CPUs
+};
+
+struct z80_system_t* z80_system_create(int threaded, int min_quantum,
+        int max_quantum);
+void z80_system_free(struct z80_system_t* system);
+
+int z80_system_add(struct z80_system_t* system, struct cpu_t* cpu);
+int z80_system_share(struct z80_system_t* system, int index, int first,
+        int count, byte* memory);
+int z80_system_latch(struct z80_system_t* system, int index, word addr,
+        int latch);
+
+int z80_system_run(struct z80_system_t* system, long tstates);
+
+#endif // SYSTEM_H_
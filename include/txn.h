@@ -0,0 +1,47 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef TXN_H_
+#define TXN_H_
+
+#include "cpu.h"
+
+/**
+ * Transaction on the state of a CPU. Registers are saved when it begins
+ * and memory writes are kept in an undo log of the bus, so rolling back
+ * costs as much as the bytes written instead of a copy of the whole
+ * address space. Writes to handlers without host memory, such as memory
+ * mapped I/O, can not be undone. Neither can writes to pages whose mapping
+ * changes before the rollback, such as a bank switched out or a Z180 MMU
+ * reprogrammed: they are skipped and the rollback reports an error.
+ */
+struct z80_txn_t
+{
+    struct cpu_t* cpu;          //< CPU in the transaction
+    struct cpu_t saved;         //< Registers when it began
+    struct bus_undo_t undo;     //< Writes done since it began
+};
+
+int z80_txn_begin(struct z80_txn_t* txn, struct cpu_t* cpu);
+void z80_txn_commit(struct z80_txn_t* txn);
+int z80_txn_rollback(struct z80_txn_t* txn);
+
+#endif // TXN_H_
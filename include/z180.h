@@ -0,0 +1,125 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef Z180_H_
+#define Z180_H_
+
+#include "cpu.h"
+
+/** Size of the Z180 physical address space (20 bit). */
+#define Z180_PHYS_SIZE 0x100000
+
+/** Number of internal I/O registers. */
+#define Z180_IO_SIZE 0x40
+
+/**
+ * Internal I/O registers. Addresses are relative to the I/O base that is
+ * selected through the ICR register (0x00 after reset).
+ */
+enum z180_reg_t
+{
+    Z180_CNTLA0 = 0x00, //< ASCI control register A, channel 0
+    Z180_CNTLA1 = 0x01, //< ASCI control register A, channel 1
+    Z180_CNTLB0 = 0x02, //< ASCI control register B, channel 0
+    Z180_CNTLB1 = 0x03, //< ASCI control register B, channel 1
+    Z180_STAT0  = 0x04, //< ASCI status register, channel 0
+    Z180_STAT1  = 0x05, //< ASCI status register, channel 1
+    Z180_TDR0   = 0x06, //< ASCI transmit data register, channel 0
+    Z180_TDR1   = 0x07, //< ASCI transmit data register, channel 1
+    Z180_RDR0   = 0x08, //< ASCI receive data register, channel 0
+    Z180_RDR1   = 0x09, //< ASCI receive data register, channel 1
+    Z180_SAR0L  = 0x20, //< DMA source address, channel 0 (3 bytes)
+    Z180_DAR0L  = 0x23, //< DMA destination address, channel 0 (3 bytes)
+    Z180_BCR0L  = 0x26, //< DMA byte count, channel 0 (2 bytes)
+    Z180_MAR1L  = 0x28, //< DMA memory address, channel 1 (3 bytes)
+    Z180_IAR1L  = 0x2B, //< DMA I/O address, channel 1 (2 bytes)
+    Z180_BCR1L  = 0x2E, //< DMA byte count, channel 1 (2 bytes)
+    Z180_DSTAT  = 0x30, //< DMA status register
+    Z180_DMODE  = 0x31, //< DMA mode register
+    Z180_DCNTL  = 0x32, //< DMA/WAIT control register
+    Z180_CBR    = 0x38, //< MMU common base register
+    Z180_BBR    = 0x39, //< MMU bank base register
+    Z180_CBAR   = 0x3A, //< MMU common/bank area register
+    Z180_ICR    = 0x3F  //< I/O control register
+};
+
+/**
+ * ASCI status register bits.
+ */
+enum z180_stat_t
+{
+    Z180_STAT_RDRF = 0x80, //< Receive data register full
+    Z180_STAT_OVRN = 0x40, //< Overrun error
+    Z180_STAT_TDRE = 0x02  //< Transmit data register empty
+};
+
+/**
+ * DMA status register bits.
+ */
+enum z180_dstat_t
+{
+    Z180_DSTAT_DE1  = 0x80, //< DMA enable, channel 1
+    Z180_DSTAT_DE0  = 0x40, //< DMA enable, channel 0
+    Z180_DSTAT_DWE1 = 0x20, //< DE1 write enable (active low)
+    Z180_DSTAT_DWE0 = 0x10, //< DE0 write enable (active low)
+    Z180_DSTAT_DME  = 0x01  //< DMA main enable
+};
+
+struct z180_t;
+
+/** External I/O read callback. Returns the byte present on the bus. */
+typedef byte (*z180_in_t)(struct z180_t* z180, word port);
+
+/** External I/O write callback. */
+typedef void (*z180_out_t)(struct z180_t* z180, word port, byte value);
+
+/** ASCI transmit callback, called whenever TDR0 or TDR1 is written. */
+typedef void (*z180_tx_t)(struct z180_t* z180, int channel, byte value);
+
+/**
+ * Z180 structure. The Z80 core is embedded and keeps executing the regular
+ * opcodes, but the pages of its memory bus point into the 1 MB physical
+ * memory according to the MMU registers.
+ */
+struct z180_t
+{
+    struct cpu_t cpu;           //< Z80 core
+    struct bus_t bus;           //< Logical address space
+    byte phys[Z180_PHYS_SIZE];  //< Physical memory
+    byte io[Z180_IO_SIZE];      //< Internal I/O registers
+
+    z180_in_t in;               //< External I/O read, NULL reads 0xFF
+    z180_out_t out;             //< External I/O write, NULL ignores
+    z180_tx_t tx;               //< ASCI transmit, NULL ignores
+    void* userdata;             //< Free for the callbacks to use
+};
+
+void z180_init(struct z180_t* z180);
+void z180_mmu_update(struct z180_t* z180);
+unsigned long z180_translate(const struct z180_t* z180, word addr);
+
+byte z180_in0(struct z180_t* z180, byte port);
+void z180_out0(struct z180_t* z180, byte port, byte value);
+void z180_asci_receive(struct z180_t* z180, int channel, byte value);
+
+void z180_execute_opcode(struct z180_t* z180);
+
+#endif // Z180_H_
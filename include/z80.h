@@ -0,0 +1,100 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef Z80_H_
+#define Z80_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "cpu.h"
+#include "bus.h"
+
+/**
+ * ROM file mapped read-only into the host. It is never written, so any
+ * number of instances can map it at the same time and the host keeps a
+ * single copy of it in the page cache.
+ */
+struct z80_rom_file_t
+{
+    const byte* data;           //< ROM contents
+    size_t size;                //< Size of the file
+    int pages;                  //< Size in bus pages, rounded up
+    void* mapping;              //< Host mapping
+    size_t mapping_size;        //< Size of the host mapping
+};
+
+struct z80_pool_t;
+struct z80_baseline_t;
+
+/**
+ * RAM page. Pages are shared copy-on-write between an instance and its
+ * forks: a page with more than one reference is mapped read-only in all of
+ * them and the first write makes a private copy.
+ */
+struct z80_page_t
+{
+    atomic_int refs;            //< Instances that map the page
+    byte data[MEM_PAGE_SIZE];   //< Contents
+};
+
+/**
+ * Z80 instance that owns its address space. ROM pages point to a shared
+ * ROM file and RAM pages start as a shared page of zeros: a private page
+ * is only allocated the first time the guest writes to it, so the memory
+ * used by an instance grows with the RAM it actually touches.
+ */
+struct z80_t
+{
+    struct cpu_t cpu;           //< Z80 core
+    struct bus_t bus;           //< Address space
+    struct z80_page_t* ram[MEM_PAGES]; //< RAM pages, NULL if not allocated
+    const struct z80_rom_file_t* rom; //< ROM file, may be NULL
+    struct z80_pool_t* pool;    //< Pool the instance comes from, or NULL
+    struct z80_baseline_t* baseline; //< Baseline state, or NULL
+};
+
+/**
+ * Memory statistics of an instance.
+ */
+struct z80_stats_t
+{
+    size_t resident;            //< Host bytes owned by the instance
+    int ram_pages;              //< RAM pages allocated
+    int shared_pages;           //< RAM pages shared with other instances
+    int rom_pages;              //< Pages mapped to the ROM file
+};
+
+struct z80_rom_file_t* z80_rom_open(const char* path);
+void z80_rom_close(struct z80_rom_file_t* rom);
+
+int z80_init(struct z80_t* z80, const struct z80_rom_file_t* rom, word base,
+        byte fill);
+struct z80_t* z80_create(const struct z80_rom_file_t* rom, word base,
+        byte fill);
+void z80_free(struct z80_t* z80);
+struct z80_t* z80_fork(struct z80_t* parent);
+void z80_stats(const struct z80_t* z80, struct z80_stats_t* stats);
+
+int z80_set_baseline(struct z80_t* z80);
+void z80_reset_to_baseline(struct z80_t* z80);
+void z80_clear_baseline(struct z80_t* z80);
+
+#endif // Z80_H_
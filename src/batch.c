@@ -0,0 +1,561 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <pthread.h>        // pthread_once
+#include <stdlib.h>         // calloc, free
+#include <string.h>         // memcpy, memset
+
+#include <alu.h>
+#include <batch.h>
+#include <opcodes.h>
+
+/*
+ * The kernels are written with vector extensions, one vector per chunk of
+ * lanes, and built twice: for AVX2 and for the baseline of the target.
+ * Results and flags come from the macros of alu.h, the ones the handlers
+ * in opcodes.c use, so a lane ends up exactly where execute_opcode would
+ * have left it.
+ */
+typedef byte vbyte __attribute__((vector_size(BATCH_CHUNK)));
+typedef byte vbyte_u
+    __attribute__((vector_size(BATCH_CHUNK), aligned(1), may_alias));
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_X86
+#endif
+
+// Unaligned loads and stores of a chunk of lanes.
+#define LOAD(v, p) ((v) = *(const vbyte_u*) (p))
+#define STORE(p, v) (*(vbyte_u*) (p) = (v))
+
+/**
+ * Creates a batch. Every lane starts inactive, see z80_batch_load.
+ *
+ * @param lanes number of lanes
+ * @return new batch, or NULL on error
+ */
+struct z80_batch_t*
+z80_batch_create(int lanes)
+{
+    struct z80_batch_t* batch;
+    int capacity = (lanes + BATCH_CHUNK - 1) / BATCH_CHUNK * BATCH_CHUNK;
+    int i, ok;
+
+    if (lanes <= 0) return NULL;
+    batch = calloc(1, sizeof(struct z80_batch_t));
+    if (!batch) return NULL;
+    batch->lanes = lanes;
+    batch->capacity = capacity;
+
+    ok = 1;
+    for (i = 0; i < 8; i++) {
+        ok &= (batch->reg[i] = calloc(capacity, 1)) != NULL;
+    }
+    ok &= (batch->pc = calloc(capacity, sizeof(word))) != NULL;
+    ok &= (batch->tstates = calloc(capacity, sizeof(int))) != NULL;
+    ok &= (batch->active = calloc(capacity, 1)) != NULL;
+    ok &= (batch->bus = calloc(capacity, sizeof(struct bus_t*))) != NULL;
+    ok &= (batch->cpu = calloc(capacity, sizeof(struct cpu_t))) != NULL;
+    ok &= (batch->opcode = calloc(capacity, 1)) != NULL;
+    ok &= (batch->pending = calloc(capacity, 1)) != NULL;
+    ok &= (batch->sel = calloc(capacity, 1)) != NULL;
+    if (!ok) {
+        z80_batch_free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+/**
+ * Frees a batch.
+ *
+ * @param batch batch to free
+ */
+void
+z80_batch_free(struct z80_batch_t* batch)
+{
+    int i;
+    if (!batch) return;
+    for (i = 0; i < 8; i++) {
+        free(batch->reg[i]);
+    }
+    free(batch->pc);
+    free(batch->tstates);
+    free(batch->active);
+    free(batch->bus);
+    free(batch->cpu);
+    free(batch->opcode);
+    free(batch->pending);
+    free(batch->sel);
+    free(batch);
+}
+
+// Moves the registers of a lane from the arrays into its cpu_t.
+static void
+gather(const struct z80_batch_t* batch, int lane, struct cpu_t* cpu)
+{
+    REG_B(*cpu) = batch->reg[0][lane];
+    REG_C(*cpu) = batch->reg[1][lane];
+    REG_D(*cpu) = batch->reg[2][lane];
+    REG_E(*cpu) = batch->reg[3][lane];
+    REG_H(*cpu) = batch->reg[4][lane];
+    REG_L(*cpu) = batch->reg[5][lane];
+    REG_F(*cpu) = batch->reg[BATCH_F][lane];
+    REG_A(*cpu) = batch->reg[BATCH_A][lane];
+    PC(*cpu) = batch->pc[lane];
+    cpu->tstates = batch->tstates[lane];
+}
+
+// Moves the registers of a lane from its cpu_t into the arrays.
+static void
+scatter(struct z80_batch_t* batch, int lane, const struct cpu_t* cpu)
+{
+    batch->reg[0][lane] = REG_B(*cpu);
+    batch->reg[1][lane] = REG_C(*cpu);
+    batch->reg[2][lane] = REG_D(*cpu);
+    batch->reg[3][lane] = REG_E(*cpu);
+    batch->reg[4][lane] = REG_H(*cpu);
+    batch->reg[5][lane] = REG_L(*cpu);
+    batch->reg[BATCH_F][lane] = REG_F(*cpu);
+    batch->reg[BATCH_A][lane] = REG_A(*cpu);
+    batch->pc[lane] = PC(*cpu);
+    batch->tstates[lane] = cpu->tstates;
+}
+
+/**
+ * Puts a machine into a lane and makes the lane active. The CPU is
+ * copied, its bus is not: the lane keeps using the same bus.
+ *
+ * @param batch batch
+ * @param lane lane index
+ * @param cpu state to load
+ */
+void
+z80_batch_load(struct z80_batch_t* batch, int lane, const struct cpu_t* cpu)
+{
+    memcpy(&batch->cpu[lane], cpu, sizeof(struct cpu_t));
+    scatter(batch, lane, cpu);
+    batch->bus[lane] = cpu->bus;
+    batch->active[lane] = 0xFF;
+}
+
+/**
+ * Copies the state of a lane out of the batch.
+ *
+ * @param batch batch
+ * @param lane lane index
+ * @param cpu where to copy the state
+ */
+void
+z80_batch_store(const struct z80_batch_t* batch, int lane,
+        struct cpu_t* cpu)
+{
+    memcpy(cpu, &batch->cpu[lane], sizeof(struct cpu_t));
+    gather(batch, lane, cpu);
+}
+
+/*
+ * Whether an opcode has a vector kernel. Those are the implemented
+ * opcodes that only touch the registers kept in arrays, plus the relative
+ * jumps and loads whose immediates are fetched lane by lane. Everything
+ * else goes through execute_opcode.
+ */
+static int
+vectorized(byte opcode)
+{
+    struct opcode_t op;
+    extract_opcode(opcode, &op);
+    switch (op.x) {
+        case 0:
+            switch (op.z) {
+                case 0: return op.y != 1;       // EX AF, AF'
+                case 1: case 3: return op.p != 3;   // SP
+                case 2: return 0;               // Memory
+                case 4: case 5: case 6: return op.y != 6;  // (HL)
+                default: return op.y != 4;      // DAA is not implemented
+            }
+        case 1:
+            return op.y != 6 && op.z != 6;      // HALT and (HL)
+        case 2:
+            return op.y < 3 && op.z != 6;       // ADD, ADC, SUB
+        default:
+            return 0;
+    }
+}
+
+// Number of immediate bytes a vectorized opcode fetches.
+static int
+immediates(const struct opcode_t* op)
+{
+    if (op->x != 0) return 0;
+    if (op->z == 0) return op->y >= 2;
+    if (op->z == 1) return op->q == 0 ? 2 : 0;
+    return op->z == 6;
+}
+
+/*
+ * Whether every lane of a chunk is selected by a mask and has the same bus
+ * and PC, so that what they fetch can be read once for all of them.
+ */
+static inline __attribute__((always_inline)) int
+chunk_uniform(const struct z80_batch_t* batch, const byte* mask, int base)
+{
+    const word* pc = batch->pc + base;
+    struct bus_t* const* bus = batch->bus + base;
+    uint64_t all = ~(uint64_t) 0, bits;
+    uintptr_t bus_diff = 0;
+    unsigned pc_diff = 0, i;
+
+    for (i = 0; i < BATCH_CHUNK; i += sizeof(bits)) {
+        memcpy(&bits, mask + base + i, sizeof(bits));
+        all &= bits;
+    }
+    if (~all) return 0;
+    for (i = 0; i < BATCH_CHUNK; i++) {
+        pc_diff |= pc[i] ^ pc[0];
+        bus_diff |= (uintptr_t) bus[i] ^ (uintptr_t) bus[0];
+    }
+    return !pc_diff && !bus_diff;
+}
+
+/*
+ * Runs a vectorized opcode on the selected lanes of a chunk. It is always
+ * inlined, so each pass function gets a copy built for its target.
+ */
+static inline __attribute__((always_inline)) void
+run_chunk(struct z80_batch_t* batch, int base, byte opcode)
+{
+    vbyte reg[8], old[8], sel, imm0, imm1, a, f, mask, cost = {0}, step;
+    vbyte jump = {0};
+    byte imm[2][BATCH_CHUNK], out[3][BATCH_CHUNK];
+    word* restrict lane_pc = batch->pc + base;
+    int* restrict lane_tstates = batch->tstates + base;
+    const word* pc = lane_pc;
+    struct opcode_t op;
+    int i, count, x, y, z, p, q;
+
+    extract_opcode(opcode, &op);
+    x = op.x;
+    y = op.y;
+    z = op.z;
+    p = op.p;
+    q = op.q;
+    LOAD(sel, batch->sel + base);
+    for (i = 0; i < 8; i++) {
+        LOAD(reg[i], batch->reg[i] + base);
+        old[i] = reg[i];
+    }
+
+    // Immediates are fetched once if every lane has the same, as when
+    // they share the code, or lane by lane otherwise.
+    count = immediates(&op);
+    memset(imm, 0, sizeof(imm));
+    if (count && chunk_uniform(batch, batch->sel, base)) {
+        memset(imm[0], bus_read(batch->bus[base], pc[0] + 1), BATCH_CHUNK);
+        if (count == 2) {
+            memset(imm[1], bus_read(batch->bus[base], pc[0] + 2),
+                    BATCH_CHUNK);
+        }
+    } else if (count) {
+        for (i = 0; i < BATCH_CHUNK; i++) {
+            const struct bus_t* bus = batch->bus[base + i];
+            if (!batch->sel[base + i]) continue;
+            imm[0][i] = bus_read(bus, pc[i] + 1);
+            if (count == 2) imm[1][i] = bus_read(bus, pc[i] + 2);
+        }
+    }
+    LOAD(imm0, imm[0]);
+    LOAD(imm1, imm[1]);
+    step = (vbyte) {0} + (byte) (1 + count);
+    a = reg[BATCH_A];
+    f = reg[BATCH_F];
+
+    if (x == 0 && z == 0) {
+        // NOP, DJNZ, JR and JR cc.
+        switch (y) {
+            case 0: mask = (vbyte) {0}; cost += 4; break;
+            case 2: reg[0] -= 1; mask = (vbyte) (reg[0] != 0); break;
+            case 3: mask = (vbyte) {0} + 0xFF; break;
+            case 4: mask = (vbyte) ((f & FLAG_Z) == 0); break;
+            case 5: mask = (vbyte) ((f & FLAG_Z) != 0); break;
+            case 6: mask = (vbyte) ((f & FLAG_C) == 0); break;
+            default: mask = (vbyte) ((f & FLAG_C) != 0); break;
+        }
+        if (y == 2) {
+            cost += 8 + (5 & mask);
+        } else if (y != 0) {
+            cost += 7 + (5 & mask);
+        }
+        jump = imm0 & mask;
+    } else if (x == 0 && z == 1) {
+        vbyte* hi = &reg[p * 2];
+        vbyte* lo = &reg[p * 2 + 1];
+        if (q == 0) {
+            // LD dd, nn
+            *lo = imm0;
+            *hi = imm1;
+            cost += 10;
+        } else {
+            // ADD HL, ss
+            ALU_ADD16(reg[4], reg[5], f, *hi, *lo);
+            cost += 11;
+        }
+    } else if (x == 0 && z == 3) {
+        // INC ss and DEC ss.
+        vbyte* hi = &reg[p * 2];
+        vbyte* lo = &reg[p * 2 + 1];
+        if (q == 0) {
+            *lo += 1;
+            *hi -= (vbyte) (*lo == 0);
+        } else {
+            *hi += (vbyte) (*lo == 0);
+            *lo -= 1;
+        }
+        cost += 6;
+    } else if (x == 0 && z == 4) {
+        // INC r
+        ALU_INC8(reg[y], f);
+        cost += 4;
+    } else if (x == 0 && z == 5) {
+        // DEC r
+        ALU_DEC8(reg[y], f);
+        cost += 4;
+    } else if (x == 0 && z == 6) {
+        // LD r, n
+        reg[y] = imm0;
+        cost += 7;
+    } else if (x == 0) {
+        // Rotations and flag operations on A.
+        switch (y) {
+            case 5: ALU_CPL(a, f); break;
+            case 6: ALU_SCF(f); break;
+            case 7: ALU_CCF(f); break;
+            default: ALU_ROTATE(a, f, y); break;
+        }
+        reg[BATCH_A] = a;
+        cost += 4;
+    } else if (x == 1) {
+        // LD r, r'
+        reg[y] = reg[z];
+        cost += 4;
+    } else {
+        // ADD A, r; ADC A, r; SUB r
+        if (y == 2) {
+            ALU_SUB8(a, f, reg[z]);
+        } else {
+            ALU_ADD8(a, f, reg[z], y ? f & FLAG_C : (vbyte) {0});
+        }
+        reg[BATCH_A] = a;
+        cost += 4;
+    }
+    reg[BATCH_F] = f;
+
+    for (i = 0; i < 8; i++) {
+        reg[i] = (reg[i] & sel) | (old[i] & ~sel);
+        STORE(batch->reg[i] + base, reg[i]);
+    }
+    // Widened lane by lane: the jump is a signed displacement.
+    step &= sel;
+    jump &= sel;
+    cost &= sel;
+    STORE(out[0], step);
+    STORE(out[1], jump);
+    STORE(out[2], cost);
+    for (i = 0; i < BATCH_CHUNK; i++) {
+        lane_pc[i] += out[0][i] + (signed char) out[1][i];
+        lane_tstates[i] += out[2][i];
+    }
+}
+
+typedef void (*pass_t)(struct z80_batch_t* batch, byte opcode);
+
+// Whether any lane of a chunk is selected.
+static int
+chunk_selected(const struct z80_batch_t* batch, int base)
+{
+    uint64_t bits[BATCH_CHUNK / 8];
+    unsigned i;
+    memcpy(bits, batch->sel + base, sizeof(bits));
+    for (i = 1; i < BATCH_CHUNK / 8; i++) {
+        bits[0] |= bits[i];
+    }
+    return bits[0] != 0;
+}
+
+#ifdef BATCH_X86
+__attribute__((target("avx2")))
+static void
+pass_avx2(struct z80_batch_t* batch, byte opcode)
+{
+    int base;
+    for (base = 0; base < batch->capacity; base += BATCH_CHUNK) {
+        if (chunk_selected(batch, base)) run_chunk(batch, base, opcode);
+    }
+}
+#endif
+
+static void
+pass_generic(struct z80_batch_t* batch, byte opcode)
+{
+    int base;
+    for (base = 0; base < batch->capacity; base += BATCH_CHUNK) {
+        if (chunk_selected(batch, base)) run_chunk(batch, base, opcode);
+    }
+}
+
+static pass_t pass;
+static pthread_once_t pass_once = PTHREAD_ONCE_INIT;
+
+// Picks the kernel once, batches may run on several threads.
+static void
+pick_pass(void)
+{
+    pass = pass_generic;
+#ifdef BATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) pass = pass_avx2;
+#endif
+}
+
+/**
+ * Runs one instruction on every active lane. Lanes are grouped by the
+ * opcode they are about to run, not by PC: lanes that agree on PC agree
+ * on the opcode unless their code differs, and lanes that have diverged
+ * still share a pass whenever they meet the same instruction. Each group
+ * runs in a vector kernel if the opcode has one, or lane by lane through
+ * execute_opcode otherwise. Opcodes are fetched ahead of running them,
+ * so code in pages with read handlers sees more reads than it would on
+ * the scalar core.
+ *
+ * @param batch batch
+ * @return number of lanes that ran an instruction
+ */
+int
+z80_batch_step(struct z80_batch_t* batch)
+{
+    byte* restrict opcode = batch->opcode;
+    byte* restrict pending = batch->pending;
+    byte* restrict sel = batch->sel;
+    const byte* restrict active = batch->active;
+    const word* restrict pc = batch->pc;
+    struct bus_t* const* restrict lane_bus = batch->bus;
+    const struct bus_t* bus = NULL;
+    int capacity = batch->capacity, lanes = 0, first = 0, base, i;
+    word addr = 0;
+    byte value = 0;
+
+    pthread_once(&pass_once, pick_pass);
+    for (i = 0; i < capacity; i++) {
+        pending[i] = active[i];
+        lanes += active[i] & 1;
+    }
+    // Lanes next to each other usually share the bus and PC: fetch once
+    // per chunk if they all do, once per run of equal lanes otherwise.
+    for (base = 0; base < capacity; base += BATCH_CHUNK) {
+        if (chunk_uniform(batch, active, base)) {
+            memset(opcode + base, bus_read(lane_bus[base], pc[base]),
+                    BATCH_CHUNK);
+            continue;
+        }
+        for (i = base; i < base + BATCH_CHUNK; i++) {
+            if (!active[i]) continue;
+            if (!bus || lane_bus[i] != bus || pc[i] != addr) {
+                bus = lane_bus[i];
+                addr = pc[i];
+                value = bus_read(bus, addr);
+            }
+            opcode[i] = value;
+        }
+    }
+
+    for (;;) {
+        byte next;
+        int count = 0;
+
+        // Most lanes are done after the first pass, skip them by words.
+        while (first < capacity && !pending[first]) {
+            uint64_t bits;
+            if (first % sizeof(bits) == 0) {
+                memcpy(&bits, pending + first, sizeof(bits));
+                if (!bits) {
+                    first += sizeof(bits);
+                    continue;
+                }
+            }
+            first++;
+        }
+        if (first == capacity) break;
+        next = opcode[first];
+        memset(sel, 0, first);
+        for (i = first; i < capacity; i++) {
+            byte mask = pending[i] & -(opcode[i] == next);
+            sel[i] = mask;
+            pending[i] &= ~mask;
+            count += mask & 1;
+        }
+
+        if (vectorized(next)) {
+            pass(batch, next);
+            batch->vector_ops += count;
+        } else {
+            for (i = first; i < capacity; i++) {
+                if (sel[i]) {
+                    struct cpu_t* cpu = &batch->cpu[i];
+                    gather(batch, i, cpu);
+                    execute_opcode(cpu);
+                    scatter(batch, i, cpu);
+                }
+            }
+            batch->scalar_ops += count;
+        }
+    }
+    return lanes;
+}
+
+/**
+ * Runs the batch until every lane has reached a stop address or for a
+ * number of steps, whatever comes first. Lanes that reach the stop
+ * address become inactive and keep their state.
+ *
+ * @param batch batch
+ * @param stop address where lanes stop
+ * @param max_steps most instructions to run per lane, negative for no limit
+ * @return number of steps run
+ */
+long
+z80_batch_run(struct z80_batch_t* batch, word stop, long max_steps)
+{
+    byte* restrict active = batch->active;
+    const word* restrict pc = batch->pc;
+    long steps = 0;
+    int i, any;
+
+    for (;;) {
+        any = 0;
+        for (i = 0; i < batch->capacity; i++) {
+            active[i] &= -(pc[i] != stop);
+            any |= active[i];
+        }
+        if (!any || steps == max_steps) return steps;
+        z80_batch_step(batch);
+        steps++;
+    }
+}
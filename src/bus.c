@@ -0,0 +1,645 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stdlib.h>         // realloc
+#include <string.h>         // memset
+#include <sys/mman.h>       // mmap, munmap
+
+#include <bus.h>
+
+// Points a page at its host memory, unless its accesses have to be trapped.
+static void
+page_protect(const struct bus_t* bus, struct page_t* page)
+{
+    int contended = bus->contention && page->contention;
+    page->read = contended ? NULL : page->source;
+    int traced = bus->dirty || bus->hash || bus->undo;
+    page->write = (contended || traced) ? NULL : page->mapped;
+}
+
+// Updates every page after attaching or detaching a tracker or a model.
+static void
+bus_protect(struct bus_t* bus)
+{
+    int i;
+    for (i = 0; i < MEM_PAGES; i++) {
+        page_protect(bus, &bus->page[i]);
+    }
+}
+
+/**
+ * Initializes a memory bus. Every page is mapped read-write to the given
+ * 64 KB block of RAM, or left unmapped if ram is NULL. Handlers and
+ * contention classes are cleared.
+ *
+ * @param bus memory bus
+ * @param ram 64 KB of host memory, or NULL
+ */
+void
+bus_init(struct bus_t* bus, byte* ram)
+{
+    int i;
+    bus->dirty = NULL;
+    bus->contention = NULL;
+    bus->hash = NULL;
+    bus->undo = NULL;
+    for (i = 0; i < MEM_PAGES; i++) {
+        bus->page[i].contention = 0;
+    }
+    bus_map(bus, 0, MEM_PAGES, ram, ram);
+    bus_handlers(bus, 0, MEM_PAGES, NULL, NULL, NULL);
+}
+
+/**
+ * Maps a range of pages to host memory. The host memory has to be count
+ * pages long. Pass the same pointer twice to map RAM, NULL as the write
+ * pointer to map ROM, or NULL for both to send every access to the page
+ * handlers. Handlers are left as they are. While dirty trackers or a hash
+ * are attached, writes keep being trapped so that they can be recorded, and
+ * the same goes for every access to contended pages.
+ *
+ * @param bus memory bus
+ * @param first first page to map
+ * @param count number of pages
+ * @param read host memory for reads, or NULL
+ * @param write host memory for writes, or NULL
+ */
+void
+bus_map(struct bus_t* bus, int first, int count,
+        const byte* read, byte* write)
+{
+    int i;
+    for (i = 0; i < count; i++) {
+        struct page_t* page = &bus->page[first + i];
+        page->source = read ? read + i * MEM_PAGE_SIZE : NULL;
+        page->mapped = write ? write + i * MEM_PAGE_SIZE : NULL;
+        page_protect(bus, page);
+    }
+    bus_hash_refresh(bus, first, count);
+}
+
+/**
+ * Maps a range of pages to memory owned by a file descriptor, such as a
+ * memfd, a POSIX shared memory object or a file on hugetlbfs. The object is
+ * mapped shared and read-write, so other processes that map it see guest
+ * memory as it changes and loading it needs no copy. The object must be at
+ * least offset + count pages long, and offset must be aligned to the host
+ * page size.
+ *
+ * @param bus memory bus
+ * @param first first page to map
+ * @param count number of pages
+ * @param fd file descriptor, it can be closed afterwards
+ * @param offset offset of the first page in the object
+ * @return host address of the mapping, or NULL on error
+ */
+byte*
+bus_map_fd(struct bus_t* bus, int first, int count, int fd, off_t offset)
+{
+    size_t size = (size_t) count * MEM_PAGE_SIZE;
+    void* host = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, offset);
+    if (host == MAP_FAILED) return NULL;
+    bus_map(bus, first, count, host, host);
+    return host;
+}
+
+/**
+ * Undoes bus_map_fd. The pages are left unmapped.
+ *
+ * @param bus memory bus
+ * @param host address returned by bus_map_fd
+ * @param first first page, as given to bus_map_fd
+ * @param count number of pages, as given to bus_map_fd
+ */
+void
+bus_unmap_fd(struct bus_t* bus, byte* host, int first, int count)
+{
+    bus_map(bus, first, count, NULL, NULL);
+    munmap(host, (size_t) count * MEM_PAGE_SIZE);
+}
+
+/**
+ * Sets the handlers of a range of pages. They are only called for the
+ * accesses that the page has no host memory for.
+ *
+ * @param bus memory bus
+ * @param first first page
+ * @param count number of pages
+ * @param on_read read handler, or NULL
+ * @param on_write write handler, or NULL
+ * @param ctx context given to the handlers
+ */
+void
+bus_handlers(struct bus_t* bus, int first, int count,
+        mem_read_t on_read, mem_write_t on_write, void* ctx)
+{
+    int i;
+    for (i = 0; i < count; i++) {
+        struct page_t* page = &bus->page[first + i];
+        page->on_read = on_read;
+        page->on_write = on_write;
+        page->ctx = ctx;
+    }
+}
+
+/**
+ * Copies the page table of a bus, handlers and contention classes
+ * included. Dirty trackers and the contention model are not copied, they
+ * stay attached to the source bus only.
+ *
+ * @param dst destination bus
+ * @param src source bus
+ */
+void
+bus_copy(struct bus_t* dst, const struct bus_t* src)
+{
+    int i;
+    for (i = 0; i < MEM_PAGES; i++) {
+        dst->page[i] = src->page[i];
+    }
+    dst->dirty = NULL;
+    dst->contention = NULL;
+    dst->hash = NULL;
+    dst->undo = NULL;
+    bus_protect(dst);
+}
+
+// Adds the wait states of an access to the T-state counter.
+static int
+contend(const struct bus_contention_t* contention, byte class)
+{
+    const byte* delay = contention->delay[class];
+    int wait;
+    if (!delay) return 0;
+    wait = delay[(unsigned) *contention->clock % contention->frame];
+    *contention->clock += wait;
+    return wait;
+}
+
+/**
+ * Slow path of bus_read, for pages without a read pointer. Reads from
+ * contended pages are delayed here.
+ *
+ * @param bus memory bus
+ * @param addr logical address
+ * @return value read, 0xFF if the page has no read handler
+ */
+byte
+bus_trap_read(const struct bus_t* bus, word addr)
+{
+    const struct page_t* page = &bus->page[addr >> MEM_PAGE_SHIFT];
+    if (bus->contention && page->contention) {
+        contend(bus->contention, page->contention);
+    }
+    if (page->source) {
+        return page->source[addr & MEM_PAGE_MASK];
+    }
+    if (page->on_read) {
+        return page->on_read(page->ctx, addr);
+    }
+    return 0xFF;
+}
+
+// Appends the previous value of a byte to an undo log, NULL on error.
+static struct bus_undo_entry_t*
+undo_push(struct bus_undo_t* undo, word addr, byte value)
+{
+    if (undo->count == undo->capacity) {
+        size_t capacity = undo->capacity ? undo->capacity * 2 : 1024;
+        struct bus_undo_entry_t* entry = realloc(undo->entry,
+                capacity * sizeof(struct bus_undo_entry_t));
+        if (!entry) {
+            undo->failed = 1;
+            return NULL;
+        }
+        undo->entry = entry;
+        undo->capacity = capacity;
+    }
+    undo->entry[undo->count].addr = addr;
+    undo->entry[undo->count].value = value;
+    return &undo->entry[undo->count++];
+}
+
+// Records a write in every dirty tracker of the bus.
+static void
+dirty_mark(struct bus_t* bus, int page, uint64_t lines)
+{
+    struct bus_dirty_t* dirty;
+    unsigned bit = 1u << page;
+    for (dirty = bus->dirty; dirty; dirty = dirty->next) {
+        // Loads first: setting bits that are already set is the common case.
+        if (!(atomic_load_explicit(&dirty->pages, memory_order_relaxed)
+                    & bit)) {
+            atomic_fetch_or(&dirty->pages, bit);
+        }
+        if (dirty->track_lines && (atomic_load_explicit(&dirty->lines[page],
+                        memory_order_relaxed) & lines) != lines) {
+            atomic_fetch_or(&dirty->lines[page], lines);
+        }
+    }
+}
+
+/**
+ * Slow path of bus_write, for pages without a write pointer. Writes to
+ * contended pages are delayed, and writes to mapped memory are recorded by
+ * the dirty trackers and the undo log before being done and by the hash
+ * after.
+ *
+ * @param bus memory bus
+ * @param addr logical address
+ * @param value value to write
+ */
+void
+bus_trap_write(struct bus_t* bus, word addr, byte value)
+{
+    int index = addr >> MEM_PAGE_SHIFT;
+    const struct page_t* page = &bus->page[index];
+    const byte* source = page->source;
+    byte old = source ? source[addr & MEM_PAGE_MASK] : 0;
+    struct bus_undo_entry_t* entry = NULL;
+    if (bus->contention && page->contention) {
+        contend(bus->contention, page->contention);
+    }
+    if (bus->dirty && (page->mapped || page->on_write)) {
+        dirty_mark(bus, index,
+                (uint64_t) 1 << ((addr & MEM_PAGE_MASK) >> MEM_LINE_SHIFT));
+    }
+    if (bus->undo && source && (page->mapped || page->on_write)) {
+        entry = undo_push(bus->undo, addr, old);
+    }
+    if (page->mapped) {
+        page->mapped[addr & MEM_PAGE_MASK] = value;
+    } else if (page->on_write) {
+        page->on_write(page->ctx, addr, value);
+    }
+    if (entry) {
+        // After the write, which may have mapped a private copy.
+        entry->source = page->source;
+    }
+    if (bus->hash) {
+        if (page->source != source) {
+            // The handler mapped other memory, such as a private copy.
+            bus_hash_refresh(bus, index, 1);
+        } else if (source) {
+            bus->hash->page[index] ^= bus_hash_key(addr, old)
+                ^ bus_hash_key(addr, source[addr & MEM_PAGE_MASK]);
+        }
+    }
+}
+
+/**
+ * Writes a block of bytes through the bus, wrapping around 0xFFFF.
+ *
+ * @param bus memory bus
+ * @param addr first address
+ * @param data bytes to write
+ * @param size number of bytes
+ */
+void
+bus_load(struct bus_t* bus, word addr, const byte* data, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        bus_write(bus, addr + i, data[i]);
+    }
+}
+
+/**
+ * Reads a block of bytes through the bus, wrapping around 0xFFFF.
+ *
+ * @param bus memory bus
+ * @param addr first address
+ * @param data buffer for the bytes
+ * @param size number of bytes
+ */
+void
+bus_dump(const struct bus_t* bus, word addr, byte* data, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        data[i] = bus_read(bus, addr + i);
+    }
+}
+
+/**
+ * Attaches a dirty tracker to a bus. The tracker starts clean. While any
+ * tracker is attached every write goes through the slow path, which sets
+ * the bit of the page, and of the 64 byte line if track_lines is set, in
+ * every tracker. Buses without trackers are not slowed down at all. Call
+ * this from the thread that runs the CPU or while it is stopped.
+ *
+ * @param bus memory bus
+ * @param dirty tracker, owned by the caller
+ * @param track_lines non-zero to also track 64 byte lines
+ */
+void
+bus_dirty_attach(struct bus_t* bus, struct bus_dirty_t* dirty,
+        int track_lines)
+{
+    int i;
+    atomic_init(&dirty->pages, 0);
+    for (i = 0; i < MEM_PAGES; i++) {
+        atomic_init(&dirty->lines[i], 0);
+    }
+    dirty->track_lines = track_lines;
+    dirty->next = bus->dirty;
+    bus->dirty = dirty;
+    bus_protect(bus);
+}
+
+/**
+ * Detaches a dirty tracker from a bus. Same threading rules as attaching.
+ *
+ * @param bus memory bus
+ * @param dirty tracker
+ */
+void
+bus_dirty_detach(struct bus_t* bus, struct bus_dirty_t* dirty)
+{
+    struct bus_dirty_t** link;
+    for (link = &bus->dirty; *link; link = &(*link)->next) {
+        if (*link == dirty) {
+            *link = dirty->next;
+            break;
+        }
+    }
+    bus_protect(bus);
+}
+
+/**
+ * Gets and clears the dirty pages of a tracker in a single atomic step, so
+ * no write is lost even if the CPU is running on another thread.
+ *
+ * @param dirty tracker
+ * @return bitmap of pages written since the last call, bit n is page n
+ */
+unsigned
+bus_dirty_fetch_pages(struct bus_dirty_t* dirty)
+{
+    return atomic_exchange(&dirty->pages, 0);
+}
+
+/**
+ * Gets and clears the dirty lines of a page in a single atomic step. Only
+ * trackers attached with track_lines record lines.
+ *
+ * @param dirty tracker
+ * @param page page number
+ * @return bitmap of 64 byte lines of the page written since the last call
+ */
+uint64_t
+bus_dirty_fetch_lines(struct bus_dirty_t* dirty, int page)
+{
+    return atomic_exchange(&dirty->lines[page], 0);
+}
+
+/**
+ * Records writes done to host memory behind the back of the bus, such as
+ * DMA transfers. Every logical page mapped read-write over the host range
+ * is marked, and its hash is computed again.
+ *
+ * @param bus memory bus
+ * @param host first host byte written
+ * @param size number of bytes written
+ */
+void
+bus_dirty_mark_host(struct bus_t* bus, const byte* host, size_t size)
+{
+    int i;
+    if ((!bus->dirty && !bus->hash) || size == 0) return;
+    for (i = 0; i < MEM_PAGES; i++) {
+        const byte* base = bus->page[i].mapped;
+        size_t first, last;
+        uint64_t lines;
+        if (!base || host >= base + MEM_PAGE_SIZE || host + size <= base) {
+            continue;
+        }
+        first = host > base ? (size_t) (host - base) : 0;
+        last = host + size < base + MEM_PAGE_SIZE
+            ? (size_t) (host + size - base) - 1 : MEM_PAGE_SIZE - 1;
+        first >>= MEM_LINE_SHIFT;
+        last >>= MEM_LINE_SHIFT;
+        lines = (last - first == 63) ? ~(uint64_t) 0
+            : (((uint64_t) 1 << (last - first + 1)) - 1) << first;
+        if (bus->dirty) dirty_mark(bus, i, lines);
+        bus_hash_refresh(bus, i, 1);
+    }
+}
+
+/**
+ * Attaches a contention model to a bus, replacing the previous one. From
+ * now on every access to a page with a contention class other than 0 is
+ * trapped and adds the wait states of its class at the current position
+ * in the frame to the clock of the model. Pages of class 0 are not slowed
+ * down at all. Same threading rules as bus_dirty_attach.
+ *
+ * @param bus memory bus
+ * @param contention contention model, owned by the caller
+ */
+void
+bus_contention_attach(struct bus_t* bus, struct bus_contention_t* contention)
+{
+    bus->contention = contention;
+    bus_protect(bus);
+}
+
+/**
+ * Detaches the contention model of a bus. Contention classes are kept.
+ *
+ * @param bus memory bus
+ */
+void
+bus_contention_detach(struct bus_t* bus)
+{
+    bus->contention = NULL;
+    bus_protect(bus);
+}
+
+/**
+ * Sets the contention class of a range of pages.
+ *
+ * @param bus memory bus
+ * @param first first page
+ * @param count number of pages
+ * @param class contention class, 0 for uncontended
+ */
+void
+bus_contend(struct bus_t* bus, int first, int count, byte class)
+{
+    int i;
+    for (i = 0; i < count; i++) {
+        struct page_t* page = &bus->page[first + i];
+        page->contention = class;
+        page_protect(bus, page);
+    }
+}
+
+/**
+ * Delays an I/O access by the wait states of the class of its port. This
+ * is meant to be called by whoever emulates the I/O cycle.
+ *
+ * @param bus memory bus
+ * @param port port address
+ * @return wait states added to the clock
+ */
+int
+bus_contend_io(const struct bus_t* bus, word port)
+{
+    byte class;
+    if (!bus->contention) return 0;
+    class = bus->contention->io[port >> 8];
+    return class ? contend(bus->contention, class) : 0;
+}
+
+/**
+ * Fills a delay table with the pattern of the Spectrum ULA: 192 screen
+ * lines whose first 128 T-states are contended in groups of eight as
+ * 6, 5, 4, 3, 2, 1, 0, 0 wait states. The rest of the frame is
+ * uncontended. A 48K Spectrum has 69888 T-states per frame, the first
+ * contended one is 14335 and lines are 224 T-states long.
+ *
+ * @param delay table to fill, frame bytes long
+ * @param frame T-states per frame
+ * @param first first contended T-state
+ * @param line T-states per line
+ */
+void
+bus_contention_ula(byte* delay, int frame, int first, int line)
+{
+    static const byte pattern[8] = { 6, 5, 4, 3, 2, 1, 0, 0 };
+    int y, t;
+
+    memset(delay, 0, frame);
+    for (y = 0; y < 192; y++) {
+        for (t = 0; t < 128; t++) {
+            int tstate = first + y * line + t;
+            if (tstate < frame) {
+                delay[tstate] = pattern[t & 7];
+            }
+        }
+    }
+}
+
+/**
+ * Attaches a hash to a bus, replacing the previous one, and computes it
+ * from the current contents of memory. From then on writes through the
+ * bus keep it up to date at the cost of two keys each. Writes done to
+ * host memory behind the back of the bus have to be reported with
+ * bus_dirty_mark_host or bus_hash_refresh. Same threading rules as
+ * bus_dirty_attach.
+ *
+ * @param bus memory bus
+ * @param hash hash, owned by the caller
+ */
+void
+bus_hash_attach(struct bus_t* bus, struct bus_hash_t* hash)
+{
+    bus->hash = hash;
+    bus_hash_refresh(bus, 0, MEM_PAGES);
+    bus_protect(bus);
+}
+
+/**
+ * Detaches the hash of a bus.
+ *
+ * @param bus memory bus
+ */
+void
+bus_hash_detach(struct bus_t* bus)
+{
+    bus->hash = NULL;
+    bus_protect(bus);
+}
+
+/**
+ * Computes the hash of a range of pages again from their contents. It
+ * does nothing if the bus has no hash.
+ *
+ * @param bus memory bus
+ * @param first first page
+ * @param count number of pages
+ */
+void
+bus_hash_refresh(struct bus_t* bus, int first, int count)
+{
+    int i;
+    if (!bus->hash) return;
+    for (i = first; i < first + count; i++) {
+        const byte* source = bus->page[i].source;
+        uint64_t hash = 0;
+        word addr = i << MEM_PAGE_SHIFT;
+        int offset;
+        if (source) {
+            for (offset = 0; offset < MEM_PAGE_SIZE; offset++) {
+                hash ^= bus_hash_key(addr + offset, source[offset]);
+            }
+        }
+        bus->hash->page[i] = hash;
+    }
+}
+
+/**
+ * Gets the hash of the memory of a bus. Pages without host memory, such
+ * as memory mapped I/O, do not count.
+ *
+ * @param bus memory bus
+ * @return hash value, 0 if the bus has no hash
+ */
+uint64_t
+bus_hash(const struct bus_t* bus)
+{
+    uint64_t hash = 0;
+    int i;
+    if (!bus->hash) return 0;
+    for (i = 0; i < MEM_PAGES; i++) {
+        hash ^= bus->hash->page[i];
+    }
+    return hash;
+}
+
+/**
+ * Attaches an undo log to a bus, replacing the previous one. From then on
+ * the value that every byte of host memory had before being written is
+ * appended to it. Writes to handlers without host memory are not logged.
+ * Same threading rules as bus_dirty_attach.
+ *
+ * @param bus memory bus
+ * @param undo undo log, owned by the caller
+ */
+void
+bus_undo_attach(struct bus_t* bus, struct bus_undo_t* undo)
+{
+    bus->undo = undo;
+    bus_protect(bus);
+}
+
+/**
+ * Detaches the undo log of a bus. The entries are kept.
+ *
+ * @param bus memory bus
+ */
+void
+bus_undo_detach(struct bus_t* bus)
+{
+    bus->undo = NULL;
+    bus_protect(bus);
+}
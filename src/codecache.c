@@ -0,0 +1,280 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memcmp, memcpy, memset
+#include <fcntl.h>          // open
+#include <unistd.h>         // close, getpid
+#include <sys/mman.h>       // mmap, munmap
+#include <sys/stat.h>       // fstat
+
+#include <codecache.h>
+
+/*
+ * Cache files are named after the hash, base and size of the region they
+ * describe, so they never have to be invalidated: different code simply
+ * ends up in a different file. Layout is the header, the code bytes and
+ * then the insn_t array, aligned to 8 bytes. Files are written in host
+ * byte order, they are not meant to be copied between machines.
+ */
+struct cache_header_t
+{
+    char magic[4];          //< "Z80C"
+    uint32_t version;       //< CODECACHE_VERSION
+    uint32_t insn_size;     //< sizeof(struct insn_t)
+    uint32_t size;          //< Region size
+    uint64_t hash;          //< Region hash
+    uint32_t base;          //< Region base address
+    uint32_t reserved;      //< Always zero
+};
+
+#define INSNS_OFFSET(size) \
+    ((sizeof(struct cache_header_t) + (size) + 7) & ~((size_t) 7))
+
+/**
+ * Hashes a block of memory using 64-bit FNV-1a.
+ *
+ * @param data bytes to hash
+ * @param size number of bytes
+ * @return hash value
+ */
+uint64_t
+code_hash(const byte* data, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/**
+ * Decodes a region into heap memory.
+ *
+ * @param region region to fill
+ * @param bytes code to decode, copied into the region
+ * @param base address of the first byte
+ * @param size number of bytes (the region may not wrap around 0xFFFF)
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int
+code_region_decode(struct code_region_t* region, const byte* bytes,
+        word base, size_t size)
+{
+    byte* copy = malloc(size);
+    struct insn_t* insns = malloc(size * sizeof(struct insn_t));
+    size_t i;
+
+    if (!copy || !insns) {
+        free(copy);
+        free(insns);
+        return -1;
+    }
+    memcpy(copy, bytes, size);
+    for (i = 0; i < size; i++) {
+        if (!decode_insn(&copy[i], size - i, base + i, &insns[i])) {
+            // Does not fit in the region, mark it as empty.
+            insns[i].length = 0;
+        }
+    }
+
+    region->base = base;
+    region->size = size;
+    region->hash = code_hash(bytes, size);
+    region->bytes = copy;
+    region->insns = insns;
+    region->validated = 1;
+    region->mapping = NULL;
+    region->mapping_size = 0;
+    return 0;
+}
+
+/**
+ * Checks that the region still matches the memory of a CPU. Regions that
+ * come from the cache are only trusted by their hash until this is called,
+ * so callers should validate them the first time they are used.
+ *
+ * @param region region to check
+ * @param cpu CPU instance whose memory has the code
+ * @return 1 if the region is valid, 0 otherwise
+ */
+int
+code_region_validate(struct code_region_t* region, struct cpu_t* cpu)
+{
+    size_t i;
+    if (region->validated) return 1;
+    for (i = 0; i < region->size; i++) {
+        if (mem_read(cpu, region->base + i) != region->bytes[i]) {
+            return 0;
+        }
+    }
+    region->validated = 1;
+    return 1;
+}
+
+/**
+ * Releases the memory used by a region, either heap or file mapping.
+ *
+ * @param region region to free
+ */
+void
+code_region_free(struct code_region_t* region)
+{
+    if (region->mapping) {
+        munmap(region->mapping, region->mapping_size);
+    } else {
+        free((void*) region->bytes);
+        free((void*) region->insns);
+    }
+    memset(region, 0, sizeof(struct code_region_t));
+}
+
+static void
+cache_path(char* path, size_t len, const char* dir, uint64_t hash,
+        word base, size_t size)
+{
+    snprintf(path, len, "%s/%016llx-%04x-%05lx.z80c", dir,
+            (unsigned long long) hash, base, (unsigned long) size);
+}
+
+/**
+ * Stores a region in the cache directory. The file is written under a
+ * temporary name and renamed, so concurrent readers never see it partly
+ * written.
+ *
+ * @param dir cache directory, must exist
+ * @param region region to store
+ * @return 0 on success, -1 on error
+ */
+int
+code_cache_store(const char* dir, const struct code_region_t* region)
+{
+    struct cache_header_t header;
+    static const byte padding[8];
+    char path[1024], temp[1100];
+    size_t pad = INSNS_OFFSET(region->size) - sizeof(header) - region->size;
+    FILE* file;
+    int ok;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "Z80C", 4);
+    header.version = CODECACHE_VERSION;
+    header.insn_size = sizeof(struct insn_t);
+    header.size = region->size;
+    header.hash = region->hash;
+    header.base = region->base;
+
+    cache_path(path, sizeof(path), dir, region->hash, region->base,
+            region->size);
+    snprintf(temp, sizeof(temp), "%s.%ld.tmp", path, (long) getpid());
+    file = fopen(temp, "wb");
+    if (!file) return -1;
+
+    ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(region->bytes, 1, region->size, file) == region->size
+        && fwrite(padding, 1, pad, file) == pad
+        && fwrite(region->insns, sizeof(struct insn_t), region->size, file)
+            == region->size;
+    if (fclose(file) != 0 || !ok || rename(temp, path) != 0) {
+        remove(temp);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+cache_map(const char* path, struct code_region_t* region, uint64_t hash,
+        word base, size_t size)
+{
+    const struct cache_header_t* header;
+    size_t expected = INSNS_OFFSET(size) + size * sizeof(struct insn_t);
+    struct stat st;
+    void* mapping;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size != expected) {
+        close(fd);
+        return -1;
+    }
+    mapping = mmap(NULL, expected, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return -1;
+
+    header = mapping;
+    if (memcmp(header->magic, "Z80C", 4) != 0
+            || header->version != CODECACHE_VERSION
+            || header->insn_size != sizeof(struct insn_t)
+            || header->size != size || header->hash != hash
+            || header->base != base) {
+        munmap(mapping, expected);
+        return -1;
+    }
+
+    region->base = base;
+    region->size = size;
+    region->hash = hash;
+    region->bytes = (const byte*) mapping + sizeof(struct cache_header_t);
+    region->insns = (const struct insn_t*)
+        ((const byte*) mapping + INSNS_OFFSET(size));
+    region->validated = 0;
+    region->mapping = mapping;
+    region->mapping_size = expected;
+    return 0;
+}
+
+/**
+ * Gets the decoded region for a block of code. If the cache directory
+ * already has it, the file is mapped read-only and nothing is decoded;
+ * otherwise the code is decoded and stored for the next time. A cache
+ * directory that cannot be written is not an error.
+ *
+ * @param dir cache directory, or NULL to skip the cache
+ * @param region region to fill
+ * @param bytes code bytes
+ * @param base address of the first byte
+ * @param size number of bytes
+ * @return 0 on success, -1 if the region could not be decoded
+ */
+int
+code_cache_load(const char* dir, struct code_region_t* region,
+        const byte* bytes, word base, size_t size)
+{
+    uint64_t hash = code_hash(bytes, size);
+    char path[1024];
+
+    if (dir) {
+        cache_path(path, sizeof(path), dir, hash, base, size);
+        if (cache_map(path, region, hash, base, size) == 0) {
+            return 0;
+        }
+    }
+    if (code_region_decode(region, bytes, base, size) != 0) {
+        return -1;
+    }
+    if (dir) {
+        code_cache_store(dir, region);
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stddef.h>         // NULL
+#include <cpu.h>
+
+/**
+ * Attaches a CPU to a memory bus and detaches any ROM image. Registers are
+ * left untouched, so this can be called after filling the structure.
+ *
+ * @param cpu CPU instance
+ * @param bus memory bus
+ */
+void
+cpu_init(struct cpu_t* cpu, struct bus_t* bus)
+{
+    cpu->bus = bus;
+    cpu->rom = NULL;
+}
+
+/**
+ * Gets a fingerprint of the state of a machine: the registers and the
+ * memory of its bus. The memory part is kept up to date by the hash
+ * attached to the bus, see bus_hash_attach, and is 0 without one. The
+ * registers are few enough to be hashed on every call. The T-state
+ * counter is left out, so a program stuck in a loop that does not change
+ * memory or registers gets the same value on every turn.
+ *
+ * @param cpu CPU instance
+ * @return hash value
+ */
+uint64_t
+z80_state_hash(const struct cpu_t* cpu)
+{
+    const union register_t* pairs[] = {
+        &cpu->main.af, &cpu->main.bc, &cpu->main.de, &cpu->main.hl,
+        &cpu->alternate.af, &cpu->alternate.bc, &cpu->alternate.de,
+        &cpu->alternate.hl, &cpu->pc, &cpu->sp, &cpu->ix, &cpu->iy
+    };
+    const byte bytes[] = { cpu->i, cpu->r, cpu->iff1, cpu->iff2, cpu->im };
+    uint64_t hash = bus_hash(cpu->bus);
+    uint32_t slot = 0x10000;
+    size_t i;
+
+    for (i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+        hash ^= bus_hash_key(slot++, pairs[i]->BYTES.H);
+        hash ^= bus_hash_key(slot++, pairs[i]->BYTES.L);
+    }
+    for (i = 0; i < sizeof(bytes); i++) {
+        hash ^= bus_hash_key(slot++, bytes[i]);
+    }
+    return hash;
+}
@@ -0,0 +1,226 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <string.h>         // memset
+#include <decode.h>
+
+/**
+ * Base T-states for unprefixed opcodes in the x = 0 and x = 3 tables.
+ * Conditional instructions use the not taken value. Prefixes are 0.
+ */
+static const byte tstates_x0[64] = {
+    4, 10,  7,  6,  4,  4,  7,  4,  4, 11,  7,  6,  4,  4,  7,  4,
+    8, 10,  7,  6,  4,  4,  7,  4, 12, 11,  7,  6,  4,  4,  7,  4,
+    7, 10, 16,  6,  4,  4,  7,  4,  7, 11, 16,  6,  4,  4,  7,  4,
+    7, 10, 13,  6, 11, 11, 10,  4,  7, 11, 13,  6,  4,  4,  7,  4
+};
+
+static const byte tstates_x3[64] = {
+    5, 10, 10, 10, 10, 11,  7, 11,  5, 10, 10,  0, 10, 17,  7, 11,
+    5, 10, 10, 11, 10, 11,  7, 11,  5,  4, 10, 11, 10,  0,  7, 11,
+    5, 10, 10, 19, 10, 11,  7, 11,  5,  4, 10,  4, 10,  0,  7, 11,
+    5, 10, 10,  4, 10, 11,  7, 11,  5,  6, 10,  4, 10,  0,  7, 11
+};
+
+static byte
+base_tstates(byte op)
+{
+    int x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+    switch (x) {
+        case 0: return tstates_x0[op];
+        case 1: return (op != 0x76 && (y == 6 || z == 6)) ? 7 : 4;
+        case 2: return (z == 6) ? 7 : 4;
+        default: return tstates_x3[op & 0x3F];
+    }
+}
+
+// Whether the opcode uses (HL), which becomes (IX+d) under a DD prefix.
+static int
+uses_ihl(byte op)
+{
+    int x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+    switch (x) {
+        case 0: return op == 0x34 || op == 0x35 || op == 0x36;
+        case 1: return op != 0x76 && (y == 6 || z == 6);
+        case 2: return z == 6;
+        default: return 0;
+    }
+}
+
+static word
+get_nn(const byte* code)
+{
+    return code[0] | (code[1] << 8);
+}
+
+/*
+ * Decodes an unprefixed opcode. code[0] is the opcode, addr is the address
+ * of the instruction as a whole and extra is the number of prefix bytes
+ * that come before the opcode.
+ */
+static int
+decode_main(const byte* code, size_t avail, word addr, int extra,
+        struct insn_t* insn)
+{
+    byte op = code[0];
+    int x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+    int p = y >> 1, q = y & 1;
+    int length = 1;
+
+    insn->opcode = op;
+    insn->flow = FLOW_NEXT;
+    if (x == 0) {
+        if (z == 0 && y >= 2) {
+            length = 2;
+        } else if (z == 1 && q == 0) {
+            length = 3;
+        } else if (z == 2 && p >= 2) {
+            length = 3;
+        } else if (z == 6) {
+            length = 2;
+        }
+    } else if (x == 3) {
+        if (z == 2 || z == 4 || (z == 3 && y == 0) || op == 0xCD) {
+            length = 3;
+        } else if (z == 6 || op == 0xD3 || op == 0xDB) {
+            length = 2;
+        }
+    }
+    if ((size_t) length > avail) return 0;
+    insn->length = length + extra;
+
+    if (x == 0 && z == 0 && y >= 2) {
+        // DJNZ d, JR d, JR cc, d
+        insn->flow = FLOW_JUMP;
+        insn->cond = (y != 3);
+        insn->target = addr + insn->length + (signed char) code[1];
+    } else if (op == 0x76) {
+        insn->flow = FLOW_HALT;
+    } else if (x == 3) {
+        if (z == 0) {
+            insn->flow = FLOW_RETURN;
+            insn->cond = 1;
+        } else if (op == 0xC9) {
+            insn->flow = FLOW_RETURN;
+        } else if (op == 0xE9) {
+            insn->flow = FLOW_INDIRECT;
+        } else if (z == 2 || op == 0xC3) {
+            insn->flow = FLOW_JUMP;
+            insn->cond = (z == 2);
+            insn->target = get_nn(&code[1]);
+        } else if (z == 4 || op == 0xCD) {
+            insn->flow = FLOW_CALL;
+            insn->cond = (z == 4);
+            insn->target = get_nn(&code[1]);
+        } else if (z == 7) {
+            insn->flow = FLOW_CALL;
+            insn->target = y << 3;
+        }
+    }
+    return insn->length;
+}
+
+static int
+decode_ed(const byte* code, size_t avail, struct insn_t* insn)
+{
+    byte op;
+    if (avail < 2) return 0;
+
+    op = code[1];
+    insn->opcode = op;
+    insn->length = 2;
+    if ((op & 0xC7) == 0x43) {
+        // LD (nn), rp and LD rp, (nn)
+        insn->length = 4;
+    } else if ((op & 0xC7) == 0x45) {
+        // RETN, RETI
+        insn->flow = FLOW_RETURN;
+    }
+    return (avail >= insn->length) ? insn->length : 0;
+}
+
+static int
+decode_index(const byte* code, size_t avail, word addr, struct insn_t* insn)
+{
+    byte op;
+    if (avail < 2) return 0;
+
+    op = code[1];
+    if (op == 0xDD || op == 0xED || op == 0xFD) {
+        // Repeated prefix: the first one behaves as a NOP.
+        insn->prefix = 0;
+        insn->opcode = code[0];
+        insn->length = 1;
+        return 1;
+    }
+    if (op == 0xCB) {
+        // DD CB d op
+        insn->opcode = (avail >= 4) ? code[3] : 0;
+        insn->length = 4;
+        return (avail >= 4) ? 4 : 0;
+    }
+    if (uses_ihl(op)) {
+        // The displacement byte goes between the opcode and the operand.
+        if (avail < 3) return 0;
+        if (!decode_main(&code[1], avail - 1, addr, 1, insn)) return 0;
+        insn->length++;
+        return (avail >= insn->length) ? insn->length : 0;
+    }
+    return decode_main(&code[1], avail - 1, addr, 1, insn);
+}
+
+/**
+ * Decodes the instruction at the beginning of a buffer. It works with the
+ * whole Z80 instruction set, including prefixed and undocumented opcodes,
+ * even if the CPU does not implement them yet.
+ *
+ * @param code pointer to the first byte of the instruction
+ * @param avail number of bytes that can be read from code
+ * @param addr address of the instruction, to compute jump targets
+ * @param insn structure to fill
+ * @return length of the instruction, 0 if it does not fit in avail
+ */
+int
+decode_insn(const byte* code, size_t avail, word addr, struct insn_t* insn)
+{
+    memset(insn, 0, sizeof(struct insn_t));
+    insn->addr = addr;
+    if (avail == 0) return 0;
+
+    switch (code[0]) {
+        case 0xCB:
+            insn->prefix = 0xCB;
+            insn->opcode = (avail >= 2) ? code[1] : 0;
+            insn->length = 2;
+            return (avail >= 2) ? 2 : 0;
+        case 0xED:
+            insn->prefix = 0xED;
+            return decode_ed(code, avail, insn);
+        case 0xDD:
+        case 0xFD:
+            insn->prefix = code[0];
+            return decode_index(code, avail, addr, insn);
+        default:
+            if (!decode_main(code, avail, addr, 0, insn)) return 0;
+            insn->tstates = base_tstates(code[0]);
+            return insn->length;
+    }
+}
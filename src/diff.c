@@ -0,0 +1,266 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <pthread.h>        // pthread_once
+#include <string.h>         // memset
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DIFF_X86
+#endif
+
+#include <diff.h>
+
+/*
+ * Memory is compared with the widest vector compare the host has, picked
+ * the first time a diff is done: AVX2, SSE2 or 8 bytes at a time. Equal
+ * blocks are skipped without looking at their bytes, so comparing two
+ * mostly equal address spaces costs little more than reading them.
+ */
+typedef size_t (*skip_t)(const byte* x, const byte* y, size_t offset);
+
+// Offset of the first byte at or after offset that differs, or the size.
+static size_t
+skip_scalar(const byte* x, const byte* y, size_t offset)
+{
+    while (offset + 8 <= MEM_PAGE_SIZE
+            && memcmp(x + offset, y + offset, 8) == 0) {
+        offset += 8;
+    }
+    while (offset < MEM_PAGE_SIZE && x[offset] == y[offset]) {
+        offset++;
+    }
+    return offset;
+}
+
+#ifdef DIFF_X86
+__attribute__((target("sse2")))
+static size_t
+skip_sse2(const byte* x, const byte* y, size_t offset)
+{
+    for (; offset + 16 <= MEM_PAGE_SIZE; offset += 16) {
+        __m128i vx = _mm_loadu_si128((const __m128i*) (x + offset));
+        __m128i vy = _mm_loadu_si128((const __m128i*) (y + offset));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(vx, vy));
+        if (mask != 0xFFFF) return offset + __builtin_ctz(~mask);
+    }
+    return skip_scalar(x, y, offset);
+}
+
+__attribute__((target("avx2")))
+static size_t
+skip_avx2(const byte* x, const byte* y, size_t offset)
+{
+    for (; offset + 32 <= MEM_PAGE_SIZE; offset += 32) {
+        __m256i vx = _mm256_loadu_si256((const __m256i*) (x + offset));
+        __m256i vy = _mm256_loadu_si256((const __m256i*) (y + offset));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(vx, vy));
+        if (mask != 0xFFFFFFFFu) return offset + __builtin_ctz(~mask);
+    }
+    return skip_scalar(x, y, offset);
+}
+#endif
+
+static skip_t skip;
+static pthread_once_t skip_once = PTHREAD_ONCE_INIT;
+
+// Picks the kernel once, diffs may run on several threads.
+static void
+pick_skip(void)
+{
+    skip = skip_scalar;
+#ifdef DIFF_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        skip = skip_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        skip = skip_sse2;
+    }
+#endif
+}
+
+// Register pairs in the order of their bits in diff_reg_t.
+#define PAIRS 12
+
+static void
+pairs(const struct cpu_t* cpu, const union register_t** pair)
+{
+    pair[0] = &cpu->main.af;
+    pair[1] = &cpu->main.bc;
+    pair[2] = &cpu->main.de;
+    pair[3] = &cpu->main.hl;
+    pair[4] = &cpu->alternate.af;
+    pair[5] = &cpu->alternate.bc;
+    pair[6] = &cpu->alternate.de;
+    pair[7] = &cpu->alternate.hl;
+    pair[8] = &cpu->pc;
+    pair[9] = &cpu->sp;
+    pair[10] = &cpu->ix;
+    pair[11] = &cpu->iy;
+}
+
+// Adds size bytes that differ at addr, merging with the last range.
+static void
+add_range(struct z80_diff_t* out, unsigned addr, unsigned size)
+{
+    struct diff_range_t* last = out->count ? &out->range[out->count - 1]
+        : NULL;
+    out->bytes += size;
+    if (last && last->addr + last->size == addr) {
+        last->size += size;
+    } else if (out->count < DIFF_MAX_RANGES) {
+        out->range[out->count].addr = addr;
+        out->range[out->count].size = size;
+        out->count++;
+    } else {
+        out->truncated++;
+    }
+}
+
+// Compares two pages of host memory.
+static void
+diff_page(struct z80_diff_t* out, skip_t skip, const byte* x,
+        const byte* y, unsigned base)
+{
+    size_t offset = 0;
+    while ((offset = skip(x, y, offset)) < MEM_PAGE_SIZE) {
+        size_t start = offset;
+        while (offset < MEM_PAGE_SIZE && x[offset] != y[offset]) {
+            offset++;
+        }
+        add_range(out, base + start, offset - start);
+    }
+}
+
+/**
+ * Compares the state of two CPUs: registers, flip-flops and T-state
+ * counter, and the memory of their buses. Pages that map the same host
+ * memory on both sides, such as pages shared between forks, are not even
+ * read.
+ *
+ * @param a first CPU
+ * @param b second CPU
+ * @param out differences found
+ * @return 0 if the states are equal, 1 otherwise
+ */
+int
+z80_state_diff(const struct cpu_t* a, const struct cpu_t* b,
+        struct z80_diff_t* out)
+{
+    const union register_t* pa[PAIRS];
+    const union register_t* pb[PAIRS];
+    int i;
+
+    pthread_once(&skip_once, pick_skip);
+    memset(out, 0, sizeof(struct z80_diff_t));
+    pairs(a, pa);
+    pairs(b, pb);
+    for (i = 0; i < PAIRS; i++) {
+        if (pa[i]->WORD != pb[i]->WORD) out->regs |= 1u << i;
+    }
+    if (a->i != b->i) out->regs |= DIFF_I;
+    if (a->r != b->r) out->regs |= DIFF_R;
+    if (a->iff1 != b->iff1 || a->iff2 != b->iff2) out->regs |= DIFF_IFF;
+    if (a->im != b->im) out->regs |= DIFF_IM;
+    if (a->tstates != b->tstates) out->regs |= DIFF_TSTATES;
+
+    for (i = 0; i < MEM_PAGES; i++) {
+        const byte* x = a->bus->page[i].source;
+        const byte* y = b->bus->page[i].source;
+        if (x == y) continue;
+        if (x && y) {
+            diff_page(out, skip, x, y, i << MEM_PAGE_SHIFT);
+        } else {
+            add_range(out, i << MEM_PAGE_SHIFT, MEM_PAGE_SIZE);
+        }
+    }
+    return out->regs || out->bytes;
+}
+
+/**
+ * Prints a diff, one line per register and per range, with the values on
+ * each side. Meant for tests that want to show why two states differ.
+ *
+ * @param file stream to print to
+ * @param diff differences, as given by z80_state_diff
+ * @param a first CPU
+ * @param b second CPU
+ */
+void
+z80_diff_print(FILE* file, const struct z80_diff_t* diff,
+        const struct cpu_t* a, const struct cpu_t* b)
+{
+    static const char* names[] = {
+        "AF", "BC", "DE", "HL", "AF'", "BC'", "DE'", "HL'",
+        "PC", "SP", "IX", "IY"
+    };
+    const union register_t* pa[PAIRS];
+    const union register_t* pb[PAIRS];
+    int i, j;
+
+    pairs(a, pa);
+    pairs(b, pb);
+    for (i = 0; i < PAIRS; i++) {
+        if (diff->regs & (1u << i)) {
+            fprintf(file, "%s: %04X != %04X\n", names[i], pa[i]->WORD,
+                    pb[i]->WORD);
+        }
+    }
+    if (diff->regs & DIFF_I) fprintf(file, "I: %02X != %02X\n", a->i, b->i);
+    if (diff->regs & DIFF_R) fprintf(file, "R: %02X != %02X\n", a->r, b->r);
+    if (diff->regs & DIFF_IFF) {
+        fprintf(file, "IFF1/IFF2: %d/%d != %d/%d\n", a->iff1, a->iff2,
+                b->iff1, b->iff2);
+    }
+    if (diff->regs & DIFF_IM) {
+        fprintf(file, "IM: %d != %d\n", a->im, b->im);
+    }
+    if (diff->regs & DIFF_TSTATES) {
+        fprintf(file, "T-states: %d != %d\n", a->tstates, b->tstates);
+    }
+
+    // Up to eight bytes of each range, read only from host memory.
+    for (i = 0; i < diff->count; i++) {
+        const struct diff_range_t* range = &diff->range[i];
+        const struct cpu_t* side[] = { a, b };
+        int k;
+        fprintf(file, "%04X-%04X:", range->addr,
+                (unsigned) (range->addr + range->size - 1) & 0xFFFF);
+        for (k = 0; k < 2; k++) {
+            fputs(k ? " !=" : "", file);
+            for (j = 0; j < 8 && (unsigned) j < range->size; j++) {
+                word addr = range->addr + j;
+                const byte* host =
+                    side[k]->bus->page[addr >> MEM_PAGE_SHIFT].source;
+                if (host) {
+                    fprintf(file, " %02X", host[addr & MEM_PAGE_MASK]);
+                } else {
+                    fputs(" --", file);
+                }
+            }
+            if (range->size > 8) fputs(" ...", file);
+        }
+        fputc('\n', file);
+    }
+    if (diff->truncated) {
+        fprintf(file, "%d more ranges\n", diff->truncated);
+    }
+}
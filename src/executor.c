@@ -0,0 +1,304 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#define _GNU_SOURCE         // pthread_setaffinity_np
+#include <sched.h>          // CPU_SET
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memset
+#include <unistd.h>         // sysconf
+
+#include <executor.h>
+#include <opcodes.h>
+
+static void
+deque_lock(struct executor_deque_t* deque)
+{
+    while (atomic_flag_test_and_set_explicit(&deque->lock,
+                memory_order_acquire)) {
+        // Spin: the critical sections are a handful of instructions.
+    }
+}
+
+static void
+deque_unlock(struct executor_deque_t* deque)
+{
+    atomic_flag_clear_explicit(&deque->lock, memory_order_release);
+}
+
+// Appends a task at the tail, growing the ring if it is full.
+static int
+deque_push(struct executor_deque_t* deque, struct z80_task_t* task)
+{
+    deque_lock(deque);
+    if (deque->count == deque->capacity) {
+        size_t capacity = deque->capacity ? deque->capacity * 2 : 64, i;
+        struct z80_task_t** ring = malloc(capacity * sizeof(*ring));
+        if (!ring) {
+            deque_unlock(deque);
+            return -1;
+        }
+        for (i = 0; i < deque->count; i++) {
+            ring[i] = deque->task[(deque->head + i) & (deque->capacity - 1)];
+        }
+        free(deque->task);
+        deque->task = ring;
+        deque->capacity = capacity;
+        deque->head = 0;
+    }
+    deque->task[(deque->head + deque->count) & (deque->capacity - 1)] = task;
+    deque->count++;
+    deque_unlock(deque);
+    return 0;
+}
+
+// Takes the task at the head, the one that has waited the longest.
+static struct z80_task_t*
+deque_pop(struct executor_deque_t* deque)
+{
+    struct z80_task_t* task = NULL;
+    deque_lock(deque);
+    if (deque->count) {
+        task = deque->task[deque->head];
+        deque->head = (deque->head + 1) & (deque->capacity - 1);
+        deque->count--;
+    }
+    deque_unlock(deque);
+    return task;
+}
+
+// Takes the task at the tail, the one its worker would run last.
+static struct z80_task_t*
+deque_steal(struct executor_deque_t* deque)
+{
+    struct z80_task_t* task = NULL;
+    deque_lock(deque);
+    if (deque->count) {
+        deque->count--;
+        task = deque->task[(deque->head + deque->count)
+            & (deque->capacity - 1)];
+    }
+    deque_unlock(deque);
+    return task;
+}
+
+// Runs a slice of a task. Returns whether the task is done.
+static int
+run_slice(struct z80_task_t* task, int slice)
+{
+    struct cpu_t* cpu = task->cpu;
+    long left = task->budget - task->used, ran = 0;
+    if (left > slice) left = slice;
+    while (ran < left) {
+        int before = cpu->tstates;
+        execute_opcode(cpu);
+        // Opcodes that are not implemented yet take no time: count them
+        // as one T-state so that the budget always runs out.
+        ran += cpu->tstates - before > 0 ? cpu->tstates - before : 1;
+    }
+    task->used += ran;
+    return task->used >= task->budget;
+}
+
+static struct z80_task_t*
+find_task(struct executor_worker_t* worker)
+{
+    struct z80_executor_t* executor = worker->executor;
+    struct z80_task_t* task = deque_pop(&worker->deque);
+    int i;
+    if (task) return task;
+    for (i = 1; i < executor->workers; i++) {
+        int victim = (worker->index + i) % executor->workers;
+        task = deque_steal(&executor->worker[victim].deque);
+        if (task) {
+            worker->steals++;
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static void
+pin(struct executor_worker_t* worker)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+    if (cores < 1) return;
+    CPU_ZERO(&set);
+    CPU_SET(worker->index % cores, &set);
+    // Not being able to pin is not an error, the host picks the core.
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void*
+worker_main(void* arg)
+{
+    struct executor_worker_t* worker = arg;
+    struct z80_executor_t* executor = worker->executor;
+
+    pin(worker);
+    for (;;) {
+        struct z80_task_t* task = find_task(worker);
+        if (!task) {
+            pthread_mutex_lock(&executor->mutex);
+            while (atomic_load(&executor->runnable) == 0
+                    && !atomic_load(&executor->stop)) {
+                pthread_cond_wait(&executor->work, &executor->mutex);
+            }
+            pthread_mutex_unlock(&executor->mutex);
+            if (atomic_load(&executor->stop)) return NULL;
+            continue;
+        }
+        atomic_fetch_sub(&executor->runnable, 1);
+
+        worker->slices++;
+        if (!run_slice(task, executor->slice)) {
+            atomic_fetch_add(&executor->runnable, 1);
+            if (!deque_push(&worker->deque, task)) continue;
+            // The queue could not grow: the task keeps this worker.
+            atomic_fetch_sub(&executor->runnable, 1);
+            do {
+                worker->slices++;
+            } while (!run_slice(task, executor->slice));
+        }
+        if (task->done) task->done(task);
+        if (atomic_fetch_sub(&executor->pending, 1) == 1) {
+            pthread_mutex_lock(&executor->mutex);
+            pthread_cond_broadcast(&executor->idle);
+            pthread_mutex_unlock(&executor->mutex);
+        }
+    }
+}
+
+/**
+ * Creates an executor and starts its workers.
+ *
+ * @param workers number of worker threads, 0 for one per core
+ * @param slice T-states a task runs before the next one gets its turn
+ * @return new executor, or NULL on error
+ */
+struct z80_executor_t*
+z80_executor_create(int workers, int slice)
+{
+    struct z80_executor_t* executor;
+    int i;
+
+    if (workers <= 0) workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers <= 0) workers = 1;
+    if (workers > EXECUTOR_MAX_WORKERS || slice <= 0) return NULL;
+
+    executor = malloc(sizeof(struct z80_executor_t));
+    if (!executor) return NULL;
+    memset(executor, 0, sizeof(struct z80_executor_t));
+    executor->workers = workers;
+    executor->slice = slice;
+    atomic_init(&executor->next, 0);
+    atomic_init(&executor->runnable, 0);
+    atomic_init(&executor->pending, 0);
+    atomic_init(&executor->stop, 0);
+    pthread_mutex_init(&executor->mutex, NULL);
+    pthread_cond_init(&executor->work, NULL);
+    pthread_cond_init(&executor->idle, NULL);
+
+    for (i = 0; i < workers; i++) {
+        struct executor_worker_t* worker = &executor->worker[i];
+        worker->executor = executor;
+        worker->index = i;
+        atomic_flag_clear(&worker->deque.lock);
+        if (pthread_create(&worker->thread, NULL, worker_main, worker)) {
+            executor->workers = i;
+            z80_executor_destroy(executor);
+            return NULL;
+        }
+    }
+    return executor;
+}
+
+/**
+ * Stops the workers and frees the executor. Tasks still queued are not
+ * run any further and their callbacks are not called; call
+ * z80_executor_wait first to let them finish.
+ *
+ * @param executor executor
+ */
+void
+z80_executor_destroy(struct z80_executor_t* executor)
+{
+    int i;
+    if (!executor) return;
+    pthread_mutex_lock(&executor->mutex);
+    atomic_store(&executor->stop, 1);
+    pthread_cond_broadcast(&executor->work);
+    pthread_mutex_unlock(&executor->mutex);
+    for (i = 0; i < executor->workers; i++) {
+        pthread_join(executor->worker[i].thread, NULL);
+        free(executor->worker[i].deque.task);
+    }
+    pthread_cond_destroy(&executor->idle);
+    pthread_cond_destroy(&executor->work);
+    pthread_mutex_destroy(&executor->mutex);
+    free(executor);
+}
+
+/**
+ * Queues a task. Submissions are spread over the workers round robin.
+ * It can be called from any thread, completion callbacks included, so a
+ * long-lived machine can be submitted again with a new budget when the
+ * last one runs out.
+ *
+ * @param executor executor
+ * @param task task, with its budget set
+ * @return 0 on success, -1 if the budget is not positive or memory ran out
+ */
+int
+z80_executor_submit(struct z80_executor_t* executor, struct z80_task_t* task)
+{
+    unsigned index = atomic_fetch_add(&executor->next, 1)
+        % executor->workers;
+    if (task->budget <= 0) return -1;
+    task->used = 0;
+    atomic_fetch_add(&executor->pending, 1);
+    atomic_fetch_add(&executor->runnable, 1);
+    if (deque_push(&executor->worker[index].deque, task)) {
+        atomic_fetch_sub(&executor->runnable, 1);
+        atomic_fetch_sub(&executor->pending, 1);
+        return -1;
+    }
+    pthread_mutex_lock(&executor->mutex);
+    pthread_cond_signal(&executor->work);
+    pthread_mutex_unlock(&executor->mutex);
+    return 0;
+}
+
+/**
+ * Waits until every task submitted is done, including tasks submitted
+ * meanwhile by the completion callbacks.
+ *
+ * @param executor executor
+ */
+void
+z80_executor_wait(struct z80_executor_t* executor)
+{
+    pthread_mutex_lock(&executor->mutex);
+    while (atomic_load(&executor->pending) != 0) {
+        pthread_cond_wait(&executor->idle, &executor->mutex);
+    }
+    pthread_mutex_unlock(&executor->mutex);
+}
@@ -0,0 +1,378 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memset, memcmp, memcpy
+
+#include <cpu.h>
+#include <opcodes.h>
+#include <codecache.h>
+#include <idiom.h>
+
+// Emulated steps allowed when verifying before giving up on the exit.
+#define VERIFY_MAX_STEPS 1000000
+
+/**
+ * Initializes an empty idiom map.
+ *
+ * @param map map to initialize
+ */
+void
+idiom_init(struct idiom_map_t* map)
+{
+    memset(map, 0, sizeof(struct idiom_map_t));
+}
+
+/**
+ * Registers an idiom.
+ *
+ * @param map idiom map
+ * @param name name of the routine
+ * @param signature code bytes of the routine, starting at its entry
+ * @param length number of bytes in the signature
+ * @param exit offset of the exit PC from the entry
+ * @param native native implementation
+ * @param footprint memory the routine writes, NULL if it writes none
+ * @return 0 on success, -1 if the map is full or the signature too long
+ */
+int
+idiom_register(struct idiom_map_t* map, const char* name,
+        const byte* signature, word length, word exit,
+        idiom_native_t native, idiom_footprint_t footprint)
+{
+    struct idiom_t* idiom;
+    if (map->count == IDIOM_MAX || length == 0
+            || length > IDIOM_MAX_LENGTH) {
+        return -1;
+    }
+    idiom = &map->idiom[map->count++];
+    idiom->name = name;
+    idiom->length = length;
+    idiom->exit = exit;
+    idiom->first = signature[0];
+    idiom->hash = code_hash(signature, length);
+    idiom->native = native;
+    idiom->footprint = footprint;
+    return 0;
+}
+
+// Whether the code at addr matches the signature of an idiom.
+static int
+matches(const struct idiom_t* idiom, struct cpu_t* cpu, word addr)
+{
+    byte code[IDIOM_MAX_LENGTH];
+    int i;
+    if (mem_read(cpu, addr) != idiom->first) return 0;
+    for (i = 0; i < idiom->length; i++) {
+        code[i] = mem_read(cpu, addr + i);
+    }
+    return code_hash(code, idiom->length) == idiom->hash;
+}
+
+/**
+ * Looks for registered idioms in a range of memory and marks every match
+ * as an entry point. Overlapping matches keep the first idiom found.
+ *
+ * @param map idiom map
+ * @param cpu CPU instance whose memory is scanned
+ * @param start first address to check
+ * @param size number of addresses to check
+ * @return number of entry points found
+ */
+int
+idiom_scan(struct idiom_map_t* map, struct cpu_t* cpu, word start,
+        size_t size)
+{
+    int found = 0, i;
+    size_t offset;
+
+    for (offset = 0; offset < size; offset++) {
+        word addr = start + offset;
+        for (i = 0; i < map->count; i++) {
+            if (matches(&map->idiom[i], cpu, addr)) {
+                map->entry[addr] = i + 1;
+                found++;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+// Host memory for writes behind an address, or NULL.
+static byte*
+host_byte(struct bus_t* bus, word addr)
+{
+    byte* mapped = bus->page[addr >> MEM_PAGE_SHIFT].mapped;
+    return mapped ? mapped + (addr & MEM_PAGE_MASK) : NULL;
+}
+
+// Copies the footprint out of host memory, -1 if part of it has none.
+static int
+footprint_save(struct bus_t* bus, const struct idiom_range_t* range,
+        int count, byte* data)
+{
+    size_t i;
+    for (; count > 0; count--, range++) {
+        for (i = 0; i < range->size; i++) {
+            byte* host = host_byte(bus, range->addr + i);
+            if (!host) return -1;
+            *data++ = *host;
+        }
+    }
+    return 0;
+}
+
+// Writes the footprint back to host memory and tells the trackers.
+static void
+footprint_load(struct bus_t* bus, const struct idiom_range_t* range,
+        int count, const byte* data)
+{
+    size_t i, run;
+    for (; count > 0; count--, range++) {
+        for (i = 0; i < range->size; i += run, data += run) {
+            word addr = range->addr + i;
+            byte* host = host_byte(bus, addr);
+            run = MEM_PAGE_SIZE - (addr & MEM_PAGE_MASK);
+            if (run > range->size - i) run = range->size - i;
+            memcpy(host, data, run);
+            bus_dirty_mark_host(bus, host, run);
+        }
+    }
+}
+
+/*
+ * Runs the routine both ways and keeps the emulated result. Only the
+ * footprint of the routine is saved and restored, straight from host
+ * memory, so no handler is called and trackers only see those bytes.
+ * Routines whose footprint is not all host memory, such as memory mapped
+ * I/O, cannot be verified and are just run natively.
+ */
+static void
+verify(struct idiom_map_t* map, const struct idiom_t* idiom,
+        struct cpu_t* cpu)
+{
+    struct idiom_range_t range[IDIOM_MAX_RANGES];
+    int count = idiom->footprint ? idiom->footprint(cpu, range) : 0, i;
+    size_t total = 1;
+    byte *before, *emulated_mem, *native_mem;
+    struct cpu_t start, emulated;
+    word exit = PC(*cpu) + idiom->exit;
+    long steps = 0;
+
+    for (i = 0; i < count; i++) {
+        total += range[i].size;
+    }
+    before = malloc(total);
+    emulated_mem = malloc(total);
+    native_mem = malloc(total);
+    if (!before || !emulated_mem || !native_mem
+            || footprint_save(cpu->bus, range, count, before)) {
+        free(before);
+        free(emulated_mem);
+        free(native_mem);
+        idiom->native(cpu);
+        return;
+    }
+
+    memcpy(&start, cpu, sizeof(struct cpu_t));
+    do {
+        execute_opcode(cpu);
+    } while (PC(*cpu) != exit && ++steps < VERIFY_MAX_STEPS);
+    memcpy(&emulated, cpu, sizeof(struct cpu_t));
+    footprint_save(cpu->bus, range, count, emulated_mem);
+
+    memcpy(cpu, &start, sizeof(struct cpu_t));
+    footprint_load(cpu->bus, range, count, before);
+    idiom->native(cpu);
+    footprint_save(cpu->bus, range, count, native_mem);
+    if (memcmp(cpu, &emulated, sizeof(struct cpu_t)) != 0
+            || memcmp(native_mem, emulated_mem, total - 1) != 0) {
+        map->mismatches++;
+        memcpy(cpu, &emulated, sizeof(struct cpu_t));
+        footprint_load(cpu->bus, range, count, emulated_mem);
+    }
+
+    free(before);
+    free(emulated_mem);
+    free(native_mem);
+}
+
+/**
+ * Executes the next instruction, or a whole routine natively if PC is the
+ * entry of an idiom and the code still matches its signature.
+ *
+ * @param map idiom map
+ * @param cpu CPU instance
+ * @return 1 if a routine was executed natively, 0 otherwise
+ */
+int
+idiom_execute_opcode(struct idiom_map_t* map, struct cpu_t* cpu)
+{
+    int index = map->entry[PC(*cpu)];
+    if (index) {
+        const struct idiom_t* idiom = &map->idiom[index - 1];
+        if (matches(idiom, cpu, PC(*cpu))) {
+            if (map->verify) {
+                verify(map, idiom, cpu);
+            } else {
+                idiom->native(cpu);
+            }
+            map->hits++;
+            return 1;
+        }
+    }
+    execute_opcode(cpu);
+    return 0;
+}
+
+/*
+ * Built-in idioms. They are loops made of opcodes the interpreter already
+ * runs, so they can be verified against it. T-states follow the loops:
+ * DJNZ takes 13 T-states while looping and 8 when it falls through.
+ */
+
+// Flags after ADD HL, ss, the same way the interpreter computes them.
+static byte
+add16_flags(byte f, word op1, word op2)
+{
+    SET_IF(f, FLAG_H, ((op1 & 0xFFF) + (op2 & 0xFFF)) & 0x1000);
+    SET_IF(f, FLAG_C, (op1 + op2) & 0x10000);
+    return f & ~FLAG_N;
+}
+
+/*
+ * HL = H * E, shift and add.
+ *
+ *     LD D, 0
+ *     LD L, D
+ *     LD B, 8
+ * loop:
+ *     ADD HL, HL
+ *     JR NC, skip
+ *     ADD HL, DE
+ * skip:
+ *     DJNZ loop
+ */
+static const byte mul8_code[] = {
+    0x16, 0x00, 0x6A, 0x06, 0x08, 0x29, 0x30, 0x01, 0x19, 0x10, 0xFA
+};
+
+static void
+mul8_native(struct cpu_t* cpu)
+{
+    word hl = REG_H(*cpu) << 8, de = REG_E(*cpu);
+    byte f = REG_F(*cpu);
+    int tstates = 7 + 4 + 7, i;
+
+    for (i = 0; i < 8; i++) {
+        f = add16_flags(f, hl, hl);
+        hl += hl;
+        if (f & FLAG_C) {
+            f = add16_flags(f, hl, de);
+            hl += de;
+            tstates += 11 + 7 + 11;
+        } else {
+            tstates += 11 + 12;
+        }
+        tstates += (i < 7) ? 13 : 8;
+    }
+
+    REG_HL(*cpu) = hl;
+    REG_D(*cpu) = 0;
+    REG_B(*cpu) = 0;
+    REG_F(*cpu) = f;
+    PC(*cpu) += sizeof(mul8_code);
+    cpu->tstates += tstates;
+}
+
+/*
+ * Copies B bytes from (DE) to (HL), B = 0 copies 256.
+ *
+ * loop:
+ *     LD A, (DE)
+ *     LD (HL), A
+ *     INC DE
+ *     INC HL
+ *     DJNZ loop
+ */
+static const byte copy_code[] = { 0x1A, 0x77, 0x13, 0x23, 0x10, 0xFA };
+
+static void
+copy_native(struct cpu_t* cpu)
+{
+    int count = REG_B(*cpu) ? REG_B(*cpu) : 256, i;
+    for (i = 0; i < count; i++) {
+        REG_A(*cpu) = mem_read(cpu, REG_DE(*cpu)++);
+        mem_write(cpu, REG_HL(*cpu)++, REG_A(*cpu));
+    }
+    REG_B(*cpu) = 0;
+    PC(*cpu) += sizeof(copy_code);
+    cpu->tstates += count * (7 + 7 + 6 + 6) + (count - 1) * 13 + 8;
+}
+
+// Copy and fill write B bytes from HL, B = 0 writes 256.
+static int
+block_footprint(const struct cpu_t* cpu, struct idiom_range_t* range)
+{
+    range->addr = REG_HL(*cpu);
+    range->size = REG_B(*cpu) ? REG_B(*cpu) : 256;
+    return 1;
+}
+
+/*
+ * Fills B bytes at (HL) with A, B = 0 fills 256.
+ *
+ * loop:
+ *     LD (HL), A
+ *     INC HL
+ *     DJNZ loop
+ */
+static const byte fill_code[] = { 0x77, 0x23, 0x10, 0xFC };
+
+static void
+fill_native(struct cpu_t* cpu)
+{
+    int count = REG_B(*cpu) ? REG_B(*cpu) : 256, i;
+    for (i = 0; i < count; i++) {
+        mem_write(cpu, REG_HL(*cpu)++, REG_A(*cpu));
+    }
+    REG_B(*cpu) = 0;
+    PC(*cpu) += sizeof(fill_code);
+    cpu->tstates += count * (7 + 6) + (count - 1) * 13 + 8;
+}
+
+/**
+ * Registers the idioms that come with the library: an 8 bit shift and add
+ * multiplication, a block copy loop and a block fill loop.
+ *
+ * @param map idiom map
+ */
+void
+idiom_register_builtins(struct idiom_map_t* map)
+{
+    idiom_register(map, "mul8", mul8_code, sizeof(mul8_code),
+            sizeof(mul8_code), mul8_native, NULL);
+    idiom_register(map, "copy", copy_code, sizeof(copy_code),
+            sizeof(copy_code), copy_native, block_footprint);
+    idiom_register(map, "fill", fill_code, sizeof(fill_code),
+            sizeof(fill_code), fill_native, block_footprint);
+}
@@ -0,0 +1,153 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <fcntl.h>          // open
+#include <string.h>         // memset
+#include <unistd.h>         // close, ftruncate, sysconf
+#include <sys/mman.h>       // msync
+#include <sys/stat.h>       // fstat
+
+#include <nvram.h>
+
+/**
+ * Maps a range of pages to a file. The file is created if it does not
+ * exist and grown with zeros if it is too short, otherwise its contents
+ * are what the guest sees. The pages are read-write.
+ *
+ * @param nvram NVRAM to initialize
+ * @param bus memory bus
+ * @param first first page
+ * @param count number of pages
+ * @param path file that holds the contents
+ * @param frames flush every this many calls to nvram_frame, 0 for never
+ * @param track non-zero to only sync the pages written since the last
+ *        flush, at the cost of tracking writes on the whole bus
+ * @return 0 on success, -1 on error
+ */
+int
+nvram_open(struct nvram_t* nvram, struct bus_t* bus, int first, int count,
+        const char* path, int frames, int track)
+{
+    off_t size = (off_t) count * MEM_PAGE_SIZE;
+    struct stat st;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+
+    memset(nvram, 0, sizeof(struct nvram_t));
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0 || (st.st_size < size && ftruncate(fd, size))) {
+        close(fd);
+        return -1;
+    }
+    nvram->host = bus_map_fd(bus, first, count, fd, 0);
+    close(fd);
+    if (!nvram->host) return -1;
+
+    nvram->bus = bus;
+    nvram->first = first;
+    nvram->count = count;
+    nvram->frames = frames;
+    nvram->tracked = track;
+    if (track) {
+        bus_dirty_attach(bus, &nvram->dirty, 0);
+    }
+    return 0;
+}
+
+/**
+ * Flushes and unmaps the NVRAM. The pages are left unmapped.
+ *
+ * @param nvram NVRAM
+ * @return 0 on success, -1 if the last flush failed
+ */
+int
+nvram_close(struct nvram_t* nvram)
+{
+    int result = nvram_flush(nvram);
+    if (nvram->tracked) {
+        bus_dirty_detach(nvram->bus, &nvram->dirty);
+    }
+    bus_unmap_fd(nvram->bus, nvram->host, nvram->first, nvram->count);
+    return result;
+}
+
+// Syncs a run of pages, rounded out to host pages.
+static int
+sync_pages(struct nvram_t* nvram, int first, int count)
+{
+    size_t host_page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t start = (size_t) first * MEM_PAGE_SIZE;
+    size_t end = start + (size_t) count * MEM_PAGE_SIZE;
+
+    start &= ~(host_page - 1);
+    nvram->syncs++;
+    return msync(nvram->host + start, end - start, MS_SYNC);
+}
+
+/**
+ * Writes the NVRAM back to its file. When writes are tracked, pages that
+ * were not written since the last flush are skipped, and nothing is done
+ * at all if none was. Pages that fail to sync are kept dirty.
+ *
+ * @param nvram NVRAM
+ * @return 0 on success, -1 on error
+ */
+int
+nvram_flush(struct nvram_t* nvram)
+{
+    unsigned range = ((1u << nvram->count) - 1) << nvram->first;
+    unsigned pages;
+    int result = 0;
+
+    nvram->elapsed = 0;
+    if (!nvram->tracked) {
+        return sync_pages(nvram, 0, nvram->count);
+    }
+
+    pages = (bus_dirty_fetch_pages(&nvram->dirty) & range) >> nvram->first;
+    while (pages) {
+        int first = __builtin_ctz(pages), count = 0;
+        while (pages & (1u << (first + count))) {
+            count++;
+        }
+        pages &= ~(((1u << count) - 1) << first);
+        if (sync_pages(nvram, first, count) != 0) {
+            atomic_fetch_or(&nvram->dirty.pages,
+                    ((1u << count) - 1) << (nvram->first + first));
+            result = -1;
+        }
+    }
+    return result;
+}
+
+/**
+ * Counts a frame and flushes the NVRAM when the flush period is over.
+ *
+ * @param nvram NVRAM
+ * @return 0 on success, -1 if a flush was due and it failed
+ */
+int
+nvram_frame(struct nvram_t* nvram)
+{
+    if (nvram->frames == 0 || ++nvram->elapsed < nvram->frames) {
+        return 0;
+    }
+    return nvram_flush(nvram);
+}
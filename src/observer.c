@@ -0,0 +1,201 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memcpy, memset
+
+#include <observer.h>
+
+// Torn reads allowed before giving up on a reader.
+#define OBSERVER_MAX_RETRIES 1000
+
+/**
+ * Creates an observer. Page versions need a dirty tracker on the bus of
+ * the CPU, which sends writes through the slow path of the bus for as
+ * long as the observer exists; leave them off if only the registers and
+ * watched ranges matter.
+ *
+ * @param cpu CPU instance
+ * @param track_pages non-zero to keep page versions
+ * @return new observer, or NULL on error
+ */
+struct observer_t*
+observer_create(struct cpu_t* cpu, int track_pages)
+{
+    struct observer_t* observer = malloc(sizeof(struct observer_t));
+    int i;
+    if (!observer) return NULL;
+    memset(observer, 0, sizeof(struct observer_t));
+    observer->cpu = cpu;
+    observer->tracking = track_pages;
+    atomic_init(&observer->sequence, 0);
+    for (i = 0; i < MEM_PAGES; i++) {
+        atomic_init(&observer->version[i], 0);
+    }
+    for (i = 0; i < (int) OBSERVER_WORDS; i++) {
+        atomic_init(&observer->data[i], 0);
+    }
+    if (track_pages) bus_dirty_attach(cpu->bus, &observer->dirty, 0);
+    return observer;
+}
+
+/**
+ * Frees an observer. No reader may be using it anymore.
+ *
+ * @param observer observer
+ */
+void
+observer_free(struct observer_t* observer)
+{
+    if (!observer) return;
+    if (observer->tracking) {
+        bus_dirty_detach(observer->cpu->bus, &observer->dirty);
+    }
+    free(observer);
+}
+
+/**
+ * Adds a range of memory to every publication. Call it from the thread
+ * that runs the CPU.
+ *
+ * @param observer observer
+ * @param addr first address
+ * @param size number of bytes, the range may wrap around 0xFFFF
+ * @return 0 on success, -1 if there is no room for the range
+ */
+int
+observer_watch(struct observer_t* observer, word addr, word size)
+{
+    if (observer->count == OBSERVER_RANGES
+            || observer->bytes + size > OBSERVER_BYTES) {
+        return -1;
+    }
+    observer->range[observer->count].addr = addr;
+    observer->range[observer->count].size = size;
+    observer->count++;
+    observer->bytes += size;
+    return 0;
+}
+
+/**
+ * Publishes the registers and the watched ranges, and raises the version
+ * of the pages written since the last publication. Call it from the
+ * thread that runs the CPU, between instructions, as often as readers
+ * need: it costs a copy of the registers and the watched bytes. Watched
+ * bytes are taken from host memory, so memory mapped I/O reads as 0xFF.
+ *
+ * @param observer observer
+ */
+void
+observer_publish(struct observer_t* observer)
+{
+    union {
+        uint64_t words[OBSERVER_WORDS];
+        byte bytes[OBSERVER_WORDS * 8];
+    } copy;
+    const struct bus_t* bus = observer->cpu->bus;
+    unsigned sequence = atomic_load_explicit(&observer->sequence,
+            memory_order_relaxed);
+    size_t offset = sizeof(struct cpu_t);
+    size_t words = (offset + observer->bytes + 7) / 8;
+    int i;
+
+    copy.words[words - 1] = 0;
+    memcpy(copy.bytes, observer->cpu, sizeof(struct cpu_t));
+    for (i = 0; i < observer->count; i++) {
+        const struct observer_range_t* range = &observer->range[i];
+        size_t j;
+        for (j = 0; j < range->size; j++) {
+            word addr = range->addr + j;
+            const byte* host = bus->page[addr >> MEM_PAGE_SHIFT].source;
+            copy.bytes[offset++] = host ? host[addr & MEM_PAGE_MASK] : 0xFF;
+        }
+    }
+
+    atomic_store_explicit(&observer->sequence, sequence + 1,
+            memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (i = 0; i < (int) words; i++) {
+        atomic_store_explicit(&observer->data[i], copy.words[i],
+                memory_order_relaxed);
+    }
+    if (observer->tracking) {
+        unsigned pages = bus_dirty_fetch_pages(&observer->dirty);
+        while (pages) {
+            int page = __builtin_ctz(pages);
+            atomic_store_explicit(&observer->version[page],
+                    atomic_load_explicit(&observer->version[page],
+                        memory_order_relaxed) + 1,
+                    memory_order_relaxed);
+            pages &= pages - 1;
+        }
+    }
+    atomic_store_explicit(&observer->sequence, sequence + 2,
+            memory_order_release);
+}
+
+/**
+ * Takes a consistent copy of the last publication. It never blocks the
+ * thread that runs the CPU: if a publication is being written while the
+ * copy is taken, the copy is taken again. Call it from any thread.
+ *
+ * @param observer observer
+ * @param sample copy of the state
+ * @return 0 on success, -1 if nothing was published yet or every try
+ *         was torn
+ */
+int
+observer_read(const struct observer_t* observer,
+        struct observer_sample_t* sample)
+{
+    union {
+        uint64_t words[OBSERVER_WORDS];
+        byte bytes[OBSERVER_WORDS * 8];
+    } copy;
+    int retries, i;
+
+    for (retries = 0; retries < OBSERVER_MAX_RETRIES; retries++) {
+        unsigned before = atomic_load_explicit(&observer->sequence,
+                memory_order_acquire), after;
+        if (before == 0) return -1;
+        if (before & 1) continue;
+        for (i = 0; i < (int) OBSERVER_WORDS; i++) {
+            copy.words[i] = atomic_load_explicit(&observer->data[i],
+                    memory_order_relaxed);
+        }
+        for (i = 0; i < MEM_PAGES; i++) {
+            sample->version[i] = atomic_load_explicit(&observer->version[i],
+                    memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&observer->sequence,
+                memory_order_relaxed);
+        if (before == after) {
+            sample->sequence = before / 2;
+            sample->retries = retries;
+            memcpy(&sample->regs, copy.bytes, sizeof(struct cpu_t));
+            memcpy(sample->memory, copy.bytes + sizeof(struct cpu_t),
+                    OBSERVER_BYTES);
+            return 0;
+        }
+    }
+    return -1;
+}
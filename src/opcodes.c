@@ -20,10 +20,22 @@
  */
 
 #include <stdio.h>
+#include <alu.h>
 #include <opcodes.h>
 #include <cpu.h>
+#include <romimage.h>
 
-byte* r(struct cpu_t* cpu, unsigned int index)
+/*
+ * 8 bit operand registers, indexed by the y and z fields. Index 6 is not a
+ * register but the memory operand [HL], see get_r and set_r.
+ *
+ * Memory is accessed at the T-state where the M-cycle of the access
+ * starts, see mem_read_at. The opcode fetch takes T-states 0 to 3 (0 to 4
+ * for DJNZ, 0 to 5 for INC ss and DEC ss), and every read or write cycle
+ * after it takes 3.
+ */
+static byte*
+r(struct cpu_t* cpu, unsigned int index)
 {
     switch (index)
     {
@@ -33,12 +45,29 @@ byte* r(struct cpu_t* cpu, unsigned int index)
         case 3: return &REG_E(*cpu);
         case 4: return &REG_H(*cpu);
         case 5: return &REG_L(*cpu);
-        case 6: return &cpu->mem[REG_HL(*cpu)];
         case 7: return &REG_A(*cpu);
         default: return NULL;
     }
 }
 
+// Reads the 8 bit operand r[index], [HL] at T-state at.
+static byte
+get_r(struct cpu_t* cpu, unsigned int index, int at)
+{
+    return index == 6 ? mem_read_at(cpu, at, REG_HL(*cpu)) : *r(cpu, index);
+}
+
+// Writes the 8 bit operand r[index], [HL] at T-state at.
+static void
+set_r(struct cpu_t* cpu, unsigned int index, byte value, int at)
+{
+    if (index == 6) {
+        mem_write_at(cpu, at, REG_HL(*cpu), value);
+    } else {
+        *r(cpu, index) = value;
+    }
+}
+
 /**
  * Executes NOP. This opcode does nothing. It just refreshes memory.
  *
@@ -53,37 +82,35 @@ nop(struct cpu_t* cpu)
 static void
 ex_af_af(struct cpu_t* cpu)
 {
-    word tmp = REG_AF(*cpu);
-    REG_AF(*cpu) = ALT_AF(*cpu);
-    ALT_AF(*cpu) = tmp;
+    alu_ex_af(cpu);
     cpu->tstates += 4;
 }
 
 static void
 djnz_d(struct cpu_t* cpu)
 {
-    char e = (char) cpu->mem[PC(*cpu)++];
+    char e = (char) mem_read_at(cpu, 5, PC(*cpu)++);
 
     if (--REG_B(*cpu) == 0) {
         cpu->tstates += 8;
     } else {
         PC(*cpu) += e;
-        cpu->tstates = 13;
+        cpu->tstates += 13;
     }
 }
 
 static void
 jr_d(struct cpu_t* cpu)
 {
-    char e = (char) cpu->mem[PC(*cpu)++];
+    char e = (char) mem_read_at(cpu, 4, PC(*cpu)++);
     PC(*cpu) += e;
-    cpu->tstates = 12;
+    cpu->tstates += 12;
 }
 
 static void
 jr_nz(struct cpu_t* cpu)
 {
-    char e = (char) cpu->mem[PC(*cpu)++];
+    char e = (char) mem_read_at(cpu, 4, PC(*cpu)++);
     if (GET_FLAG(REG_F(*cpu), FLAG_Z) == 0) {
         PC(*cpu) += e;
         cpu->tstates += 12;
@@ -95,7 +122,7 @@ jr_nz(struct cpu_t* cpu)
 static void
 jr_z(struct cpu_t* cpu)
 {
-    char e = (char) cpu->mem[PC(*cpu)++];
+    char e = (char) mem_read_at(cpu, 4, PC(*cpu)++);
     if (GET_FLAG(REG_F(*cpu), FLAG_Z) != 0) {
         cpu->pc.WORD += e;
         cpu->tstates += 12;
@@ -107,7 +134,7 @@ jr_z(struct cpu_t* cpu)
 static void
 jr_nc(struct cpu_t* cpu)
 {
-    char e = (char) cpu->mem[PC(*cpu)++];
+    char e = (char) mem_read_at(cpu, 4, PC(*cpu)++);
     if (GET_FLAG(REG_F(*cpu), FLAG_C) == 0) {
         cpu->pc.WORD += e;
         cpu->tstates += 12;
@@ -119,7 +146,7 @@ jr_nc(struct cpu_t* cpu)
 static void
 jr_c(struct cpu_t* cpu)
 {
-    char e = (char) cpu->mem[PC(*cpu)++];
+    char e = (char) mem_read_at(cpu, 4, PC(*cpu)++);
     if(GET_FLAG(REG_F(*cpu), FLAG_C) != 0) {
         cpu->pc.WORD += e;
         cpu->tstates += 12;
@@ -132,7 +159,7 @@ static void
 ld_dd_nn(struct cpu_t* cpu, union register_t* reg)
 {
     // Read NN in memory. Remember: Z80 is little endian.
-    word nn = cpu->mem[PC(*cpu)] | (cpu->mem[PC(*cpu) + 1] << 8);
+    word nn = mem_read16(cpu, 4, PC(*cpu));
     PC(*cpu) += 2; // Increment program counter after read.
     reg->WORD = nn;
     cpu->tstates += 10;
@@ -141,13 +168,7 @@ ld_dd_nn(struct cpu_t* cpu, union register_t* reg)
 static void
 add_hl_ss(struct cpu_t* cpu, union register_t* reg)
 {
-    word op1 = REG_HL(*cpu), op2 = reg->WORD;
-
-    RESET_FLAG(REG_F(*cpu), FLAG_N);
-    SET_IF(REG_F(*cpu), FLAG_H, ((op1 & 0xFFF) + (op2 & 0xFFF)) & 0x1000);
-    SET_IF(REG_F(*cpu), FLAG_C, (op1 + op2) & 0x10000);
-
-    REG_HL(*cpu) += reg->WORD;
+    alu_add_hl(cpu, reg->WORD);
     cpu->tstates += 11;
 }
 
@@ -155,7 +176,7 @@ add_hl_ss(struct cpu_t* cpu, union register_t* reg)
 static void
 ld_bci_a(struct cpu_t* cpu)
 {
-    cpu->mem[REG_BC(*cpu)] = REG_A(*cpu);
+    mem_write_at(cpu, 4, REG_BC(*cpu), REG_A(*cpu));
     cpu->tstates += 7;
 }
 
@@ -163,7 +184,7 @@ ld_bci_a(struct cpu_t* cpu)
 static void
 ld_dei_a(struct cpu_t* cpu)
 {
-    cpu->mem[REG_DE(*cpu)] = REG_A(*cpu);
+    mem_write_at(cpu, 4, REG_DE(*cpu), REG_A(*cpu));
     cpu->tstates += 7;
 }
 
@@ -171,9 +192,9 @@ ld_dei_a(struct cpu_t* cpu)
 static void
 ld_nni_a(struct cpu_t* cpu)
 {
-    word addr = cpu->mem[PC(*cpu)] | (cpu->mem[PC(*cpu) + 1] << 8);
+    word addr = mem_read16(cpu, 4, PC(*cpu));
     PC(*cpu) += 2;
-    cpu->mem[addr] = REG_A(*cpu);
+    mem_write_at(cpu, 10, addr, REG_A(*cpu));
     cpu->tstates += 13;
 }
 
@@ -181,10 +202,9 @@ ld_nni_a(struct cpu_t* cpu)
 static void
 ld_nni_hl(struct cpu_t* cpu)
 {
-    word addr = cpu->mem[PC(*cpu)] | (cpu->mem[PC(*cpu) + 1] << 8);
+    word addr = mem_read16(cpu, 4, PC(*cpu));
     PC(*cpu) += 2;
-    cpu->mem[addr] = REG_L(*cpu);
-    cpu->mem[addr + 1] = REG_H(*cpu);
+    mem_write16(cpu, 10, addr, REG_HL(*cpu));
     cpu->tstates += 16;
 }
 
@@ -192,7 +212,7 @@ ld_nni_hl(struct cpu_t* cpu)
 static void
 ld_a_bci(struct cpu_t* cpu)
 {
-    REG_A(*cpu) = cpu->mem[REG_BC(*cpu)];
+    REG_A(*cpu) = mem_read_at(cpu, 4, REG_BC(*cpu));
     cpu->tstates += 7;
 }
 
@@ -200,7 +220,7 @@ ld_a_bci(struct cpu_t* cpu)
 static void
 ld_a_dei(struct cpu_t* cpu)
 {
-    REG_A(*cpu) = cpu->mem[REG_DE(*cpu)];
+    REG_A(*cpu) = mem_read_at(cpu, 4, REG_DE(*cpu));
     cpu->tstates += 7;
 }
 
@@ -208,9 +228,9 @@ ld_a_dei(struct cpu_t* cpu)
 static void
 ld_a_nni(struct cpu_t* cpu)
 {
-    word addr = cpu->mem[PC(*cpu)] | (cpu->mem[PC(*cpu)+1] << 8);
+    word addr = mem_read16(cpu, 4, PC(*cpu));
     PC(*cpu) += 2;
-    REG_A(*cpu) = cpu->mem[addr];
+    REG_A(*cpu) = mem_read_at(cpu, 10, addr);
     cpu->tstates += 13;
 }
 
@@ -218,11 +238,10 @@ ld_a_nni(struct cpu_t* cpu)
 static void
 ld_hl_nni(struct cpu_t* cpu)
 {
-    word addr = cpu->mem[PC(*cpu)] | (cpu->mem[PC(*cpu)+1] << 8);
+    word addr = mem_read16(cpu, 4, PC(*cpu));
     PC(*cpu) += 2;
-    REG_L(*cpu) = cpu->mem[addr];
-    REG_H(*cpu) = cpu->mem[addr + 1];
-    cpu->tstates = 16;
+    REG_HL(*cpu) = mem_read16(cpu, 10, addr);
+    cpu->tstates += 16;
 }
 
 static void
@@ -242,128 +261,77 @@ dec_r16(struct cpu_t* cpu, union register_t* reg)
 static void
 inc_r8(struct cpu_t* cpu, int index)
 {
-    byte* val = r(cpu, index);
-    FLAG_SIF(*cpu, FLAG_H, (*val & 0xF));
-    FLAG_SIF(*cpu, FLAG_P, (*val == 0x7F));
-
-    (*val)++;
-
-    FLAG_SIF(*cpu, FLAG_S, (*val & 0x80));
-    FLAG_SIF(*cpu, FLAG_Z, (*val == 0));
-    FLAG_RST(*cpu, FLAG_N);
-
+    set_r(cpu, index, alu_inc(cpu, get_r(cpu, index, 4)), 8);
     cpu->tstates += (index == 6 ? 11 : 4);
 }
 
 static void
 dec_r8(struct cpu_t* cpu, int index)
 {
-    byte* val = r(cpu, index);
-    FLAG_SIF(*cpu, FLAG_P, (*val == 0x80));
-
-    (*val)--;
-
-    FLAG_SIF(*cpu, FLAG_S, (*val & 0x80));
-    FLAG_SIF(*cpu, FLAG_Z, (*val == 0));
-    FLAG_SIF(*cpu, FLAG_H, (*val & 0xF) == 0xF);
-    FLAG_SET(*cpu, FLAG_N);
-
+    set_r(cpu, index, alu_dec(cpu, get_r(cpu, index, 4)), 8);
     cpu->tstates += (index == 6 ? 11 : 4);
 }
 
 static void
 ld_r_n(struct cpu_t* cpu, int index)
 {
-    byte n = cpu->mem[PC(*cpu)++];
-    byte* pos = r(cpu, index);
-    *pos = n;
+    byte n = mem_read_at(cpu, 4, PC(*cpu)++);
+    set_r(cpu, index, n, 7);
     cpu->tstates += 7;
 }
 
 static void
 rlca(struct cpu_t* cpu)
 {
-    byte bit7 = (REG_A(*cpu) & 0x80) >> 7;
-    REG_A(*cpu) <<= 1;
-    REG_A(*cpu) &= 0xFE;
-    REG_A(*cpu) |= bit7;
-    SET_IF(REG_F(*cpu), FLAG_C, (bit7 != 0));
-    RESET_FLAG(REG_F(*cpu), FLAG_H);
-    RESET_FLAG(REG_F(*cpu), FLAG_N);
+    alu_rotate(cpu, 0);
     cpu->tstates += 4;
 }
 
 static void
 rrca(struct cpu_t* cpu)
 {
-    byte bit0 = REG_A(*cpu) & 1;
-    REG_A(*cpu) = ((REG_A(*cpu) >> 1) & 0x7F) | (bit0 << 7);
-    SET_IF(REG_F(*cpu), FLAG_C, bit0);
-    RESET_FLAG(REG_F(*cpu), FLAG_H);
-    RESET_FLAG(REG_F(*cpu), FLAG_N);
+    alu_rotate(cpu, 1);
     cpu->tstates += 4;
 }
 
 static void
 rla(struct cpu_t* cpu)
 {
-    byte bit7 = (REG_A(*cpu) & 0x80) >> 7;
-    byte cf = GET_FLAG(REG_F(*cpu), FLAG_C) ? 1 : 0;
-    REG_A(*cpu) <<= 1;
-    REG_A(*cpu) &= 0xFE;
-    REG_A(*cpu) |= cf;
-    SET_IF(REG_F(*cpu), FLAG_C, (bit7 != 0));
-    RESET_FLAG(REG_F(*cpu), FLAG_H);
-    RESET_FLAG(REG_F(*cpu), FLAG_N);
+    alu_rotate(cpu, 2);
     cpu->tstates += 4;
 }
 
 static void
 rra(struct cpu_t* cpu)
 {
-    byte bit0 = REG_A(*cpu) & 1;
-    byte cf = GET_FLAG(REG_F(*cpu), FLAG_C) ? 1 : 0;
-    REG_A(*cpu) >>= 1;
-    REG_A(*cpu) &= 0x7F;
-    REG_A(*cpu) |= (cf << 7);
-    SET_IF(REG_F(*cpu), FLAG_C, bit0 != 0);
-    RESET_FLAG(REG_F(*cpu), FLAG_H);
-    RESET_FLAG(REG_F(*cpu), FLAG_N);
+    alu_rotate(cpu, 3);
     cpu->tstates += 4;
 }
 
 static void
 cpl(struct cpu_t* cpu)
 {
-    REG_A(*cpu) = ~REG_A(*cpu);
-    SET_FLAG(REG_F(*cpu), FLAG_H);
-    SET_FLAG(REG_F(*cpu), FLAG_N);
+    alu_flags(cpu, 5);
     cpu->tstates += 4;
 }
 
 static void
 scf(struct cpu_t* cpu)
 {
-    SET_FLAG(REG_F(*cpu), FLAG_C);
-    RESET_FLAG(REG_F(*cpu), FLAG_H);
-    RESET_FLAG(REG_F(*cpu), FLAG_N);
+    alu_flags(cpu, 6);
     cpu->tstates += 4;
 }
 
 static void
 ccf(struct cpu_t* cpu)
 {
-    SET_IF(REG_F(*cpu), FLAG_H, GET_FLAG(REG_F(*cpu), FLAG_C) != 0);
-    SET_IF(REG_F(*cpu), FLAG_C, GET_FLAG(REG_F(*cpu), FLAG_C) == 0);
-    RESET_FLAG(REG_F(*cpu), FLAG_N);
+    alu_flags(cpu, 7);
     cpu->tstates += 4;
 }
 
 // x = 1, y != 6 && z != 6 -> LD r[y], r[z]
 static void ld_ry_rz(struct cpu_t* cpu, int y, int z) {
-    byte* regZ = r(cpu, z);
-    byte* regY = r(cpu, y);
-    *regY = *regZ;
+    set_r(cpu, y, get_r(cpu, z, 4), 4);
     if (y == 6 || z == 6) {
         cpu->tstates += 7;
     } else {
@@ -391,17 +359,20 @@ extract_opcode(char opcode, struct opcode_t* opstruct)
     opstruct->q = opstruct->y & 1;
 }
 
-/**
- * Este es el tipo de datos para la función que va a procesar la tabla
- * de opcodes. Construiré con ellas un array de callbacks para que pueda
- * llamar rápidamente a la función apropiada.
- */
-typedef void (*table_function)(struct cpu_t*, struct opcode_t*);
-
-static union register_t* rp[4];
+static union register_t*
+rp(struct cpu_t* cpu, int index)
+{
+    switch (index)
+    {
+        case 0: return &cpu->main.bc;
+        case 1: return &cpu->main.de;
+        case 2: return &cpu->main.hl;
+        default: return &cpu->sp;
+    }
+}
 
 static void
-execute_table0(struct cpu_t* cpu, struct opcode_t* opstruct)
+execute_table0(struct cpu_t* cpu, const struct opcode_t* opstruct)
 {
     if (opstruct->z == 0)
     {
@@ -416,8 +387,8 @@ execute_table0(struct cpu_t* cpu, struct opcode_t* opstruct)
     }
     else if (opstruct->z == 1)
     {
-        if (opstruct->q == 0) ld_dd_nn(cpu, rp[(int) opstruct->p]);
-        if (opstruct->q == 1) add_hl_ss(cpu, rp[(int) opstruct->p]);
+        if (opstruct->q == 0) ld_dd_nn(cpu, rp(cpu, opstruct->p));
+        if (opstruct->q == 1) add_hl_ss(cpu, rp(cpu, opstruct->p));
     }
     else if (opstruct->z == 2)
     {
@@ -438,9 +409,9 @@ execute_table0(struct cpu_t* cpu, struct opcode_t* opstruct)
     else if (opstruct->z == 3)
     {
         if (opstruct->q == 0) {
-            inc_r16(cpu, rp[opstruct->p]);
+            inc_r16(cpu, rp(cpu, opstruct->p));
         } else {
-            dec_r16(cpu, rp[opstruct->p]);
+            dec_r16(cpu, rp(cpu, opstruct->p));
         }
     }
     else if (opstruct->z == 4)
@@ -470,15 +441,6 @@ execute_table0(struct cpu_t* cpu, struct opcode_t* opstruct)
 static void
 add_a(struct cpu_t* cpu, int z)
 {
-    byte* zz = r(cpu, z);
-    byte old_a = REG_A(*cpu);
-    char same_sign = ((old_a ^ *zz) & 0x80) == 0;
-
-    FLAG_SIF(*cpu, FLAG_H, ((old_a & 0xF) + (*zz & 0xF)) & 0x10);
-    FLAG_SIF(*cpu, FLAG_C, (old_a + *zz) & 0x100);
-
-    REG_A(*cpu) += *zz;
-
     /*
      * H: Set if A last nibble + zz last nibble overflows.
      * C: Set if A + zz overflows.
@@ -488,27 +450,13 @@ add_a(struct cpu_t* cpu, int z)
      *        if both operands negative and result positive
      * N: Always unset.
      */
-    FLAG_SIF(*cpu, FLAG_S, (REG_A(*cpu) & 0x80) != 0);
-    FLAG_SIF(*cpu, FLAG_Z, REG_A(*cpu) == 0);
-    FLAG_RST(*cpu, FLAG_N);
-    FLAG_SIF(*cpu, FLAG_P, same_sign && ((REG_A(*cpu) ^ old_a) & 0x80));
-
+    alu_add(cpu, get_r(cpu, z, 4), 0);
     cpu->tstates += (z == 6 ? 7 : 4);
 }
 
 static void
 adc_a(struct cpu_t* cpu, int z)
 {
-    byte* zz = r(cpu, z);
-    byte old_a = REG_A(*cpu);
-    char carry = FLAG_GET(*cpu, FLAG_C) != 0;
-    char same_sign = ((REG_A(*cpu) ^ (*zz + carry)) & 0x80) == 0;
-
-    FLAG_SIF(*cpu, FLAG_H, (((old_a & 0xF) + (*zz & 0xF) + carry) & 0xF0));
-    FLAG_SIF(*cpu, FLAG_C, (old_a + (*zz + carry)) & 0x100);
-
-    REG_A(*cpu) += *zz + carry;
-
     /*
      * H: Set if A last nibble + zz + last nibble + CF overflows.
      * C: Set if A + zz + CF overflows.
@@ -518,11 +466,7 @@ adc_a(struct cpu_t* cpu, int z)
      *     or if both operands + CF negative and result positive
      * N: Always unset.
      */
-    FLAG_SIF(*cpu, FLAG_S, (REG_A(*cpu) & 0x80) != 0);
-    FLAG_SIF(*cpu, FLAG_Z, REG_A(*cpu) == 0);
-    FLAG_RST(*cpu, FLAG_N);
-    FLAG_SIF(*cpu, FLAG_P, same_sign && ((REG_A(*cpu) ^ old_a) & 0x80));
-
+    alu_add(cpu, get_r(cpu, z, 4), 1);
     cpu->tstates += (z == 6 ? 7 : 4);
 }
 
@@ -534,25 +478,11 @@ sub_a(struct cpu_t* cpu, int z)
      * C: Set if borrow:
      * Z: Set if A - zz == 0
      * S: Set if A - zz < 0 (bit 7 ON)
-     * V: Set if
-     *     or if
+     * V: Set if both operands have different sign and the result has
+     *     the sign of zz
      * N: Always set.
      */
-    byte* zz = r(cpu, z);
-    byte old_a = REG_A(*cpu);
-    byte old_b = *zz;
-    char same_sign = ((old_a ^ *zz) & 0x80) == 0;
-
-    FLAG_SIF(*cpu, FLAG_H, (((old_a & 0xF) - (old_b & 0xF)) & 0xF00) != 0);
-    FLAG_SIF(*cpu, FLAG_C, old_a < old_b);
-
-    REG_A(*cpu) -= *zz;
-
-    FLAG_SIF(*cpu, FLAG_S, (REG_A(*cpu) & 0x80) != 0);
-    FLAG_SIF(*cpu, FLAG_Z, REG_A(*cpu) == 0);
-    FLAG_SET(*cpu, FLAG_N);
-    FLAG_SIF(*cpu, FLAG_P, !same_sign && (((REG_A(*cpu) ^ old_b) & 0x80) == 0));
-
+    alu_sub(cpu, get_r(cpu, z, 4));
     cpu->tstates += (z == 6 ? 7 : 4);
 }
 
@@ -572,7 +502,7 @@ sbc_a(struct cpu_t* cpu, int z)
 }
 
 static void
-execute_table1(struct cpu_t* cpu, struct opcode_t* opstruct)
+execute_table1(struct cpu_t* cpu, const struct opcode_t* opstruct)
 {
     if (opstruct->y == 6 && opstruct->z == 6) {
         // HALT:
@@ -582,7 +512,7 @@ execute_table1(struct cpu_t* cpu, struct opcode_t* opstruct)
 }
 
 static void
-execute_table2(struct cpu_t* cpu, struct opcode_t* opstruct)
+execute_table2(struct cpu_t* cpu, const struct opcode_t* opstruct)
 {
     switch (opstruct->y) {
         case 0:
@@ -600,7 +530,7 @@ execute_table2(struct cpu_t* cpu, struct opcode_t* opstruct)
 }
 
 static void
-execute_table3(struct cpu_t* cpu, struct opcode_t* opstruct)
+execute_table3(struct cpu_t* cpu, const struct opcode_t* opstruct)
 {
 }
 
@@ -613,18 +543,30 @@ static table_function tables[] = {
     &execute_table0, &execute_table1, &execute_table2, &execute_table3
 };
 
-void
-execute_opcode(struct cpu_t* cpu)
+/**
+ * Gets the table function that executes a given opcode.
+ *
+ * @param opcode opcode
+ * @return table function for the x field of the opcode
+ */
+table_function
+opcode_table(byte opcode)
 {
-    // Fill arrays
-    rp[0] = &cpu->main.bc;
-    rp[1] = &cpu->main.de;
-    rp[2] = &cpu->main.hl;
-    rp[3] = &cpu->sp;
+    return tables[opcode >> 6];
+}
 
+/**
+ * Executes an opcode that has already been fetched. PC must point to the
+ * byte that follows the opcode, as if execute_opcode had read it.
+ *
+ * @param cpu CPU instance
+ * @param opcode opcode to execute
+ */
+void
+dispatch_opcode(struct cpu_t* cpu, byte opcode)
+{
     // Extraer opcode.
     struct opcode_t opdata;
-    byte opcode = cpu->mem[cpu->pc.WORD++];
     extract_opcode(opcode, &opdata);
 
     // Procesar opcode.
@@ -633,3 +575,94 @@ execute_opcode(struct cpu_t* cpu)
 
     // Otras operaciones.
 }
+
+/**
+ * Fetches and executes the next instruction. Inside the region of a ROM
+ * image the instruction is not decoded again, the predecoded entry is
+ * used, unless the bus no longer maps the ROM there.
+ *
+ * @param cpu CPU instance
+ */
+void
+execute_opcode(struct cpu_t* cpu)
+{
+    const struct z80_rom_image_t* rom = cpu->rom;
+    if (rom) {
+        size_t offset = (word) (cpu->pc.WORD - rom->base);
+        if (offset < rom->size
+                && rom_image_mapped(cpu, rom, cpu->pc.WORD, offset)) {
+            const struct rom_entry_t* entry = &rom->entry[offset];
+            cpu->pc.WORD++;
+            entry->handler(cpu, &entry->op);
+            return;
+        }
+    }
+    dispatch_opcode(cpu, mem_read(cpu, cpu->pc.WORD++));
+}
+
+// Pushes PC, the first step of accepting an interrupt.
+static void
+push_pc(struct cpu_t* cpu)
+{
+    mem_write(cpu, --SP(*cpu), cpu->pc.BYTES.H);
+    mem_write(cpu, --SP(*cpu), cpu->pc.BYTES.L);
+}
+
+/**
+ * Raises the INT line for one instruction boundary. Call it between
+ * instructions. The interrupt is accepted only if IFF1 is set: both
+ * flip-flops are cleared and the handler is entered according to the
+ * interrupt mode. In mode 0 the vector is the opcode the device puts on
+ * the data bus, usually an RST.
+ *
+ * @param cpu CPU instance
+ * @param vector byte on the data bus during the acknowledge cycle
+ * @return 1 if the interrupt was accepted, 0 otherwise
+ */
+int
+z80_irq(struct cpu_t* cpu, byte vector)
+{
+    if (!cpu->iff1) return 0;
+    cpu->iff1 = cpu->iff2 = 0;
+    switch (cpu->im) {
+        case 0:
+            if ((vector & 0xC7) == 0xC7) {
+                push_pc(cpu);
+                PC(*cpu) = vector & 0x38;
+                cpu->tstates += 13;
+            } else {
+                cpu->tstates += 2;
+                dispatch_opcode(cpu, vector);
+            }
+            break;
+        case 1:
+            push_pc(cpu);
+            PC(*cpu) = 0x0038;
+            cpu->tstates += 13;
+            break;
+        default: {
+            word table = (cpu->i << 8) | vector;
+            push_pc(cpu);
+            PC(*cpu) = mem_read(cpu, table)
+                | (mem_read(cpu, (word) (table + 1)) << 8);
+            cpu->tstates += 19;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Raises the NMI line. Call it between instructions. IFF1 is cleared and
+ * IFF2 keeps its value, so RETN can restore it, and the handler at 0x0066
+ * is entered.
+ *
+ * @param cpu CPU instance
+ */
+void
+z80_nmi(struct cpu_t* cpu)
+{
+    cpu->iff1 = 0;
+    push_pc(cpu);
+    PC(*cpu) = 0x0066;
+    cpu->tstates += 11;
+}
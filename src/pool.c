@@ -0,0 +1,215 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stdlib.h>         // malloc, free
+#include <sys/mman.h>       // mmap, munmap, madvise
+
+#include <pool.h>
+
+#define SLOT_ALIGN 64       // Cache line
+
+/*
+ * Arenas start with this header. The slots follow it, and the ones that
+ * have never been handed out are taken in order, see z80_pool_slot.
+ */
+struct pool_arena_t
+{
+    struct pool_arena_t* next;  //< Older arena
+    size_t size;                //< Size of the mapping
+    int huge;                   //< Backed by explicit huge pages
+};
+
+#define ARENA_HEADER (((sizeof(struct pool_arena_t) + SLOT_ALIGN - 1) \
+            / SLOT_ALIGN) * SLOT_ALIGN)
+
+static void
+pool_lock(struct z80_pool_t* pool)
+{
+    while (atomic_flag_test_and_set_explicit(&pool->lock,
+                memory_order_acquire)) {
+        // Spin: the critical sections are a handful of instructions.
+    }
+}
+
+static void
+pool_unlock(struct z80_pool_t* pool)
+{
+    atomic_flag_clear_explicit(&pool->lock, memory_order_release);
+}
+
+/*
+ * Maps a new arena of the given size, a multiple of POOL_ARENA_SIZE. It
+ * must be called with the lock held, once the newest arena is used up.
+ */
+static int
+pool_grow(struct z80_pool_t* pool, size_t size)
+{
+    struct pool_arena_t* arena;
+    void* mem = MAP_FAILED;
+    int huge = 0;
+
+#ifdef MAP_HUGETLB
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    huge = mem != MAP_FAILED;
+#endif
+    if (mem == MAP_FAILED) {
+        // No huge pages reserved: ask for transparent ones instead.
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return -1;
+#ifdef MADV_HUGEPAGE
+        madvise(mem, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    arena = mem;
+    arena->next = pool->arena;
+    arena->size = size;
+    arena->huge = huge;
+    pool->arena = arena;
+    pool->unused = (size - ARENA_HEADER) / pool->slot_size;
+    pool->slots += pool->unused;
+    pool->arenas++;
+    pool->huge_arenas += huge;
+    return 0;
+}
+
+/**
+ * Creates a pool with room for at least the given number of instances, in
+ * a single arena. More arenas are mapped later if the pool runs out of
+ * slots.
+ *
+ * @param capacity number of slots to preallocate
+ * @return new pool, or NULL on error
+ */
+struct z80_pool_t*
+z80_pool_create(size_t capacity)
+{
+    struct z80_pool_t* pool = malloc(sizeof(struct z80_pool_t));
+    size_t size;
+    if (!pool) return NULL;
+
+    atomic_flag_clear(&pool->lock);
+    pool->free = NULL;
+    pool->arena = NULL;
+    pool->unused = 0;
+    pool->slot_size = ((sizeof(struct z80_t) + SLOT_ALIGN - 1)
+            / SLOT_ALIGN) * SLOT_ALIGN;
+    pool->slots = 0;
+    pool->in_use = 0;
+    pool->arenas = 0;
+    pool->huge_arenas = 0;
+
+    size = ARENA_HEADER + capacity * pool->slot_size;
+    size = (size + POOL_ARENA_SIZE - 1) / POOL_ARENA_SIZE * POOL_ARENA_SIZE;
+    if (pool_grow(pool, size) != 0) {
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/**
+ * Destroys a pool and unmaps its arenas. Instances that have not been put
+ * back become invalid, and their RAM pages are not freed.
+ *
+ * @param pool pool
+ */
+void
+z80_pool_destroy(struct z80_pool_t* pool)
+{
+    struct pool_arena_t* arena = pool->arena;
+    while (arena) {
+        struct pool_arena_t* next = arena->next;
+        munmap(arena, arena->size);
+        arena = next;
+    }
+    free(pool);
+}
+
+/**
+ * Takes an uninitialized slot from the pool. Most callers want
+ * z80_pool_get instead.
+ *
+ * @param pool pool
+ * @return slot, or NULL if no arena could be mapped
+ */
+struct z80_t*
+z80_pool_slot(struct z80_pool_t* pool)
+{
+    struct z80_t* slot = NULL;
+
+    pool_lock(pool);
+    if (pool->free) {
+        slot = pool->free;
+        pool->free = *(struct z80_t**) slot;
+    } else if (pool->unused > 0 || pool_grow(pool, POOL_ARENA_SIZE) == 0) {
+        size_t index = (pool->arena->size - ARENA_HEADER) / pool->slot_size
+            - pool->unused--;
+        slot = (struct z80_t*) ((byte*) pool->arena + ARENA_HEADER
+                + index * pool->slot_size);
+    }
+    if (slot) pool->in_use++;
+    pool_unlock(pool);
+    return slot;
+}
+
+/**
+ * Gets an instance from the pool, initialized as z80_init does. Give it
+ * back with z80_free.
+ *
+ * @param pool pool
+ * @param rom ROM file, or NULL for an all-RAM address space
+ * @param base address of the ROM, multiple of MEM_PAGE_SIZE
+ * @param fill power-on value of RAM, 0x00 or 0xFF
+ * @return instance, or NULL on error
+ */
+struct z80_t*
+z80_pool_get(struct z80_pool_t* pool, const struct z80_rom_file_t* rom,
+        word base, byte fill)
+{
+    struct z80_t* z80 = z80_pool_slot(pool);
+    if (!z80) return NULL;
+    if (z80_init(z80, rom, base, fill) != 0) {
+        z80_pool_put(pool, z80);
+        return NULL;
+    }
+    z80->pool = pool;
+    return z80;
+}
+
+/**
+ * Gives a slot back to the pool. Instances are put back by z80_free, which
+ * also releases their RAM.
+ *
+ * @param pool pool
+ * @param z80 slot to recycle
+ */
+void
+z80_pool_put(struct z80_pool_t* pool, struct z80_t* z80)
+{
+    pool_lock(pool);
+    *(struct z80_t**) z80 = pool->free;
+    pool->free = z80;
+    pool->in_use--;
+    pool_unlock(pool);
+}
@@ -0,0 +1,359 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memcmp
+
+#include <opcodes.h>
+#include <replay.h>
+
+/*
+ * The stream is a header, the magic and the T-state counter when the
+ * recording started, followed by the events. An event is its type, the
+ * T-states since the previous event as a LEB128 number and then, by type:
+ * the value for reads, the vector for interrupts, nothing for NMIs and
+ * the address (little endian) and value for pokes. Stamps are only ever
+ * subtracted, so the counter may wrap around.
+ */
+static const char magic[8] = { 'Z', '8', '0', 'R', 'P', 'L', 'Y', 1 };
+
+// Whether stamp a comes before stamp b, the counter may have wrapped.
+#define BEFORE(a, b) ((int) ((unsigned) (a) - (unsigned) (b)) < 0)
+
+static void
+put_u32(FILE* file, unsigned value)
+{
+    putc(value & 0xFF, file);
+    putc((value >> 8) & 0xFF, file);
+    putc((value >> 16) & 0xFF, file);
+    putc((value >> 24) & 0xFF, file);
+}
+
+static void
+put_event(struct replay_t* replay, int kind)
+{
+    unsigned stamp = replay->cpu->tstates;
+    unsigned delta = stamp - replay->last;
+    putc(kind, replay->file);
+    while (delta >= 0x80) {
+        putc((delta & 0x7F) | 0x80, replay->file);
+        delta >>= 7;
+    }
+    putc(delta, replay->file);
+    replay->last = stamp;
+    replay->events++;
+}
+
+// Reads the next event, REPLAY_NONE at the end of the stream.
+static void
+fetch(struct replay_t* replay)
+{
+    struct replay_entry_t* next = &replay->next;
+    unsigned delta = 0;
+    int c, shift = 0;
+
+    next->kind = REPLAY_NONE;
+    c = getc(replay->file);
+    if (c == EOF) return;
+    do {
+        int b = getc(replay->file);
+        if (b == EOF || shift > 28) {
+            replay->desync = 1;
+            return;
+        }
+        delta |= (unsigned) (b & 0x7F) << shift;
+        shift += 7;
+        if (!(b & 0x80)) break;
+    } while (1);
+
+    switch (c) {
+        case REPLAY_READ:
+        case REPLAY_IRQ: {
+            int value = getc(replay->file);
+            if (value == EOF) c = EOF;
+            next->value = value;
+            break;
+        }
+        case REPLAY_NMI:
+            break;
+        case REPLAY_POKE: {
+            int lo = getc(replay->file), hi = getc(replay->file);
+            int value = getc(replay->file);
+            if (value == EOF) c = EOF;
+            next->addr = lo | (hi << 8);
+            next->value = value;
+            break;
+        }
+        default:
+            c = EOF;
+    }
+    if (c == EOF) {
+        replay->desync = 1;
+        return;
+    }
+    next->kind = c;
+    next->stamp = replay->last += delta;
+}
+
+static byte
+record_read(void* ctx, word addr)
+{
+    struct replay_t* replay = ctx;
+    int index = addr >> MEM_PAGE_SHIFT;
+    byte value = replay->on_read[index](replay->ctx[index], addr);
+    put_event(replay, REPLAY_READ);
+    putc(value, replay->file);
+    return value;
+}
+
+static void
+record_write(void* ctx, word addr, byte value)
+{
+    struct replay_t* replay = ctx;
+    int index = addr >> MEM_PAGE_SHIFT;
+    replay->on_write[index](replay->ctx[index], addr, value);
+}
+
+static byte
+replay_read(void* ctx, word addr)
+{
+    struct replay_t* replay = ctx;
+    byte value;
+    (void) addr;
+    if (replay->next.kind != REPLAY_READ
+            || replay->next.stamp != (unsigned) replay->cpu->tstates) {
+        replay->desync = 1;
+        return 0xFF;
+    }
+    value = replay->next.value;
+    replay->events++;
+    fetch(replay);
+    return value;
+}
+
+// Device side effects are not repeated on replay.
+static void
+replay_write(void* ctx, word addr, byte value)
+{
+    (void) ctx;
+    (void) addr;
+    (void) value;
+}
+
+/*
+ * Swaps the handlers of the bus for the given ones, NULL to restore. Both
+ * share the context of the page, so pages with any handler get both.
+ */
+static void
+hook(struct replay_t* replay, mem_read_t on_read, mem_write_t on_write)
+{
+    struct bus_t* bus = replay->cpu->bus;
+    int i;
+    for (i = 0; i < MEM_PAGES; i++) {
+        struct page_t* page = &bus->page[i];
+        if (on_read) {
+            replay->on_read[i] = page->on_read;
+            replay->on_write[i] = page->on_write;
+            replay->ctx[i] = page->ctx;
+            if (page->on_read || page->on_write) {
+                page->on_read = page->on_read ? on_read : NULL;
+                page->on_write = page->on_write ? on_write : NULL;
+                page->ctx = replay;
+            }
+        } else if (replay->on_read[i] || replay->on_write[i]) {
+            page->on_read = replay->on_read[i];
+            page->on_write = replay->on_write[i];
+            page->ctx = replay->ctx[i];
+        }
+    }
+}
+
+static struct replay_t*
+attach(struct cpu_t* cpu, FILE* file, int recording)
+{
+    struct replay_t* replay = malloc(sizeof(struct replay_t));
+    if (!replay) return NULL;
+    replay->cpu = cpu;
+    replay->file = file;
+    replay->recording = recording;
+    replay->last = cpu->tstates;
+    replay->next.kind = REPLAY_NONE;
+    replay->desync = 0;
+    replay->events = 0;
+    return replay;
+}
+
+/**
+ * Starts recording the inputs of a CPU. The stream should be saved along
+ * with the state the CPU is in, such as a state file: replaying starts
+ * from there. The handlers of the bus are wrapped until the recording is
+ * closed, so they must not be changed in the meantime.
+ *
+ * @param cpu CPU instance
+ * @param file stream open for writing
+ * @return recorder, or NULL on error
+ */
+struct replay_t*
+replay_record(struct cpu_t* cpu, FILE* file)
+{
+    struct replay_t* replay = attach(cpu, file, 1);
+    if (!replay) return NULL;
+    if (fwrite(magic, sizeof(magic), 1, file) != 1) {
+        free(replay);
+        return NULL;
+    }
+    put_u32(file, cpu->tstates);
+    hook(replay, record_read, record_write);
+    return replay;
+}
+
+/**
+ * Starts replaying a stream. The CPU has to be in the state the recording
+ * started from. From now on the handlers of the bus are not called: reads
+ * get the values in the stream and trapped writes are dropped, so devices
+ * do not see them again.
+ *
+ * @param cpu CPU instance
+ * @param file stream open for reading
+ * @return replayer, or NULL if the stream is not valid or does not start
+ *         at the T-state counter of the CPU
+ */
+struct replay_t*
+replay_open(struct cpu_t* cpu, FILE* file)
+{
+    struct replay_t* replay;
+    byte header[sizeof(magic) + 4];
+    unsigned start;
+
+    if (fread(header, sizeof(header), 1, file) != 1
+            || memcmp(header, magic, sizeof(magic)) != 0) {
+        return NULL;
+    }
+    start = header[8] | (header[9] << 8) | (header[10] << 16)
+        | ((unsigned) header[11] << 24);
+    if (start != (unsigned) cpu->tstates) return NULL;
+    replay = attach(cpu, file, 0);
+    if (!replay) return NULL;
+    fetch(replay);
+    hook(replay, replay_read, replay_write);
+    return replay;
+}
+
+/**
+ * Stops recording or replaying and gives the handlers back. The
+ * stream is flushed but not closed.
+ *
+ * @param replay recorder or replayer
+ * @return 0 on success, -1 if the stream could not be written or the
+ *         replay went out of sync
+ */
+int
+replay_close(struct replay_t* replay)
+{
+    int result = replay->desync ? -1 : 0;
+    hook(replay, NULL, NULL);
+    if (replay->recording && (fflush(replay->file) != 0
+                || ferror(replay->file))) {
+        result = -1;
+    }
+    free(replay);
+    return result;
+}
+
+/**
+ * Raises an interrupt while recording, see z80_irq. Call it between
+ * instructions.
+ *
+ * @param replay recorder
+ * @param vector byte on the data bus
+ * @return 1 if the interrupt was accepted, 0 otherwise
+ */
+int
+replay_irq(struct replay_t* replay, byte vector)
+{
+    put_event(replay, REPLAY_IRQ);
+    putc(vector, replay->file);
+    return z80_irq(replay->cpu, vector);
+}
+
+/**
+ * Raises an NMI while recording, see z80_nmi. Call it between
+ * instructions.
+ *
+ * @param replay recorder
+ */
+void
+replay_nmi(struct replay_t* replay)
+{
+    put_event(replay, REPLAY_NMI);
+    z80_nmi(replay->cpu);
+}
+
+/**
+ * Writes to memory on behalf of the host while recording, such as a
+ * debugger or a cheat. Call it between instructions.
+ *
+ * @param replay recorder
+ * @param addr logical address
+ * @param value value to write
+ */
+void
+replay_poke(struct replay_t* replay, word addr, byte value)
+{
+    put_event(replay, REPLAY_POKE);
+    putc(addr & 0xFF, replay->file);
+    putc(addr >> 8, replay->file);
+    putc(value, replay->file);
+    mem_write(replay->cpu, addr, value);
+}
+
+/**
+ * Runs the CPU until its T-state counter reaches a value. While replaying,
+ * the interrupts, NMIs and pokes of the stream are delivered between
+ * instructions as soon as the counter reaches their stamp, which is where
+ * the recording saw them as long as every instruction takes time.
+ *
+ * @param replay recorder or replayer
+ * @param tstates value of the T-state counter to run to
+ * @return 0 on success, -1 if the replay went out of sync
+ */
+int
+replay_run(struct replay_t* replay, int tstates)
+{
+    struct cpu_t* cpu = replay->cpu;
+    struct replay_entry_t* next = &replay->next;
+
+    for (;;) {
+        while (next->kind > REPLAY_READ
+                && !BEFORE(cpu->tstates, next->stamp)) {
+            switch (next->kind) {
+                case REPLAY_IRQ: z80_irq(cpu, next->value); break;
+                case REPLAY_NMI: z80_nmi(cpu); break;
+                case REPLAY_POKE: mem_write(cpu, next->addr, next->value);
+            }
+            replay->events++;
+            fetch(replay);
+        }
+        if (replay->desync) return -1;
+        if (!BEFORE(cpu->tstates, tstates)) return 0;
+        execute_opcode(cpu);
+    }
+}
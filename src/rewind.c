@@ -0,0 +1,376 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memcmp, memcpy, memset
+
+#include <rewind.h>
+
+/*
+ * A record is this header followed by one block per stored page, in page
+ * order. A block is a 16 bit length and the XOR of the page against its
+ * previous contents (zeros for key frames) as a sequence of tokens: a 16
+ * bit count of unchanged bytes, a 16 bit count of changed bytes and the
+ * changed bytes. A block as long as a page is the XOR itself, an empty
+ * block is a page that did not change.
+ */
+struct record_t
+{
+    uint32_t size;              //< Record size, a multiple of 8
+    uint16_t pages;             //< Stored pages, one bit per page
+    uint16_t key;               //< Whether this is a key frame
+    struct cpu_t cpu;           //< Registers
+};
+
+#define RECORD_ALIGN(size) (((size) + 7) & ~((size_t) 7))
+#define BLOCK_MAX (2 + MEM_PAGE_SIZE)
+#define RECORD_MAX RECORD_ALIGN(sizeof(struct record_t) \
+        + MEM_PAGES * BLOCK_MAX)
+
+static const byte zero_page[MEM_PAGE_SIZE];
+
+// Blocks have any length, so 16 bit fields may be unaligned.
+static uint16_t
+get16(const byte* p)
+{
+    uint16_t value;
+    memcpy(&value, p, 2);
+    return value;
+}
+
+static void
+put16(byte* p, uint16_t value)
+{
+    memcpy(p, &value, 2);
+}
+
+/**
+ * Starts recording a CPU. The first frame captured is a key frame. A dirty
+ * tracker is attached to the bus of the CPU for as long as the buffer
+ * exists.
+ *
+ * @param cpu CPU instance
+ * @param capacity ring size in bytes, at least enough for a key frame
+ * @param interval frames between key frames, at least 1
+ * @return rewind buffer, or NULL on error
+ */
+struct rewind_t*
+rewind_create(struct cpu_t* cpu, size_t capacity, int interval)
+{
+    struct rewind_t* rewind;
+    if (capacity < RECORD_MAX || interval < 1) return NULL;
+    rewind = malloc(sizeof(struct rewind_t));
+    if (!rewind) return NULL;
+    rewind->ring = malloc(capacity);
+    if (!rewind->ring) {
+        free(rewind);
+        return NULL;
+    }
+    rewind->cpu = cpu;
+    rewind->capacity = capacity;
+    rewind->head = rewind->tail = rewind->wrap = 0;
+    rewind->count = 0;
+    rewind->interval = interval;
+    rewind->since_key = 0;
+    rewind->frame = 0;
+    bus_dirty_attach(cpu->bus, &rewind->dirty, 0);
+    return rewind;
+}
+
+/**
+ * Stops recording and frees the buffer.
+ *
+ * @param rewind rewind buffer
+ */
+void
+rewind_free(struct rewind_t* rewind)
+{
+    if (!rewind) return;
+    bus_dirty_detach(rewind->cpu->bus, &rewind->dirty);
+    free(rewind->ring);
+    free(rewind);
+}
+
+static struct record_t*
+record_at(const struct rewind_t* rewind, size_t offset)
+{
+    return (struct record_t*) (rewind->ring + offset);
+}
+
+// Offset of the record that follows the one at offset.
+static size_t
+record_next(const struct rewind_t* rewind, size_t offset)
+{
+    offset += record_at(rewind, offset)->size;
+    return (offset == rewind->wrap && offset != rewind->head) ? 0 : offset;
+}
+
+// Drops the oldest key frame and every delta that depends on it.
+static void
+evict(struct rewind_t* rewind)
+{
+    do {
+        rewind->tail = record_next(rewind, rewind->tail);
+        rewind->count--;
+        if (rewind->tail == 0) rewind->wrap = 0;
+    } while (rewind->count && !record_at(rewind, rewind->tail)->key);
+    if (!rewind->count) {
+        rewind->head = rewind->tail = rewind->wrap = 0;
+    }
+}
+
+// Makes room for a record of up to size bytes and returns where it goes.
+static size_t
+reserve(struct rewind_t* rewind, size_t size)
+{
+    for (;;) {
+        size_t offset = rewind->head;
+        if (!rewind->count) return 0;
+        if (rewind->tail < rewind->head) {
+            // Records do not wrap: room after them, or else before them.
+            if (offset + size <= rewind->capacity) return offset;
+            if (size <= rewind->tail) {
+                rewind->wrap = rewind->head;
+                return 0;
+            }
+        } else if (offset + size <= rewind->tail) {
+            return offset;
+        }
+        evict(rewind);
+    }
+}
+
+/*
+ * XOR of a page against its previous contents as tokens, see record_t.
+ * Returns the block length, 0 if nothing changed, or SIZE_MAX if the
+ * tokens do not fit in a page.
+ */
+static size_t
+encode(byte* out, const byte* page, const byte* old)
+{
+    size_t offset = 0, length = 0;
+    while (offset < MEM_PAGE_SIZE) {
+        size_t start = offset, changed, i;
+        // Unchanged bytes, eight at a time while possible.
+        while (offset + 8 <= MEM_PAGE_SIZE
+                && memcmp(page + offset, old + offset, 8) == 0) {
+            offset += 8;
+        }
+        while (offset < MEM_PAGE_SIZE && page[offset] == old[offset]) {
+            offset++;
+        }
+        if (offset == MEM_PAGE_SIZE) break;
+
+        // Changed bytes, up to eight unchanged ones in a row.
+        changed = offset;
+        for (i = offset; i < MEM_PAGE_SIZE && i < changed + 8; i++) {
+            if (page[i] != old[i]) changed = i + 1;
+        }
+        while (i < MEM_PAGE_SIZE && (page[i] != old[i] || i < changed + 8)) {
+            if (page[i] != old[i]) changed = i + 1;
+            i++;
+        }
+        if (length + 4 + (changed - offset) >= MEM_PAGE_SIZE) {
+            return SIZE_MAX;
+        }
+        put16(out + length, offset - start);
+        put16(out + length + 2, changed - offset);
+        length += 4;
+        for (i = offset; i < changed; i++) {
+            out[length++] = page[i] ^ old[i];
+        }
+        offset = changed;
+    }
+    return length;
+}
+
+// Applies a block to a page.
+static void
+decode(byte* page, const byte* block, size_t length)
+{
+    size_t offset = 0, position = 0, i;
+    if (length == MEM_PAGE_SIZE) {
+        for (i = 0; i < MEM_PAGE_SIZE; i++) {
+            page[i] ^= block[i];
+        }
+        return;
+    }
+    while (position < length) {
+        uint16_t skip = get16(block + position);
+        uint16_t count = get16(block + position + 2);
+        position += 4;
+        offset += skip;
+        for (i = 0; i < count; i++) {
+            page[offset++] ^= block[position++];
+        }
+    }
+}
+
+/**
+ * Captures a frame: the registers and the pages written since the last
+ * frame, or every page that has host memory if a key frame is due. Call it
+ * once per frame from the thread that runs the CPU. Page mapping changes
+ * are not recorded.
+ *
+ * @param rewind rewind buffer
+ * @return 0 on success
+ */
+int
+rewind_capture(struct rewind_t* rewind)
+{
+    struct bus_t* bus = rewind->cpu->bus;
+    unsigned dirty = bus_dirty_fetch_pages(&rewind->dirty);
+    unsigned pages = 0;
+    int key = rewind->count == 0 || rewind->since_key + 1 >= rewind->interval;
+    struct record_t* record;
+    size_t offset, size;
+    int i;
+
+    for (i = 0; i < MEM_PAGES; i++) {
+        if (bus->page[i].source && (key || (dirty & (1u << i)))) {
+            pages |= 1u << i;
+        }
+    }
+    offset = reserve(rewind, RECORD_ALIGN(sizeof(struct record_t)
+                + __builtin_popcount(pages) * BLOCK_MAX));
+    if (!key && !rewind->count) {
+        // The key frame of this delta was dropped to make room.
+        for (i = 0; i < MEM_PAGES; i++) {
+            if (bus->page[i].source) pages |= 1u << i;
+        }
+        key = 1;
+        offset = reserve(rewind, RECORD_MAX);
+    }
+
+    record = record_at(rewind, offset);
+    record->pages = pages;
+    record->key = key;
+    memcpy(&record->cpu, rewind->cpu, sizeof(struct cpu_t));
+    size = sizeof(struct record_t);
+    for (i = 0; i < MEM_PAGES; i++) {
+        const byte* page = bus->page[i].source;
+        byte* block = rewind->ring + offset + size + 2;
+        size_t length;
+        if (!(pages & (1u << i))) continue;
+        length = encode(block, page, key ? zero_page : rewind->shadow[i]);
+        if (length == SIZE_MAX) {
+            size_t j;
+            const byte* old = key ? zero_page : rewind->shadow[i];
+            for (j = 0; j < MEM_PAGE_SIZE; j++) {
+                block[j] = page[j] ^ old[j];
+            }
+            length = MEM_PAGE_SIZE;
+        }
+        put16(block - 2, length);
+        size += 2 + length;
+        memcpy(rewind->shadow[i], page, MEM_PAGE_SIZE);
+    }
+    record->size = RECORD_ALIGN(size);
+
+    rewind->head = offset + record->size;
+    rewind->count++;
+    rewind->since_key = key ? 0 : rewind->since_key + 1;
+    rewind->frame++;
+    return 0;
+}
+
+/**
+ * Gets how many frames back rewind_seek can go.
+ *
+ * @param rewind rewind buffer
+ * @return number of frames stored
+ */
+int
+rewind_frames(const struct rewind_t* rewind)
+{
+    return rewind->count;
+}
+
+/**
+ * Brings the CPU and its memory back to a captured frame. The frames
+ * after it are dropped, and recording goes on from there.
+ *
+ * @param rewind rewind buffer
+ * @param back frames to go back, 0 for the last frame captured
+ * @return 0 on success, -1 if the frame is not in the buffer anymore
+ */
+int
+rewind_seek(struct rewind_t* rewind, int back)
+{
+    struct bus_t* bus = rewind->cpu->bus;
+    size_t offset = rewind->tail, key = rewind->tail, target;
+    int index = rewind->count - 1 - back, i, deltas = 0;
+    struct record_t* record;
+
+    if (back < 0 || index < 0) return -1;
+    for (i = 0; i < index; i++) {
+        offset = record_next(rewind, offset);
+        if (record_at(rewind, offset)->key) key = offset;
+    }
+    target = offset;
+
+    // Rebuild memory in the shadow pages: key frame, then the deltas.
+    for (offset = key; ; offset = record_next(rewind, offset)) {
+        size_t position = sizeof(struct record_t);
+        record = record_at(rewind, offset);
+        for (i = 0; i < MEM_PAGES; i++) {
+            const byte* block = rewind->ring + offset + position;
+            uint16_t length = get16(block);
+            if (!(record->pages & (1u << i))) continue;
+            if (record->key) memset(rewind->shadow[i], 0, MEM_PAGE_SIZE);
+            decode(rewind->shadow[i], block + 2, length);
+            position += 2 + length;
+        }
+        if (offset == target) break;
+        deltas++;
+    }
+
+    record = record_at(rewind, target);
+    {
+        struct bus_t* saved_bus = rewind->cpu->bus;
+        const struct z80_rom_image_t* saved_rom = rewind->cpu->rom;
+        memcpy(rewind->cpu, &record->cpu, sizeof(struct cpu_t));
+        rewind->cpu->bus = saved_bus;
+        rewind->cpu->rom = saved_rom;
+    }
+    for (i = 0; i < MEM_PAGES; i++) {
+        byte* host = bus->page[i].mapped;
+        if (!bus->page[i].source) continue;
+        if (host) {
+            // Written behind the back of the bus, so tell every tracker.
+            memcpy(host, rewind->shadow[i], MEM_PAGE_SIZE);
+            bus_dirty_mark_host(bus, host, MEM_PAGE_SIZE);
+        } else {
+            bus_load(bus, i << MEM_PAGE_SHIFT, rewind->shadow[i],
+                    MEM_PAGE_SIZE);
+        }
+    }
+    bus_dirty_fetch_pages(&rewind->dirty);
+
+    // Drop the frames after the target.
+    rewind->frame -= rewind->count - 1 - index;
+    rewind->count = index + 1;
+    rewind->head = target + record->size;
+    if (rewind->tail <= target) rewind->wrap = 0;
+    rewind->since_key = deltas;
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memcmp, memcpy
+
+#include <romimage.h>
+
+/**
+ * Builds a ROM image. Decoding is a table lookup per byte, so there is
+ * nothing worth keeping in a code cache between runs.
+ *
+ * @param bytes host memory the ROM is mapped from, it has to stay there
+ *        and unchanged while the image is in use
+ * @param base address where the ROM is mapped
+ * @param size number of bytes (the region may not wrap around 0xFFFF)
+ * @return new image, or NULL on error
+ */
+struct z80_rom_image_t*
+z80_rom_image_create(const byte* bytes, word base, size_t size)
+{
+    struct z80_rom_image_t* image;
+    struct rom_entry_t* entry;
+    byte* copy;
+    size_t i;
+
+    if (size == 0 || base + size > 0x10000) return NULL;
+
+    image = malloc(sizeof(struct z80_rom_image_t));
+    entry = malloc(size * sizeof(struct rom_entry_t));
+    copy = malloc(size);
+    if (!image || !entry || !copy) {
+        free(image);
+        free(entry);
+        free(copy);
+        return NULL;
+    }
+
+    memcpy(copy, bytes, size);
+    for (i = 0; i < size; i++) {
+        entry[i].handler = opcode_table(bytes[i]);
+        extract_opcode(bytes[i], &entry[i].op);
+    }
+
+    image->base = base;
+    image->size = size;
+    image->host = bytes;
+    image->bytes = copy;
+    image->entry = entry;
+    return image;
+}
+
+/**
+ * Frees a ROM image. No CPU may be using it anymore.
+ *
+ * @param image image to free
+ */
+void
+z80_rom_image_free(struct z80_rom_image_t* image)
+{
+    if (!image) return;
+    free((void*) image->bytes);
+    free((void*) image->entry);
+    free(image);
+}
+
+/**
+ * Maps a ROM image into a CPU. The bus must already map the host memory
+ * the image was built from at its base address, read-only: pages with
+ * host memory for writes are refused. Instructions fetched from inside
+ * the region are run from the predecoded entries from now on, for as long
+ * as the bus keeps that mapping and does not trap reads from it, such as
+ * for contention. The CPU keeps a pointer to the image.
+ * Pass NULL to stop using predecoded entries.
+ *
+ * @param cpu CPU instance
+ * @param image ROM image, or NULL
+ * @return 0 on success, -1 if the bus does not map the image read-only
+ *         or its contents changed since it was built
+ */
+int
+z80_rom_image_map(struct cpu_t* cpu, const struct z80_rom_image_t* image)
+{
+    size_t offset;
+
+    cpu->rom = NULL;
+    if (!image) return 0;
+    for (offset = 0; offset < image->size; offset++) {
+        word addr = image->base + offset;
+        const struct page_t* page = &cpu->bus->page[addr >> MEM_PAGE_SHIFT];
+        if (!page->source || page->mapped || page->source
+                + (addr & MEM_PAGE_MASK) != image->host + offset) {
+            return -1;
+        }
+    }
+    if (memcmp(image->host, image->bytes, image->size) != 0) return -1;
+    cpu->rom = image;
+    return 0;
+}
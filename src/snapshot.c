@@ -0,0 +1,850 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stdint.h>
+#include <string.h>         // memcmp, memcpy, memset, strrchr
+#include <strings.h>        // strcasecmp
+#ifdef ZETA80_ZLIB
+#include <zlib.h>
+#endif
+
+#include <snapshot.h>
+
+/*
+ * Memory is streamed between the file and the pages of the bus, a page at
+ * a time when the page is backed by host memory and through the bus
+ * otherwise, so no full memory image is ever built. Registers are only
+ * changed once the whole file has been read and found valid, but memory
+ * may have been partly written when a malformed file is rejected.
+ */
+
+#define RAM_START 0x4000            // 48K RAM, up to the end of memory
+#define RAM_SIZE 0xC000
+#define BANK_SIZE 0x4000            // .Z80 and .SZX memory blocks
+#define BANK_PAGES (BANK_SIZE / MEM_PAGE_SIZE)
+
+#define SNA_HEADER 27
+#define Z80_HEADER 30
+#define Z80_EXTRA 54                // Extra header length of version 3
+#define SZX_Z80R 37                 // Length of the Z80R block
+
+static word
+get16(const byte* data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t
+get32(const byte* data)
+{
+    return get16(data) | ((uint32_t) get16(data + 2) << 16);
+}
+
+static void
+put16(byte* data, word value)
+{
+    data[0] = value & 0xFF;
+    data[1] = value >> 8;
+}
+
+static void
+put32(byte* data, uint32_t value)
+{
+    put16(data, value & 0xFFFF);
+    put16(data + 2, value >> 16);
+}
+
+/**
+ * Guesses the format of a snapshot from the extension of its file name.
+ *
+ * @param path file name
+ * @return snapshot format, or -1 if the extension is unknown
+ */
+int
+snapshot_format(const char* path)
+{
+    const char* dot = strrchr(path, '.');
+    if (!dot) return -1;
+    if (strcasecmp(dot, ".sna") == 0) return SNAPSHOT_SNA;
+    if (strcasecmp(dot, ".z80") == 0) return SNAPSHOT_Z80;
+    if (strcasecmp(dot, ".szx") == 0) return SNAPSHOT_SZX;
+    return -1;
+}
+
+// Reads guest memory without going through contention or trap handlers.
+static byte
+peek(const struct bus_t* bus, word addr)
+{
+    const byte* host = bus->page[addr >> MEM_PAGE_SHIFT].source;
+    return host ? host[addr & MEM_PAGE_MASK] : bus_read(bus, addr);
+}
+
+// Reads bytes from the file into guest memory.
+static int
+read_memory(struct bus_t* bus, word addr, size_t size, FILE* file)
+{
+    byte buffer[MEM_PAGE_SIZE];
+    while (size) {
+        size_t offset = addr & MEM_PAGE_MASK;
+        size_t chunk = MEM_PAGE_SIZE - offset;
+        byte* host = bus->page[addr >> MEM_PAGE_SHIFT].mapped;
+        if (chunk > size) chunk = size;
+        if (fread(host ? host + offset : buffer, 1, chunk, file) != chunk) {
+            return -1;
+        }
+        if (!host) bus_load(bus, addr, buffer, chunk);
+        addr += chunk;
+        size -= chunk;
+    }
+    return 0;
+}
+
+// Writes guest memory to the file.
+static int
+write_memory(const struct bus_t* bus, word addr, size_t size, FILE* file)
+{
+    while (size) {
+        size_t offset = addr & MEM_PAGE_MASK;
+        size_t chunk = MEM_PAGE_SIZE - offset, i;
+        const byte* host = bus->page[addr >> MEM_PAGE_SHIFT].source;
+        if (chunk > size) chunk = size;
+        if (host) {
+            if (fwrite(host + offset, 1, chunk, file) != chunk) return -1;
+        } else {
+            for (i = 0; i < chunk; i++) {
+                putc_unlocked(bus_read(bus, addr + i), file);
+            }
+        }
+        addr += chunk;
+        size -= chunk;
+    }
+    return ferror(file) ? -1 : 0;
+}
+
+// Skips bytes of the file.
+static int
+skip(FILE* file, uint32_t size)
+{
+    byte buffer[1024];
+    while (size) {
+        size_t chunk = size < sizeof(buffer) ? size : sizeof(buffer);
+        if (fread(buffer, 1, chunk, file) != chunk) return -1;
+        size -= chunk;
+    }
+    return 0;
+}
+
+/*
+ * Sequential writer into guest memory, for decompressors. It refuses to
+ * write past the end of the block it was given.
+ */
+struct sink_t
+{
+    struct bus_t* bus;          //< Memory bus
+    word addr;                  //< Next address
+    size_t left;                //< Bytes left in the block
+};
+
+// Writes count bytes, copied from data or all equal to value if it is NULL.
+static int
+put(struct sink_t* sink, const byte* data, byte value, size_t count)
+{
+    if (count > sink->left) return -1;
+    sink->left -= count;
+    while (count) {
+        size_t offset = sink->addr & MEM_PAGE_MASK;
+        size_t chunk = MEM_PAGE_SIZE - offset, i;
+        byte* host = sink->bus->page[sink->addr >> MEM_PAGE_SHIFT].mapped;
+        if (chunk > count) chunk = count;
+        if (host && data) {
+            memcpy(host + offset, data, chunk);
+        } else if (host) {
+            memset(host + offset, value, chunk);
+        } else {
+            for (i = 0; i < chunk; i++) {
+                bus_write(sink->bus, sink->addr + i, data ? data[i] : value);
+            }
+        }
+        if (data) data += chunk;
+        sink->addr += chunk;
+        count -= chunk;
+    }
+    return 0;
+}
+
+/*
+ * .Z80 RLE: runs of five or more equal bytes, and runs of two or more 0xED
+ * bytes, are stored as ED ED count value. The byte that follows a single
+ * 0xED is never part of a run.
+ */
+
+/*
+ * Buffered input of the decoder, so that bytes between runs can be copied
+ * in one go. left is the number of bytes it may still take from the file,
+ * or -1 to read up to the end of the file.
+ */
+struct source_t
+{
+    FILE* file;
+    long left;
+    size_t position;            //< Next byte in the buffer
+    size_t end;                 //< Bytes in the buffer
+    byte buffer[1024];
+};
+
+static int
+next(struct source_t* source)
+{
+    if (source->position == source->end) {
+        size_t chunk = sizeof(source->buffer);
+        if (source->left >= 0 && (size_t) source->left < chunk) {
+            chunk = source->left;
+        }
+        source->position = 0;
+        source->end = chunk ? fread(source->buffer, 1, chunk, source->file) : 0;
+        if (source->left >= 0) source->left -= source->end;
+        if (source->end == 0) return EOF;
+    }
+    return source->buffer[source->position++];
+}
+
+static int
+rle_decode(struct sink_t* sink, struct source_t* source)
+{
+    while (sink->left) {
+        int value, second, count;
+        // Bytes up to the next 0xED are copied as they are.
+        const byte* start = source->buffer + source->position;
+        size_t length = source->end - source->position;
+        const byte* ed;
+        if (length > sink->left) length = sink->left;
+        ed = memchr(start, 0xED, length);
+        if (ed != start && length) {
+            length = ed ? (size_t) (ed - start) : length;
+            put(sink, start, 0, length);
+            source->position += length;
+            continue;
+        }
+
+        value = next(source);
+        if (value == EOF) return -1;
+        if (value != 0xED || sink->left == 1) {
+            put(sink, NULL, value, 1);
+            continue;
+        }
+        second = next(source);
+        if (second == EOF) return -1;
+        if (second != 0xED) {
+            if (put(sink, NULL, 0xED, 1) || put(sink, NULL, second, 1)) {
+                return -1;
+            }
+            continue;
+        }
+        count = next(source);
+        value = next(source);
+        if (count == EOF || value == EOF || count == 0
+                || put(sink, NULL, value, count)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Gets a bank as a single block of host memory. Banks whose pages are not
+ * contiguous in host memory, or not backed by it, are copied.
+ */
+static const byte*
+bank_view(const struct bus_t* bus, word addr, byte* copy)
+{
+    int first = addr >> MEM_PAGE_SHIFT, i;
+    const byte* host = bus->page[first].source;
+    for (i = 1; host && i < BANK_PAGES; i++) {
+        if (bus->page[first + i].source != host + i * MEM_PAGE_SIZE) {
+            host = NULL;
+        }
+    }
+    if (host) return host;
+    for (i = 0; i < BANK_SIZE; i++) {
+        copy[i] = peek(bus, addr + i);
+    }
+    return copy;
+}
+
+// Compresses a bank. Returns the compressed size, file may be NULL.
+static long
+rle_encode(const byte* data, size_t size, FILE* file)
+{
+    long length = 0;
+    size_t i = 0, literal = 0;
+
+    while (i < size) {
+        byte value;
+        size_t run = 1;
+        // Only a byte equal to the next one, or 0xED, can start a run.
+        while (i + 1 < size && data[i] != data[i + 1] && data[i] != 0xED) {
+            i++;
+        }
+        value = data[i];
+        while (i + run < size && run < 255 && data[i + run] == value) {
+            run++;
+        }
+        if (run >= 5 || (value == 0xED && run >= 2)) {
+            if (file) {
+                byte code[4] = { 0xED, 0xED, run, value };
+                fwrite(data + literal, 1, i - literal, file);
+                fwrite(code, 1, 4, file);
+            }
+            length += i - literal + 4;
+            i += run;
+            literal = i;
+        } else if (value == 0xED) {
+            i += (i + 1 < size) ? 2 : 1;
+        } else {
+            i += run;
+        }
+    }
+    if (file) fwrite(data + literal, 1, i - literal, file);
+    return length + i - literal;
+}
+
+/*
+ * .SNA: a 27 byte header and the 48K of RAM. PC is on the stack.
+ */
+
+static int
+sna_load(struct cpu_t* cpu, FILE* file)
+{
+    byte header[SNA_HEADER];
+    struct cpu_t regs;
+
+    if (fread(header, 1, SNA_HEADER, file) != SNA_HEADER || header[25] > 2
+            || read_memory(cpu->bus, RAM_START, RAM_SIZE, file)
+            || getc_unlocked(file) != EOF) {
+        return -1;
+    }
+
+    memcpy(&regs, cpu, sizeof(struct cpu_t));
+    regs.i = header[0];
+    ALT_HL(regs) = get16(header + 1);
+    ALT_DE(regs) = get16(header + 3);
+    ALT_BC(regs) = get16(header + 5);
+    ALT_AF(regs) = get16(header + 7);
+    REG_HL(regs) = get16(header + 9);
+    REG_DE(regs) = get16(header + 11);
+    REG_BC(regs) = get16(header + 13);
+    IY(regs) = get16(header + 15);
+    IX(regs) = get16(header + 17);
+    regs.iff1 = regs.iff2 = (header[19] >> 2) & 1;
+    regs.r = header[20];
+    REG_AF(regs) = get16(header + 21);
+    SP(regs) = get16(header + 23);
+    regs.im = header[25];
+    PC(regs) = peek(cpu->bus, SP(regs))
+        | (peek(cpu->bus, SP(regs) + 1) << 8);
+    SP(regs) += 2;
+    memcpy(cpu, &regs, sizeof(struct cpu_t));
+    return 0;
+}
+
+static int
+sna_save(const struct cpu_t* cpu, FILE* file)
+{
+    byte header[SNA_HEADER];
+    word sp = SP(*cpu) - 2;
+    byte pc[2];
+
+    // PC is pushed into the image, so the stack has to be in RAM.
+    if (sp < RAM_START || sp == 0xFFFF) return -1;
+
+    header[0] = cpu->i;
+    put16(header + 1, ALT_HL(*cpu));
+    put16(header + 3, ALT_DE(*cpu));
+    put16(header + 5, ALT_BC(*cpu));
+    put16(header + 7, ALT_AF(*cpu));
+    put16(header + 9, REG_HL(*cpu));
+    put16(header + 11, REG_DE(*cpu));
+    put16(header + 13, REG_BC(*cpu));
+    put16(header + 15, IY(*cpu));
+    put16(header + 17, IX(*cpu));
+    header[19] = cpu->iff2 ? 0x04 : 0x00;
+    header[20] = cpu->r;
+    put16(header + 21, REG_AF(*cpu));
+    put16(header + 23, sp);
+    header[25] = cpu->im;
+    header[26] = 0;
+    put16(pc, PC(*cpu));
+
+    if (fwrite(header, 1, SNA_HEADER, file) != SNA_HEADER
+            || write_memory(cpu->bus, RAM_START, sp - RAM_START, file)
+            || fwrite(pc, 1, 2, file) != 2
+            || write_memory(cpu->bus, sp + 2, 0x10000 - (sp + 2), file)) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * .Z80: a 30 byte header, then either the RLE compressed 48K of RAM
+ * (version 1) or an extra header and one block per 16K bank.
+ */
+
+static void
+z80_registers(struct cpu_t* regs, const byte* header)
+{
+    byte flags = header[12] == 0xFF ? 0x01 : header[12];
+    REG_A(*regs) = header[0];
+    REG_F(*regs) = header[1];
+    REG_BC(*regs) = get16(header + 2);
+    REG_HL(*regs) = get16(header + 4);
+    SP(*regs) = get16(header + 8);
+    regs->i = header[10];
+    regs->r = (header[11] & 0x7F) | ((flags & 0x01) << 7);
+    REG_DE(*regs) = get16(header + 13);
+    ALT_BC(*regs) = get16(header + 15);
+    ALT_DE(*regs) = get16(header + 17);
+    ALT_HL(*regs) = get16(header + 19);
+    ALT_A(*regs) = header[21];
+    ALT_F(*regs) = header[22];
+    IY(*regs) = get16(header + 23);
+    IX(*regs) = get16(header + 25);
+    regs->iff1 = header[27] != 0;
+    regs->iff2 = header[28] != 0;
+    regs->im = header[29] & 0x03;
+}
+
+// Address of a 48K bank by .Z80 page number, 0 for pages that are skipped.
+static word
+z80_bank(int page)
+{
+    switch (page) {
+        case 8: return 0x4000;
+        case 4: return 0x8000;
+        case 5: return 0xC000;
+        default: return 0;
+    }
+}
+
+static int
+z80_load_v1(struct cpu_t* cpu, const byte* header, FILE* file)
+{
+    static const byte end[4] = { 0x00, 0xED, 0xED, 0x00 };
+    struct sink_t sink = { cpu->bus, RAM_START, RAM_SIZE };
+    struct source_t source;
+    byte flags = header[12] == 0xFF ? 0x01 : header[12];
+    int i, value;
+
+    if (!(flags & 0x20)) {
+        return read_memory(cpu->bus, RAM_START, RAM_SIZE, file);
+    }
+    source.file = file;
+    source.left = -1;
+    source.position = source.end = 0;
+    if (rle_decode(&sink, &source)) return -1;
+    // The end marker is not always there.
+    value = next(&source);
+    for (i = 0; i < 4 && value != EOF; i++) {
+        if (value != end[i]) return -1;
+        value = next(&source);
+    }
+    return (i == 0 || i == 4) && value == EOF ? 0 : -1;
+}
+
+static int
+z80_load_blocks(struct cpu_t* cpu, FILE* file)
+{
+    int loaded = 0;
+    for (;;) {
+        byte block[3];
+        size_t read = fread(block, 1, 3, file);
+        word length, addr;
+        int bit;
+
+        if (read == 0 && !ferror(file)) break;
+        if (read != 3 || block[2] > 11) return -1;
+        length = get16(block);
+        addr = z80_bank(block[2]);
+        bit = 1 << (addr >> 14);
+        if (loaded & bit) return -1;
+        if (!addr) {
+            if (skip(file, length == 0xFFFF ? BANK_SIZE : length)) return -1;
+        } else if (length == 0xFFFF) {
+            if (read_memory(cpu->bus, addr, BANK_SIZE, file)) return -1;
+        } else {
+            struct sink_t sink = { cpu->bus, addr, BANK_SIZE };
+            struct source_t source;
+            source.file = file;
+            source.left = length;
+            source.position = source.end = 0;
+            if (rle_decode(&sink, &source) || source.left
+                    || source.position != source.end) {
+                return -1;
+            }
+        }
+        if (addr) loaded |= bit;
+    }
+    return loaded == 0x0E ? 0 : -1;
+}
+
+static int
+z80_load(struct cpu_t* cpu, FILE* file)
+{
+    byte header[Z80_HEADER + 2 + 55];
+    struct cpu_t regs;
+    word pc, extra;
+
+    if (fread(header, 1, Z80_HEADER, file) != Z80_HEADER) return -1;
+    pc = get16(header + 6);
+    if (pc) {
+        if (z80_load_v1(cpu, header, file)) return -1;
+    } else {
+        if (fread(header + Z80_HEADER, 1, 2, file) != 2) return -1;
+        extra = get16(header + Z80_HEADER);
+        if ((extra != 23 && extra != 54 && extra != 55)
+                || fread(header + Z80_HEADER + 2, 1, extra, file) != extra) {
+            return -1;
+        }
+        pc = get16(header + 32);
+        // 48K machines only: mode 3 is 128K in version 2, 48K + MGT after.
+        if ((header[34] > 1 && !(header[34] == 3 && extra != 23))
+                || (header[37] & 0x80)
+                || z80_load_blocks(cpu, file)) {
+            return -1;
+        }
+    }
+
+    memcpy(&regs, cpu, sizeof(struct cpu_t));
+    z80_registers(&regs, header);
+    PC(regs) = pc;
+    memcpy(cpu, &regs, sizeof(struct cpu_t));
+    return 0;
+}
+
+static int
+z80_save(const struct cpu_t* cpu, FILE* file)
+{
+    static const byte pages[3] = { 8, 4, 5 };
+    byte header[Z80_HEADER + 2 + Z80_EXTRA], copy[BANK_SIZE];
+    int i;
+
+    memset(header, 0, sizeof(header));
+    header[0] = REG_A(*cpu);
+    header[1] = REG_F(*cpu);
+    put16(header + 2, REG_BC(*cpu));
+    put16(header + 4, REG_HL(*cpu));
+    put16(header + 8, SP(*cpu));
+    header[10] = cpu->i;
+    header[11] = cpu->r & 0x7F;
+    header[12] = cpu->r >> 7;
+    put16(header + 13, REG_DE(*cpu));
+    put16(header + 15, ALT_BC(*cpu));
+    put16(header + 17, ALT_DE(*cpu));
+    put16(header + 19, ALT_HL(*cpu));
+    header[21] = ALT_A(*cpu);
+    header[22] = ALT_F(*cpu);
+    put16(header + 23, IY(*cpu));
+    put16(header + 25, IX(*cpu));
+    header[27] = cpu->iff1 != 0;
+    header[28] = cpu->iff2 != 0;
+    header[29] = cpu->im & 0x03;
+    put16(header + 30, Z80_EXTRA);
+    put16(header + 32, PC(*cpu));
+    header[37] = 0x03;              // R and LDIR emulation enabled
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        return -1;
+    }
+
+    // Blocks are sized first, so that nothing has to be buffered.
+    for (i = 0; i < 3; i++) {
+        const byte* bank = bank_view(cpu->bus, z80_bank(pages[i]), copy);
+        long length = rle_encode(bank, BANK_SIZE, NULL);
+        byte block[3];
+        put16(block, length < BANK_SIZE ? length : 0xFFFF);
+        block[2] = pages[i];
+        if (fwrite(block, 1, 3, file) != 3) return -1;
+        if (length < BANK_SIZE) {
+            rle_encode(bank, BANK_SIZE, file);
+        } else if (fwrite(bank, 1, BANK_SIZE, file) != BANK_SIZE) {
+            return -1;
+        }
+    }
+    return ferror(file) ? -1 : 0;
+}
+
+/*
+ * .SZX: an 8 byte header and a sequence of blocks, each one with a four
+ * character id and a length. Only the registers and the RAM pages are
+ * used, everything else is skipped.
+ */
+
+// Address of a 48K bank by .SZX page number, 0 for other pages.
+static word
+szx_bank(int page)
+{
+    switch (page) {
+        case 5: return 0x4000;
+        case 2: return 0x8000;
+        case 0: return 0xC000;
+        default: return 0;
+    }
+}
+
+#ifdef ZETA80_ZLIB
+// Inflates a compressed RAMP block into guest memory, a page at a time.
+static int
+szx_inflate(struct bus_t* bus, word addr, uint32_t length, FILE* file)
+{
+    byte input[MEM_PAGE_SIZE], output[MEM_PAGE_SIZE];
+    z_stream stream;
+    int page, status = Z_OK;
+
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) return -1;
+    // One more round after the bank: data left there is an error.
+    for (page = 0; page <= BANK_PAGES && status == Z_OK; page++) {
+        word base = addr + page * MEM_PAGE_SIZE;
+        byte* host = page < BANK_PAGES
+            ? bus->page[base >> MEM_PAGE_SHIFT].mapped : NULL;
+        stream.next_out = host ? host : output;
+        stream.avail_out = page < BANK_PAGES ? MEM_PAGE_SIZE : 1;
+        while (stream.avail_out && status == Z_OK) {
+            if (stream.avail_in == 0 && length) {
+                size_t chunk = length < sizeof(input) ? length : sizeof(input);
+                if (fread(input, 1, chunk, file) != chunk) {
+                    status = Z_ERRNO;
+                    break;
+                }
+                length -= chunk;
+                stream.next_in = input;
+                stream.avail_in = chunk;
+            }
+            status = inflate(&stream, Z_NO_FLUSH);
+        }
+        if (page < BANK_PAGES && !host) {
+            bus_load(bus, base, output, MEM_PAGE_SIZE - stream.avail_out);
+        }
+    }
+    inflateEnd(&stream);
+    return (status == Z_STREAM_END && stream.total_out == BANK_SIZE
+            && stream.avail_in == 0 && length == 0) ? 0 : -1;
+}
+#endif
+
+static int
+szx_ramp(struct cpu_t* cpu, uint32_t size, FILE* file, int* loaded)
+{
+    byte header[3];
+    word addr;
+    int bit;
+
+    if (size < 3 || fread(header, 1, 3, file) != 3) return -1;
+    size -= 3;
+    addr = szx_bank(header[2]);
+    bit = 1 << (addr >> 14);
+    if (!addr) return skip(file, size);
+    if (*loaded & bit) return -1;
+    *loaded |= bit;
+
+    if (get16(header) & 0x01) {
+#ifdef ZETA80_ZLIB
+        return szx_inflate(cpu->bus, addr, size, file);
+#else
+        return -1;
+#endif
+    }
+    return size == BANK_SIZE
+        ? read_memory(cpu->bus, addr, BANK_SIZE, file) : -1;
+}
+
+static void
+szx_registers(struct cpu_t* regs, const byte* block)
+{
+    REG_AF(*regs) = get16(block + 0);
+    REG_BC(*regs) = get16(block + 2);
+    REG_DE(*regs) = get16(block + 4);
+    REG_HL(*regs) = get16(block + 6);
+    ALT_AF(*regs) = get16(block + 8);
+    ALT_BC(*regs) = get16(block + 10);
+    ALT_DE(*regs) = get16(block + 12);
+    ALT_HL(*regs) = get16(block + 14);
+    IX(*regs) = get16(block + 16);
+    IY(*regs) = get16(block + 18);
+    SP(*regs) = get16(block + 20);
+    PC(*regs) = get16(block + 22);
+    regs->i = block[24];
+    regs->r = block[25];
+    regs->iff1 = block[26] != 0;
+    regs->iff2 = block[27] != 0;
+    regs->im = block[28] & 0x03;
+    regs->tstates = get32(block + 29);
+}
+
+static int
+szx_load(struct cpu_t* cpu, FILE* file)
+{
+    byte header[8], z80r[SZX_Z80R];
+    struct cpu_t regs;
+    int loaded = 0, registers = 0;
+
+    // Version 1.x of a 48K machine.
+    if (fread(header, 1, 8, file) != 8 || memcmp(header, "ZXST", 4) != 0
+            || header[4] != 1 || header[6] != 1) {
+        return -1;
+    }
+    for (;;) {
+        byte block[8];
+        size_t read = fread(block, 1, 8, file);
+        uint32_t size;
+
+        if (read == 0 && !ferror(file)) break;
+        if (read != 8) return -1;
+        size = get32(block + 4);
+        if (memcmp(block, "Z80R", 4) == 0) {
+            if (registers || size != SZX_Z80R
+                    || fread(z80r, 1, SZX_Z80R, file) != SZX_Z80R) {
+                return -1;
+            }
+            registers = 1;
+        } else if (memcmp(block, "RAMP", 4) == 0) {
+            if (szx_ramp(cpu, size, file, &loaded)) return -1;
+        } else if (skip(file, size)) {
+            return -1;
+        }
+    }
+    if (!registers || loaded != 0x0E) return -1;
+
+    memcpy(&regs, cpu, sizeof(struct cpu_t));
+    szx_registers(&regs, z80r);
+    memcpy(cpu, &regs, sizeof(struct cpu_t));
+    return 0;
+}
+
+static int
+szx_save(const struct cpu_t* cpu, FILE* file)
+{
+    static const byte header[8] = { 'Z', 'X', 'S', 'T', 1, 4, 1, 0 };
+    static const byte pages[3] = { 5, 2, 0 };
+    byte z80r[8 + SZX_Z80R];
+    int i;
+
+    memset(z80r, 0, sizeof(z80r));
+    memcpy(z80r, "Z80R", 4);
+    put32(z80r + 4, SZX_Z80R);
+    put16(z80r + 8, REG_AF(*cpu));
+    put16(z80r + 10, REG_BC(*cpu));
+    put16(z80r + 12, REG_DE(*cpu));
+    put16(z80r + 14, REG_HL(*cpu));
+    put16(z80r + 16, ALT_AF(*cpu));
+    put16(z80r + 18, ALT_BC(*cpu));
+    put16(z80r + 20, ALT_DE(*cpu));
+    put16(z80r + 22, ALT_HL(*cpu));
+    put16(z80r + 24, IX(*cpu));
+    put16(z80r + 26, IY(*cpu));
+    put16(z80r + 28, SP(*cpu));
+    put16(z80r + 30, PC(*cpu));
+    z80r[32] = cpu->i;
+    z80r[33] = cpu->r;
+    z80r[34] = cpu->iff1 != 0;
+    z80r[35] = cpu->iff2 != 0;
+    z80r[36] = cpu->im & 0x03;
+    put32(z80r + 37, cpu->tstates);
+    if (fwrite(header, 1, 8, file) != 8
+            || fwrite(z80r, 1, sizeof(z80r), file) != sizeof(z80r)) {
+        return -1;
+    }
+
+    // Pages are stored uncompressed: the length goes first and this way
+    // nothing has to be compressed twice or buffered.
+    for (i = 0; i < 3; i++) {
+        byte ramp[8 + 3];
+        memcpy(ramp, "RAMP", 4);
+        put32(ramp + 4, 3 + BANK_SIZE);
+        put16(ramp + 8, 0);
+        ramp[10] = pages[i];
+        if (fwrite(ramp, 1, sizeof(ramp), file) != sizeof(ramp)
+                || write_memory(cpu->bus, szx_bank(pages[i]), BANK_SIZE,
+                    file)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Loads a 48K snapshot into a CPU and the RAM of its memory bus. The file
+ * is read sequentially, it does not need to be seekable, and it has to end
+ * where the snapshot does. Registers are left untouched if the file is
+ * rejected, memory may not.
+ *
+ * @param cpu CPU instance
+ * @param format snapshot format
+ * @param file file to read from
+ * @return 0 on success, -1 if the file cannot be read, is malformed or is
+ *         not a 48K snapshot
+ */
+int
+snapshot_load(struct cpu_t* cpu, int format, FILE* file)
+{
+    int result, page;
+
+    flockfile(file);
+    switch (format) {
+        case SNAPSHOT_SNA: result = sna_load(cpu, file); break;
+        case SNAPSHOT_Z80: result = z80_load(cpu, file); break;
+        case SNAPSHOT_SZX: result = szx_load(cpu, file); break;
+        default: result = -1;
+    }
+    funlockfile(file);
+
+    // Host memory was written behind the back of the bus.
+    for (page = RAM_START >> MEM_PAGE_SHIFT; page < MEM_PAGES; page++) {
+        const byte* host = cpu->bus->page[page].mapped;
+        if (host) bus_dirty_mark_host(cpu->bus, host, MEM_PAGE_SIZE);
+    }
+    return result;
+}
+
+/**
+ * Saves the state of a CPU and the RAM of its memory bus as a 48K
+ * snapshot. The file is written sequentially. .SNA snapshots keep PC on
+ * the stack, so they can only be saved when the two bytes below SP are
+ * in RAM.
+ *
+ * @param cpu CPU instance
+ * @param format snapshot format
+ * @param file file to write to
+ * @return 0 on success, -1 on error
+ */
+int
+snapshot_save(const struct cpu_t* cpu, int format, FILE* file)
+{
+    int result;
+
+    flockfile(file);
+    switch (format) {
+        case SNAPSHOT_SNA: result = sna_save(cpu, file); break;
+        case SNAPSHOT_Z80: result = z80_save(cpu, file); break;
+        case SNAPSHOT_SZX: result = szx_save(cpu, file); break;
+        default: result = -1;
+    }
+    funlockfile(file);
+    return result == 0 && !ferror(file) ? 0 : -1;
+}
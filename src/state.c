@@ -0,0 +1,402 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <errno.h>          // EINTR
+#include <stdio.h>          // rename, snprintf
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memcmp, memcpy, memset, strdup
+#include <fcntl.h>          // open
+#include <pthread.h>
+#include <unistd.h>         // close, fsync, write
+#include <sys/mman.h>       // mmap, munmap
+#include <sys/stat.h>       // fstat
+
+#include <state.h>
+
+// Offsets of the blocks in files written by this version.
+#define REGS_OFFSET sizeof(struct state_header_t)
+#define DIR_OFFSET (REGS_OFFSET + sizeof(struct state_regs_t))
+#define DATA_OFFSET \
+    ((DIR_OFFSET + MEM_PAGES * sizeof(struct state_page_t) + MEM_PAGE_MASK) \
+     & ~((size_t) MEM_PAGE_MASK))
+
+static int
+write_all(int fd, const void* data, size_t size)
+{
+    const byte* bytes = data;
+    while (size) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return -1;
+        bytes += written;
+        size -= written;
+    }
+    return 0;
+}
+
+// Kind of a bus page. Pages that trap writes to a handler are still RAM.
+static int
+page_kind(const struct page_t* page)
+{
+    if (!page->source) return STATE_PAGE_NONE;
+    return (page->mapped || page->on_write) ? STATE_PAGE_RAM : STATE_PAGE_ROM;
+}
+
+/**
+ * Writes the state of a CPU and its memory bus to a file descriptor, from
+ * its current position, which has to be the start of the file. Memory is
+ * read straight from the host pages of the bus, pages that only have
+ * handlers are recorded as such and have no contents.
+ *
+ * @param cpu CPU instance
+ * @param fd file descriptor open for writing
+ * @return 0 on success, -1 on error
+ */
+int
+state_save(const struct cpu_t* cpu, int fd)
+{
+    static const byte padding[MEM_PAGE_SIZE];
+    struct state_header_t header;
+    struct state_regs_t regs;
+    struct state_page_t dir[MEM_PAGES];
+    uint64_t offset = DATA_OFFSET;
+    int i;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "ZETA80ST", 8);
+    header.byte_order = STATE_BYTE_ORDER;
+    header.version = STATE_VERSION;
+    header.header_size = sizeof(struct state_header_t);
+    header.regs_offset = REGS_OFFSET;
+    header.regs_size = sizeof(struct state_regs_t);
+    header.dir_offset = DIR_OFFSET;
+    header.dir_size = sizeof(struct state_page_t);
+    header.dir_entries = MEM_PAGES;
+
+    memset(&regs, 0, sizeof(regs));
+    regs.af = REG_AF(*cpu);
+    regs.bc = REG_BC(*cpu);
+    regs.de = REG_DE(*cpu);
+    regs.hl = REG_HL(*cpu);
+    regs.af_alt = ALT_AF(*cpu);
+    regs.bc_alt = ALT_BC(*cpu);
+    regs.de_alt = ALT_DE(*cpu);
+    regs.hl_alt = ALT_HL(*cpu);
+    regs.pc = PC(*cpu);
+    regs.sp = SP(*cpu);
+    regs.ix = IX(*cpu);
+    regs.iy = IY(*cpu);
+    regs.i = cpu->i;
+    regs.r = cpu->r;
+    regs.iff1 = cpu->iff1;
+    regs.iff2 = cpu->iff2;
+    regs.im = cpu->im;
+    regs.tstates = cpu->tstates;
+
+    memset(dir, 0, sizeof(dir));
+    for (i = 0; i < MEM_PAGES; i++) {
+        const struct page_t* page = &cpu->bus->page[i];
+        dir[i].kind = page_kind(page);
+        dir[i].contention = page->contention;
+        if (dir[i].kind != STATE_PAGE_NONE) {
+            dir[i].offset = offset;
+            offset += MEM_PAGE_SIZE;
+        }
+    }
+    header.size = offset;
+
+    if (write_all(fd, &header, sizeof(header))
+            || write_all(fd, &regs, sizeof(regs))
+            || write_all(fd, dir, sizeof(dir))
+            || write_all(fd, padding, DATA_OFFSET - DIR_OFFSET - sizeof(dir))) {
+        return -1;
+    }
+    for (i = 0; i < MEM_PAGES; i++) {
+        if (dir[i].kind != STATE_PAGE_NONE
+                && write_all(fd, cpu->bus->page[i].source, MEM_PAGE_SIZE)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Writes a state file so that a crash never leaves a partial file behind:
+ * the state goes to a temporary file that is synced to disk and then
+ * renamed over the path.
+ *
+ * @param cpu CPU instance
+ * @param path file to write
+ * @return 0 on success, -1 on error
+ */
+int
+state_write(const struct cpu_t* cpu, const char* path)
+{
+    char temp[1100];
+    int fd, ok;
+
+    snprintf(temp, sizeof(temp), "%s.%ld.tmp", path, (long) getpid());
+    fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    ok = state_save(cpu, fd) == 0 && fsync(fd) == 0;
+    if (close(fd) != 0 || !ok || rename(temp, path) != 0) {
+        unlink(temp);
+        return -1;
+    }
+    return 0;
+}
+
+// Checks that a mapped file is a state file this version can resume.
+static int
+state_valid(const byte* data, size_t size)
+{
+    const struct state_header_t* header = (const void*) data;
+    const struct state_page_t* dir;
+    int i;
+
+    if (size < sizeof(struct state_header_t)
+            || memcmp(header->magic, "ZETA80ST", 8) != 0
+            || header->byte_order != STATE_BYTE_ORDER
+            || header->version != STATE_VERSION
+            || header->size != size
+            || header->header_size < sizeof(struct state_header_t)
+            || header->regs_size < sizeof(struct state_regs_t)
+            || header->dir_entries != MEM_PAGES
+            || header->dir_size != sizeof(struct state_page_t)
+            || header->regs_offset % 8 || header->dir_offset % 8
+            || (uint64_t) header->regs_offset + header->regs_size > size
+            || (uint64_t) header->dir_offset
+                + (uint64_t) header->dir_size * MEM_PAGES > size) {
+        return 0;
+    }
+    dir = (const void*) (data + header->dir_offset);
+    for (i = 0; i < MEM_PAGES; i++) {
+        if (dir[i].kind > STATE_PAGE_RAM || dir[i].contention >= BUS_CLASSES
+                || (dir[i].kind != STATE_PAGE_NONE
+                    && (dir[i].offset & MEM_PAGE_MASK
+                        || size < MEM_PAGE_SIZE
+                        || dir[i].offset > size - MEM_PAGE_SIZE))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Maps a state file. The mapping is private: resumed pages can be written
+ * without changing the file, and only the pages that are written are
+ * copied by the host.
+ *
+ * @param path state file
+ * @return mapped state, or NULL if it cannot be read or is not valid
+ */
+struct state_t*
+state_map(const char* path)
+{
+    struct state_t* state;
+    struct stat st;
+    void* mapping;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+            fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    state = malloc(sizeof(struct state_t));
+    if (!state || !state_valid(mapping, st.st_size)) {
+        munmap(mapping, st.st_size);
+        free(state);
+        return NULL;
+    }
+    state->mapping = mapping;
+    state->size = st.st_size;
+    state->header = mapping;
+    state->regs = (const void*) ((byte*) mapping + state->header->regs_offset);
+    state->page = (const void*) ((byte*) mapping + state->header->dir_offset);
+    return state;
+}
+
+/**
+ * Unmaps a state file. No bus may be using its pages anymore.
+ *
+ * @param state mapped state
+ */
+void
+state_unmap(struct state_t* state)
+{
+    if (!state) return;
+    munmap(state->mapping, state->size);
+    free(state);
+}
+
+/**
+ * Resumes a mapped state: registers are loaded and every page of the bus
+ * that has contents in the file is pointed at the mapping, so nothing is
+ * copied. Pages without contents keep their current mapping and handlers.
+ * Contention classes are restored. The pages belong to the mapping, which
+ * must outlive the bus, so instances resumed this way must not be forked.
+ *
+ * @param state mapped state
+ * @param cpu CPU instance
+ */
+void
+state_resume(const struct state_t* state, struct cpu_t* cpu)
+{
+    const struct state_regs_t* regs = state->regs;
+    int i;
+
+    REG_AF(*cpu) = regs->af;
+    REG_BC(*cpu) = regs->bc;
+    REG_DE(*cpu) = regs->de;
+    REG_HL(*cpu) = regs->hl;
+    ALT_AF(*cpu) = regs->af_alt;
+    ALT_BC(*cpu) = regs->bc_alt;
+    ALT_DE(*cpu) = regs->de_alt;
+    ALT_HL(*cpu) = regs->hl_alt;
+    PC(*cpu) = regs->pc;
+    SP(*cpu) = regs->sp;
+    IX(*cpu) = regs->ix;
+    IY(*cpu) = regs->iy;
+    cpu->i = regs->i;
+    cpu->r = regs->r;
+    cpu->iff1 = regs->iff1;
+    cpu->iff2 = regs->iff2;
+    cpu->im = regs->im;
+    cpu->tstates = regs->tstates;
+
+    for (i = 0; i < MEM_PAGES; i++) {
+        const struct state_page_t* page = &state->page[i];
+        byte* data = (byte*) state->mapping + page->offset;
+        if (page->kind == STATE_PAGE_RAM) {
+            bus_map(cpu->bus, i, 1, data, data);
+        } else if (page->kind == STATE_PAGE_ROM) {
+            bus_map(cpu->bus, i, 1, data, NULL);
+        }
+        bus_contend(cpu->bus, i, 1, page->contention);
+    }
+}
+
+/*
+ * Asynchronous checkpoint: a fork of the instance, which shares every page
+ * with it copy-on-write, written out by a thread of its own. Writable host
+ * memory that the instance does not own, such as NVRAM or RAM given by the
+ * caller, is not copy-on-write, so it is copied when the checkpoint starts.
+ */
+struct z80_checkpoint_t
+{
+    pthread_t thread;           //< Writer thread
+    struct z80_t* fork;         //< Frozen copy of the instance
+    byte* copy;                 //< Copies of the pages not owned, or NULL
+    char* path;                 //< File to write
+    int result;                 //< Result of state_write
+};
+
+static void*
+checkpoint_main(void* arg)
+{
+    struct z80_checkpoint_t* checkpoint = arg;
+    checkpoint->result = state_write(&checkpoint->fork->cpu,
+            checkpoint->path);
+    z80_free(checkpoint->fork);
+    free(checkpoint->copy);
+    return NULL;
+}
+
+// Points the fork at copies of the writable pages it does not own.
+static int
+checkpoint_copy(struct z80_checkpoint_t* checkpoint)
+{
+    struct bus_t* bus = &checkpoint->fork->bus;
+    int i, count = 0;
+
+    for (i = 0; i < MEM_PAGES; i++) {
+        count += bus->page[i].mapped != NULL;
+    }
+    checkpoint->copy = count ? malloc(count * MEM_PAGE_SIZE) : NULL;
+    if (count && !checkpoint->copy) return -1;
+    for (i = 0, count = 0; i < MEM_PAGES; i++) {
+        if (bus->page[i].mapped) {
+            byte* copy = checkpoint->copy + count++ * MEM_PAGE_SIZE;
+            memcpy(copy, bus->page[i].source, MEM_PAGE_SIZE);
+            bus_map(bus, i, 1, copy, copy);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Starts writing a checkpoint of an instance to a file in the background.
+ * The instance is only held up while it is forked, which copies no RAM of
+ * its own: it can keep running right away, and the pages it writes from
+ * now on are copied the first time. Other writable host pages are copied
+ * before returning. Read-only pages are written from the memory they are
+ * mapped to, which must not change until the checkpoint is waited for.
+ * The file is written the same way state_write
+ * does, so it is either the old one or the whole new one.
+ *
+ * @param z80 instance
+ * @param path file to write
+ * @return checkpoint to wait for, or NULL if it could not be started
+ */
+struct z80_checkpoint_t*
+z80_checkpoint(struct z80_t* z80, const char* path)
+{
+    struct z80_checkpoint_t* checkpoint;
+
+    checkpoint = malloc(sizeof(struct z80_checkpoint_t));
+    if (!checkpoint) return NULL;
+    checkpoint->copy = NULL;
+    checkpoint->path = strdup(path);
+    checkpoint->fork = checkpoint->path ? z80_fork(z80) : NULL;
+    if (!checkpoint->fork || checkpoint_copy(checkpoint)
+            || pthread_create(&checkpoint->thread, NULL,
+                checkpoint_main, checkpoint) != 0) {
+        z80_free(checkpoint->fork);
+        free(checkpoint->copy);
+        free(checkpoint->path);
+        free(checkpoint);
+        return NULL;
+    }
+    return checkpoint;
+}
+
+/**
+ * Waits for a checkpoint to be written and frees it.
+ *
+ * @param checkpoint checkpoint
+ * @return 0 if the file was written, -1 otherwise
+ */
+int
+z80_checkpoint_wait(struct z80_checkpoint_t* checkpoint)
+{
+    int result;
+    pthread_join(checkpoint->thread, NULL);
+    result = checkpoint->result;
+    free(checkpoint->path);
+    free(checkpoint);
+    return result;
+}
@@ -0,0 +1,379 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <sched.h>          // sched_yield
+#include <stdlib.h>         // calloc, free
+
+#include <system.h>
+#include <opcodes.h>
+
+/**
+ * Creates an empty system. Quanta start as long as allowed.
+ *
+ * @param threaded whether every CPU runs on its own thread
+ * @param min_quantum shortest quantum, in T-states
+ * @param max_quantum longest quantum, in T-states
+ * @return new system, or NULL if the quanta are invalid or on error
+ */
+struct z80_system_t*
+z80_system_create(int threaded, int min_quantum, int max_quantum)
+{
+    struct z80_system_t* system;
+
+    if (min_quantum <= 0 || max_quantum < min_quantum) return NULL;
+    system = calloc(1, sizeof(struct z80_system_t));
+    if (!system) return NULL;
+    system->threaded = threaded;
+    system->min_quantum = min_quantum;
+    system->max_quantum = max_quantum;
+    system->quantum = max_quantum;
+    system->last = -1;
+    pthread_mutex_init(&system->mutex, NULL);
+    pthread_cond_init(&system->start, NULL);
+    pthread_cond_init(&system->done, NULL);
+    return system;
+}
+
+/**
+ * Frees a system. The CPUs, their buses and the shared memory belong to
+ * the caller and are left as they are.
+ *
+ * @param system system to free
+ */
+void
+z80_system_free(struct z80_system_t* system)
+{
+    if (!system) return;
+    pthread_mutex_destroy(&system->mutex);
+    pthread_cond_destroy(&system->start);
+    pthread_cond_destroy(&system->done);
+    free(system);
+}
+
+/**
+ * Adds a CPU to a system. Its clock starts at the current system time,
+ * whatever its T-state counter says.
+ *
+ * @param system system
+ * @param cpu CPU instance, with its bus already set up
+ * @return index of the CPU, or -1 if the system is full
+ */
+int
+z80_system_add(struct z80_system_t* system, struct cpu_t* cpu)
+{
+    struct system_cpu_t* node;
+
+    if (system->cpus == SYSTEM_MAX_CPUS) return -1;
+    node = &system->node[system->cpus];
+    node->system = system;
+    node->index = system->cpus;
+    node->cpu = cpu;
+    node->clock = system->time;
+    atomic_init(&node->now, node->clock);
+    return system->cpus++;
+}
+
+// Whether a clock and index come before the access the node is making.
+static int
+behind(long clock, int index, const struct system_cpu_t* node)
+{
+    return clock < node->clock
+        || (clock == node->clock && index < node->index);
+}
+
+// Runs one instruction and publishes the new clock.
+static void
+step(struct system_cpu_t* node)
+{
+    int before = node->cpu->tstates, delta;
+    execute_opcode(node->cpu);
+    delta = node->cpu->tstates - before;
+    node->clock += delta > 0 ? delta : 1;
+    atomic_store_explicit(&node->now, node->clock, memory_order_release);
+}
+
+/*
+ * Holds a shared access back until every other CPU is past its timestamp.
+ * One thread runs the CPUs that are behind up to it, which is safe because
+ * they can only be waiting on CPUs further behind; threads wait for them
+ * instead. The CPU that comes first never waits, so there is no deadlock,
+ * and no two shared accesses are ever done at the same time, so the
+ * counters below need no locking.
+ */
+static void
+order(struct system_cpu_t* node)
+{
+    struct z80_system_t* system = node->system;
+    int i, waited = 0;
+
+    for (i = 0; i < system->cpus; i++) {
+        struct system_cpu_t* other = &system->node[i];
+        if (other == node) continue;
+        if (system->threaded) {
+            while (behind(atomic_load_explicit(&other->now,
+                            memory_order_acquire), i, node)) {
+                waited = 1;
+                sched_yield();
+            }
+        } else {
+            while (behind(other->clock, i, node)) {
+                waited = 1;
+                step(other);
+            }
+        }
+    }
+    node->waits += waited;
+    system->accesses++;
+    if (system->last >= 0 && system->last != node->index) {
+        system->crossings++;
+        system->handovers++;
+    }
+    system->last = node->index;
+}
+
+// Latch mapped at an address of a CPU, or -1.
+static int
+find_latch(const struct system_cpu_t* node, word addr)
+{
+    int i;
+    for (i = 0; i < node->latches; i++) {
+        if (node->latch[i].addr == addr) return node->latch[i].latch;
+    }
+    return -1;
+}
+
+static byte
+shared_read(void* ctx, word addr)
+{
+    struct system_cpu_t* node = ctx;
+    byte* memory = node->shared[addr >> MEM_PAGE_SHIFT];
+    int latch = memory ? -1 : find_latch(node, addr);
+
+    if (!memory && latch < 0) return 0xFF;
+    order(node);
+    return memory ? memory[addr & MEM_PAGE_MASK]
+        : node->system->latch[latch];
+}
+
+static void
+shared_write(void* ctx, word addr, byte value)
+{
+    struct system_cpu_t* node = ctx;
+    byte* memory = node->shared[addr >> MEM_PAGE_SHIFT];
+    int latch = memory ? -1 : find_latch(node, addr);
+
+    if (!memory && latch < 0) return;
+    order(node);
+    if (memory) {
+        memory[addr & MEM_PAGE_MASK] = value;
+    } else {
+        node->system->latch[latch] = value;
+    }
+}
+
+/**
+ * Maps shared memory into a range of pages of a CPU. The pages are
+ * trapped from now on, whatever was mapped there before, and the handlers
+ * of the range are replaced. Each CPU may map the memory at its own
+ * address.
+ *
+ * @param system system
+ * @param index index of the CPU
+ * @param first first page
+ * @param count number of pages
+ * @param memory count pages of host memory, owned by the caller
+ * @return 0 on success, -1 if the arguments are out of range
+ */
+int
+z80_system_share(struct z80_system_t* system, int index, int first,
+        int count, byte* memory)
+{
+    struct system_cpu_t* node;
+    int i;
+
+    if (index < 0 || index >= system->cpus || !memory || first < 0
+            || count <= 0 || first + count > MEM_PAGES) {
+        return -1;
+    }
+    node = &system->node[index];
+    for (i = 0; i < count; i++) {
+        node->shared[first + i] = memory + i * MEM_PAGE_SIZE;
+    }
+    bus_map(node->cpu->bus, first, count, NULL, NULL);
+    bus_handlers(node->cpu->bus, first, count, shared_read, shared_write,
+            node);
+    return 0;
+}
+
+/**
+ * Maps a latch at an address of a CPU. A latch is a byte that every CPU
+ * it is mapped in can read and write, such as the sound command latch of
+ * an arcade board (there are no I/O instructions, so it is memory mapped).
+ * The whole page is trapped: other addresses in it read as 0xFF and
+ * ignore writes, unless they have latches too.
+ *
+ * @param system system
+ * @param index index of the CPU
+ * @param addr address of the latch in that CPU
+ * @param latch latch number
+ * @return 0 on success, -1 if the arguments are out of range or the CPU
+ *         has no room for more latches
+ */
+int
+z80_system_latch(struct z80_system_t* system, int index, word addr,
+        int latch)
+{
+    struct system_cpu_t* node;
+    int page = addr >> MEM_PAGE_SHIFT;
+
+    if (index < 0 || index >= system->cpus || latch < 0
+            || latch >= SYSTEM_MAX_LATCHES
+            || system->node[index].latches == SYSTEM_MAX_LATCHES) {
+        return -1;
+    }
+    node = &system->node[index];
+    node->latch[node->latches].addr = addr;
+    node->latch[node->latches].latch = latch;
+    node->latches++;
+    node->shared[page] = NULL;
+    bus_map(node->cpu->bus, page, 1, NULL, NULL);
+    bus_handlers(node->cpu->bus, page, 1, shared_read, shared_write, node);
+    return 0;
+}
+
+// Runs a CPU up to the end of the quantum.
+static void
+run_cpu(struct system_cpu_t* node, long end)
+{
+    while (node->clock < end) {
+        step(node);
+    }
+}
+
+static void*
+cpu_thread(void* arg)
+{
+    struct system_cpu_t* node = arg;
+    struct z80_system_t* system = node->system;
+    unsigned long seen = 0;
+    long end;
+
+    for (;;) {
+        pthread_mutex_lock(&system->mutex);
+        while (system->generation == seen) {
+            pthread_cond_wait(&system->start, &system->mutex);
+        }
+        seen = system->generation;
+        end = system->end;
+        pthread_mutex_unlock(&system->mutex);
+        if (end < 0) return NULL;
+
+        run_cpu(node, end);
+        pthread_mutex_lock(&system->mutex);
+        if (--system->running == 0) {
+            pthread_cond_signal(&system->done);
+        }
+        pthread_mutex_unlock(&system->mutex);
+    }
+}
+
+// Starts a quantum on every thread, or tells them to exit if end is -1.
+static void
+start_threads(struct z80_system_t* system, long end)
+{
+    pthread_mutex_lock(&system->mutex);
+    system->end = end;
+    system->running = system->cpus;
+    system->generation++;
+    pthread_cond_broadcast(&system->start);
+    if (end >= 0) {
+        while (system->running) {
+            pthread_cond_wait(&system->done, &system->mutex);
+        }
+    }
+    pthread_mutex_unlock(&system->mutex);
+}
+
+// Halves the quantum after crossings, doubles it back otherwise.
+static void
+adapt(struct z80_system_t* system)
+{
+    if (system->crossings) {
+        system->quantum /= 2;
+        if (system->quantum < system->min_quantum) {
+            system->quantum = system->min_quantum;
+        }
+    } else if (system->quantum <= system->max_quantum / 2) {
+        system->quantum *= 2;
+    } else {
+        system->quantum = system->max_quantum;
+    }
+    system->crossings = 0;
+    system->quanta++;
+}
+
+/**
+ * Runs every CPU of a system for some T-states, quantum by quantum. CPUs
+ * stop at the first instruction boundary past the end of each quantum and
+ * go on from there in the next one. In threaded mode the threads only
+ * live for the duration of the call.
+ *
+ * @param system system
+ * @param tstates T-states to run
+ * @return 0 on success, -1 if the threads could not be created
+ */
+int
+z80_system_run(struct z80_system_t* system, long tstates)
+{
+    long target = system->time + tstates;
+    int started = 0, failed = 0, i;
+
+    if (system->threaded) {
+        system->generation = 0;
+        for (started = 0; started < system->cpus; started++) {
+            struct system_cpu_t* node = &system->node[started];
+            if (pthread_create(&node->thread, NULL, cpu_thread, node)) {
+                failed = 1;
+                break;
+            }
+        }
+    }
+    while (!failed && system->time < target) {
+        long end = system->time + system->quantum;
+        if (end > target) end = target;
+        if (system->threaded) {
+            start_threads(system, end);
+        } else {
+            for (i = 0; i < system->cpus; i++) {
+                run_cpu(&system->node[i], end);
+            }
+        }
+        system->time = end;
+        adapt(system);
+    }
+    if (system->threaded) {
+        start_threads(system, -1);
+        for (i = 0; i < started; i++) {
+            pthread_join(system->node[i].thread, NULL);
+        }
+    }
+    return failed ? -1 : 0;
+}
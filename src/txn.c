@@ -0,0 +1,98 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stdlib.h>         // free
+#include <string.h>         // memcpy, memset
+
+#include <txn.h>
+
+/**
+ * Begins a transaction. Only one transaction can be open on a bus at a
+ * time. Call it between instructions.
+ *
+ * @param txn transaction, owned by the caller
+ * @param cpu CPU instance
+ * @return 0 on success, -1 if the bus already has an undo log
+ */
+int
+z80_txn_begin(struct z80_txn_t* txn, struct cpu_t* cpu)
+{
+    if (cpu->bus->undo) return -1;
+    txn->cpu = cpu;
+    memcpy(&txn->saved, cpu, sizeof(struct cpu_t));
+    memset(&txn->undo, 0, sizeof(struct bus_undo_t));
+    bus_undo_attach(cpu->bus, &txn->undo);
+    return 0;
+}
+
+// Closes the transaction and releases the log.
+static void
+txn_end(struct z80_txn_t* txn)
+{
+    bus_undo_detach(txn->cpu->bus);
+    free(txn->undo.entry);
+    txn->undo.entry = NULL;
+}
+
+/**
+ * Keeps everything done since the transaction began and closes it.
+ *
+ * @param txn transaction
+ */
+void
+z80_txn_commit(struct z80_txn_t* txn)
+{
+    txn_end(txn);
+}
+
+/**
+ * Undoes every memory write done since the transaction began, newest
+ * first, restores the registers and closes the transaction. The old
+ * values are written back through the bus, so dirty trackers and hashes
+ * see them. Writes to addresses that no longer map the host page they
+ * went to, because of a bank switch or any other bus_map, are skipped:
+ * writing them back would corrupt whatever is mapped there now.
+ *
+ * @param txn transaction
+ * @return 0 on success, -1 if the log ran out of memory or the mapping
+ *         changed, and some writes could not be undone
+ */
+int
+z80_txn_rollback(struct z80_txn_t* txn)
+{
+    struct cpu_t* cpu = txn->cpu;
+    size_t i = txn->undo.count;
+    int failed = txn->undo.failed;
+
+    bus_undo_detach(cpu->bus);
+    while (i--) {
+        const struct bus_undo_entry_t* entry = &txn->undo.entry[i];
+        if (cpu->bus->page[entry->addr >> MEM_PAGE_SHIFT].source
+                != entry->source) {
+            failed = 1;
+            continue;
+        }
+        bus_write(cpu->bus, entry->addr, entry->value);
+    }
+    memcpy(cpu, &txn->saved, sizeof(struct cpu_t));
+    txn_end(txn);
+    return failed ? -1 : 0;
+}
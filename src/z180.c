@@ -0,0 +1,448 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <string.h>         // memset, memmove
+#include <cpu.h>
+#include <opcodes.h>
+#include <z180.h>
+
+#define PHYS_MASK (Z180_PHYS_SIZE - 1)
+
+/**
+ * Initializes a Z180 to its power-on state: MMU registers select a flat
+ * mapping of the first 64 KB of physical memory, DMA is idle and ASCI
+ * transmitters are empty. Physical memory and CPU registers are left
+ * untouched, and callbacks are cleared.
+ *
+ * @param z180 Z180 instance
+ */
+void
+z180_init(struct z180_t* z180)
+{
+    bus_init(&z180->bus, NULL);
+    cpu_init(&z180->cpu, &z180->bus);
+    memset(z180->io, 0, sizeof(z180->io));
+    z180->io[Z180_STAT0] = Z180_STAT_TDRE;
+    z180->io[Z180_STAT1] = Z180_STAT_TDRE;
+    z180->io[Z180_DSTAT] = Z180_DSTAT_DWE1 | Z180_DSTAT_DWE0;
+    z180->io[Z180_CBAR] = 0xF0;
+    z180->io[Z180_ICR] = 0x1F;
+    z180->in = NULL;
+    z180->out = NULL;
+    z180->tx = NULL;
+    z180->userdata = NULL;
+    z180_mmu_update(z180);
+}
+
+/**
+ * Translates a logical address into a physical address according to the
+ * current value of the CBAR, BBR and CBR registers.
+ *
+ * @param z180 Z180 instance
+ * @param addr logical address
+ * @return 20-bit physical address
+ */
+unsigned long
+z180_translate(const struct z180_t* z180, word addr)
+{
+    int page = addr >> MEM_PAGE_SHIFT;
+    int common1 = z180->io[Z180_CBAR] >> 4;
+    int bank = z180->io[Z180_CBAR] & 0x0F;
+    unsigned long base = 0;
+
+    if (page >= common1) {
+        base = z180->io[Z180_CBR];
+    } else if (page >= bank) {
+        base = z180->io[Z180_BBR];
+    }
+    return ((base << MEM_PAGE_SHIFT) + addr) & PHYS_MASK;
+}
+
+/**
+ * Rebuilds the page table of the memory bus. Because the Z180 MMU works with
+ * 4 KB granularity each logical page is backed by a contiguous piece of
+ * physical memory, so translation is done once here instead of on every
+ * memory access. Call after changing MMU registers behind OUT0's back.
+ *
+ * @param z180 Z180 instance
+ */
+void
+z180_mmu_update(struct z180_t* z180)
+{
+    int page;
+    for (page = 0; page < MEM_PAGES; page++) {
+        word addr = page << MEM_PAGE_SHIFT;
+        byte* host = &z180->phys[z180_translate(z180, addr)];
+        bus_map(&z180->bus, page, 1, host, host);
+    }
+}
+
+static int
+is_internal(const struct z180_t* z180, word port)
+{
+    return port < 0x100 && (port & 0xC0) == (z180->io[Z180_ICR] & 0xC0);
+}
+
+static unsigned long
+get_addr20(const struct z180_t* z180, int reg)
+{
+    return z180->io[reg] | (z180->io[reg + 1] << 8)
+        | ((unsigned long) (z180->io[reg + 2] & 0x0F) << 16);
+}
+
+static void
+set_addr20(struct z180_t* z180, int reg, unsigned long addr)
+{
+    z180->io[reg] = addr & 0xFF;
+    z180->io[reg + 1] = (addr >> 8) & 0xFF;
+    z180->io[reg + 2] = (addr >> 16) & 0x0F;
+}
+
+static unsigned long
+get_count(const struct z180_t* z180, int reg)
+{
+    unsigned long count = z180->io[reg] | (z180->io[reg + 1] << 8);
+    return count ? count : 0x10000;
+}
+
+static byte read_port(struct z180_t* z180, word port);
+static void write_port(struct z180_t* z180, word port, byte value);
+
+/*
+ * DMA channel 0 can move data between any combination of memory and I/O.
+ * DMODE bits 5-4 select the destination and bits 3-2 select the source:
+ * 0 = memory, increment; 1 = memory, decrement; 2 = memory, fixed; 3 = I/O.
+ */
+static void
+dma_channel0(struct z180_t* z180)
+{
+    unsigned long sar = get_addr20(z180, Z180_SAR0L);
+    unsigned long dar = get_addr20(z180, Z180_DAR0L);
+    unsigned long count = get_count(z180, Z180_BCR0L);
+    int dm = (z180->io[Z180_DMODE] >> 4) & 3;
+    int sm = (z180->io[Z180_DMODE] >> 2) & 3;
+    unsigned long i;
+
+    z180->io[Z180_DSTAT] &= ~Z180_DSTAT_DE0;
+
+    if (sm == 0 && dm == 0 && sar + count <= Z180_PHYS_SIZE
+            && dar + count <= Z180_PHYS_SIZE
+            && (dar <= sar || dar >= sar + count)) {
+        // Plain memory to memory burst, it can be done as a bulk copy.
+        memmove(&z180->phys[dar], &z180->phys[sar], count);
+        bus_dirty_mark_host(&z180->bus, &z180->phys[dar], count);
+        sar += count;
+        dar += count;
+    } else {
+        for (i = 0; i < count; i++) {
+            byte value = (sm == 3) ? read_port(z180, sar & 0xFFFF)
+                : z180->phys[sar];
+            if (dm == 3) {
+                write_port(z180, dar & 0xFFFF, value);
+            } else {
+                z180->phys[dar] = value;
+                bus_dirty_mark_host(&z180->bus, &z180->phys[dar], 1);
+            }
+            if (sm == 0) sar = (sar + 1) & PHYS_MASK;
+            if (sm == 1) sar = (sar - 1) & PHYS_MASK;
+            if (dm == 0) dar = (dar + 1) & PHYS_MASK;
+            if (dm == 1) dar = (dar - 1) & PHYS_MASK;
+        }
+    }
+
+    set_addr20(z180, Z180_SAR0L, sar & PHYS_MASK);
+    set_addr20(z180, Z180_DAR0L, dar & PHYS_MASK);
+    z180->io[Z180_BCR0L] = z180->io[Z180_BCR0L + 1] = 0;
+    z180->cpu.tstates += count * ((sm == 3 || dm == 3) ? 7 : 6);
+}
+
+/*
+ * DMA channel 1 moves data between memory and an I/O port. DCNTL bits 1-0
+ * select direction and MAR stepping: 0 = memory to I/O, increment;
+ * 1 = memory to I/O, decrement; 2 = I/O to memory, increment;
+ * 3 = I/O to memory, decrement. There is no DREQ1 handshake: the whole
+ * block is moved as soon as the channel is enabled.
+ */
+static void
+dma_channel1(struct z180_t* z180)
+{
+    unsigned long mar = get_addr20(z180, Z180_MAR1L);
+    word iar = z180->io[Z180_IAR1L] | (z180->io[Z180_IAR1L + 1] << 8);
+    unsigned long count = get_count(z180, Z180_BCR1L);
+    int dim = z180->io[Z180_DCNTL] & 3;
+    unsigned long i;
+
+    z180->io[Z180_DSTAT] &= ~Z180_DSTAT_DE1;
+
+    for (i = 0; i < count; i++) {
+        if (dim < 2) {
+            write_port(z180, iar, z180->phys[mar]);
+        } else {
+            z180->phys[mar] = read_port(z180, iar);
+            bus_dirty_mark_host(&z180->bus, &z180->phys[mar], 1);
+        }
+        mar = (dim & 1) ? (mar - 1) & PHYS_MASK : (mar + 1) & PHYS_MASK;
+    }
+
+    set_addr20(z180, Z180_MAR1L, mar);
+    z180->io[Z180_BCR1L] = z180->io[Z180_BCR1L + 1] = 0;
+    z180->cpu.tstates += count * 7;
+}
+
+static void
+write_dstat(struct z180_t* z180, byte value)
+{
+    byte dstat = z180->io[Z180_DSTAT];
+
+    // DE bits are only written when their write enable bit is zero.
+    if (!(value & Z180_DSTAT_DWE0)) {
+        dstat = (dstat & ~Z180_DSTAT_DE0) | (value & Z180_DSTAT_DE0);
+    }
+    if (!(value & Z180_DSTAT_DWE1)) {
+        dstat = (dstat & ~Z180_DSTAT_DE1) | (value & Z180_DSTAT_DE1);
+    }
+    if (dstat & (Z180_DSTAT_DE0 | Z180_DSTAT_DE1)) {
+        dstat |= Z180_DSTAT_DME;
+    }
+    dstat = (dstat & ~0x0C) | (value & 0x0C); // DIE1, DIE0
+    z180->io[Z180_DSTAT] = dstat | Z180_DSTAT_DWE1 | Z180_DSTAT_DWE0;
+
+    if (dstat & Z180_DSTAT_DME) {
+        if (dstat & Z180_DSTAT_DE0) dma_channel0(z180);
+        if (dstat & Z180_DSTAT_DE1) dma_channel1(z180);
+    }
+}
+
+static byte
+read_internal(struct z180_t* z180, int reg)
+{
+    byte value = z180->io[reg];
+    if (reg == Z180_RDR0 || reg == Z180_RDR1) {
+        z180->io[Z180_STAT0 + (reg - Z180_RDR0)] &= ~Z180_STAT_RDRF;
+    }
+    return value;
+}
+
+static void
+write_internal(struct z180_t* z180, int reg, byte value)
+{
+    const byte stat_ro = Z180_STAT_RDRF | Z180_STAT_OVRN | Z180_STAT_TDRE;
+
+    switch (reg) {
+        case Z180_CBR:
+        case Z180_BBR:
+        case Z180_CBAR:
+            z180->io[reg] = value;
+            z180_mmu_update(z180);
+            break;
+        case Z180_TDR0:
+        case Z180_TDR1:
+            z180->io[reg] = value;
+            if (z180->tx) z180->tx(z180, reg - Z180_TDR0, value);
+            break;
+        case Z180_STAT0:
+        case Z180_STAT1:
+            z180->io[reg] = (z180->io[reg] & stat_ro) | (value & ~stat_ro);
+            break;
+        case Z180_DSTAT:
+            write_dstat(z180, value);
+            break;
+        default:
+            z180->io[reg] = value;
+    }
+}
+
+// External ports are delayed by the contention model of the bus, if any.
+static byte
+read_port(struct z180_t* z180, word port)
+{
+    if (is_internal(z180, port)) {
+        return read_internal(z180, port & 0x3F);
+    }
+    bus_contend_io(&z180->bus, port);
+    return z180->in ? z180->in(z180, port) : 0xFF;
+}
+
+static void
+write_port(struct z180_t* z180, word port, byte value)
+{
+    if (is_internal(z180, port)) {
+        write_internal(z180, port & 0x3F, value);
+        return;
+    }
+    bus_contend_io(&z180->bus, port);
+    if (z180->out) {
+        z180->out(z180, port, value);
+    }
+}
+
+/**
+ * Reads an I/O port in page zero, the same way IN0 does.
+ *
+ * @param z180 Z180 instance
+ * @param port port address (high byte is always zero)
+ * @return value read
+ */
+byte
+z180_in0(struct z180_t* z180, byte port)
+{
+    return read_port(z180, port);
+}
+
+/**
+ * Writes an I/O port in page zero, the same way OUT0 does. Writing to the
+ * MMU registers rebuilds the page map and writing to DSTAT may start DMA.
+ *
+ * @param z180 Z180 instance
+ * @param port port address (high byte is always zero)
+ * @param value value to write
+ */
+void
+z180_out0(struct z180_t* z180, byte port, byte value)
+{
+    write_port(z180, port, value);
+}
+
+/**
+ * Delivers a byte received by an ASCI channel into its RDR register.
+ *
+ * @param z180 Z180 instance
+ * @param channel ASCI channel, 0 or 1
+ * @param value received byte
+ */
+void
+z180_asci_receive(struct z180_t* z180, int channel, byte value)
+{
+    byte* stat = &z180->io[Z180_STAT0 + channel];
+    if (*stat & Z180_STAT_RDRF) {
+        *stat |= Z180_STAT_OVRN;
+    }
+    z180->io[Z180_RDR0 + channel] = value;
+    *stat |= Z180_STAT_RDRF;
+}
+
+static byte*
+reg8(struct cpu_t* cpu, int index)
+{
+    switch (index) {
+        case 0: return &REG_B(*cpu);
+        case 1: return &REG_C(*cpu);
+        case 2: return &REG_D(*cpu);
+        case 3: return &REG_E(*cpu);
+        case 4: return &REG_H(*cpu);
+        case 5: return &REG_L(*cpu);
+        case 6: return NULL; // (HL), see execute_ed
+        default: return &REG_A(*cpu);
+    }
+}
+
+static int
+parity(byte value)
+{
+    value ^= value >> 4;
+    value ^= value >> 2;
+    value ^= value >> 1;
+    return (value & 1) == 0;
+}
+
+static void
+set_szp(struct cpu_t* cpu, byte value)
+{
+    FLAG_SIF(*cpu, FLAG_S, (value & 0x80));
+    FLAG_SIF(*cpu, FLAG_Z, (value == 0));
+    FLAG_SIF(*cpu, FLAG_P, parity(value));
+}
+
+// TST: A AND value, only flags are changed.
+static void
+tst(struct cpu_t* cpu, byte value)
+{
+    set_szp(cpu, REG_A(*cpu) & value);
+    FLAG_SET(*cpu, FLAG_H);
+    FLAG_RST(*cpu, FLAG_N | FLAG_C);
+}
+
+/*
+ * Executes one of the ED-prefixed instructions added by the Z180. Returns
+ * zero if the opcode is not one of them, so that it can be executed by the
+ * Z80 core instead.
+ */
+static int
+execute_ed(struct z180_t* z180, byte op)
+{
+    struct cpu_t* cpu = &z180->cpu;
+    word pc = PC(*cpu);
+    int y = (op >> 3) & 7;
+
+    if ((op & 0xC7) == 0x00) {
+        // IN0 r, (n). ED 30 only changes flags.
+        byte value = z180_in0(z180, mem_read(cpu, pc + 2));
+        if (y != 6) *reg8(cpu, y) = value;
+        set_szp(cpu, value);
+        FLAG_RST(*cpu, FLAG_H | FLAG_N);
+        PC(*cpu) += 3;
+        cpu->tstates += 12;
+    } else if ((op & 0xC7) == 0x01 && y != 6) {
+        // OUT0 (n), r
+        z180_out0(z180, mem_read(cpu, pc + 2), *reg8(cpu, y));
+        PC(*cpu) += 3;
+        cpu->tstates += 13;
+    } else if ((op & 0xC7) == 0x04) {
+        // TST r, TST (HL)
+        tst(cpu, y == 6 ? mem_read(cpu, REG_HL(*cpu)) : *reg8(cpu, y));
+        PC(*cpu) += 2;
+        cpu->tstates += (y == 6 ? 10 : 7);
+    } else if (op == 0x64) {
+        // TST n
+        tst(cpu, mem_read(cpu, pc + 2));
+        PC(*cpu) += 3;
+        cpu->tstates += 9;
+    } else if ((op & 0xCF) == 0x4C) {
+        // MLT ss: ss <- ssH * ssL
+        union register_t* ss[] = {
+            &cpu->main.bc, &cpu->main.de, &cpu->main.hl, &cpu->sp
+        };
+        union register_t* reg = ss[(op >> 4) & 3];
+        reg->WORD = reg->BYTES.H * reg->BYTES.L;
+        PC(*cpu) += 2;
+        cpu->tstates += 17;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Executes the next instruction. Z180 extensions are handled here and
+ * everything else is executed by the Z80 core through the memory bus.
+ *
+ * @param z180 Z180 instance
+ */
+void
+z180_execute_opcode(struct z180_t* z180)
+{
+    struct cpu_t* cpu = &z180->cpu;
+    if (mem_read(cpu, PC(*cpu)) == 0xED
+            && execute_ed(z180, mem_read(cpu, PC(*cpu) + 1))) {
+        return;
+    }
+    execute_opcode(cpu);
+}
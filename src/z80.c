@@ -0,0 +1,423 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memcpy, memset
+#include <fcntl.h>          // open
+#include <unistd.h>         // close
+#include <sys/mman.h>       // mmap, munmap
+#include <sys/stat.h>       // fstat
+
+#include <pool.h>
+#include <z80.h>
+
+/*
+ * State saved by z80_set_baseline. RAM pages are shared with the instance
+ * the same way a fork shares them, and the dirty tracker knows which lines
+ * of them the instance has written since.
+ */
+struct z80_baseline_t
+{
+    struct cpu_t cpu;                   //< Registers
+    struct z80_page_t* ram[MEM_PAGES];  //< RAM pages, NULL if unallocated
+    const byte* read[MEM_PAGES];        //< Contents of every page
+    byte* copy[MEM_PAGES];              //< Writable pages not in ram
+    struct bus_dirty_t dirty;           //< Writes since the baseline
+};
+
+// Back every RAM page that has not been written yet, see z80_init.
+static const byte zero_page[MEM_PAGE_SIZE];
+static const byte ones_page[MEM_PAGE_SIZE] = {
+    [0 ... MEM_PAGE_SIZE - 1] = 0xFF
+};
+
+/**
+ * Maps a ROM file read-only. The mapping is private, so the file can not
+ * be changed through it, and it is rounded up to whole bus pages: the
+ * bytes past the end of the file read as zero.
+ *
+ * @param path path to the ROM file
+ * @return ROM file, or NULL on error
+ */
+struct z80_rom_file_t*
+z80_rom_open(const char* path)
+{
+    struct z80_rom_file_t* rom;
+    struct stat st;
+    void* mapping;
+    size_t size;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size > 0x10000) {
+        close(fd);
+        return NULL;
+    }
+    size = (st.st_size + MEM_PAGE_MASK) & ~((size_t) MEM_PAGE_MASK);
+    mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    rom = malloc(sizeof(struct z80_rom_file_t));
+    if (!rom) {
+        munmap(mapping, size);
+        return NULL;
+    }
+    rom->data = mapping;
+    rom->size = st.st_size;
+    rom->pages = size >> MEM_PAGE_SHIFT;
+    rom->mapping = mapping;
+    rom->mapping_size = size;
+    return rom;
+}
+
+/**
+ * Unmaps a ROM file. No instance may be using it anymore.
+ *
+ * @param rom ROM file
+ */
+void
+z80_rom_close(struct z80_rom_file_t* rom)
+{
+    if (!rom) return;
+    munmap(rom->mapping, rom->mapping_size);
+    free(rom);
+}
+
+// Drops a reference to a RAM page.
+static void
+page_release(struct z80_page_t* page)
+{
+    if (page && atomic_fetch_sub(&page->refs, 1) == 1) {
+        free(page);
+    }
+}
+
+/*
+ * Write handler of RAM pages that are not private yet: either they have
+ * never been written and still show the fill pattern, or they are shared
+ * with a fork. The page is made private, mapped read-write and the write
+ * is retried. If there is no memory left the write is lost.
+ */
+static void
+ram_fault(void* ctx, word addr, byte value)
+{
+    struct z80_t* z80 = ctx;
+    int index = addr >> MEM_PAGE_SHIFT;
+    struct z80_page_t* page = z80->ram[index];
+
+    if (!page || atomic_load(&page->refs) > 1) {
+        struct z80_page_t* copy = malloc(sizeof(struct z80_page_t));
+        if (!copy) return;
+        atomic_init(&copy->refs, 1);
+        memcpy(copy->data, z80->bus.page[index].source, MEM_PAGE_SIZE);
+        page_release(page);
+        page = copy;
+    }
+    // Otherwise every fork that shared the page has already let it go.
+
+    z80->ram[index] = page;
+    bus_map(&z80->bus, index, 1, page->data, page->data);
+    page->data[addr & MEM_PAGE_MASK] = value;
+}
+
+/**
+ * Initializes an instance in caller-provided storage. The ROM file is
+ * mapped read-only starting at the given address and every other page is
+ * RAM that shows the power-on fill pattern until it is written: reads come
+ * from a page of fill bytes shared by every instance. Registers are
+ * cleared.
+ *
+ * @param z80 instance
+ * @param rom ROM file, or NULL for an all-RAM address space
+ * @param base address of the ROM, multiple of MEM_PAGE_SIZE
+ * @param fill power-on value of RAM, 0x00 or 0xFF
+ * @return 0 on success, -1 if the arguments are not valid
+ */
+int
+z80_init(struct z80_t* z80, const struct z80_rom_file_t* rom, word base,
+        byte fill)
+{
+    int first = base >> MEM_PAGE_SHIFT, page;
+
+    if ((base & MEM_PAGE_MASK) || (rom && first + rom->pages > MEM_PAGES)
+            || (fill != 0x00 && fill != 0xFF)) {
+        return -1;
+    }
+
+    memset(z80, 0, sizeof(struct z80_t));
+    z80->rom = rom;
+    for (page = 0; page < MEM_PAGES; page++) {
+        if (rom && page >= first && page < first + rom->pages) {
+            bus_map(&z80->bus, page, 1,
+                    rom->data + ((page - first) << MEM_PAGE_SHIFT), NULL);
+        } else {
+            bus_map(&z80->bus, page, 1, fill ? ones_page : zero_page, NULL);
+            bus_handlers(&z80->bus, page, 1, NULL, ram_fault, z80);
+        }
+    }
+    cpu_init(&z80->cpu, &z80->bus);
+    return 0;
+}
+
+/**
+ * Creates an instance on the heap, see z80_init.
+ *
+ * @param rom ROM file, or NULL for an all-RAM address space
+ * @param base address of the ROM, multiple of MEM_PAGE_SIZE
+ * @param fill power-on value of RAM, 0x00 or 0xFF
+ * @return new instance, or NULL on error
+ */
+struct z80_t*
+z80_create(const struct z80_rom_file_t* rom, word base, byte fill)
+{
+    struct z80_t* z80 = malloc(sizeof(struct z80_t));
+    if (z80 && z80_init(z80, rom, base, fill) != 0) {
+        free(z80);
+        return NULL;
+    }
+    return z80;
+}
+
+/**
+ * Frees an instance and its RAM, giving it back to its pool if it came
+ * from one. The ROM file is not closed.
+ *
+ * @param z80 instance
+ */
+void
+z80_free(struct z80_t* z80)
+{
+    int page;
+    if (!z80) return;
+    z80_clear_baseline(z80);
+    for (page = 0; page < MEM_PAGES; page++) {
+        page_release(z80->ram[page]);
+    }
+    if (z80->pool) {
+        z80_pool_put(z80->pool, z80);
+    } else {
+        free(z80);
+    }
+}
+
+/**
+ * Forks an instance. The child starts with the same registers and shares
+ * every RAM page with the parent copy-on-write, so forking copies no guest
+ * memory at all: pages are copied one by one the first time either of the
+ * two writes to them. Parent and child can then run on different threads.
+ * Forks of pooled instances are taken from the same pool when possible.
+ *
+ * @param parent instance to fork, it must not be running
+ * @return new instance, or NULL on error
+ */
+struct z80_t*
+z80_fork(struct z80_t* parent)
+{
+    struct z80_pool_t* pool = parent->pool;
+    struct z80_t* child = pool ? z80_pool_slot(pool) : NULL;
+    int index;
+
+    if (!child) {
+        pool = NULL;
+        child = malloc(sizeof(struct z80_t));
+        if (!child) return NULL;
+    }
+    memcpy(child, parent, sizeof(struct z80_t));
+    child->pool = pool;
+    child->baseline = NULL;
+    bus_copy(&child->bus, &parent->bus);
+    child->cpu.bus = &child->bus;
+
+    for (index = 0; index < MEM_PAGES; index++) {
+        struct z80_page_t* page = parent->ram[index];
+        if (page) {
+            atomic_fetch_add(&page->refs, 1);
+            bus_map(&parent->bus, index, 1, page->data, NULL);
+            bus_map(&child->bus, index, 1, page->data, NULL);
+        }
+        if (child->bus.page[index].on_write == ram_fault) {
+            child->bus.page[index].ctx = child;
+        }
+    }
+    return child;
+}
+
+/**
+ * Gets the memory statistics of an instance. The resident size counts the
+ * instance structure and its RAM pages, each page divided by the number of
+ * instances that share it, but not the ROM file, which is shared by every
+ * instance that maps it.
+ *
+ * @param z80 instance
+ * @param stats statistics to fill
+ */
+void
+z80_stats(const struct z80_t* z80, struct z80_stats_t* stats)
+{
+    int page;
+    memset(stats, 0, sizeof(struct z80_stats_t));
+    stats->resident = sizeof(struct z80_t);
+    stats->rom_pages = z80->rom ? z80->rom->pages : 0;
+    for (page = 0; page < MEM_PAGES; page++) {
+        if (z80->ram[page]) {
+            int refs = atomic_load(&z80->ram[page]->refs);
+            stats->ram_pages++;
+            stats->shared_pages += refs > 1;
+            stats->resident += MEM_PAGE_SIZE / refs;
+        }
+    }
+}
+
+/**
+ * Saves the current state of an instance as its baseline, replacing the
+ * previous one. RAM pages are shared with the baseline copy-on-write, and
+ * from now on every write to memory is tracked with 64 byte granularity,
+ * so that z80_reset_to_baseline only has to restore the lines that were
+ * written. Writable host memory the instance does not own, such as NVRAM
+ * or pages mapped from a file, is copied.
+ *
+ * @param z80 instance
+ * @return 0 on success, -1 if there is no memory left
+ */
+int
+z80_set_baseline(struct z80_t* z80)
+{
+    struct z80_baseline_t* baseline;
+    int index;
+
+    z80_clear_baseline(z80);
+    baseline = malloc(sizeof(struct z80_baseline_t));
+    if (!baseline) return -1;
+
+    memcpy(&baseline->cpu, &z80->cpu, sizeof(struct cpu_t));
+    for (index = 0; index < MEM_PAGES; index++) {
+        byte* mapped = z80->bus.page[index].mapped;
+        baseline->copy[index] = NULL;
+        if (!z80->ram[index] && mapped) {
+            baseline->copy[index] = malloc(MEM_PAGE_SIZE);
+            if (!baseline->copy[index]) {
+                while (index--) free(baseline->copy[index]);
+                free(baseline);
+                return -1;
+            }
+            memcpy(baseline->copy[index], mapped, MEM_PAGE_SIZE);
+        }
+    }
+    for (index = 0; index < MEM_PAGES; index++) {
+        struct z80_page_t* page = z80->ram[index];
+        baseline->ram[index] = page;
+        baseline->read[index] = z80->bus.page[index].source;
+        if (page) {
+            atomic_fetch_add(&page->refs, 1);
+            bus_map(&z80->bus, index, 1, page->data, NULL);
+        }
+    }
+    bus_dirty_attach(&z80->bus, &baseline->dirty, 1);
+    z80->baseline = baseline;
+    return 0;
+}
+
+/**
+ * Brings an instance back to its baseline: registers are restored and so
+ * are the 64 byte lines of memory written since the baseline was set, or
+ * since the last reset. Pages that are shared with a fork are swapped
+ * back to the baseline page instead. Pages the instance does not own are
+ * restored from their copy while the same host memory is still mapped,
+ * and the other dirty trackers of the bus are told about them.
+ *
+ * @param z80 instance, it must have a baseline
+ */
+void
+z80_reset_to_baseline(struct z80_t* z80)
+{
+    struct z80_baseline_t* baseline = z80->baseline;
+    unsigned pages = bus_dirty_fetch_pages(&baseline->dirty);
+
+    memcpy(&z80->cpu, &baseline->cpu, sizeof(struct cpu_t));
+    while (pages) {
+        int index = __builtin_ctz(pages);
+        uint64_t lines = bus_dirty_fetch_lines(&baseline->dirty, index);
+        struct z80_page_t* page = z80->ram[index];
+        struct z80_page_t* saved = baseline->ram[index];
+        byte* mapped = z80->bus.page[index].mapped;
+        pages &= pages - 1;
+
+        if (!page && !saved) {
+            if (!baseline->copy[index] || !mapped
+                    || z80->bus.page[index].source != baseline->read[index]) {
+                continue;
+            }
+            while (lines) {
+                size_t offset = (size_t) __builtin_ctzll(lines)
+                    << MEM_LINE_SHIFT;
+                memcpy(mapped + offset, baseline->copy[index] + offset,
+                        1 << MEM_LINE_SHIFT);
+                bus_dirty_mark_host(&z80->bus, mapped + offset,
+                        1 << MEM_LINE_SHIFT);
+                lines &= lines - 1;
+            }
+            // Not a write of the guest: forget it in the baseline tracker.
+            bus_dirty_fetch_lines(&baseline->dirty, index);
+            continue;
+        }
+        if (page == saved) {
+            continue;
+        }
+        if (atomic_load(&page->refs) > 1) {
+            // Can not be written in place: go back to the saved page.
+            if (saved) atomic_fetch_add(&saved->refs, 1);
+            page_release(page);
+            z80->ram[index] = saved;
+            bus_map(&z80->bus, index, 1, baseline->read[index], NULL);
+            continue;
+        }
+        while (lines) {
+            size_t offset = (size_t) __builtin_ctzll(lines) << MEM_LINE_SHIFT;
+            memcpy(page->data + offset, baseline->read[index] + offset,
+                    1 << MEM_LINE_SHIFT);
+            lines &= lines - 1;
+        }
+        bus_hash_refresh(&z80->bus, index, 1);
+    }
+    bus_dirty_fetch_pages(&baseline->dirty);
+}
+
+/**
+ * Drops the baseline of an instance and stops tracking its writes.
+ *
+ * @param z80 instance
+ */
+void
+z80_clear_baseline(struct z80_t* z80)
+{
+    struct z80_baseline_t* baseline = z80->baseline;
+    int index;
+
+    if (!baseline) return;
+    bus_dirty_detach(&z80->bus, &baseline->dirty);
+    for (index = 0; index < MEM_PAGES; index++) {
+        page_release(baseline->ram[index]);
+        free(baseline->copy[index]);
+    }
+    free(baseline);
+    z80->baseline = NULL;
+}
@@ -0,0 +1,48 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+/*
+ * aot_rom: writes the ROM of the AOT test to the given file, so that the
+ * build can translate it with zeta80-aot.
+ */
+
+#include <stdio.h>
+
+#include "aot_rom.h"
+
+int
+main(int argc, char** argv)
+{
+    static byte rom[0x1000];
+    FILE* file;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s rom.bin\n", argv[0]);
+        return 1;
+    }
+    aot_rom_build(rom, sizeof(rom));
+    file = fopen(argv[1], "wb");
+    if (!file || fwrite(rom, 1, sizeof(rom), file) != sizeof(rom)) {
+        perror(argv[1]);
+        return 1;
+    }
+    return fclose(file) != 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef AOT_ROM_H_
+#define AOT_ROM_H_
+
+#include <stddef.h>         // size_t
+
+#include <types.h>
+
+#define AOT_ROM_START 0x0070    // Past the RST and NMI vectors
+
+word aot_rom_build(byte* rom, size_t size);
+
+#endif // AOT_ROM_H_
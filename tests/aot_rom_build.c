@@ -0,0 +1,68 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <string.h>         // memset
+
+#include <decode.h>
+
+#include "aot_rom.h"
+
+/*
+ * ROM for the AOT test: every opcode zeta80-aot translates, in order, with
+ * 16 bit operands pointing to RAM and relative jumps to the next
+ * instruction. The opcodes are there twice: first each one followed by a
+ * JR to the next instruction, so that every instruction is a block of its
+ * own and its result is checked before the next one overwrites it, then
+ * all in a row, as long blocks. A RET that is left untranslated marks the
+ * end. The ROM is built here instead of being stored, and linked into both
+ * the tool that writes it for zeta80-aot and the test that runs it through
+ * the interpreter. Returns the address of the RET.
+ */
+word
+aot_rom_build(byte* rom, size_t size)
+{
+    struct insn_t insn;
+    size_t pc = AOT_ROM_START;
+    int pass, op;
+
+    memset(rom, 0, size);
+    rom[0] = 0x18;                                  // JR AOT_ROM_START
+    rom[1] = AOT_ROM_START - 2;
+    for (pass = 0; pass < 2; pass++) {
+        for (op = 0; op < 0xC0; op++) {
+            rom[pc] = op;
+            rom[pc + 1] = op ^ 0x5A;
+            rom[pc + 2] = 0x80 + (op & 0x3F);
+            decode_insn(&rom[pc], 3, pc, &insn);
+            if (insn.flow == FLOW_JUMP) {
+                rom[pc + 1] = 0;
+            }
+            memset(&rom[pc + insn.length], 0, 3 - insn.length);
+            pc += insn.length;
+            if (pass == 0 && insn.flow == FLOW_NEXT) {
+                rom[pc++] = 0x18;                   // JR $+2
+                rom[pc++] = 0x00;
+            }
+        }
+    }
+    rom[pc] = 0xC9;                                 // RET
+    return pc;
+}
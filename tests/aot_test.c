@@ -0,0 +1,124 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <stdio.h>
+
+#include <bus.h>
+#include <cpu.h>
+#include <diff.h>
+#include <opcodes.h>
+
+#include "aot_rom.h"
+#include "aot_test.h"
+#include "machine.h"
+
+// Generated by zeta80-aot from the ROM of aot_rom_build.c at build time.
+int aot_test_rom_step(struct cpu_t* cpu);
+
+static byte rom[MEM_PAGE_SIZE];
+static word rom_end;
+
+static struct machine_t translated, interpreted;
+
+static void
+load(struct machine_t* m, int seed)
+{
+    int i;
+    machine_init(m, NULL, 0);
+    for (i = 0; i < 0x10000; i++) {
+        m->ram[i] = i * 7 + (i >> 8) + seed;
+    }
+    bus_map(&m->bus, 0, 1, rom, NULL);
+    // Every 8 bit register starts at a different value for each seed.
+    REG_AF(m->cpu) = seed << 8 | (byte) (seed * 0x35);
+    REG_BC(m->cpu) = (seed + 1) << 8 | (byte) (seed - 1);
+    REG_DE(m->cpu) = (seed + 0x7F) << 8 | (byte) (seed + 0x80);
+    REG_HL(m->cpu) = 0x8000 | seed << 4 | (seed & 0xF);
+    SP(m->cpu) = 0xF000;
+}
+
+static void
+setup_aot(void)
+{
+    rom_end = aot_rom_build(rom, sizeof(rom));
+}
+
+/*
+ * Runs the ROM twice from a seed, block by block, and checks that the
+ * interpreter ends every block in the same state.
+ */
+static void
+check_seed(int seed)
+{
+    struct z80_diff_t diff;
+    long blocks = 0, calls = 0;
+    int loops = 0;
+
+    load(&translated, seed);
+    load(&interpreted, seed);
+    while (loops < 2) {
+        int steps = 0;
+        blocks += aot_test_rom_step(&translated.cpu);
+        calls++;
+        // The interpreter catches up to the end of the block.
+        while ((interpreted.cpu.tstates < translated.cpu.tstates
+                    || PC(interpreted.cpu) != PC(translated.cpu))
+                && steps++ < 1000) {
+            execute_opcode(&interpreted.cpu);
+        }
+        if (z80_state_diff(&translated.cpu, &interpreted.cpu, &diff)) {
+            fprintf(stderr, "AOT block ending at %04X differs, seed %d:\n",
+                    PC(translated.cpu), seed);
+            z80_diff_print(stderr, &diff, &translated.cpu,
+                    &interpreted.cpu);
+            ck_abort_msg("translated code differs from the interpreter");
+        }
+        if (PC(translated.cpu) == rom_end) {
+            PC(translated.cpu) = AOT_ROM_START;
+            PC(interpreted.cpu) = AOT_ROM_START;
+            loops++;
+        }
+    }
+    // Every instruction of the ROM is in a block.
+    ck_assert_int_eq(calls, blocks);
+}
+
+START_TEST(test_aot_blocks)
+{
+    int seed;
+    for (seed = 0; seed < 256; seed++) {
+        check_seed(seed);
+    }
+}
+END_TEST
+
+Suite*
+gensuite_aot(void)
+{
+    TCase* tc_aot = tcase_create("AOT");
+    tcase_add_checked_fixture(tc_aot, setup_aot, NULL);
+    tcase_add_test(tc_aot, test_aot_blocks);
+
+    Suite* s = suite_create("AOT");
+    suite_add_tcase(s, tc_aot);
+    return s;
+}
@@ -0,0 +1,241 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <stddef.h>         // offsetof
+#include <string.h>         // memcmp, memcpy, memset
+
+#include <batch.h>
+#include <bus.h>
+#include <cpu.h>
+#include <opcodes.h>
+
+#include "batch_test.h"
+
+#define LANES 40
+
+static byte lane_ram[LANES][0x10000], scalar_ram[LANES][0x10000];
+static struct bus_t lane_bus[LANES], scalar_bus[LANES];
+static unsigned seed;
+
+static byte
+next_random(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+static void
+random_cpu(struct cpu_t* cpu, struct bus_t* bus)
+{
+    byte* bytes = (byte*) cpu;
+    size_t i;
+    memset(cpu, 0, sizeof(struct cpu_t));
+    for (i = 0; i < offsetof(struct cpu_t, tstates); i++) {
+        bytes[i] = next_random();
+    }
+    cpu->im = next_random() % 3;
+    cpu->tstates = next_random();
+    cpu->bus = bus;
+}
+
+// Checks a lane against the machine that ran the same code by itself.
+static void
+assert_lane(const struct z80_batch_t* batch, int lane,
+        const struct cpu_t* expected)
+{
+    struct cpu_t cpu;
+    z80_batch_store(batch, lane, &cpu);
+    cpu.bus = expected->bus;
+    ck_assert_int_eq(0, memcmp(&cpu, expected, sizeof(struct cpu_t)));
+}
+
+START_TEST(test_batch_every_opcode)
+{
+    struct z80_batch_t* batch = z80_batch_create(LANES);
+    struct cpu_t cpu[LANES];
+    int round, i;
+
+    ck_assert_ptr_ne(NULL, batch);
+    seed = 1;
+    for (i = 0; i < LANES; i++) {
+        int j;
+        for (j = 0; j < 0x10000; j++) {
+            lane_ram[i][j] = scalar_ram[i][j] = next_random();
+        }
+        bus_init(&lane_bus[i], lane_ram[i]);
+        bus_init(&scalar_bus[i], scalar_ram[i]);
+    }
+
+    // Every lane runs every opcode, next to lanes running other ones.
+    for (round = 0; round < 256; round++) {
+        for (i = 0; i < LANES; i++) {
+            byte opcode = round + i * 7;
+            random_cpu(&cpu[i], &scalar_bus[i]);
+            lane_ram[i][PC(cpu[i])] = scalar_ram[i][PC(cpu[i])] = opcode;
+            cpu[i].bus = &lane_bus[i];
+            z80_batch_load(batch, i, &cpu[i]);
+            cpu[i].bus = &scalar_bus[i];
+            execute_opcode(&cpu[i]);
+        }
+        ck_assert_int_eq(LANES, z80_batch_step(batch));
+        for (i = 0; i < LANES; i++) {
+            assert_lane(batch, i, &cpu[i]);
+            ck_assert_int_eq(0, memcmp(lane_ram[i], scalar_ram[i], 0x10000));
+        }
+    }
+    ck_assert_uint_gt(batch->vector_ops, 0);
+    ck_assert_uint_gt(batch->scalar_ops, 0);
+    ck_assert_uint_eq(256 * LANES, batch->vector_ops + batch->scalar_ops);
+    z80_batch_free(batch);
+}
+END_TEST
+
+START_TEST(test_batch_alu_exhaustive)
+{
+    // Every value of A against every operand value and carry.
+    struct z80_batch_t* batch = z80_batch_create(512);
+    static struct cpu_t cpu[512];
+    int opcode, a, i;
+
+    ck_assert_ptr_ne(NULL, batch);
+    memset(lane_ram[0], 0, 0x10000);
+    bus_init(&lane_bus[0], lane_ram[0]);
+    seed = 2;
+    for (opcode = 0; opcode < 256; opcode++) {
+        unsigned long vector_ops = batch->vector_ops;
+        lane_ram[0][0x4000] = opcode;
+        lane_ram[0][0x4001] = 0x85;
+        lane_ram[0][0x4002] = 0x3C;
+        for (a = 0; a < 256; a++) {
+            for (i = 0; i < 512; i++) {
+                random_cpu(&cpu[i], &lane_bus[0]);
+                PC(cpu[i]) = 0x4000;
+                REG_A(cpu[i]) = a;
+                REG_F(cpu[i]) = (REG_F(cpu[i]) & ~FLAG_C) | (i >> 8);
+                REG_B(cpu[i]) = REG_C(cpu[i]) = REG_D(cpu[i]) = i;
+                REG_E(cpu[i]) = REG_H(cpu[i]) = REG_L(cpu[i]) = i;
+                z80_batch_load(batch, i, &cpu[i]);
+            }
+            z80_batch_step(batch);
+            // Opcodes without a kernel are covered by the test above.
+            if (batch->vector_ops == vector_ops) break;
+            for (i = 0; i < 512; i++) {
+                execute_opcode(&cpu[i]);
+                assert_lane(batch, i, &cpu[i]);
+            }
+        }
+    }
+    z80_batch_free(batch);
+}
+END_TEST
+
+/*
+ * Counts the bits of A into L. Lanes take the JR NC branch at different
+ * times, so they split and meet again on every iteration.
+ *
+ *     LD B, 8
+ * loop:
+ *     ADD A, A
+ *     JR NC, skip
+ *     INC L
+ * skip:
+ *     DJNZ loop
+ *     HALT
+ */
+static const byte popcount_code[] = {
+    0x06, 0x08, 0x87, 0x30, 0x01, 0x2C, 0x10, 0xFA, 0x76
+};
+
+START_TEST(test_batch_diverge)
+{
+    struct z80_batch_t* batch = z80_batch_create(256);
+    struct cpu_t cpu;
+    int i;
+
+    ck_assert_ptr_ne(NULL, batch);
+    memset(lane_ram[0], 0, 0x10000);
+    memcpy(lane_ram[0], popcount_code, sizeof(popcount_code));
+    bus_init(&lane_bus[0], lane_ram[0]);
+    for (i = 0; i < 256; i++) {
+        memset(&cpu, 0, sizeof(cpu));
+        cpu_init(&cpu, &lane_bus[0]);
+        REG_A(cpu) = i;
+        z80_batch_load(batch, i, &cpu);
+    }
+
+    ck_assert_int_eq(33, z80_batch_run(batch, 0x0008, 1000));
+    ck_assert_uint_eq(0, batch->scalar_ops);
+    for (i = 0; i < 256; i++) {
+        struct cpu_t expected;
+        memset(&expected, 0, sizeof(expected));
+        cpu_init(&expected, &lane_bus[0]);
+        REG_A(expected) = i;
+        while (PC(expected) != 0x0008) {
+            execute_opcode(&expected);
+        }
+        assert_lane(batch, i, &expected);
+        ck_assert_uint_eq(__builtin_popcount(i), REG_L(expected));
+        ck_assert_uint_eq(0, batch->active[i]);
+    }
+    z80_batch_free(batch);
+}
+END_TEST
+
+START_TEST(test_batch_run_limit)
+{
+    struct z80_batch_t* batch = z80_batch_create(3);
+    struct cpu_t cpu;
+
+    ck_assert_ptr_ne(NULL, batch);
+    memset(lane_ram[0], 0, 0x10000);
+    memcpy(lane_ram[0], popcount_code, sizeof(popcount_code));
+    bus_init(&lane_bus[0], lane_ram[0]);
+    memset(&cpu, 0, sizeof(cpu));
+    cpu_init(&cpu, &lane_bus[0]);
+    z80_batch_load(batch, 1, &cpu);
+
+    // Lanes that were never loaded do not run.
+    ck_assert_int_eq(5, z80_batch_run(batch, 0x0008, 5));
+    ck_assert_uint_eq(5, batch->vector_ops);
+    ck_assert_uint_eq(0xFF, batch->active[1]);
+    z80_batch_free(batch);
+
+    batch = z80_batch_create(1);
+    ck_assert_ptr_ne(NULL, batch);
+    ck_assert_int_eq(0, z80_batch_step(batch));
+    z80_batch_free(batch);
+}
+END_TEST
+
+Suite*
+gensuite_batch(void)
+{
+    TCase* tc_batch = tcase_create("Batch");
+    tcase_add_test(tc_batch, test_batch_every_opcode);
+    tcase_add_test(tc_batch, test_batch_alu_exhaustive);
+    tcase_add_test(tc_batch, test_batch_diverge);
+    tcase_add_test(tc_batch, test_batch_run_limit);
+
+    Suite* s = suite_create("Batch");
+    suite_add_tcase(s, tc_batch);
+    return s;
+}
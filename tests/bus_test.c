@@ -0,0 +1,634 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <stdlib.h>         // mkstemp
+#include <string.h>         // memset
+#include <unistd.h>         // ftruncate, pread, unlink
+#include <sys/mman.h>       // mmap, munmap
+
+#include <bus.h>
+#include <cpu.h>
+#include <opcodes.h>
+
+#include "bus_test.h"
+
+static struct bus_t bus;
+static byte ram[0x10000];
+static byte banks[4][0x4000];
+
+// Memory mapped port: reads return the last value written plus one.
+static byte port;
+static word port_addr;
+
+static byte
+port_read(void* ctx, word addr)
+{
+    port_addr = addr;
+    return *(byte*) ctx + 1;
+}
+
+static void
+port_write(void* ctx, word addr, byte value)
+{
+    port_addr = addr;
+    *(byte*) ctx = value;
+}
+
+static void
+setup_bus(void)
+{
+    int i;
+    memset(ram, 0, sizeof(ram));
+    for (i = 0; i < 4; i++) {
+        memset(banks[i], 0x10 * i, sizeof(banks[i]));
+    }
+    bus_init(&bus, ram);
+    port = 0;
+    port_addr = 0;
+}
+
+START_TEST(test_bus_ram)
+{
+    bus_write(&bus, 0x1234, 0x56);
+    ck_assert_uint_eq(0x56, ram[0x1234]);
+    ck_assert_uint_eq(0x56, bus_read(&bus, 0x1234));
+}
+END_TEST
+
+START_TEST(test_bus_rom)
+{
+    ram[0x0100] = 0xAA;
+    bus_map(&bus, 0, 4, ram, NULL);
+    bus_write(&bus, 0x0100, 0x55);
+    ck_assert_uint_eq(0xAA, ram[0x0100]);
+    ck_assert_uint_eq(0xAA, bus_read(&bus, 0x0100));
+
+    // Pages above the ROM are still RAM.
+    bus_write(&bus, 0x4000, 0x55);
+    ck_assert_uint_eq(0x55, ram[0x4000]);
+}
+END_TEST
+
+START_TEST(test_bus_unmapped)
+{
+    bus_map(&bus, 8, 1, NULL, NULL);
+    bus_write(&bus, 0x8000, 0x12);
+    ck_assert_uint_eq(0xFF, bus_read(&bus, 0x8000));
+    ck_assert_uint_eq(0x00, ram[0x8000]);
+}
+END_TEST
+
+START_TEST(test_bus_bank_switch)
+{
+    bus_map(&bus, 12, 4, banks[1], banks[1]);
+    ck_assert_uint_eq(0x10, bus_read(&bus, 0xC000));
+    bus_write(&bus, 0xFFFF, 0x99);
+    ck_assert_uint_eq(0x99, banks[1][0x3FFF]);
+
+    bus_map(&bus, 12, 4, banks[3], banks[3]);
+    ck_assert_uint_eq(0x30, bus_read(&bus, 0xC000));
+    ck_assert_uint_eq(0x30, bus_read(&bus, 0xFFFF));
+}
+END_TEST
+
+START_TEST(test_bus_mmio)
+{
+    bus_map(&bus, 15, 1, NULL, NULL);
+    bus_handlers(&bus, 15, 1, port_read, port_write, &port);
+    bus_write(&bus, 0xF010, 0x41);
+    ck_assert_uint_eq(0x41, port);
+    ck_assert_uint_eq(0xF010, port_addr);
+    ck_assert_uint_eq(0x42, bus_read(&bus, 0xF020));
+    ck_assert_uint_eq(0xF020, port_addr);
+}
+END_TEST
+
+START_TEST(test_bus_rom_write_handler)
+{
+    // ROM whose writes go to a mapper register, as in MSX cartridges.
+    bus_map(&bus, 4, 4, banks[2], NULL);
+    bus_handlers(&bus, 4, 4, port_read, port_write, &port);
+    bus_write(&bus, 0x5000, 0x03);
+    ck_assert_uint_eq(0x03, port);
+    ck_assert_uint_eq(0x20, bus_read(&bus, 0x5000));
+}
+END_TEST
+
+START_TEST(test_bus_load_dump)
+{
+    static const byte data[] = { 1, 2, 3, 4 };
+    byte back[4];
+    bus_load(&bus, 0xFFFE, data, sizeof(data));
+    ck_assert_uint_eq(1, ram[0xFFFE]);
+    ck_assert_uint_eq(4, ram[0x0001]);
+    bus_dump(&bus, 0xFFFE, back, sizeof(back));
+    ck_assert_int_eq(0, memcmp(data, back, sizeof(data)));
+}
+END_TEST
+
+START_TEST(test_bus_cpu)
+{
+    static struct cpu_t cpu;
+    memset(&cpu, 0, sizeof(cpu));
+    cpu_init(&cpu, &bus);
+
+    // LD (HL), A into a bank mapped at 0xC000.
+    bus_map(&bus, 12, 4, banks[0], banks[0]);
+    ram[0x0000] = 0x77;
+    REG_HL(cpu) = 0xC123;
+    REG_A(cpu) = 0x5A;
+    execute_opcode(&cpu);
+    ck_assert_uint_eq(0x5A, banks[0][0x0123]);
+    ck_assert_uint_eq(0x00, ram[0xC123]);
+}
+END_TEST
+
+START_TEST(test_bus_map_fd)
+{
+    char path[] = "/tmp/zeta80-bus-XXXXXX";
+    int fd = mkstemp(path);
+    byte* host;
+    byte* view;
+    byte value = 0;
+
+    ck_assert_int_ne(-1, fd);
+    unlink(path);
+    ck_assert_int_eq(0, ftruncate(fd, 0x10000));
+
+    host = bus_map_fd(&bus, 0, MEM_PAGES, fd, 0);
+    ck_assert_ptr_ne(NULL, host);
+    view = mmap(NULL, 0x10000, PROT_READ, MAP_SHARED, fd, 0);
+    ck_assert_ptr_ne(MAP_FAILED, view);
+
+    // Writes are seen by other mappings of the object without copies.
+    bus_write(&bus, 0x8000, 0x42);
+    ck_assert_uint_eq(0x42, view[0x8000]);
+    ck_assert_int_eq(1, pread(fd, &value, 1, 0x8000));
+    ck_assert_uint_eq(0x42, value);
+
+    bus_unmap_fd(&bus, host, 0, MEM_PAGES);
+    ck_assert_uint_eq(0xFF, bus_read(&bus, 0x8000));
+    munmap(view, 0x10000);
+    close(fd);
+}
+END_TEST
+
+START_TEST(test_dirty_untracked)
+{
+    ck_assert_ptr_eq(ram, bus.page[0].write);
+    ck_assert_ptr_eq(NULL, bus.dirty);
+}
+END_TEST
+
+START_TEST(test_dirty_pages)
+{
+    static struct bus_dirty_t dirty;
+    bus_dirty_attach(&bus, &dirty, 0);
+    ck_assert_uint_eq(0, bus_dirty_fetch_pages(&dirty));
+
+    bus_write(&bus, 0x1234, 0x56);
+    bus_write(&bus, 0x1235, 0x57);
+    bus_write(&bus, 0xF000, 0x01);
+    ck_assert_uint_eq(0x56, ram[0x1234]);
+    ck_assert_uint_eq(0x8002, bus_dirty_fetch_pages(&dirty));
+    ck_assert_uint_eq(0, bus_dirty_fetch_pages(&dirty));
+
+    // Reads do not dirty memory, and neither do writes to ROM.
+    bus_map(&bus, 2, 1, ram + 0x2000, NULL);
+    bus_read(&bus, 0x3000);
+    bus_write(&bus, 0x2000, 0x01);
+    ck_assert_uint_eq(0, bus_dirty_fetch_pages(&dirty));
+    ck_assert_uint_eq(0x00, ram[0x2000]);
+
+    bus_dirty_detach(&bus, &dirty);
+    ck_assert_ptr_eq(ram + 0x1000, bus.page[1].write);
+}
+END_TEST
+
+START_TEST(test_dirty_lines)
+{
+    static struct bus_dirty_t dirty;
+    bus_dirty_attach(&bus, &dirty, 1);
+
+    bus_write(&bus, 0x4000, 0x01);
+    bus_write(&bus, 0x403F, 0x01);
+    bus_write(&bus, 0x4FC0, 0x01);
+    ck_assert_uint_eq(0x0010, bus_dirty_fetch_pages(&dirty));
+    ck_assert(0x8000000000000001ULL == bus_dirty_fetch_lines(&dirty, 4));
+    ck_assert(0 == bus_dirty_fetch_lines(&dirty, 4));
+    bus_dirty_detach(&bus, &dirty);
+}
+END_TEST
+
+START_TEST(test_dirty_clients)
+{
+    static struct bus_dirty_t screen, snapshot;
+    bus_dirty_attach(&bus, &screen, 1);
+    bus_dirty_attach(&bus, &snapshot, 0);
+
+    bus_write(&bus, 0x4000, 0x01);
+    ck_assert_uint_eq(0x0010, bus_dirty_fetch_pages(&screen));
+    bus_write(&bus, 0x5000, 0x01);
+
+    // Every client keeps its own bits.
+    ck_assert_uint_eq(0x0030, bus_dirty_fetch_pages(&snapshot));
+    ck_assert_uint_eq(0x0020, bus_dirty_fetch_pages(&screen));
+
+    bus_dirty_detach(&bus, &screen);
+    bus_write(&bus, 0x6000, 0x01);
+    ck_assert_uint_eq(0, bus_dirty_fetch_pages(&screen));
+    ck_assert_uint_eq(0x0040, bus_dirty_fetch_pages(&snapshot));
+    bus_dirty_detach(&bus, &snapshot);
+}
+END_TEST
+
+START_TEST(test_dirty_remap)
+{
+    static struct bus_dirty_t dirty;
+    bus_dirty_attach(&bus, &dirty, 0);
+
+    // Banks mapped while tracking are tracked too.
+    bus_map(&bus, 12, 4, banks[1], banks[1]);
+    ck_assert_ptr_eq(NULL, bus.page[12].write);
+    bus_write(&bus, 0xC000, 0x77);
+    ck_assert_uint_eq(0x77, banks[1][0]);
+    ck_assert_uint_eq(0x1000, bus_dirty_fetch_pages(&dirty));
+    bus_dirty_detach(&bus, &dirty);
+}
+END_TEST
+
+START_TEST(test_dirty_mark_host)
+{
+    static struct bus_dirty_t dirty;
+    bus_dirty_attach(&bus, &dirty, 1);
+
+    bus_dirty_mark_host(&bus, ram + 0x1FC0, 0x80);
+    ck_assert_uint_eq(0x0006, bus_dirty_fetch_pages(&dirty));
+    ck_assert(0x8000000000000000ULL == bus_dirty_fetch_lines(&dirty, 1));
+    ck_assert(0x0000000000000001ULL == bus_dirty_fetch_lines(&dirty, 2));
+
+    bus_dirty_mark_host(&bus, ram + 0x3000, MEM_PAGE_SIZE);
+    ck_assert(~0ULL == bus_dirty_fetch_lines(&dirty, 3));
+    ck_assert_uint_eq(0x0008, bus_dirty_fetch_pages(&dirty));
+
+    // Host memory that is not mapped anywhere.
+    bus_dirty_mark_host(&bus, banks[0], 16);
+    ck_assert_uint_eq(0, bus_dirty_fetch_pages(&dirty));
+    bus_dirty_detach(&bus, &dirty);
+}
+END_TEST
+
+// 48K Spectrum timings, see bus_contention_ula.
+#define ULA_FRAME 69888
+#define ULA_FIRST 14335
+
+static byte ula[ULA_FRAME];
+static byte slow[ULA_FRAME];
+static struct bus_contention_t contention;
+static int frame_clock;
+
+static void
+setup_contention(void)
+{
+    setup_bus();
+    bus_contention_ula(ula, ULA_FRAME, ULA_FIRST, 224);
+    memset(slow, 1, sizeof(slow));
+    memset(&contention, 0, sizeof(contention));
+    contention.clock = &frame_clock;
+    contention.frame = ULA_FRAME;
+    contention.delay[1] = ula;
+    contention.delay[2] = slow;
+    frame_clock = 0;
+}
+
+START_TEST(test_contention_ula_table)
+{
+    ck_assert_uint_eq(0, ula[ULA_FIRST - 1]);
+    ck_assert_uint_eq(6, ula[ULA_FIRST]);
+    ck_assert_uint_eq(1, ula[ULA_FIRST + 5]);
+    ck_assert_uint_eq(0, ula[ULA_FIRST + 7]);
+    ck_assert_uint_eq(6, ula[ULA_FIRST + 8]);
+    ck_assert_uint_eq(0, ula[ULA_FIRST + 128]);
+    ck_assert_uint_eq(6, ula[ULA_FIRST + 224]);
+    ck_assert_uint_eq(0, ula[ULA_FIRST + 192 * 224]);
+}
+END_TEST
+
+START_TEST(test_contention_fast_path)
+{
+    bus_contend(&bus, 4, 4, 1);
+    ck_assert_ptr_eq(ram + 0x4000, bus.page[4].read);
+
+    // Only contended pages lose their pointers.
+    bus_contention_attach(&bus, &contention);
+    ck_assert_ptr_eq(NULL, bus.page[4].read);
+    ck_assert_ptr_eq(NULL, bus.page[7].write);
+    ck_assert_ptr_eq(ram, bus.page[0].read);
+    ck_assert_ptr_eq(ram + 0x8000, bus.page[8].write);
+
+    bus_contention_detach(&bus);
+    ck_assert_ptr_eq(ram + 0x4000, bus.page[4].read);
+    ck_assert_ptr_eq(ram + 0x7000, bus.page[7].write);
+}
+END_TEST
+
+START_TEST(test_contention_delay)
+{
+    bus_contend(&bus, 4, 4, 1);
+    bus_contention_attach(&bus, &contention);
+    ram[0x4000] = 0x12;
+
+    frame_clock = ULA_FIRST;
+    ck_assert_uint_eq(0x12, bus_read(&bus, 0x4000));
+    ck_assert_int_eq(ULA_FIRST + 6, frame_clock);
+    bus_write(&bus, 0x5000, 0x34);
+    ck_assert_int_eq(ULA_FIRST + 6, frame_clock);
+    ck_assert_uint_eq(0x34, ram[0x5000]);
+
+    // Outside of the screen, and in uncontended pages, there is no delay.
+    frame_clock = ULA_FIRST + 1;
+    bus_read(&bus, 0x8000);
+    ck_assert_int_eq(ULA_FIRST + 1, frame_clock);
+    frame_clock = 100;
+    bus_write(&bus, 0x4000, 0x56);
+    ck_assert_int_eq(100, frame_clock);
+    ck_assert_uint_eq(0x56, ram[0x4000]);
+
+    // Positions wrap around the frame.
+    frame_clock = ULA_FRAME + ULA_FIRST + 1;
+    bus_read(&bus, 0x4000);
+    ck_assert_int_eq(ULA_FRAME + ULA_FIRST + 6, frame_clock);
+}
+END_TEST
+
+START_TEST(test_contention_wait_states)
+{
+    // Slow ROM: one wait state per access, and writes are still dropped.
+    bus_map(&bus, 0, 4, banks[1], NULL);
+    bus_contend(&bus, 0, 4, 2);
+    bus_contention_attach(&bus, &contention);
+    frame_clock = 1000;
+    ck_assert_uint_eq(0x10, bus_read(&bus, 0x0000));
+    bus_write(&bus, 0x0000, 0xAA);
+    ck_assert_int_eq(1002, frame_clock);
+    ck_assert_uint_eq(0x10, bus_read(&bus, 0x0000));
+}
+END_TEST
+
+START_TEST(test_contention_cpu)
+{
+    static struct cpu_t cpu;
+    memset(&cpu, 0, sizeof(cpu));
+    cpu_init(&cpu, &bus);
+    contention.clock = &cpu.tstates;
+    bus_contend(&bus, 4, 4, 1);
+    bus_contention_attach(&bus, &contention);
+
+    // LD (HL), A: 7 T-states plus the wait states of the write, which
+    // comes after the 4 of the opcode fetch.
+    ram[0x0000] = 0x77;
+    REG_HL(cpu) = 0x4000;
+    REG_A(cpu) = 0x5A;
+    cpu.tstates = ULA_FIRST - 4;
+    execute_opcode(&cpu);
+    ck_assert_uint_eq(0x5A, ram[0x4000]);
+    ck_assert_int_eq(ULA_FIRST - 4 + 6 + 7, cpu.tstates);
+
+    // LD A, (nn): the read is in the fourth M-cycle, at T-state 10.
+    ram[0x0001] = 0x3A;
+    ram[0x0002] = 0x00;
+    ram[0x0003] = 0x40;
+    cpu.tstates = ULA_FIRST - 10;
+    execute_opcode(&cpu);
+    ck_assert_uint_eq(0x5A, REG_A(cpu));
+    ck_assert_int_eq(ULA_FIRST - 10 + 6 + 13, cpu.tstates);
+
+    // INC (HL): read at T-state 4, delayed by 6, then written 4 T-states
+    // later, at ULA_FIRST + 10, which waits 4.
+    ram[0x0004] = 0x34;
+    cpu.tstates = ULA_FIRST - 4;
+    execute_opcode(&cpu);
+    ck_assert_uint_eq(0x5B, ram[0x4000]);
+    ck_assert_int_eq(ULA_FIRST - 4 + 6 + 4 + 11, cpu.tstates);
+}
+END_TEST
+
+START_TEST(test_contention_dirty)
+{
+    struct bus_dirty_t dirty;
+    bus_contend(&bus, 4, 4, 1);
+    bus_contention_attach(&bus, &contention);
+    bus_dirty_attach(&bus, &dirty, 0);
+    bus_write(&bus, 0x4000, 0x01);
+    bus_write(&bus, 0x8000, 0x02);
+    ck_assert_uint_eq(0x0110, bus_dirty_fetch_pages(&dirty));
+
+    // Detaching the tracker does not untrap contended pages.
+    bus_dirty_detach(&bus, &dirty);
+    ck_assert_ptr_eq(NULL, bus.page[4].write);
+    ck_assert_ptr_eq(ram + 0x8000, bus.page[8].write);
+}
+END_TEST
+
+START_TEST(test_contention_io)
+{
+    bus_contention_attach(&bus, &contention);
+    contention.io[0x40] = 1;
+    frame_clock = ULA_FIRST;
+    ck_assert_int_eq(6, bus_contend_io(&bus, 0x40FE));
+    ck_assert_int_eq(ULA_FIRST + 6, frame_clock);
+    ck_assert_int_eq(0, bus_contend_io(&bus, 0x00FE));
+    ck_assert_int_eq(ULA_FIRST + 6, frame_clock);
+
+    bus_contention_detach(&bus);
+    frame_clock = ULA_FIRST;
+    ck_assert_int_eq(0, bus_contend_io(&bus, 0x40FE));
+}
+END_TEST
+
+// Hash of the memory of the bus computed from scratch.
+static uint64_t
+fresh_hash(void)
+{
+    struct bus_t copy;
+    struct bus_hash_t hash;
+    bus_copy(&copy, &bus);
+    bus_hash_attach(&copy, &hash);
+    return bus_hash(&copy);
+}
+
+START_TEST(test_hash_incremental)
+{
+    struct bus_hash_t hash;
+    uint64_t empty;
+    int i;
+
+    ck_assert_uint_eq(0, bus_hash(&bus));
+    bus_hash_attach(&bus, &hash);
+    ck_assert_ptr_eq(NULL, bus.page[3].write);
+    empty = bus_hash(&bus);
+    ck_assert_uint_ne(0, empty);
+
+    for (i = 0; i < 1000; i++) {
+        bus_write(&bus, i * 61, i);
+    }
+    ck_assert_uint_ne(empty, bus_hash(&bus));
+    ck_assert_uint_eq(fresh_hash(), bus_hash(&bus));
+
+    // Same contents, same hash, whatever the order of the writes.
+    for (i = 999; i >= 0; i--) {
+        bus_write(&bus, i * 61, 0);
+    }
+    ck_assert_uint_eq(empty, bus_hash(&bus));
+
+    // Values and addresses both count.
+    bus_write(&bus, 0x1234, 0x01);
+    bus_write(&bus, 0x1235, 0x02);
+    empty = bus_hash(&bus);
+    bus_write(&bus, 0x1234, 0x02);
+    bus_write(&bus, 0x1235, 0x01);
+    ck_assert_uint_ne(empty, bus_hash(&bus));
+
+    bus_hash_detach(&bus);
+    ck_assert_ptr_eq(ram + 0x3000, bus.page[3].write);
+    ck_assert_uint_eq(0, bus_hash(&bus));
+}
+END_TEST
+
+START_TEST(test_hash_remap)
+{
+    struct bus_hash_t hash;
+    uint64_t before;
+
+    bus_map(&bus, 8, 4, banks[0], banks[0]);
+    bus_hash_attach(&bus, &hash);
+    bus_write(&bus, 0x8000, 0x11);
+    before = bus_hash(&bus);
+
+    // Bank switching changes what reads see.
+    bus_map(&bus, 8, 4, banks[1], banks[1]);
+    ck_assert_uint_ne(before, bus_hash(&bus));
+    ck_assert_uint_eq(fresh_hash(), bus_hash(&bus));
+    bus_map(&bus, 8, 4, banks[0], banks[0]);
+    ck_assert_uint_eq(before, bus_hash(&bus));
+
+    // Writes to ROM and to handlers leave it alone.
+    bus_map(&bus, 0, 1, ram, NULL);
+    before = bus_hash(&bus);
+    bus_write(&bus, 0x0000, 0x55);
+    ck_assert_uint_eq(before, bus_hash(&bus));
+    bus_map(&bus, 15, 1, NULL, NULL);
+    bus_handlers(&bus, 15, 1, port_read, port_write, &port);
+    ck_assert_uint_eq(fresh_hash(), bus_hash(&bus));
+    before = bus_hash(&bus);
+    bus_write(&bus, 0xF000, 0x55);
+    ck_assert_uint_eq(before, bus_hash(&bus));
+
+    // Writes behind the back of the bus have to be reported.
+    banks[0][0x100] = 0x22;
+    ck_assert_uint_ne(fresh_hash(), bus_hash(&bus));
+    bus_dirty_mark_host(&bus, &banks[0][0x100], 1);
+    ck_assert_uint_eq(fresh_hash(), bus_hash(&bus));
+    bus_hash_detach(&bus);
+}
+END_TEST
+
+START_TEST(test_hash_state)
+{
+    struct bus_hash_t hash;
+    struct cpu_t cpu;
+    uint64_t before;
+
+    memset(&cpu, 0, sizeof(cpu));
+    cpu_init(&cpu, &bus);
+    bus_hash_attach(&bus, &hash);
+    before = z80_state_hash(&cpu);
+    ck_assert_uint_ne(bus_hash(&bus), before);
+
+    // Every register counts, the T-state counter does not.
+    REG_A(cpu) = 0x01;
+    ck_assert_uint_ne(before, z80_state_hash(&cpu));
+    REG_A(cpu) = 0x00;
+    ALT_DE(cpu) = 0x0100;
+    ck_assert_uint_ne(before, z80_state_hash(&cpu));
+    ALT_DE(cpu) = 0x0000;
+    cpu.im = 1;
+    ck_assert_uint_ne(before, z80_state_hash(&cpu));
+    cpu.im = 0;
+    cpu.tstates = 1000;
+    ck_assert_uint_eq(before, z80_state_hash(&cpu));
+
+    mem_write(&cpu, 0x4000, 0x01);
+    ck_assert_uint_ne(before, z80_state_hash(&cpu));
+    mem_write(&cpu, 0x4000, 0x00);
+    ck_assert_uint_eq(before, z80_state_hash(&cpu));
+    bus_hash_detach(&bus);
+}
+END_TEST
+
+Suite*
+gensuite_bus(void)
+{
+    TCase* tc_bus = tcase_create("Memory bus");
+    tcase_add_checked_fixture(tc_bus, setup_bus, NULL);
+    tcase_add_test(tc_bus, test_bus_ram);
+    tcase_add_test(tc_bus, test_bus_rom);
+    tcase_add_test(tc_bus, test_bus_unmapped);
+    tcase_add_test(tc_bus, test_bus_bank_switch);
+    tcase_add_test(tc_bus, test_bus_mmio);
+    tcase_add_test(tc_bus, test_bus_rom_write_handler);
+    tcase_add_test(tc_bus, test_bus_load_dump);
+    tcase_add_test(tc_bus, test_bus_cpu);
+    tcase_add_test(tc_bus, test_bus_map_fd);
+
+    TCase* tc_dirty = tcase_create("Dirty tracking");
+    tcase_add_checked_fixture(tc_dirty, setup_bus, NULL);
+    tcase_add_test(tc_dirty, test_dirty_untracked);
+    tcase_add_test(tc_dirty, test_dirty_pages);
+    tcase_add_test(tc_dirty, test_dirty_lines);
+    tcase_add_test(tc_dirty, test_dirty_clients);
+    tcase_add_test(tc_dirty, test_dirty_remap);
+    tcase_add_test(tc_dirty, test_dirty_mark_host);
+
+    TCase* tc_contention = tcase_create("Contention");
+    tcase_add_checked_fixture(tc_contention, setup_contention, NULL);
+    tcase_add_test(tc_contention, test_contention_ula_table);
+    tcase_add_test(tc_contention, test_contention_fast_path);
+    tcase_add_test(tc_contention, test_contention_delay);
+    tcase_add_test(tc_contention, test_contention_wait_states);
+    tcase_add_test(tc_contention, test_contention_cpu);
+    tcase_add_test(tc_contention, test_contention_dirty);
+    tcase_add_test(tc_contention, test_contention_io);
+
+    TCase* tc_hash = tcase_create("Hashing");
+    tcase_add_checked_fixture(tc_hash, setup_bus, NULL);
+    tcase_add_test(tc_hash, test_hash_incremental);
+    tcase_add_test(tc_hash, test_hash_remap);
+    tcase_add_test(tc_hash, test_hash_state);
+
+    Suite* s = suite_create("Memory bus");
+    suite_add_tcase(s, tc_bus);
+    suite_add_tcase(s, tc_dirty);
+    suite_add_tcase(s, tc_contention);
+    suite_add_tcase(s, tc_hash);
+    return s;
+}
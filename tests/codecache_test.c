@@ -0,0 +1,159 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <stdio.h>          // snprintf, remove
+#include <stdlib.h>         // mkdtemp
+#include <string.h>         // memset, memcmp
+#include <dirent.h>         // opendir
+#include <unistd.h>         // rmdir
+
+#include <cpu.h>
+#include <codecache.h>
+
+#include "codecache_test.h"
+
+static const byte code[] = {
+    0x06, 0x10,             // LD B, 16
+    0x21, 0x00, 0x80,       // LD HL, 0x8000
+    0x77,                   // LD (HL), A
+    0x23,                   // INC HL
+    0x10, 0xFC,             // DJNZ -4
+    0xCD, 0x00, 0x10        // CALL 0x1000
+};
+
+static char cache_dir[64];
+
+static void
+setup_cache(void)
+{
+    snprintf(cache_dir, sizeof(cache_dir), "/tmp/zeta80-cache-XXXXXX");
+    ck_assert_ptr_ne(NULL, mkdtemp(cache_dir));
+}
+
+static void
+teardown_cache(void)
+{
+    char path[1100];
+    struct dirent* entry;
+    DIR* dir = opendir(cache_dir);
+    while (dir && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s", cache_dir, entry->d_name);
+            remove(path);
+        }
+    }
+    if (dir) closedir(dir);
+    rmdir(cache_dir);
+}
+
+START_TEST(test_region_decode)
+{
+    struct code_region_t region;
+    ck_assert_int_eq(0, code_region_decode(&region, code, 0x4000,
+                sizeof(code)));
+    ck_assert_uint_eq(2, region.insns[0].length);
+    ck_assert_uint_eq(3, region.insns[2].length);
+    ck_assert_uint_eq(0x4005, region.insns[7].target);
+    ck_assert_uint_eq(0x1000, region.insns[9].target);
+    // Last byte would be DJNZ, but its operand is outside the region.
+    ck_assert_uint_eq(0, region.insns[11].length);
+    code_region_free(&region);
+}
+END_TEST
+
+START_TEST(test_cache_roundtrip)
+{
+    struct code_region_t first, second;
+
+    ck_assert_int_eq(0, code_cache_load(cache_dir, &first, code, 0x4000,
+                sizeof(code)));
+    ck_assert_ptr_eq(NULL, first.mapping);
+
+    ck_assert_int_eq(0, code_cache_load(cache_dir, &second, code, 0x4000,
+                sizeof(code)));
+    ck_assert_ptr_ne(NULL, second.mapping);
+    ck_assert_int_eq(0, second.validated);
+    ck_assert_uint_eq(first.hash, second.hash);
+    ck_assert_int_eq(0, memcmp(first.bytes, second.bytes, sizeof(code)));
+    ck_assert_int_eq(0, memcmp(first.insns, second.insns,
+                sizeof(code) * sizeof(struct insn_t)));
+
+    code_region_free(&first);
+    code_region_free(&second);
+}
+END_TEST
+
+START_TEST(test_cache_key)
+{
+    struct code_region_t first, second;
+    byte other[sizeof(code)];
+
+    memcpy(other, code, sizeof(code));
+    other[1] = 0x20;
+    code_cache_load(cache_dir, &first, code, 0x4000, sizeof(code));
+    code_cache_load(cache_dir, &second, other, 0x4000, sizeof(code));
+
+    // Different bytes are decoded again, not loaded from the first file.
+    ck_assert_ptr_eq(NULL, second.mapping);
+    ck_assert_uint_ne(first.hash, second.hash);
+    code_region_free(&first);
+    code_region_free(&second);
+}
+END_TEST
+
+START_TEST(test_cache_validate)
+{
+    static struct cpu_t cpu;
+    static struct bus_t bus;
+    static byte ram[0x10000];
+    struct code_region_t region;
+
+    bus_init(&bus, ram);
+    cpu_init(&cpu, &bus);
+    memcpy(&ram[0x4000], code, sizeof(code));
+    code_cache_load(cache_dir, &region, code, 0x4000, sizeof(code));
+    code_region_free(&region);
+    code_cache_load(cache_dir, &region, code, 0x4000, sizeof(code));
+
+    ram[0x4003] = 0x90;
+    ck_assert_int_eq(0, code_region_validate(&region, &cpu));
+    ram[0x4003] = 0x00;
+    ck_assert_int_eq(1, code_region_validate(&region, &cpu));
+    ck_assert_int_eq(1, region.validated);
+    code_region_free(&region);
+}
+END_TEST
+
+Suite*
+gensuite_codecache(void)
+{
+    TCase* tc_cache = tcase_create("Code cache");
+    tcase_add_checked_fixture(tc_cache, setup_cache, teardown_cache);
+    tcase_add_test(tc_cache, test_region_decode);
+    tcase_add_test(tc_cache, test_cache_roundtrip);
+    tcase_add_test(tc_cache, test_cache_key);
+    tcase_add_test(tc_cache, test_cache_validate);
+
+    Suite* s = suite_create("Code cache");
+    suite_add_tcase(s, tc_cache);
+    return s;
+}
@@ -0,0 +1,135 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+
+#include <decode.h>
+
+#include "decode_test.h"
+
+START_TEST(test_decode_lengths)
+{
+    static const struct { byte code[4]; int length; } cases[] = {
+        { { 0x00 }, 1 },                    // NOP
+        { { 0x01, 0x34, 0x12 }, 3 },        // LD BC, nn
+        { { 0x22, 0x00, 0x80 }, 3 },        // LD (nn), HL
+        { { 0x3E, 0x55 }, 2 },              // LD A, n
+        { { 0x78 }, 1 },                    // LD A, B
+        { { 0xC6, 0x01 }, 2 },              // ADD A, n
+        { { 0xCD, 0x00, 0x10 }, 3 },        // CALL nn
+        { { 0xDB, 0xFE }, 2 },              // IN A, (n)
+        { { 0xCB, 0x11 }, 2 },              // RL C
+        { { 0xED, 0xB0 }, 2 },              // LDIR
+        { { 0xED, 0x4B, 0x00, 0x80 }, 4 },  // LD BC, (nn)
+        { { 0xDD, 0x21, 0x00, 0x80 }, 4 },  // LD IX, nn
+        { { 0xDD, 0x7E, 0x05 }, 3 },        // LD A, (IX+d)
+        { { 0xFD, 0x36, 0x05, 0xAA }, 4 },  // LD (IY+d), n
+        { { 0xDD, 0xCB, 0x05, 0x46 }, 4 },  // BIT 0, (IX+d)
+        { { 0xDD, 0x7C }, 2 },              // LD A, IXh
+        { { 0xDD, 0xFD }, 1 },              // Repeated prefix
+    };
+    struct insn_t insn;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        ck_assert_int_eq(cases[i].length,
+                decode_insn(cases[i].code, 4, 0x0000, &insn));
+        ck_assert_int_eq(cases[i].length, insn.length);
+    }
+}
+END_TEST
+
+START_TEST(test_decode_truncated)
+{
+    static const byte code[] = { 0xCD, 0x00, 0x10 };
+    struct insn_t insn;
+    ck_assert_int_eq(0, decode_insn(code, 2, 0x0000, &insn));
+    ck_assert_int_eq(0, decode_insn(code, 0, 0x0000, &insn));
+}
+END_TEST
+
+START_TEST(test_decode_relative_jumps)
+{
+    static const byte djnz[] = { 0x10, 0xFE };
+    static const byte jr_nz[] = { 0x20, 0x10 };
+    struct insn_t insn;
+
+    decode_insn(djnz, 2, 0x8000, &insn);
+    ck_assert_int_eq(FLOW_JUMP, insn.flow);
+    ck_assert_int_ne(0, insn.cond);
+    ck_assert_uint_eq(0x8000, insn.target);
+    ck_assert_uint_eq(8, insn.tstates);
+
+    decode_insn(jr_nz, 2, 0x8000, &insn);
+    ck_assert_int_eq(FLOW_JUMP, insn.flow);
+    ck_assert_uint_eq(0x8012, insn.target);
+    ck_assert_uint_eq(7, insn.tstates);
+}
+END_TEST
+
+START_TEST(test_decode_flow)
+{
+    static const byte jp[] = { 0xC3, 0x34, 0x12 };
+    static const byte rst[] = { 0xEF };
+    static const byte ret_z[] = { 0xC8 };
+    static const byte jp_ix[] = { 0xDD, 0xE9 };
+    static const byte reti[] = { 0xED, 0x4D };
+    static const byte halt[] = { 0x76 };
+    struct insn_t insn;
+
+    decode_insn(jp, 3, 0x0000, &insn);
+    ck_assert_int_eq(FLOW_JUMP, insn.flow);
+    ck_assert_int_eq(0, insn.cond);
+    ck_assert_uint_eq(0x1234, insn.target);
+
+    decode_insn(rst, 1, 0x0000, &insn);
+    ck_assert_int_eq(FLOW_CALL, insn.flow);
+    ck_assert_uint_eq(0x28, insn.target);
+    ck_assert_uint_eq(11, insn.tstates);
+
+    decode_insn(ret_z, 1, 0x0000, &insn);
+    ck_assert_int_eq(FLOW_RETURN, insn.flow);
+    ck_assert_int_ne(0, insn.cond);
+
+    decode_insn(jp_ix, 2, 0x0000, &insn);
+    ck_assert_int_eq(FLOW_INDIRECT, insn.flow);
+
+    decode_insn(reti, 2, 0x0000, &insn);
+    ck_assert_int_eq(FLOW_RETURN, insn.flow);
+
+    decode_insn(halt, 1, 0x0000, &insn);
+    ck_assert_int_eq(FLOW_HALT, insn.flow);
+}
+END_TEST
+
+Suite*
+gensuite_decode(void)
+{
+    TCase* tc_decode = tcase_create("Decode");
+    tcase_add_test(tc_decode, test_decode_lengths);
+    tcase_add_test(tc_decode, test_decode_truncated);
+    tcase_add_test(tc_decode, test_decode_relative_jumps);
+    tcase_add_test(tc_decode, test_decode_flow);
+
+    Suite* s = suite_create("Decode");
+    suite_add_tcase(s, tc_decode);
+    return s;
+}
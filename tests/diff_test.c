@@ -0,0 +1,190 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <stdio.h>          // open_memstream
+#include <stdlib.h>         // free, rand, srand
+#include <string.h>         // memcpy, memset, strstr
+
+#include <bus.h>
+#include <cpu.h>
+#include <diff.h>
+
+#include "diff_test.h"
+
+static struct cpu_t a, b;
+static struct bus_t bus_a, bus_b;
+static byte ram_a[0x10000], ram_b[0x10000];
+
+static void
+setup_diff(void)
+{
+    int i;
+    for (i = 0; i < 0x10000; i++) {
+        ram_a[i] = ram_b[i] = i ^ (i >> 8);
+    }
+    bus_init(&bus_a, ram_a);
+    bus_init(&bus_b, ram_b);
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+    cpu_init(&a, &bus_a);
+    cpu_init(&b, &bus_b);
+}
+
+START_TEST(test_diff_equal)
+{
+    struct z80_diff_t diff;
+    ck_assert_int_eq(0, z80_state_diff(&a, &b, &diff));
+    ck_assert_uint_eq(0, diff.regs);
+    ck_assert_uint_eq(0, diff.bytes);
+    ck_assert_int_eq(0, diff.count);
+}
+END_TEST
+
+START_TEST(test_diff_registers)
+{
+    struct z80_diff_t diff;
+    PC(a) = 0x1234;
+    ALT_HL(b) = 0x0001;
+    IY(a) = 0x8000;
+    a.r = 0x7F;
+    b.iff2 = 1;
+    b.tstates = 4;
+    ck_assert_int_eq(1, z80_state_diff(&a, &b, &diff));
+    ck_assert_uint_eq(DIFF_PC | DIFF_HL_ALT | DIFF_IY | DIFF_R | DIFF_IFF
+            | DIFF_TSTATES, diff.regs);
+    ck_assert_uint_eq(0, diff.bytes);
+}
+END_TEST
+
+START_TEST(test_diff_ranges)
+{
+    struct z80_diff_t diff;
+    ram_b[0x0000] ^= 1;
+    ram_b[0x1001] ^= 1;
+    ram_b[0x1002] ^= 1;
+    ram_b[0x1003] ^= 1;
+    // Across a page boundary and into the vector tail.
+    ram_b[0x2FFF] ^= 1;
+    ram_b[0x3000] ^= 1;
+    ram_b[0x3FFF] ^= 1;
+    ck_assert_int_eq(1, z80_state_diff(&a, &b, &diff));
+    ck_assert_uint_eq(0, diff.regs);
+    ck_assert_uint_eq(7, diff.bytes);
+    ck_assert_int_eq(4, diff.count);
+    ck_assert_uint_eq(0x0000, diff.range[0].addr);
+    ck_assert_uint_eq(1, diff.range[0].size);
+    ck_assert_uint_eq(0x1001, diff.range[1].addr);
+    ck_assert_uint_eq(3, diff.range[1].size);
+    ck_assert_uint_eq(0x2FFF, diff.range[2].addr);
+    ck_assert_uint_eq(2, diff.range[2].size);
+    ck_assert_uint_eq(0x3FFF, diff.range[3].addr);
+    ck_assert_uint_eq(1, diff.range[3].size);
+}
+END_TEST
+
+START_TEST(test_diff_pages)
+{
+    struct z80_diff_t diff;
+
+    // Shared host memory is equal, memory mapped I/O is not compared.
+    bus_map(&bus_b, 4, 1, ram_a + 0x4000, ram_a + 0x4000);
+    ram_a[0x4000] ^= 1;
+    bus_map(&bus_a, 15, 1, NULL, NULL);
+    bus_map(&bus_b, 15, 1, NULL, NULL);
+    ck_assert_int_eq(0, z80_state_diff(&a, &b, &diff));
+
+    // A page with host memory on one side only differs as a whole.
+    bus_map(&bus_b, 14, 1, NULL, NULL);
+    ck_assert_int_eq(1, z80_state_diff(&a, &b, &diff));
+    ck_assert_int_eq(1, diff.count);
+    ck_assert_uint_eq(0xE000, diff.range[0].addr);
+    ck_assert_uint_eq(MEM_PAGE_SIZE, diff.range[0].size);
+}
+END_TEST
+
+START_TEST(test_diff_random)
+{
+    // Compared against a byte at a time scan, ranges left out included.
+    struct z80_diff_t diff;
+    unsigned long bytes = 0;
+    int i, ranges = 0, in_range = 0;
+
+    srand(7);
+    for (i = 0; i < 400; i++) {
+        ram_b[rand() & 0xFFFF] ^= 1 + rand() % 255;
+    }
+    for (i = 0; i < 0x10000; i++) {
+        if (ram_a[i] != ram_b[i]) {
+            bytes++;
+            if (!in_range) ranges++;
+        }
+        in_range = ram_a[i] != ram_b[i];
+    }
+    ck_assert_int_eq(1, z80_state_diff(&a, &b, &diff));
+    ck_assert_uint_eq(bytes, diff.bytes);
+    ck_assert_int_eq(DIFF_MAX_RANGES, diff.count);
+    ck_assert_int_eq(ranges - DIFF_MAX_RANGES, diff.truncated);
+    for (i = 0; i < diff.count; i++) {
+        ck_assert_uint_ne(ram_a[diff.range[i].addr],
+                ram_b[diff.range[i].addr]);
+        if (diff.range[i].addr) {
+            ck_assert_uint_eq(ram_a[diff.range[i].addr - 1],
+                    ram_b[diff.range[i].addr - 1]);
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_diff_print)
+{
+    struct z80_diff_t diff;
+    char* text = NULL;
+    size_t size;
+    FILE* file = open_memstream(&text, &size);
+
+    PC(b) = 0x5678;
+    ram_b[0x8000] = 0xAB;
+    z80_state_diff(&a, &b, &diff);
+    z80_diff_print(file, &diff, &a, &b);
+    fclose(file);
+    ck_assert_ptr_ne(NULL, strstr(text, "PC: 0000 != 5678\n"));
+    ck_assert_ptr_ne(NULL, strstr(text, "8000-8000: 80 != AB\n"));
+    free(text);
+}
+END_TEST
+
+Suite*
+gensuite_diff(void)
+{
+    TCase* tc_diff = tcase_create("State diff");
+    tcase_add_checked_fixture(tc_diff, setup_diff, NULL);
+    tcase_add_test(tc_diff, test_diff_equal);
+    tcase_add_test(tc_diff, test_diff_registers);
+    tcase_add_test(tc_diff, test_diff_ranges);
+    tcase_add_test(tc_diff, test_diff_pages);
+    tcase_add_test(tc_diff, test_diff_random);
+    tcase_add_test(tc_diff, test_diff_print);
+
+    Suite* s = suite_create("State diff");
+    suite_add_tcase(s, tc_diff);
+    return s;
+}
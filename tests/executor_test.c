@@ -0,0 +1,223 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <string.h>         // memcmp, memset
+
+#include <bus.h>
+#include <cpu.h>
+#include <executor.h>
+#include <opcodes.h>
+
+#include "executor_test.h"
+#include "machine.h"
+
+#define MACHINES 16
+
+static struct machine_t machine[MACHINES], expected[MACHINES];
+
+static struct z80_task_t task[MACHINES];
+static atomic_int done_count;
+static int runs[MACHINES];
+
+/*
+ * Fills memory from 0x8000 up with an increasing counter, forever:
+ *
+ * loop:
+ *     INC A
+ *     LD (HL), A
+ *     INC HL
+ *     JR loop
+ */
+static const byte program[] = { 0x3C, 0x77, 0x23, 0x18, 0xFB };
+
+static void
+load(struct machine_t* m, int index)
+{
+    machine_init(m, program, sizeof(program));
+    REG_HL(m->cpu) = 0x8000;
+    REG_A(m->cpu) = index;
+}
+
+// What running a task to its budget does, in a single thread.
+static void
+run_sequential(struct machine_t* m, long budget)
+{
+    long ran = 0;
+    while (ran < budget) {
+        int before = m->cpu.tstates;
+        execute_opcode(&m->cpu);
+        ran += m->cpu.tstates - before > 0 ? m->cpu.tstates - before : 1;
+    }
+}
+
+static void
+count_done(struct z80_task_t* task)
+{
+    (void) task;
+    atomic_fetch_add(&done_count, 1);
+}
+
+static void
+setup_executor(void)
+{
+    int i;
+    atomic_store(&done_count, 0);
+    memset(runs, 0, sizeof(runs));
+    for (i = 0; i < MACHINES; i++) {
+        load(&machine[i], i);
+        load(&expected[i], i);
+        memset(&task[i], 0, sizeof(struct z80_task_t));
+        task[i].cpu = &machine[i].cpu;
+        task[i].budget = 5000 + i * 997;
+        task[i].done = count_done;
+        task[i].ctx = &machine[i];
+    }
+}
+
+static void
+assert_matches(int i)
+{
+    ck_assert_int_eq(0, memcmp(expected[i].ram, machine[i].ram, 0x10000));
+    ck_assert_uint_eq(REG_HL(expected[i].cpu), REG_HL(machine[i].cpu));
+    ck_assert_uint_eq(REG_A(expected[i].cpu), REG_A(machine[i].cpu));
+    ck_assert_uint_eq(PC(expected[i].cpu), PC(machine[i].cpu));
+    ck_assert_int_eq(expected[i].cpu.tstates, machine[i].cpu.tstates);
+}
+
+START_TEST(test_executor_run)
+{
+    struct z80_executor_t* executor = z80_executor_create(4, 100);
+    unsigned long slices = 0;
+    int i;
+
+    ck_assert_ptr_ne(NULL, executor);
+    for (i = 0; i < MACHINES; i++) {
+        ck_assert_int_eq(0, z80_executor_submit(executor, &task[i]));
+    }
+    z80_executor_wait(executor);
+    ck_assert_int_eq(MACHINES, atomic_load(&done_count));
+
+    for (i = 0; i < MACHINES; i++) {
+        run_sequential(&expected[i], task[i].budget);
+        assert_matches(i);
+        ck_assert_int_ge(task[i].used, task[i].budget);
+    }
+    for (i = 0; i < executor->workers; i++) {
+        slices += executor->worker[i].slices;
+    }
+    // Every task is cut into slices of about 100 T-states.
+    ck_assert_uint_ge(slices, 5000 / 100 * MACHINES);
+    z80_executor_destroy(executor);
+}
+END_TEST
+
+// Resubmits every task from its callback until it has run three budgets.
+static void
+resubmit(struct z80_task_t* finished)
+{
+    struct z80_executor_t* executor = finished->ctx;
+    atomic_fetch_add(&done_count, 1);
+    if (++runs[finished - task] < 3) {
+        // A failure shows up as a missing completion.
+        z80_executor_submit(executor, finished);
+    }
+}
+
+START_TEST(test_executor_resubmit)
+{
+    struct z80_executor_t* executor = z80_executor_create(3, 250);
+    int i;
+
+    ck_assert_ptr_ne(NULL, executor);
+    for (i = 0; i < MACHINES; i++) {
+        task[i].budget = 3000;
+        task[i].done = resubmit;
+        task[i].ctx = executor;
+        ck_assert_int_eq(0, z80_executor_submit(executor, &task[i]));
+    }
+    z80_executor_wait(executor);
+    ck_assert_int_eq(MACHINES * 3, atomic_load(&done_count));
+
+    // Resubmitting a task starts a new budget where the last one stopped.
+    for (i = 0; i < MACHINES; i++) {
+        run_sequential(&expected[i], 3000);
+        run_sequential(&expected[i], 3000);
+        run_sequential(&expected[i], 3000);
+        assert_matches(i);
+    }
+    z80_executor_destroy(executor);
+}
+END_TEST
+
+START_TEST(test_executor_steal)
+{
+    // A long task keeps one worker busy while the short ones queued
+    // behind it get stolen; who ran each slice must not change results.
+    struct z80_executor_t* executor = z80_executor_create(2, 50);
+    int i;
+
+    ck_assert_ptr_ne(NULL, executor);
+    task[0].budget = 200000;
+    for (i = 0; i < MACHINES; i++) {
+        ck_assert_int_eq(0, z80_executor_submit(executor, &task[i]));
+    }
+    z80_executor_wait(executor);
+    ck_assert_int_eq(MACHINES, atomic_load(&done_count));
+    for (i = 0; i < MACHINES; i++) {
+        run_sequential(&expected[i], task[i].budget);
+        assert_matches(i);
+    }
+    z80_executor_destroy(executor);
+}
+END_TEST
+
+START_TEST(test_executor_invalid)
+{
+    struct z80_executor_t* executor = z80_executor_create(1, 100);
+    ck_assert_ptr_ne(NULL, executor);
+    task[0].budget = 0;
+    ck_assert_int_eq(-1, z80_executor_submit(executor, &task[0]));
+    // Nothing pending: wait returns right away.
+    z80_executor_wait(executor);
+    ck_assert_int_eq(0, atomic_load(&done_count));
+    z80_executor_destroy(executor);
+
+    ck_assert_ptr_eq(NULL, z80_executor_create(1, 0));
+    ck_assert_ptr_eq(NULL,
+            z80_executor_create(EXECUTOR_MAX_WORKERS + 1, 100));
+}
+END_TEST
+
+Suite*
+gensuite_executor(void)
+{
+    TCase* tc_executor = tcase_create("Executor");
+    tcase_add_checked_fixture(tc_executor, setup_executor, NULL);
+    tcase_add_test(tc_executor, test_executor_run);
+    tcase_add_test(tc_executor, test_executor_resubmit);
+    tcase_add_test(tc_executor, test_executor_steal);
+    tcase_add_test(tc_executor, test_executor_invalid);
+
+    Suite* s = suite_create("Executor");
+    suite_add_tcase(s, tc_executor);
+    return s;
+}
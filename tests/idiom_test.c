@@ -0,0 +1,277 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <string.h>         // memset, memcpy, memcmp
+
+#include <cpu.h>
+#include <opcodes.h>
+#include <idiom.h>
+
+#include "idiom_test.h"
+
+static const byte mul8[] = {
+    0x16, 0x00, 0x6A, 0x06, 0x08, 0x29, 0x30, 0x01, 0x19, 0x10, 0xFA
+};
+static const byte copy[] = { 0x1A, 0x77, 0x13, 0x23, 0x10, 0xFA };
+static const byte fill[] = { 0x77, 0x23, 0x10, 0xFC };
+
+static struct cpu_t emulated, native;
+static struct bus_t emulated_bus, native_bus;
+static byte emulated_ram[0x10000], native_ram[0x10000];
+static struct idiom_map_t map;
+
+static void
+setup_idiom(void)
+{
+    int i;
+    memset(&emulated, 0, sizeof(struct cpu_t));
+    memset(emulated_ram, 0, sizeof(emulated_ram));
+    bus_init(&emulated_bus, emulated_ram);
+    cpu_init(&emulated, &emulated_bus);
+    for (i = 0; i < 0x100; i++) {
+        emulated_ram[0x4000 + i] = i * 7;
+    }
+    idiom_init(&map);
+    idiom_register_builtins(&map);
+}
+
+// Loads a routine at 0x1000 and runs it both ways.
+static void
+run_both(const byte* code, size_t size)
+{
+    memcpy(emulated_ram + 0x1000, code, size);
+    PC(emulated) = 0x1000;
+    memcpy(&native, &emulated, sizeof(struct cpu_t));
+    memcpy(native_ram, emulated_ram, sizeof(emulated_ram));
+    bus_init(&native_bus, native_ram);
+    cpu_init(&native, &native_bus);
+
+    while (PC(emulated) != 0x1000 + size) {
+        execute_opcode(&emulated);
+    }
+    ck_assert_int_eq(1, idiom_scan(&map, &native, 0x1000, size));
+    ck_assert_int_eq(1, idiom_execute_opcode(&map, &native));
+}
+
+static void
+assert_same(void)
+{
+    ck_assert_uint_eq(PC(emulated), PC(native));
+    ck_assert_uint_eq(REG_AF(emulated), REG_AF(native));
+    ck_assert_uint_eq(REG_BC(emulated), REG_BC(native));
+    ck_assert_uint_eq(REG_DE(emulated), REG_DE(native));
+    ck_assert_uint_eq(REG_HL(emulated), REG_HL(native));
+    ck_assert_int_eq(emulated.tstates, native.tstates);
+    ck_assert_int_eq(0, memcmp(emulated_ram, native_ram,
+                sizeof(emulated_ram)));
+}
+
+START_TEST(test_idiom_mul8)
+{
+    static const byte factors[][2] = {
+        { 0, 0 }, { 1, 1 }, { 12, 34 }, { 0xFF, 0xFF }, { 0x80, 0x02 },
+        { 0x55, 0xAA }
+    };
+    unsigned i;
+    for (i = 0; i < sizeof(factors) / sizeof(factors[0]); i++) {
+        REG_H(emulated) = factors[i][0];
+        REG_E(emulated) = factors[i][1];
+        REG_F(emulated) = 0;
+        emulated.tstates = 0;
+        run_both(mul8, sizeof(mul8));
+        ck_assert_uint_eq(factors[i][0] * factors[i][1], REG_HL(native));
+        assert_same();
+    }
+}
+END_TEST
+
+START_TEST(test_idiom_copy)
+{
+    REG_DE(emulated) = 0x4000;
+    REG_HL(emulated) = 0x8000;
+    REG_B(emulated) = 0x20;
+    run_both(copy, sizeof(copy));
+    ck_assert_int_eq(0, memcmp(native_ram + 0x4000, native_ram + 0x8000,
+                0x20));
+    assert_same();
+}
+END_TEST
+
+START_TEST(test_idiom_copy_256)
+{
+    REG_DE(emulated) = 0x4000;
+    REG_HL(emulated) = 0x8000;
+    REG_B(emulated) = 0x00;
+    run_both(copy, sizeof(copy));
+    ck_assert_uint_eq(0x8100, REG_HL(native));
+    assert_same();
+}
+END_TEST
+
+START_TEST(test_idiom_fill)
+{
+    REG_HL(emulated) = 0x9000;
+    REG_A(emulated) = 0x5A;
+    REG_B(emulated) = 0x11;
+    run_both(fill, sizeof(fill));
+    ck_assert_uint_eq(0x5A, native_ram[0x9010]);
+    ck_assert_uint_eq(0x00, native_ram[0x9011]);
+    assert_same();
+}
+END_TEST
+
+START_TEST(test_idiom_verify)
+{
+    map.verify = 1;
+    REG_H(emulated) = 0x9C;
+    REG_E(emulated) = 0x3B;
+    run_both(mul8, sizeof(mul8));
+    assert_same();
+    ck_assert_uint_eq(1, map.hits);
+    ck_assert_uint_eq(0, map.mismatches);
+}
+END_TEST
+
+// Native code that does not match the guest routine.
+static void
+broken_native(struct cpu_t* cpu)
+{
+    REG_A(*cpu) = 0x99;
+    PC(*cpu) += sizeof(fill);
+}
+
+// Fill writes B bytes from HL.
+static int
+fill_footprint(const struct cpu_t* cpu, struct idiom_range_t* range)
+{
+    range->addr = REG_HL(*cpu);
+    range->size = REG_B(*cpu);
+    return 1;
+}
+
+START_TEST(test_idiom_verify_mismatch)
+{
+    idiom_init(&map);
+    idiom_register(&map, "broken", fill, sizeof(fill), sizeof(fill),
+            broken_native, fill_footprint);
+    map.verify = 1;
+    REG_HL(emulated) = 0x9000;
+    REG_A(emulated) = 0x11;
+    REG_B(emulated) = 0x04;
+    run_both(fill, sizeof(fill));
+    ck_assert_uint_eq(1, map.mismatches);
+    assert_same();
+}
+END_TEST
+
+static int mmio_accesses;
+
+static byte
+count_read(void* ctx, word addr)
+{
+    (void) ctx;
+    (void) addr;
+    mmio_accesses++;
+    return 0xFF;
+}
+
+static void
+count_write(void* ctx, word addr, byte value)
+{
+    (void) ctx;
+    (void) addr;
+    (void) value;
+    mmio_accesses++;
+}
+
+START_TEST(test_idiom_verify_footprint)
+{
+    struct bus_dirty_t dirty;
+    memcpy(emulated_ram + 0x1000, fill, sizeof(fill));
+    bus_map(&emulated_bus, 0xC, 1, NULL, NULL);
+    bus_handlers(&emulated_bus, 0xC, 1, count_read, count_write, NULL);
+    bus_dirty_attach(&emulated_bus, &dirty, 0);
+    mmio_accesses = 0;
+    ck_assert_int_eq(1, idiom_scan(&map, &emulated, 0x1000, sizeof(fill)));
+
+    // Only the filled bytes are saved and restored, no handler is called.
+    map.verify = 1;
+    PC(emulated) = 0x1000;
+    REG_HL(emulated) = 0x9000;
+    REG_A(emulated) = 0x5A;
+    REG_B(emulated) = 0x10;
+    ck_assert_int_eq(1, idiom_execute_opcode(&map, &emulated));
+    ck_assert_uint_eq(0, map.mismatches);
+    ck_assert_uint_eq(0x5A, emulated_ram[0x900F]);
+    ck_assert_uint_eq(0x00, emulated_ram[0x9010]);
+    ck_assert_int_eq(0, mmio_accesses);
+    ck_assert_uint_eq(1u << 9, bus_dirty_fetch_pages(&dirty));
+    bus_dirty_detach(&emulated_bus, &dirty);
+}
+END_TEST
+
+START_TEST(test_idiom_scan)
+{
+    memcpy(emulated_ram + 0x2000, copy, sizeof(copy));
+    memcpy(emulated_ram + 0x3000, fill, sizeof(fill));
+    memcpy(emulated_ram + 0x3100, mul8, sizeof(mul8));
+    ck_assert_int_eq(3, idiom_scan(&map, &emulated, 0x0000, 0x10000));
+    ck_assert_uint_eq(2, map.entry[0x2000]);
+    ck_assert_uint_eq(3, map.entry[0x3000]);
+    ck_assert_uint_eq(1, map.entry[0x3100]);
+    ck_assert_uint_eq(0, map.entry[0x3001]);
+}
+END_TEST
+
+START_TEST(test_idiom_modified_code)
+{
+    memcpy(emulated_ram + 0x3000, fill, sizeof(fill));
+    ck_assert_int_eq(1, idiom_scan(&map, &emulated, 0x3000, sizeof(fill)));
+
+    // Self-modifying code: the entry is still marked but no longer matches.
+    emulated_ram[0x3001] = 0x00;
+    PC(emulated) = 0x3000;
+    ck_assert_int_eq(0, idiom_execute_opcode(&map, &emulated));
+    ck_assert_uint_eq(0x3001, PC(emulated));
+    ck_assert_uint_eq(0, map.hits);
+}
+END_TEST
+
+Suite*
+gensuite_idiom(void)
+{
+    TCase* tc_idiom = tcase_create("Idioms");
+    tcase_add_checked_fixture(tc_idiom, setup_idiom, NULL);
+    tcase_add_test(tc_idiom, test_idiom_mul8);
+    tcase_add_test(tc_idiom, test_idiom_copy);
+    tcase_add_test(tc_idiom, test_idiom_copy_256);
+    tcase_add_test(tc_idiom, test_idiom_fill);
+    tcase_add_test(tc_idiom, test_idiom_verify);
+    tcase_add_test(tc_idiom, test_idiom_verify_mismatch);
+    tcase_add_test(tc_idiom, test_idiom_verify_footprint);
+    tcase_add_test(tc_idiom, test_idiom_scan);
+    tcase_add_test(tc_idiom, test_idiom_modified_code);
+
+    Suite* s = suite_create("Idioms");
+    suite_add_tcase(s, tc_idiom);
+    return s;
+}
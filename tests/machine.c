@@ -0,0 +1,41 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <string.h>         // memcpy, memset
+
+#include "machine.h"
+
+/**
+ * Clears a machine, loads a program at 0x0000 and maps all of its RAM.
+ * Registers are zero, PC included.
+ *
+ * @param m machine
+ * @param code program, may be NULL
+ * @param size program size
+ */
+void
+machine_init(struct machine_t* m, const byte* code, size_t size)
+{
+    memset(m, 0, sizeof(struct machine_t));
+    if (code) memcpy(m->ram, code, size);
+    bus_init(&m->bus, m->ram);
+    cpu_init(&m->cpu, &m->bus);
+}
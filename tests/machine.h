@@ -0,0 +1,43 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#ifndef MACHINE_H_
+#define MACHINE_H_
+
+#include <stddef.h>
+
+#include <bus.h>
+#include <cpu.h>
+
+/**
+ * A CPU with 64 KB of RAM of its own, for tests and benchmarks that run
+ * programs on several machines side by side.
+ */
+struct machine_t
+{
+    struct cpu_t cpu;
+    struct bus_t bus;
+    byte ram[0x10000];
+};
+
+void machine_init(struct machine_t* m, const byte* code, size_t size);
+
+#endif // MACHINE_H_
@@ -0,0 +1,169 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <fcntl.h>          // open
+#include <stdlib.h>         // mkstemp
+#include <string.h>         // memset, strcpy
+#include <unistd.h>         // close, pread, unlink
+
+#include <bus.h>
+#include <nvram.h>
+
+#include "nvram_test.h"
+
+static char path[] = "/tmp/zeta80-nvram-XXXXXX";
+static struct bus_t bus;
+static byte ram[0x10000];
+
+static void
+setup_nvram(void)
+{
+    int fd;
+    strcpy(path, "/tmp/zeta80-nvram-XXXXXX");
+    fd = mkstemp(path);
+    ck_assert_int_ne(-1, fd);
+    close(fd);
+    memset(ram, 0, sizeof(ram));
+    bus_init(&bus, ram);
+}
+
+static void
+teardown_nvram(void)
+{
+    unlink(path);
+}
+
+// Reads a byte of the file behind the NVRAM.
+static byte
+file_byte(off_t offset)
+{
+    byte value = 0;
+    int fd = open(path, O_RDONLY);
+    ck_assert_int_ne(-1, fd);
+    ck_assert_int_eq(1, pread(fd, &value, 1, offset));
+    close(fd);
+    return value;
+}
+
+START_TEST(test_nvram_persist)
+{
+    struct nvram_t nvram;
+
+    // Two pages at 0xE000, the file is created empty.
+    ck_assert_int_eq(0, nvram_open(&nvram, &bus, 14, 2, path, 0, 0));
+    ck_assert_uint_eq(0x00, bus_read(&bus, 0xE000));
+    bus_write(&bus, 0xE000, 0x12);
+    bus_write(&bus, 0xFFFF, 0x34);
+    ck_assert_uint_eq(0x00, ram[0xE000]);
+
+    // The file is shared: it sees the writes before any flush.
+    ck_assert_uint_eq(0x12, file_byte(0x0000));
+    ck_assert_int_eq(0, nvram_close(&nvram));
+    ck_assert_uint_eq(0x34, file_byte(0x1FFF));
+    ck_assert_ptr_eq(NULL, bus.page[14].read);
+
+    // Contents survive to the next time the file is opened.
+    ck_assert_int_eq(0, nvram_open(&nvram, &bus, 8, 2, path, 0, 0));
+    ck_assert_uint_eq(0x12, bus_read(&bus, 0x8000));
+    ck_assert_uint_eq(0x34, bus_read(&bus, 0x9FFF));
+    ck_assert_int_eq(0, nvram_close(&nvram));
+}
+END_TEST
+
+START_TEST(test_nvram_tracked)
+{
+    struct nvram_t nvram;
+    ck_assert_int_eq(0, nvram_open(&nvram, &bus, 8, 4, path, 0, 1));
+
+    // Nothing written, nothing synced.
+    ck_assert_int_eq(0, nvram_flush(&nvram));
+    ck_assert_uint_eq(0, nvram.syncs);
+
+    // Writes outside of the NVRAM do not count.
+    bus_write(&bus, 0x0000, 0x01);
+    ck_assert_int_eq(0, nvram_flush(&nvram));
+    ck_assert_uint_eq(0, nvram.syncs);
+
+    // Adjacent pages are synced in one go.
+    bus_write(&bus, 0x8000, 0x01);
+    bus_write(&bus, 0x9000, 0x02);
+    bus_write(&bus, 0xB000, 0x03);
+    ck_assert_int_eq(0, nvram_flush(&nvram));
+    ck_assert_uint_eq(2, nvram.syncs);
+    ck_assert_uint_eq(0x03, file_byte(0x3000));
+
+    ck_assert_int_eq(0, nvram_close(&nvram));
+    ck_assert_uint_eq(2, nvram.syncs);
+    ck_assert_ptr_eq(NULL, bus.dirty);
+    ck_assert_ptr_eq(ram, bus.page[0].write);
+}
+END_TEST
+
+START_TEST(test_nvram_frames)
+{
+    struct nvram_t nvram;
+    int i;
+    ck_assert_int_eq(0, nvram_open(&nvram, &bus, 8, 1, path, 50, 0));
+
+    for (i = 0; i < 49; i++) {
+        ck_assert_int_eq(0, nvram_frame(&nvram));
+    }
+    ck_assert_uint_eq(0, nvram.syncs);
+    ck_assert_int_eq(0, nvram_frame(&nvram));
+    ck_assert_uint_eq(1, nvram.syncs);
+
+    // Flushing by hand starts the period again.
+    for (i = 0; i < 10; i++) {
+        nvram_frame(&nvram);
+    }
+    nvram_flush(&nvram);
+    for (i = 0; i < 49; i++) {
+        nvram_frame(&nvram);
+    }
+    ck_assert_uint_eq(2, nvram.syncs);
+    ck_assert_int_eq(0, nvram_close(&nvram));
+}
+END_TEST
+
+START_TEST(test_nvram_bad_path)
+{
+    struct nvram_t nvram;
+    ck_assert_int_eq(-1, nvram_open(&nvram, &bus, 8, 1,
+                "/nonexistent/zeta80.nv", 0, 0));
+    ck_assert_ptr_eq(ram + 0x8000, bus.page[8].read);
+}
+END_TEST
+
+Suite*
+gensuite_nvram(void)
+{
+    TCase* tc_nvram = tcase_create("NVRAM");
+    tcase_add_checked_fixture(tc_nvram, setup_nvram, teardown_nvram);
+    tcase_add_test(tc_nvram, test_nvram_persist);
+    tcase_add_test(tc_nvram, test_nvram_tracked);
+    tcase_add_test(tc_nvram, test_nvram_frames);
+    tcase_add_test(tc_nvram, test_nvram_bad_path);
+
+    Suite* s = suite_create("NVRAM");
+    suite_add_tcase(s, tc_nvram);
+    return s;
+}
@@ -0,0 +1,196 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>         // memset
+
+#include <bus.h>
+#include <cpu.h>
+#include <observer.h>
+
+#include "observer_test.h"
+
+static struct cpu_t cpu;
+static struct bus_t bus;
+static byte ram[0x10000];
+
+static void
+setup_observer(void)
+{
+    int i;
+    for (i = 0; i < 0x10000; i++) {
+        ram[i] = i;
+    }
+    bus_init(&bus, ram);
+    memset(&cpu, 0, sizeof(cpu));
+    cpu_init(&cpu, &bus);
+}
+
+START_TEST(test_observer_publish)
+{
+    struct observer_t* observer = observer_create(&cpu, 0);
+    struct observer_sample_t sample;
+    ck_assert_ptr_ne(NULL, observer);
+    ck_assert_int_eq(-1, observer_read(observer, &sample));
+
+    ck_assert_int_eq(0, observer_watch(observer, 0x1000, 4));
+    ck_assert_int_eq(0, observer_watch(observer, 0xFFFE, 3));
+    PC(cpu) = 0x8000;
+    REG_HL(cpu) = 0x1234;
+    cpu.tstates = 99;
+    observer_publish(observer);
+
+    // The registers change after the publication, the sample does not.
+    PC(cpu) = 0x9000;
+    ram[0x1000] = 0xAA;
+    ck_assert_int_eq(0, observer_read(observer, &sample));
+    ck_assert_uint_eq(1, sample.sequence);
+    ck_assert_int_eq(0, sample.retries);
+    ck_assert_uint_eq(0x8000, PC(sample.regs));
+    ck_assert_uint_eq(0x1234, REG_HL(sample.regs));
+    ck_assert_int_eq(99, sample.regs.tstates);
+    ck_assert_uint_eq(0x00, sample.memory[0]);
+    ck_assert_uint_eq(0x03, sample.memory[3]);
+    ck_assert_uint_eq(0xFE, sample.memory[4]);
+    ck_assert_uint_eq(0xFF, sample.memory[5]);
+    ck_assert_uint_eq(0x00, sample.memory[6]);
+
+    observer_publish(observer);
+    ck_assert_int_eq(0, observer_read(observer, &sample));
+    ck_assert_uint_eq(2, sample.sequence);
+    ck_assert_uint_eq(0x9000, PC(sample.regs));
+    ck_assert_uint_eq(0xAA, sample.memory[0]);
+
+    // Pages are not tracked: writes keep the fast path.
+    ck_assert_ptr_ne(NULL, bus.page[4].write);
+    ck_assert_uint_eq(0, sample.version[1]);
+    observer_free(observer);
+}
+END_TEST
+
+START_TEST(test_observer_watch_limits)
+{
+    struct observer_t* observer = observer_create(&cpu, 0);
+    int i;
+    ck_assert_int_eq(-1, observer_watch(observer, 0, OBSERVER_BYTES + 1));
+    for (i = 0; i < OBSERVER_RANGES; i++) {
+        ck_assert_int_eq(0, observer_watch(observer, i * 0x100, 16));
+    }
+    ck_assert_int_eq(-1, observer_watch(observer, 0x8000, 1));
+    observer_free(observer);
+}
+END_TEST
+
+START_TEST(test_observer_versions)
+{
+    struct observer_t* observer = observer_create(&cpu, 1);
+    struct observer_sample_t sample;
+
+    mem_write(&cpu, 0x4000, 0x01);
+    mem_write(&cpu, 0x4FFF, 0x01);
+    mem_write(&cpu, 0xC000, 0x01);
+    observer_publish(observer);
+    ck_assert_int_eq(0, observer_read(observer, &sample));
+    ck_assert_uint_eq(1, sample.version[4]);
+    ck_assert_uint_eq(1, sample.version[12]);
+    ck_assert_uint_eq(0, sample.version[5]);
+
+    // Only pages written since the last publication move.
+    mem_write(&cpu, 0xC001, 0x02);
+    observer_publish(observer);
+    observer_publish(observer);
+    ck_assert_int_eq(0, observer_read(observer, &sample));
+    ck_assert_uint_eq(1, sample.version[4]);
+    ck_assert_uint_eq(2, sample.version[12]);
+    observer_free(observer);
+    ck_assert_ptr_eq(NULL, bus.dirty);
+}
+END_TEST
+
+#define PUBLICATIONS 200000
+
+static atomic_int done;
+
+// Keeps every register pair and watched byte equal to the same counter.
+static void*
+publisher(void* arg)
+{
+    struct observer_t* observer = arg;
+    int i;
+    for (i = 1; i <= PUBLICATIONS; i++) {
+        REG_BC(cpu) = REG_DE(cpu) = REG_HL(cpu) = i;
+        PC(cpu) = i;
+        memset(&ram[0x6000], i, 64);
+        observer_publish(observer);
+    }
+    atomic_store(&done, 1);
+    return NULL;
+}
+
+START_TEST(test_observer_concurrent)
+{
+    struct observer_t* observer = observer_create(&cpu, 0);
+    struct observer_sample_t sample;
+    unsigned last = 0;
+    long reads = 0;
+    pthread_t thread;
+    int i;
+
+    ck_assert_int_eq(0, observer_watch(observer, 0x6000, 64));
+    atomic_store(&done, 0);
+    ck_assert_int_eq(0, pthread_create(&thread, NULL, publisher, observer));
+    while (!atomic_load(&done)) {
+        if (observer_read(observer, &sample) != 0) continue;
+        reads++;
+        ck_assert_uint_ge(sample.sequence, last);
+        last = sample.sequence;
+        ck_assert_uint_eq(REG_BC(sample.regs), PC(sample.regs));
+        ck_assert_uint_eq(REG_DE(sample.regs), PC(sample.regs));
+        ck_assert_uint_eq(REG_HL(sample.regs), PC(sample.regs));
+        for (i = 0; i < 64; i++) {
+            ck_assert_uint_eq((byte) PC(sample.regs), sample.memory[i]);
+        }
+    }
+    pthread_join(thread, NULL);
+    ck_assert_int_eq(0, observer_read(observer, &sample));
+    ck_assert_uint_eq(PUBLICATIONS, sample.sequence);
+    ck_assert_uint_eq((word) PUBLICATIONS, PC(sample.regs));
+    ck_assert_int_gt(reads, 0);
+    observer_free(observer);
+}
+END_TEST
+
+Suite*
+gensuite_observer(void)
+{
+    TCase* tc_observer = tcase_create("Observers");
+    tcase_add_checked_fixture(tc_observer, setup_observer, NULL);
+    tcase_add_test(tc_observer, test_observer_publish);
+    tcase_add_test(tc_observer, test_observer_watch_limits);
+    tcase_add_test(tc_observer, test_observer_versions);
+    tcase_add_test(tc_observer, test_observer_concurrent);
+
+    Suite* s = suite_create("Observers");
+    suite_add_tcase(s, tc_observer);
+    return s;
+}
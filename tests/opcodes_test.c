@@ -20,10 +20,12 @@
  */
 
 #include <check.h>
+#include <stdio.h>          // stderr
 #include <stdlib.h>         // malloc, free
-#include <string.h>         // memset
+#include <string.h>         // memset, memcpy
 
 #include <cpu.h>
+#include <diff.h>
 #include <opcodes.h>
 
 #include "opcodes_test.h"
@@ -33,6 +35,9 @@ setup_cpu(void)
 {
     // See section 2.4 from The Undocumented Z80 Documented.
     memset(&cpu, 0xFF, sizeof(struct cpu_t));
+    memset(ram, 0xFF, sizeof(ram));
+    bus_init(&bus, ram);
+    cpu_init(&cpu, &bus);
     PC(cpu) = 0;
     cpu.tstates = 0;
 }
@@ -43,6 +48,32 @@ teardown_cpu(void)
     // No actually teardown.
 }
 
+// State before the instruction under test, see snapshot_state.
+static struct cpu_t before;
+static struct bus_t before_bus;
+static byte before_ram[0x10000];
+
+void
+snapshot_state(void)
+{
+    memcpy(before_ram, ram, sizeof(ram));
+    bus_init(&before_bus, before_ram);
+    memcpy(&before, &cpu, sizeof(struct cpu_t));
+    before.bus = &before_bus;
+}
+
+void
+assert_changed(unsigned regs)
+{
+    struct z80_diff_t diff;
+    z80_state_diff(&before, &cpu, &diff);
+    regs |= DIFF_PC | DIFF_TSTATES;
+    if (diff.regs != regs || diff.bytes) {
+        z80_diff_print(stderr, &diff, &before, &cpu);
+        ck_abort_msg("Unexpected state changes, diff printed above");
+    }
+}
+
 /**
  * Generate a testsuite for opcodes.
  */
@@ -70,5 +101,6 @@ gensuite_opcodes(void)
     suite_add_tcase(s, gen_x2_z0_tcase());
     suite_add_tcase(s, gen_x2_z1_tcase());
     suite_add_tcase(s, gen_x2_z2_tcase());
+    suite_add_tcase(s, gen_interrupts_tcase());
     return s;
 }
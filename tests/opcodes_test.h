@@ -28,10 +28,19 @@
 
 // Setup and teardown functions for test case fixtures.
 // cpu has to be global since fixture setup/teardown can't have arguments.
+// Its memory bus maps the whole address space to ram.
 struct cpu_t cpu;
+struct bus_t bus;
+byte ram[0x10000];
 void setup_cpu(void);
 void teardown_cpu(void);
 
+// Checks that an instruction changes nothing but PC, the T-state counter
+// and the given registers (see diff_reg_t), printing a diff otherwise.
+// Take the snapshot right before executing the instruction.
+void snapshot_state(void);
+void assert_changed(unsigned regs);
+
 // Different suites
 Suite* gensuite_opcodes(void);
 
@@ -61,5 +70,6 @@ TCase* gen_x2_z4_tcase(void);
 TCase* gen_x2_z5_tcase(void);
 TCase* gen_x2_z6_tcase(void);
 TCase* gen_x2_z7_tcase(void);
+TCase* gen_interrupts_tcase(void);
 
 #endif // OPCODES_TEST_H_
@@ -0,0 +1,112 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+
+#include <cpu.h>
+#include <opcodes.h>
+
+#include "../opcodes_test.h" // Testcase definitions.
+
+START_TEST(test_irq_disabled)
+{
+    cpu.iff1 = 0;
+    PC(cpu) = 0x1234;
+    ck_assert_int_eq(0, z80_irq(&cpu, 0xFF));
+    ck_assert_uint_eq(0x1234, PC(cpu));
+    ck_assert_uint_eq(0, cpu.tstates);
+}
+END_TEST
+
+START_TEST(test_irq_im0_rst)
+{
+    cpu.iff1 = cpu.iff2 = 1;
+    cpu.im = 0;
+    PC(cpu) = 0x1234;
+    SP(cpu) = 0x8000;
+    ck_assert_int_eq(1, z80_irq(&cpu, 0xD7));
+    ck_assert_uint_eq(0x0010, PC(cpu));
+    ck_assert_uint_eq(0x7FFE, SP(cpu));
+    ck_assert_uint_eq(0x34, ram[0x7FFE]);
+    ck_assert_uint_eq(0x12, ram[0x7FFF]);
+    ck_assert_uint_eq(0, cpu.iff1);
+    ck_assert_uint_eq(0, cpu.iff2);
+    ck_assert_uint_eq(13, cpu.tstates);
+}
+END_TEST
+
+START_TEST(test_irq_im1)
+{
+    cpu.iff1 = cpu.iff2 = 1;
+    cpu.im = 1;
+    PC(cpu) = 0x1234;
+    SP(cpu) = 0x8000;
+    ck_assert_int_eq(1, z80_irq(&cpu, 0x00));
+    ck_assert_uint_eq(0x0038, PC(cpu));
+    ck_assert_uint_eq(0x7FFE, SP(cpu));
+    ck_assert_uint_eq(13, cpu.tstates);
+}
+END_TEST
+
+START_TEST(test_irq_im2)
+{
+    cpu.iff1 = cpu.iff2 = 1;
+    cpu.im = 2;
+    cpu.i = 0x39;
+    ram[0x39FE] = 0x00;
+    ram[0x39FF] = 0x90;
+    PC(cpu) = 0x1234;
+    SP(cpu) = 0x8000;
+    ck_assert_int_eq(1, z80_irq(&cpu, 0xFE));
+    ck_assert_uint_eq(0x9000, PC(cpu));
+    ck_assert_uint_eq(0x34, ram[0x7FFE]);
+    ck_assert_uint_eq(0x12, ram[0x7FFF]);
+    ck_assert_uint_eq(19, cpu.tstates);
+}
+END_TEST
+
+START_TEST(test_nmi)
+{
+    cpu.iff1 = cpu.iff2 = 1;
+    PC(cpu) = 0x1234;
+    SP(cpu) = 0x8000;
+    z80_nmi(&cpu);
+    ck_assert_uint_eq(0x0066, PC(cpu));
+    ck_assert_uint_eq(0x34, ram[0x7FFE]);
+    ck_assert_uint_eq(0x12, ram[0x7FFF]);
+    ck_assert_uint_eq(0, cpu.iff1);
+    ck_assert_uint_eq(1, cpu.iff2);
+    ck_assert_uint_eq(11, cpu.tstates);
+}
+END_TEST
+
+TCase*
+gen_interrupts_tcase()
+{
+    TCase* test = tcase_create("Interrupts");
+    tcase_add_checked_fixture(test, setup_cpu, teardown_cpu);
+    tcase_add_test(test, test_irq_disabled);
+    tcase_add_test(test, test_irq_im0_rst);
+    tcase_add_test(test, test_irq_im1);
+    tcase_add_test(test, test_irq_im2);
+    tcase_add_test(test, test_nmi);
+    return test;
+}
@@ -28,7 +28,7 @@
 
 START_TEST(test_NOP)
 {
-    cpu.mem[0] = 0x00; // NOP
+    ram[0] = 0x00; // NOP
     
     execute_opcode(&cpu);
     
@@ -40,7 +40,7 @@ START_TEST(test_EX_AF_AF)
 {
     REG_AF(cpu) = 0x1234;
     ALT_AF(cpu) = 0x5678;
-    cpu.mem[0] = 0x08; // Opcode for EX AF, AF'
+    ram[0] = 0x08; // Opcode for EX AF, AF'
     
     execute_opcode(&cpu);
     
@@ -52,8 +52,8 @@ END_TEST
 
 START_TEST(test_DJNZ_D_jump)
 {
-    cpu.mem[0] = 0x10; // DJNZ opcode
-    cpu.mem[1] = 0x05; // 05h -> jump 5 bytes.
+    ram[0] = 0x10; // DJNZ opcode
+    ram[1] = 0x05; // 05h -> jump 5 bytes.
     REG_B(cpu) = 2; // Set B <= 2 -> The CPU MUST jump.
     
     execute_opcode(&cpu);
@@ -66,8 +66,8 @@ END_TEST
 
 START_TEST(test_DJNZ_D_nojump)
 {
-    cpu.mem[0] = 0x10; // DJNZ opcode
-    cpu.mem[1] = 0x05; // 05h -> jump 5 bytes
+    ram[0] = 0x10; // DJNZ opcode
+    ram[1] = 0x05; // 05h -> jump 5 bytes
     REG_B(cpu) = 1; // Set B <= 1 -> The CPU must NOT jump
 
     execute_opcode(&cpu);
@@ -80,8 +80,8 @@ END_TEST
 
 START_TEST(test_JR_D)
 {
-    cpu.mem[0] = 0x18; // JR opcode
-    cpu.mem[1] = 0x05; // 05h -> jump 5 bytes
+    ram[0] = 0x18; // JR opcode
+    ram[1] = 0x05; // 05h -> jump 5 bytes
 
     execute_opcode(&cpu);
     
@@ -92,8 +92,8 @@ END_TEST
 
 START_TEST(test_JR_NZ_D_jump)
 {
-    cpu.mem[0] = 0x20; // JR NZ opcode
-    cpu.mem[1] = 0x05; // 05h -> jump 5 bytes
+    ram[0] = 0x20; // JR NZ opcode
+    ram[1] = 0x05; // 05h -> jump 5 bytes
     FLAG_RST(cpu, FLAG_Z); // Reset zero flag: CPU MUST jump.
     
     execute_opcode(&cpu);
@@ -105,8 +105,8 @@ END_TEST
 
 START_TEST(test_JR_NZ_D_nojump)
 {
-    cpu.mem[0] = 0x20; // JR NZ
-    cpu.mem[1] = 0x05; // 05h -> jump 5 bytes
+    ram[0] = 0x20; // JR NZ
+    ram[1] = 0x05; // 05h -> jump 5 bytes
     FLAG_SET(cpu, FLAG_Z); // Set zero flag: CPU must NOT jump.
     
     execute_opcode(&cpu);
@@ -118,8 +118,8 @@ END_TEST
 
 START_TEST(test_JR_Z_D_jump)
 {
-    cpu.mem[0] = 0x28; // JR Z opcode
-    cpu.mem[1] = 0x05; // 05h -> jump 5 bytes
+    ram[0] = 0x28; // JR Z opcode
+    ram[1] = 0x05; // 05h -> jump 5 bytes
     FLAG_RST(cpu, FLAG_Z); // Reset zero flag: CPU must NOT jump
     
     execute_opcode(&cpu);
@@ -131,8 +131,8 @@ END_TEST
 
 START_TEST(test_JR_Z_D_nojump)
 {
-    cpu.mem[0] = 0x28; // JR Z opcode
-    cpu.mem[1] = 0x05; // 05h -> jump 5 bytes
+    ram[0] = 0x28; // JR Z opcode
+    ram[1] = 0x05; // 05h -> jump 5 bytes
     FLAG_SET(cpu, FLAG_Z); // Reset zero flag: CPU must NOT jump
     
     execute_opcode(&cpu);
@@ -144,8 +144,8 @@ END_TEST
 
 START_TEST(test_JR_NC_D_jump)
 {
-    cpu.mem[0] = 0x30; // Opcode for JR NC
-    cpu.mem[1] = 0x05; // 05h -> jump 5 bytes
+    ram[0] = 0x30; // Opcode for JR NC
+    ram[1] = 0x05; // 05h -> jump 5 bytes
     FLAG_RST(cpu, FLAG_C); // Reset carry flag: CPU MUST jump.
     
     execute_opcode(&cpu);
@@ -157,8 +157,8 @@ END_TEST
 
 START_TEST(test_JR_NC_D_nojump)
 {
-    cpu.mem[0] = 0x30; // Opcode for JR NC
-    cpu.mem[1] = 0x05; // 05h -> jump 5 bytes
+    ram[0] = 0x30; // Opcode for JR NC
+    ram[1] = 0x05; // 05h -> jump 5 bytes
     FLAG_SET(cpu, FLAG_C); // Set carry flag: CPU must NOT jump.
     
     execute_opcode(&cpu);
@@ -170,8 +170,8 @@ END_TEST
 
 START_TEST(test_JR_C_D_nojump)
 {
-    cpu.mem[0] = 0x38; // Opcode for JR C
-    cpu.mem[1] = 0x05; // 05h -> jump 5 bytes
+    ram[0] = 0x38; // Opcode for JR C
+    ram[1] = 0x05; // 05h -> jump 5 bytes
     FLAG_RST(cpu, FLAG_C); // Reset carry flag: CPU must NOT jump
     
     execute_opcode(&cpu);
@@ -183,8 +183,8 @@ END_TEST
 
 START_TEST(test_JR_C_D_jump)
 {
-    cpu.mem[0] = 0x38; // Opcode for JR C
-    cpu.mem[1] = 0x05; // 05h -> jump 5 bytes
+    ram[0] = 0x38; // Opcode for JR C
+    ram[1] = 0x05; // 05h -> jump 5 bytes
     FLAG_SET(cpu, FLAG_C); // Set carry flag: CPU MUST jump
     
     execute_opcode(&cpu);
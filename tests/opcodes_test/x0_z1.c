@@ -28,9 +28,9 @@
 
 START_TEST(test_LC_BC_NN)
 {
-    cpu.mem[0] = 0x01;
-    cpu.mem[1] = 0x34;
-    cpu.mem[2] = 0x12;
+    ram[0] = 0x01;
+    ram[1] = 0x34;
+    ram[2] = 0x12;
     
     execute_opcode(&cpu);
     
@@ -41,9 +41,9 @@ END_TEST
 
 START_TEST(test_LD_DE_NN)
 {
-    cpu.mem[0] = 0x11;
-    cpu.mem[1] = 0x34;
-    cpu.mem[2] = 0x12;
+    ram[0] = 0x11;
+    ram[1] = 0x34;
+    ram[2] = 0x12;
     
     execute_opcode(&cpu);
     
@@ -54,9 +54,9 @@ END_TEST
 
 START_TEST(test_LD_HL_NN)
 {
-    cpu.mem[0] = 0x21;
-    cpu.mem[1] = 0x34;
-    cpu.mem[2] = 0x12;
+    ram[0] = 0x21;
+    ram[1] = 0x34;
+    ram[2] = 0x12;
     
     execute_opcode(&cpu);
     
@@ -67,9 +67,9 @@ END_TEST
 
 START_TEST(test_LD_SP_NN)
 {
-    cpu.mem[0] = 0x31;
-    cpu.mem[1] = 0x34;
-    cpu.mem[2] = 0x12;
+    ram[0] = 0x31;
+    ram[1] = 0x34;
+    ram[2] = 0x12;
     
     execute_opcode(&cpu);
     
@@ -80,7 +80,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_BC)
 {
-    cpu.mem[0] = 0x09; // ADD HL, BC
+    ram[0] = 0x09; // ADD HL, BC
     REG_HL(cpu) = 0x4242;
     REG_BC(cpu) = 0x1111;
     
@@ -96,7 +96,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_BC_hf)
 {
-    cpu.mem[0] = 0x09; // ADD HL, BC
+    ram[0] = 0x09; // ADD HL, BC
     REG_HL(cpu) = 0x0800;
     REG_BC(cpu) = 0x0800;
     
@@ -112,7 +112,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_BC_cf)
 {
-    cpu.mem[0] = 0x09; // ADD HL, BC
+    ram[0] = 0x09; // ADD HL, BC
     REG_HL(cpu) = 0x8000;
     REG_BC(cpu) = 0x8000;
     
@@ -128,7 +128,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_BC_hcf)
 {
-    cpu.mem[0] = 0x09; // ADD HL, BC
+    ram[0] = 0x09; // ADD HL, BC
     REG_HL(cpu) = 0x8800;
     REG_BC(cpu) = 0x8800;
     
@@ -144,7 +144,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_DE)
 {
-    cpu.mem[0] = 0x19; // ADD HL, DE
+    ram[0] = 0x19; // ADD HL, DE
     REG_HL(cpu) = 0x4242;
     REG_DE(cpu) = 0x1111;
     
@@ -160,7 +160,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_DE_hf)
 {
-    cpu.mem[0] = 0x19; // ADD HL, DE
+    ram[0] = 0x19; // ADD HL, DE
     REG_HL(cpu) = 0x0800;
     REG_DE(cpu) = 0x0800;
     
@@ -176,7 +176,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_DE_cf)
 {
-    cpu.mem[0] = 0x19; // ADD HL, DE
+    ram[0] = 0x19; // ADD HL, DE
     REG_HL(cpu) = 0x8000;
     REG_DE(cpu) = 0x8000;
     
@@ -192,7 +192,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_DE_hcf)
 {
-    cpu.mem[0] = 0x19; // ADD HL, DE
+    ram[0] = 0x19; // ADD HL, DE
     REG_HL(cpu) = 0x8800;
     REG_DE(cpu) = 0x8800;
     
@@ -208,7 +208,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_HL)
 {
-    cpu.mem[0] = 0x29; // ADD HL, HL
+    ram[0] = 0x29; // ADD HL, HL
     REG_HL(cpu) = 0x4242;
     
     execute_opcode(&cpu);
@@ -223,7 +223,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_HL_hf)
 {
-    cpu.mem[0] = 0x29; // ADD HL, HL
+    ram[0] = 0x29; // ADD HL, HL
     REG_HL(cpu) = 0x0800;
     
     execute_opcode(&cpu);
@@ -238,7 +238,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_HL_cf)
 {
-    cpu.mem[0] = 0x29; // ADD HL, HL
+    ram[0] = 0x29; // ADD HL, HL
     REG_HL(cpu) = 0x8000;
     
     execute_opcode(&cpu);
@@ -253,7 +253,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_HL_hcf)
 {
-    cpu.mem[0] = 0x29; // ADD HL, HL
+    ram[0] = 0x29; // ADD HL, HL
     REG_HL(cpu) = 0x8800;
     
     execute_opcode(&cpu);
@@ -268,7 +268,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_SP)
 {
-    cpu.mem[0] = 0x39; // ADD HL, SP
+    ram[0] = 0x39; // ADD HL, SP
     REG_HL(cpu) = 0x4242;
     SP(cpu) = 0x1111;
     
@@ -284,7 +284,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_SP_hf)
 {
-    cpu.mem[0] = 0x39; // ADD HL, SP
+    ram[0] = 0x39; // ADD HL, SP
     REG_HL(cpu) = 0x0800;
     SP(cpu) = 0x0800;
     
@@ -300,7 +300,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_SP_cf)
 {
-    cpu.mem[0] = 0x39; // ADD HL, SP
+    ram[0] = 0x39; // ADD HL, SP
     REG_HL(cpu) = 0x8000;
     SP(cpu) = 0x8000;
     
@@ -316,7 +316,7 @@ END_TEST
 
 START_TEST(test_ADD_HL_SP_hcf)
 {
-    cpu.mem[0] = 0x39; // ADD HL, SP
+    ram[0] = 0x39; // ADD HL, SP
     REG_HL(cpu) = 0x8800;
     SP(cpu) = 0x8800;
     
@@ -28,63 +28,63 @@
 
 START_TEST(test_LD_iBC_A)
 {
-    cpu.mem[0] = 0x02; // LD (BC), A
+    ram[0] = 0x02; // LD (BC), A
     REG_BC(cpu) = 0x8000;
     REG_A(cpu) = 0x55;
     
     execute_opcode(&cpu);
     
-    ck_assert_uint_eq(0x55, cpu.mem[0x8000]);
+    ck_assert_uint_eq(0x55, ram[0x8000]);
     ck_assert_uint_eq(7, cpu.tstates);
 }
 END_TEST
 
 START_TEST(test_LD_iDE_A)
 {
-    cpu.mem[0] = 0x12; // LD (DE), A
+    ram[0] = 0x12; // LD (DE), A
     REG_DE(cpu) = 0x8000;
     REG_A(cpu) = 0x55;
     
     execute_opcode(&cpu);
     
-    ck_assert_uint_eq(0x55, cpu.mem[0x8000]);
+    ck_assert_uint_eq(0x55, ram[0x8000]);
     ck_assert_uint_eq(7, cpu.tstates);
 }
 END_TEST
 
 START_TEST(test_LD_iNN_HL)
 {
-    cpu.mem[0] = 0x22; // LD (NN), HL
-    cpu.mem[1] = 0x00;
-    cpu.mem[2] = 0x80;
+    ram[0] = 0x22; // LD (NN), HL
+    ram[1] = 0x00;
+    ram[2] = 0x80;
     REG_HL(cpu) = 0x1234;
     
     execute_opcode(&cpu);
     
-    ck_assert_uint_eq(0x34, cpu.mem[0x8000]);
-    ck_assert_uint_eq(0x12, cpu.mem[0x8001]);
+    ck_assert_uint_eq(0x34, ram[0x8000]);
+    ck_assert_uint_eq(0x12, ram[0x8001]);
     ck_assert_uint_eq(16, cpu.tstates);
 }
 END_TEST
 
 START_TEST(test_LD_iNN_A)
 {
-    cpu.mem[0] = 0x32;
-    cpu.mem[1] = 0x00;
-    cpu.mem[2] = 0x80;
+    ram[0] = 0x32;
+    ram[1] = 0x00;
+    ram[2] = 0x80;
     REG_A(cpu) = 0x55;
     
     execute_opcode(&cpu);
     
-    ck_assert_uint_eq(0x55, cpu.mem[0x8000]);
+    ck_assert_uint_eq(0x55, ram[0x8000]);
     ck_assert_uint_eq(13, cpu.tstates);
 }
 END_TEST
 
 START_TEST(test_LD_A_iBC)
 {
-    cpu.mem[0] = 0x0A; // LD A, (BC)
-    cpu.mem[0x8000] = 0x55;
+    ram[0] = 0x0A; // LD A, (BC)
+    ram[0x8000] = 0x55;
     REG_BC(cpu) = 0x8000;
     
     execute_opcode(&cpu);
@@ -96,8 +96,8 @@ END_TEST
 
 START_TEST(test_LD_A_iDE)
 {
-    cpu.mem[0] = 0x1A; // LD A, (DE)
-    cpu.mem[0x8000] = 0x55;
+    ram[0] = 0x1A; // LD A, (DE)
+    ram[0x8000] = 0x55;
     REG_DE(cpu) = 0x8000;
     
     execute_opcode(&cpu);
@@ -110,11 +110,11 @@ END_TEST
 /* Test for LD HL, (NN) instruction. */
 START_TEST(test_LD_HL_iNN)
 {
-    cpu.mem[0] = 0x2A; // LD HL, (NN)
-    cpu.mem[1] = 0x00;
-    cpu.mem[2] = 0x80;
-    cpu.mem[0x8000] = 0x34;
-    cpu.mem[0x8001] = 0x12;
+    ram[0] = 0x2A; // LD HL, (NN)
+    ram[1] = 0x00;
+    ram[2] = 0x80;
+    ram[0x8000] = 0x34;
+    ram[0x8001] = 0x12;
     
     execute_opcode(&cpu);
     
@@ -125,10 +125,10 @@ END_TEST
 
 START_TEST(test_LD_A_iNN)
 {
-    cpu.mem[0] = 0x3A;
-    cpu.mem[1] = 0x00;
-    cpu.mem[2] = 0x80;
-    cpu.mem[0x8000] = 0x55;
+    ram[0] = 0x3A;
+    ram[1] = 0x00;
+    ram[2] = 0x80;
+    ram[0x8000] = 0x55;
 
     execute_opcode(&cpu);
     
@@ -28,7 +28,7 @@
 
 START_TEST(test_INC_BC)
 {
-    cpu.mem[0] = 0x03;
+    ram[0] = 0x03;
     REG_BC(cpu) = 0x1234;
     
     execute_opcode(&cpu);
@@ -40,7 +40,7 @@ END_TEST
 
 START_TEST(test_INC_DE)
 {
-    cpu.mem[0] = 0x13;
+    ram[0] = 0x13;
     REG_DE(cpu) = 0x1234;
     
     execute_opcode(&cpu);
@@ -52,7 +52,7 @@ END_TEST
 
 START_TEST(test_INC_HL)
 {
-    cpu.mem[0] = 0x23;
+    ram[0] = 0x23;
     REG_HL(cpu) = 0x1234;
     
     execute_opcode(&cpu);
@@ -64,7 +64,7 @@ END_TEST
 
 START_TEST(test_INC_SP)
 {
-    cpu.mem[0] = 0x33;
+    ram[0] = 0x33;
     SP(cpu) = 0x1234;
     
     execute_opcode(&cpu);
@@ -76,7 +76,7 @@ END_TEST
 
 START_TEST(test_DEC_BC)
 {
-    cpu.mem[0] = 0x0B;
+    ram[0] = 0x0B;
     REG_BC(cpu) = 0x1234;
     
     execute_opcode(&cpu);
@@ -88,7 +88,7 @@ END_TEST
 
 START_TEST(test_DEC_DE)
 {
-    cpu.mem[0] = 0x1B;
+    ram[0] = 0x1B;
     REG_DE(cpu) = 0x1234;
     
     execute_opcode(&cpu);
@@ -100,7 +100,7 @@ END_TEST
 
 START_TEST(test_DEC_HL)
 {
-    cpu.mem[0] = 0x2B;
+    ram[0] = 0x2B;
     REG_HL(cpu) = 0x1234;
     
     execute_opcode(&cpu);
@@ -112,7 +112,7 @@ END_TEST
 
 START_TEST(test_DEC_SP)
 {
-    cpu.mem[0] = 0x3B;
+    ram[0] = 0x3B;
     SP(cpu) = 0x1234;
     
     execute_opcode(&cpu);
@@ -28,7 +28,7 @@
 
 START_TEST(test_DEC_B)
 {
-    cpu.mem[0] = 0x05;
+    ram[0] = 0x05;
     REG_B(cpu) = 0x12;
     
     execute_opcode(&cpu);
@@ -40,7 +40,7 @@ END_TEST
 
 START_TEST(test_DEC_C)
 {
-    cpu.mem[0] = 0x0D;
+    ram[0] = 0x0D;
     REG_C(cpu) = 0x12;
     
     execute_opcode(&cpu);
@@ -52,7 +52,7 @@ END_TEST
 
 START_TEST(test_DEC_D)
 {
-    cpu.mem[0] = 0x15;
+    ram[0] = 0x15;
     REG_D(cpu) = 0x12;
     
     execute_opcode(&cpu);
@@ -64,7 +64,7 @@ END_TEST
 
 START_TEST(test_DEC_E)
 {
-    cpu.mem[0] = 0x1D;
+    ram[0] = 0x1D;
     REG_E(cpu) = 0x12;
     
     execute_opcode(&cpu);
@@ -76,7 +76,7 @@ END_TEST
 
 START_TEST(test_DEC_H)
 {
-    cpu.mem[0] = 0x25;
+    ram[0] = 0x25;
     REG_H(cpu) = 0x12;
     
     execute_opcode(&cpu);
@@ -88,7 +88,7 @@ END_TEST
 
 START_TEST(test_DEC_L)
 {
-    cpu.mem[0] = 0x2D;
+    ram[0] = 0x2D;
     REG_L(cpu) = 0x12;
     
     execute_opcode(&cpu);
@@ -100,20 +100,20 @@ END_TEST
 
 START_TEST(test_DEC_iHL)
 {
-    cpu.mem[0] = 0x35;
+    ram[0] = 0x35;
     REG_HL(cpu) = 0x8000;
-    cpu.mem[0x8000] = 0x12;
+    ram[0x8000] = 0x12;
     
     execute_opcode(&cpu);
     
-    ck_assert_uint_eq(0x11, cpu.mem[0x8000]);
+    ck_assert_uint_eq(0x11, ram[0x8000]);
     ck_assert_uint_eq(11, cpu.tstates);
 }
 END_TEST
 
 START_TEST(test_DEC_A)
 {
-    cpu.mem[0] = 0x3D;
+    ram[0] = 0x3D;
     REG_A(cpu) = 0x12;
     
     execute_opcode(&cpu);
@@ -125,7 +125,7 @@ END_TEST
 
 START_TEST(test_DEC_r8_sf)
 {
-    cpu.mem[0] = 0x05;
+    ram[0] = 0x05;
     byte val = 0;
     do {
         REG_B(cpu) = val;
@@ -143,7 +143,7 @@ END_TEST
 
 START_TEST(test_DEC_r8_zf)
 {
-    cpu.mem[0] = 0x05;
+    ram[0] = 0x05;
     byte val = 0;
     do {
         REG_B(cpu) = val;
@@ -161,7 +161,7 @@ END_TEST
 
 START_TEST(test_DEC_r8_hf)
 {
-    cpu.mem[0] = 0x05;
+    ram[0] = 0x05;
     byte val = 0;
     do {
         REG_B(cpu) = val;
@@ -179,7 +179,7 @@ END_TEST
 
 START_TEST(test_DEC_r8_vf)
 {
-    cpu.mem[0] = 0x05;
+    ram[0] = 0x05;
     byte val = 0x00;
     do {
         REG_B(cpu) = val;
@@ -196,7 +196,7 @@ END_TEST
 
 START_TEST(test_DEC_r8_daa)
 {
-    cpu.mem[0] = 0x05;
+    ram[0] = 0x05;
     REG_B(cpu) = 0x12;
     
     execute_opcode(&cpu);
@@ -28,8 +28,8 @@
 
 START_TEST(test_LD_B_NN)
 {
-    cpu.mem[0] = 0x06;
-    cpu.mem[1] = 0x55;
+    ram[0] = 0x06;
+    ram[1] = 0x55;
     
     execute_opcode(&cpu);
     
@@ -39,8 +39,8 @@ END_TEST
 
 START_TEST(test_LD_C_NN)
 {
-    cpu.mem[0] = 0x0E;
-    cpu.mem[1] = 0x55;
+    ram[0] = 0x0E;
+    ram[1] = 0x55;
     
     execute_opcode(&cpu);
     
@@ -50,8 +50,8 @@ END_TEST
 
 START_TEST(test_LD_D_NN)
 {
-    cpu.mem[0] = 0x16;
-    cpu.mem[1] = 0x55;
+    ram[0] = 0x16;
+    ram[1] = 0x55;
     
     execute_opcode(&cpu);
     
@@ -61,8 +61,8 @@ END_TEST
 
 START_TEST(test_LD_E_NN)
 {
-    cpu.mem[0] = 0x1E;
-    cpu.mem[1] = 0x55;
+    ram[0] = 0x1E;
+    ram[1] = 0x55;
     
     execute_opcode(&cpu);
     
@@ -72,8 +72,8 @@ END_TEST
 
 START_TEST(test_LD_H_NN)
 {
-    cpu.mem[0] = 0x26;
-    cpu.mem[1] = 0x55;
+    ram[0] = 0x26;
+    ram[1] = 0x55;
     
     execute_opcode(&cpu);
     
@@ -83,8 +83,8 @@ END_TEST
 
 START_TEST(test_LD_L_NN)
 {
-    cpu.mem[0] = 0x2E;
-    cpu.mem[1] = 0x55;
+    ram[0] = 0x2E;
+    ram[1] = 0x55;
     
     execute_opcode(&cpu);
     
@@ -94,20 +94,20 @@ END_TEST
 
 START_TEST(test_LD_iHL_NN)
 {
-    cpu.mem[0] = 0x36;
-    cpu.mem[1] = 0x55;
+    ram[0] = 0x36;
+    ram[1] = 0x55;
     REG_HL(cpu) = 0x8000;
     
     execute_opcode(&cpu);
     
-    ck_assert_uint_eq(0x55, cpu.mem[0x8000]);
+    ck_assert_uint_eq(0x55, ram[0x8000]);
 }
 END_TEST
 
 START_TEST(test_LD_A_NN)
 {
-    cpu.mem[0] = 0x3E;
-    cpu.mem[1] = 0x55;
+    ram[0] = 0x3E;
+    ram[1] = 0x55;
     
     execute_opcode(&cpu);
     
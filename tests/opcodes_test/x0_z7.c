@@ -29,7 +29,7 @@
 START_TEST(test_RLCA)
 {
     // Example from Z80 Manual: 1000 1000 -> 0001 0001 (CF = 1)
-    cpu.mem[0] = 0x07;
+    ram[0] = 0x07;
     REG_A(cpu) = 0x88;
     
     execute_opcode(&cpu);
@@ -44,7 +44,7 @@ END_TEST
 START_TEST(test_RLA)
 {
     // Example from Z80 Manual: 0111 0110 (CF = 1) -> 1110 1101 (CF = 0)
-    cpu.mem[0] = 0x17;
+    ram[0] = 0x17;
     REG_A(cpu) = 0x76;
     FLAG_SET(cpu, FLAG_C);
     
@@ -61,7 +61,7 @@ START_TEST(test_RRCA)
 {
     // Example form Z80 Manual is broken and should be reported.
     // 0001 0001 -> 1000 1000 (CF = 1)
-    cpu.mem[0] = 0x0F;
+    ram[0] = 0x0F;
     REG_A(cpu) = 0x11;
     
     execute_opcode(&cpu);
@@ -76,7 +76,7 @@ END_TEST
 START_TEST(test_RRA)
 {
     // Example from Z80 Manual: 1110 0001 (CF = 0) -> 0111 0000 (CF = 1)
-    cpu.mem[0] = 0x1F;
+    ram[0] = 0x1F;
     REG_A(cpu) = 0xE1;
     FLAG_RST(cpu, FLAG_C);
     
@@ -92,7 +92,7 @@ END_TEST
 START_TEST(test_CPL)
 {
     // Example from Book: 1011 0100 -> 0100 1011
-    cpu.mem[0] = 0x2F;
+    ram[0] = 0x2F;
     REG_A(cpu) = 0xB4;
     
     execute_opcode(&cpu);
@@ -105,7 +105,7 @@ END_TEST
 
 START_TEST(test_SCF)
 {
-    cpu.mem[0] = 0x37;
+    ram[0] = 0x37;
     
     execute_opcode(&cpu);
     
@@ -117,7 +117,7 @@ END_TEST
 
 START_TEST(test_CCF_reset)
 {
-    cpu.mem[0] = 0x3F;
+    ram[0] = 0x3F;
     FLAG_SET(cpu, FLAG_C);
     
     execute_opcode(&cpu);
@@ -130,7 +130,7 @@ END_TEST
 
 START_TEST(test_CCF_set)
 {
-    cpu.mem[0] = 0x3F;
+    ram[0] = 0x3F;
     FLAG_RST(cpu, FLAG_C);
     
     execute_opcode(&cpu);
@@ -22,88 +22,105 @@
 #include <check.h>
 
 #include <cpu.h>
+#include <diff.h>
 #include <opcodes.h>
 
 #include "../opcodes_test.h" // Testcase definitions.
 
 START_TEST(test_LD_B_B)
 {
-    cpu.mem[0] = 0x40;
+    ram[0] = 0x40;
     REG_B(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_B(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(0);
 }
 END_TEST
 
 START_TEST(test_LD_B_C)
 {
-    cpu.mem[0] = 0x41;
+    ram[0] = 0x41;
     REG_C(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_B(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_B_D)
 {
-    cpu.mem[0] = 0x42;
+    ram[0] = 0x42;
     REG_D(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_B(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_B_E)
 {
-    cpu.mem[0] = 0x43;
+    ram[0] = 0x43;
     REG_E(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_B(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_B_H)
 {
-    cpu.mem[0] = 0x44;
+    ram[0] = 0x44;
     REG_H(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_B(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_B_L)
 {
-    cpu.mem[0] = 0x45;
+    ram[0] = 0x45;
     REG_L(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_B(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_B_iHL)
 {
-    cpu.mem[0] = 0x46;
+    ram[0] = 0x46;
     REG_HL(cpu) = 0x8000;
-    cpu.mem[0x8000] = 0x12;
+    ram[0x8000] = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_B(cpu));
     ck_assert_uint_eq(7, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_B_A)
 {
-    cpu.mem[0] = 0x47;
+    ram[0] = 0x47;
     REG_A(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_B(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
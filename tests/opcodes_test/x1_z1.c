@@ -22,88 +22,105 @@
 #include <check.h>
 
 #include <cpu.h>
+#include <diff.h>
 #include <opcodes.h>
 
 #include "../opcodes_test.h" // Testcase definitions.
 
 START_TEST(test_LD_C_B)
 {
-    cpu.mem[0] = 0x48;
+    ram[0] = 0x48;
     REG_B(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_C(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_C_C)
 {
-    cpu.mem[0] = 0x49;
+    ram[0] = 0x49;
     REG_C(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_C(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(0);
 }
 END_TEST
 
 START_TEST(test_LD_C_D)
 {
-    cpu.mem[0] = 0x4A;
+    ram[0] = 0x4A;
     REG_D(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_C(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_C_E)
 {
-    cpu.mem[0] = 0x4B;
+    ram[0] = 0x4B;
     REG_E(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_C(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_C_H)
 {
-    cpu.mem[0] = 0x4C;
+    ram[0] = 0x4C;
     REG_H(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_C(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_C_L)
 {
-    cpu.mem[0] = 0x4D;
+    ram[0] = 0x4D;
     REG_L(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_C(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_C_iHL)
 {
-    cpu.mem[0] = 0x4E;
+    ram[0] = 0x4E;
     REG_HL(cpu) = 0x8000;
-    cpu.mem[0x8000] = 0x12;
+    ram[0x8000] = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_C(cpu));
     ck_assert_uint_eq(7, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
 START_TEST(test_LD_C_A)
 {
-    cpu.mem[0] = 0x4F;
+    ram[0] = 0x4F;
     REG_A(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_C(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_BC);
 }
 END_TEST
 
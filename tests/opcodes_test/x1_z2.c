@@ -22,88 +22,105 @@
 #include <check.h>
 
 #include <cpu.h>
+#include <diff.h>
 #include <opcodes.h>
 
 #include "../opcodes_test.h" // Testcase definitions.
 
 START_TEST(test_LD_D_B)
 {
-    cpu.mem[0] = 0x50;
+    ram[0] = 0x50;
     REG_B(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_D(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_D_C)
 {
-    cpu.mem[0] = 0x51;
+    ram[0] = 0x51;
     REG_C(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_D(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_D_D)
 {
-    cpu.mem[0] = 0x52;
+    ram[0] = 0x52;
     REG_D(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_D(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(0);
 }
 END_TEST
 
 START_TEST(test_LD_D_E)
 {
-    cpu.mem[0] = 0x53;
+    ram[0] = 0x53;
     REG_E(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_D(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_D_H)
 {
-    cpu.mem[0] = 0x54;
+    ram[0] = 0x54;
     REG_H(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_D(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_D_L)
 {
-    cpu.mem[0] = 0x55;
+    ram[0] = 0x55;
     REG_L(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_D(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_D_iHL)
 {
-    cpu.mem[0] = 0x56;
+    ram[0] = 0x56;
     REG_HL(cpu) = 0x8000;
-    cpu.mem[0x8000] = 0x12;
+    ram[0x8000] = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_D(cpu));
     ck_assert_uint_eq(7, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_D_A)
 {
-    cpu.mem[0] = 0x57;
+    ram[0] = 0x57;
     REG_A(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_D(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
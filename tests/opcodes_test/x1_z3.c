@@ -22,88 +22,105 @@
 #include <check.h>
 
 #include <cpu.h>
+#include <diff.h>
 #include <opcodes.h>
 
 #include "../opcodes_test.h" // Testcase definitions.
 
 START_TEST(test_LD_E_B)
 {
-    cpu.mem[0] = 0x58;
+    ram[0] = 0x58;
     REG_B(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_E(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_E_C)
 {
-    cpu.mem[0] = 0x59;
+    ram[0] = 0x59;
     REG_C(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_E(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_E_D)
 {
-    cpu.mem[0] = 0x5A;
+    ram[0] = 0x5A;
     REG_D(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_E(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_E_E)
 {
-    cpu.mem[0] = 0x5B;
+    ram[0] = 0x5B;
     REG_E(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_E(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(0);
 }
 END_TEST
 
 START_TEST(test_LD_E_H)
 {
-    cpu.mem[0] = 0x5C;
+    ram[0] = 0x5C;
     REG_H(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_E(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_E_L)
 {
-    cpu.mem[0] = 0x5D;
+    ram[0] = 0x5D;
     REG_L(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_E(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_E_iHL)
 {
-    cpu.mem[0] = 0x5E;
+    ram[0] = 0x5E;
     REG_HL(cpu) = 0x8000;
-    cpu.mem[0x8000] = 0x12;
+    ram[0x8000] = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_E(cpu));
     ck_assert_uint_eq(7, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
 START_TEST(test_LD_E_A)
 {
-    cpu.mem[0] = 0x5F;
+    ram[0] = 0x5F;
     REG_A(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_E(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_DE);
 }
 END_TEST
 
@@ -22,88 +22,105 @@
 #include <check.h>
 
 #include <cpu.h>
+#include <diff.h>
 #include <opcodes.h>
 
 #include "../opcodes_test.h" // Testcase definitions.
 
 START_TEST(test_LD_H_B)
 {
-    cpu.mem[0] = 0x60;
+    ram[0] = 0x60;
     REG_B(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_H(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_H_C)
 {
-    cpu.mem[0] = 0x61;
+    ram[0] = 0x61;
     REG_C(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_H(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_H_D)
 {
-    cpu.mem[0] = 0x62;
+    ram[0] = 0x62;
     REG_D(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_H(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_H_E)
 {
-    cpu.mem[0] = 0x63;
+    ram[0] = 0x63;
     REG_E(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_H(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_H_H)
 {
-    cpu.mem[0] = 0x64;
+    ram[0] = 0x64;
     REG_H(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_H(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(0);
 }
 END_TEST
 
 START_TEST(test_LD_H_L)
 {
-    cpu.mem[0] = 0x65;
+    ram[0] = 0x65;
     REG_L(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_H(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_H_iHL)
 {
-    cpu.mem[0] = 0x66;
+    ram[0] = 0x66;
     REG_HL(cpu) = 0x8000;
-    cpu.mem[0x8000] = 0x12;
+    ram[0x8000] = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_H(cpu));
     ck_assert_uint_eq(7, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_H_A)
 {
-    cpu.mem[0] = 0x67;
+    ram[0] = 0x67;
     REG_A(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_H(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
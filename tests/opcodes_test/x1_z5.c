@@ -22,88 +22,105 @@
 #include <check.h>
 
 #include <cpu.h>
+#include <diff.h>
 #include <opcodes.h>
 
 #include "../opcodes_test.h" // Testcase definitions.
 
 START_TEST(test_LD_L_B)
 {
-    cpu.mem[0] = 0x68;
+    ram[0] = 0x68;
     REG_B(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_L(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_L_C)
 {
-    cpu.mem[0] = 0x69;
+    ram[0] = 0x69;
     REG_C(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_L(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_L_D)
 {
-    cpu.mem[0] = 0x6A;
+    ram[0] = 0x6A;
     REG_D(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_L(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_L_E)
 {
-    cpu.mem[0] = 0x6B;
+    ram[0] = 0x6B;
     REG_E(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_L(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_L_H)
 {
-    cpu.mem[0] = 0x6C;
+    ram[0] = 0x6C;
     REG_H(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_L(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_L_L)
 {
-    cpu.mem[0] = 0x6D;
+    ram[0] = 0x6D;
     REG_L(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_L(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(0);
 }
 END_TEST
 
 START_TEST(test_LD_L_iHL)
 {
-    cpu.mem[0] = 0x6E;
+    ram[0] = 0x6E;
     REG_HL(cpu) = 0x8000;
-    cpu.mem[0x8000] = 0x12;
+    ram[0x8000] = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_L(cpu));
     ck_assert_uint_eq(7, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
 START_TEST(test_LD_L_A)
 {
-    cpu.mem[0] = 0x6F;
+    ram[0] = 0x6F;
     REG_A(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_L(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_HL);
 }
 END_TEST
 
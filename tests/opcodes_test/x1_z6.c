@@ -28,75 +28,75 @@
 
 START_TEST(test_LD_iHL_B)
 {
-    cpu.mem[0] = 0x70;
+    ram[0] = 0x70;
     REG_HL(cpu) = 0x8000;
     REG_B(cpu) = 0x12;
     execute_opcode(&cpu);
-    ck_assert_uint_eq(0x12, cpu.mem[0x8000]);
+    ck_assert_uint_eq(0x12, ram[0x8000]);
     ck_assert_uint_eq(7, cpu.tstates);
 }
 END_TEST
 
 START_TEST(test_LD_iHL_C)
 {
-    cpu.mem[0] = 0x71;
+    ram[0] = 0x71;
     REG_HL(cpu) = 0x8000;
     REG_C(cpu) = 0x12;
     execute_opcode(&cpu);
-    ck_assert_uint_eq(0x12, cpu.mem[0x8000]);
+    ck_assert_uint_eq(0x12, ram[0x8000]);
     ck_assert_uint_eq(7, cpu.tstates);
 }
 END_TEST
 
 START_TEST(test_LD_iHL_D)
 {
-    cpu.mem[0] = 0x72;
+    ram[0] = 0x72;
     REG_HL(cpu) = 0x8000;
     REG_D(cpu) = 0x12;
     execute_opcode(&cpu);
-    ck_assert_uint_eq(0x12, cpu.mem[0x8000]);
+    ck_assert_uint_eq(0x12, ram[0x8000]);
     ck_assert_uint_eq(7, cpu.tstates);
 }
 END_TEST
 
 START_TEST(test_LD_iHL_E)
 {
-    cpu.mem[0] = 0x73;
+    ram[0] = 0x73;
     REG_HL(cpu) = 0x8000;
     REG_E(cpu) = 0x12;
     execute_opcode(&cpu);
-    ck_assert_uint_eq(0x12, cpu.mem[0x8000]);
+    ck_assert_uint_eq(0x12, ram[0x8000]);
     ck_assert_uint_eq(7, cpu.tstates);
 }
 END_TEST
 
 START_TEST(test_LD_iHL_H)
 {
-    cpu.mem[0] = 0x74;
+    ram[0] = 0x74;
     REG_HL(cpu) = 0x1234;
     execute_opcode(&cpu);
-    ck_assert_uint_eq(0x12, cpu.mem[0x1234]);
+    ck_assert_uint_eq(0x12, ram[0x1234]);
     ck_assert_uint_eq(7, cpu.tstates);
 }
 END_TEST
 
 START_TEST(test_LD_iHL_L)
 {
-    cpu.mem[0] = 0x75;
+    ram[0] = 0x75;
     REG_HL(cpu) = 0x1234;
     execute_opcode(&cpu);
-    ck_assert_uint_eq(0x34, cpu.mem[0x1234]);
+    ck_assert_uint_eq(0x34, ram[0x1234]);
     ck_assert_uint_eq(7, cpu.tstates);
 }
 END_TEST
 
 START_TEST(test_LD_iHL_A)
 {
-    cpu.mem[0] = 0x77;
+    ram[0] = 0x77;
     REG_HL(cpu) = 0x8000;
     REG_A(cpu) = 0x12;
     execute_opcode(&cpu);
-    ck_assert_uint_eq(0x12, cpu.mem[0x8000]);
+    ck_assert_uint_eq(0x12, ram[0x8000]);
     ck_assert_uint_eq(7, cpu.tstates);
 }
 END_TEST
@@ -22,88 +22,105 @@
 #include <check.h>
 
 #include <cpu.h>
+#include <diff.h>
 #include <opcodes.h>
 
 #include "../opcodes_test.h" // Testcase definitions.
 
 START_TEST(test_LD_A_B)
 {
-    cpu.mem[0] = 0x78;
+    ram[0] = 0x78;
     REG_B(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_LD_A_C)
 {
-    cpu.mem[0] = 0x79;
+    ram[0] = 0x79;
     REG_C(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_LD_A_D)
 {
-    cpu.mem[0] = 0x7A;
+    ram[0] = 0x7A;
     REG_D(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_LD_A_E)
 {
-    cpu.mem[0] = 0x7B;
+    ram[0] = 0x7B;
     REG_E(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_LD_A_H)
 {
-    cpu.mem[0] = 0x7C;
+    ram[0] = 0x7C;
     REG_H(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_LD_A_L)
 {
-    cpu.mem[0] = 0x7D;
+    ram[0] = 0x7D;
     REG_L(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_LD_A_iHL)
 {
-    cpu.mem[0] = 0x7E;
+    ram[0] = 0x7E;
     REG_HL(cpu) = 0x8000;
-    cpu.mem[0x8000] = 0x12;
+    ram[0x8000] = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(7, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_LD_A_A)
 {
-    cpu.mem[0] = 0x7F;
+    ram[0] = 0x7F;
     REG_A(cpu) = 0x12;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(0);
 }
 END_TEST
 
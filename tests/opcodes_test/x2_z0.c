@@ -22,6 +22,7 @@
 #include <check.h>
 
 #include <cpu.h>
+#include <diff.h>
 #include <opcodes.h>
 
 #include "../opcodes_test.h" // Testcase definitions.
@@ -34,111 +35,127 @@
 
 START_TEST(test_ADD_A_B)
 {
-    cpu.mem[0] = 0x80;
+    ram[0] = 0x80;
     REG_A(cpu) = 0x12;
     REG_B(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x46, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADD_A_C)
 {
-    cpu.mem[0] = 0x81;
+    ram[0] = 0x81;
     REG_A(cpu) = 0x12;
     REG_C(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x46, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADD_A_D)
 {
-    cpu.mem[0] = 0x82;
+    ram[0] = 0x82;
     REG_A(cpu) = 0x12;
     REG_D(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x46, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADD_A_E)
 {
-    cpu.mem[0] = 0x83;
+    ram[0] = 0x83;
     REG_A(cpu) = 0x12;
     REG_E(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x46, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADD_A_H)
 {
-    cpu.mem[0] = 0x84;
+    ram[0] = 0x84;
     REG_A(cpu) = 0x12;
     REG_H(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x46, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADD_A_L)
 {
-    cpu.mem[0] = 0x85;
+    ram[0] = 0x85;
     REG_A(cpu) = 0x12;
     REG_L(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x46, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADD_A_iHL)
 {
-    cpu.mem[0] = 0x86;
+    ram[0] = 0x86;
     REG_A(cpu) = 0x12;
     REG_HL(cpu) = 0x8000;
-    cpu.mem[0x8000] = 0x34;
+    ram[0x8000] = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x46, REG_A(cpu));
     ck_assert_uint_eq(7, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADD_A_A)
 {
-    cpu.mem[0] = 0x87;
+    ram[0] = 0x87;
     REG_A(cpu) = 0x12;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x24, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADD_A_sf)
 {
-    cpu.mem[0] = 0x80;
+    ram[0] = 0x80;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -156,7 +173,7 @@ END_TEST
 
 START_TEST(test_ADD_A_zf)
 {
-    cpu.mem[0] = 0x80;
+    ram[0] = 0x80;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -174,7 +191,7 @@ END_TEST
 
 START_TEST(test_ADD_A_hf)
 {
-    cpu.mem[0] = 0x80;
+    ram[0] = 0x80;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -193,28 +210,32 @@ END_TEST
 START_TEST(test_ADD_A_vf_set)
 {
     // 120 + 105 should give overflow as Z80 Manual.
-    cpu.mem[0] = 0x80;
+    ram[0] = 0x80;
     REG_A(cpu) = 120;
     REG_B(cpu) = 105;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_ne(0, FLAG_GET(cpu, FLAG_P));
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADD_A_vf_rst)
 {
     // 0x30 + 0x40 should not give overflow.
-    cpu.mem[0] = 0x80;
+    ram[0] = 0x80;
     REG_A(cpu) = 0x30;
     REG_B(cpu) = 0x40;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0, FLAG_GET(cpu, FLAG_P));
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADD_A_cf)
 {
-    cpu.mem[0] = 0x80;
+    ram[0] = 0x80;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -232,11 +253,13 @@ END_TEST
 
 START_TEST(test_ADD_A_daa)
 {
-    cpu.mem[0] = 0x80;
+    ram[0] = 0x80;
     REG_A(cpu) = 0x12;
     REG_B(cpu) = 0x34;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0, FLAG_GET(cpu, FLAG_N));
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
@@ -22,6 +22,7 @@
 #include <check.h>
 
 #include <cpu.h>
+#include <diff.h>
 #include <opcodes.h>
 
 #include "../opcodes_test.h" // Testcase definitions.
@@ -34,119 +35,135 @@
 
 START_TEST(test_ADC_A_B)
 {
-    cpu.mem[0] = 0x88;
+    ram[0] = 0x88;
     REG_A(cpu) = 0x12;
     REG_B(cpu) = 0x34;
     FLAG_SET(cpu, FLAG_C);
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x47, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADC_A_C)
 {
-    cpu.mem[0] = 0x89;
+    ram[0] = 0x89;
     REG_A(cpu) = 0x12;
     REG_C(cpu) = 0x34;
     FLAG_SET(cpu, FLAG_C);
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x47, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADC_A_D)
 {
-    cpu.mem[0] = 0x8A;
+    ram[0] = 0x8A;
     REG_A(cpu) = 0x12;
     REG_D(cpu) = 0x34;
     FLAG_SET(cpu, FLAG_C);
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x47, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADC_A_E)
 {
-    cpu.mem[0] = 0x8B;
+    ram[0] = 0x8B;
     REG_A(cpu) = 0x12;
     REG_E(cpu) = 0x34;
     FLAG_SET(cpu, FLAG_C);
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x47, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADC_A_H)
 {
-    cpu.mem[0] = 0x8C;
+    ram[0] = 0x8C;
     REG_A(cpu) = 0x12;
     REG_H(cpu) = 0x34;
     FLAG_SET(cpu, FLAG_C);
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x47, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADC_A_L)
 {
-    cpu.mem[0] = 0x8D;
+    ram[0] = 0x8D;
     REG_A(cpu) = 0x12;
     REG_L(cpu) = 0x34;
     FLAG_SET(cpu, FLAG_C);
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x47, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADC_A_iHL)
 {
-    cpu.mem[0] = 0x8E;
+    ram[0] = 0x8E;
     REG_A(cpu) = 0x12;
     REG_HL(cpu) = 0x8000;
-    cpu.mem[0x8000] = 0x34;
+    ram[0x8000] = 0x34;
     FLAG_SET(cpu, FLAG_C);
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x47, REG_A(cpu));
     ck_assert_uint_eq(7, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADC_A_A)
 {
-    cpu.mem[0] = 0x8F;
+    ram[0] = 0x8F;
     REG_A(cpu) = 0x12;
     FLAG_SET(cpu, FLAG_C);
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x25, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADC_A_sf)
 {
-    cpu.mem[0] = 0x88;
+    ram[0] = 0x88;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -165,7 +182,7 @@ END_TEST
 
 START_TEST(test_ADC_A_zf)
 {
-    cpu.mem[0] = 0x88;
+    ram[0] = 0x88;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -186,7 +203,7 @@ END_TEST
 
 START_TEST(test_ADC_A_hf)
 {
-    cpu.mem[0] = 0x88;
+    ram[0] = 0x88;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -208,31 +225,35 @@ END_TEST
 START_TEST(test_ADC_A_vf_set)
 {
     // 120 + 105 + 1 should give overflow as Z80 Manual.
-    cpu.mem[0] = 0x88;
+    ram[0] = 0x88;
     REG_A(cpu) = 120;
     REG_B(cpu) = 105;
     FLAG_SET(cpu, FLAG_C);
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_ne(0, FLAG_GET(cpu, FLAG_P));
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADC_A_vf_rst)
 {
     // 0x30 + 0x40 + 1 should not give overflow.
-    cpu.mem[0] = 0x88;
+    ram[0] = 0x88;
     REG_A(cpu) = 0x30;
     REG_B(cpu) = 0x40;
     FLAG_SET(cpu, FLAG_C);
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0x71, REG_A(cpu));
     ck_assert_uint_eq(0, FLAG_GET(cpu, FLAG_P));
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_ADC_A_cf)
 {
-    cpu.mem[0] = 0x88;
+    ram[0] = 0x88;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -251,12 +272,14 @@ END_TEST
 
 START_TEST(test_ADC_A_daa)
 {
-    cpu.mem[0] = 0x88;
+    ram[0] = 0x88;
     REG_A(cpu) = 0x12;
     REG_B(cpu) = 0x34;
     FLAG_SET(cpu, FLAG_C);
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0, FLAG_GET(cpu, FLAG_N));
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
@@ -22,6 +22,7 @@
 #include <check.h>
 
 #include <cpu.h>
+#include <diff.h>
 #include <opcodes.h>
 
 #include "../opcodes_test.h" // Testcase definitions.
@@ -34,111 +35,127 @@
 
 START_TEST(test_SUB_A_B)
 {
-    cpu.mem[0] = 0x90;
+    ram[0] = 0x90;
     REG_A(cpu) = 0x46;
     REG_B(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_SUB_A_C)
 {
-    cpu.mem[0] = 0x91;
+    ram[0] = 0x91;
     REG_A(cpu) = 0x46;
     REG_C(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_SUB_A_D)
 {
-    cpu.mem[0] = 0x92;
+    ram[0] = 0x92;
     REG_A(cpu) = 0x46;
     REG_D(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_SUB_A_E)
 {
-    cpu.mem[0] = 0x93;
+    ram[0] = 0x93;
     REG_A(cpu) = 0x46;
     REG_E(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_SUB_A_H)
 {
-    cpu.mem[0] = 0x94;
+    ram[0] = 0x94;
     REG_A(cpu) = 0x46;
     REG_H(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_SUB_A_L)
 {
-    cpu.mem[0] = 0x95;
+    ram[0] = 0x95;
     REG_A(cpu) = 0x46;
     REG_L(cpu) = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_SUB_A_iHL)
 {
-    cpu.mem[0] = 0x96;
+    ram[0] = 0x96;
     REG_A(cpu) = 0x46;
     REG_HL(cpu) = 0x8000;
-    cpu.mem[0x8000] = 0x34;
+    ram[0x8000] = 0x34;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0x12, REG_A(cpu));
     ck_assert_uint_eq(7, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_SUB_A_A)
 {
-    cpu.mem[0] = 0x97;
+    ram[0] = 0x97;
     REG_A(cpu) = 0x24;
 
+    snapshot_state();
     execute_opcode(&cpu);
 
     ck_assert_uint_eq(0, REG_A(cpu));
     ck_assert_uint_eq(4, cpu.tstates);
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_SUB_A_sf)
 {
-    cpu.mem[0] = 0x90;
+    ram[0] = 0x90;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -156,7 +173,7 @@ END_TEST
 
 START_TEST(test_SUB_A_zf)
 {
-    cpu.mem[0] = 0x90;
+    ram[0] = 0x90;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -174,7 +191,7 @@ END_TEST
 
 START_TEST(test_SUB_A_hf)
 {
-    cpu.mem[0] = 0x90;
+    ram[0] = 0x90;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -193,28 +210,32 @@ END_TEST
 START_TEST(test_SUB_A_vf_set)
 {
     // 127 - -64 should give overflow as Z80 Manual.
-    cpu.mem[0] = 0x90;
+    ram[0] = 0x90;
     REG_A(cpu) = 0x7F; // 127
     REG_B(cpu) = 0xC0; // -64
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_ne(0, FLAG_GET(cpu, FLAG_P));
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_SUB_A_vf_rst)
 {
     // 0x40 + 0x30 should not give overflow.
-    cpu.mem[0] = 0x90;
+    ram[0] = 0x90;
     REG_A(cpu) = 0x40;
     REG_B(cpu) = 0x30;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(0, FLAG_GET(cpu, FLAG_P));
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
 START_TEST(test_SUB_A_cf)
 {
-    cpu.mem[0] = 0x90;
+    ram[0] = 0x90;
     byte val = 0;
     do {
         PC(cpu) = 0;
@@ -232,11 +253,13 @@ END_TEST
 
 START_TEST(test_SUB_A_daa)
 {
-    cpu.mem[0] = 0x90;
+    ram[0] = 0x90;
     REG_A(cpu) = 0x46;
     REG_B(cpu) = 0x34;
+    snapshot_state();
     execute_opcode(&cpu);
     ck_assert_uint_eq(1, FLAG_GET(cpu, FLAG_N));
+    assert_changed(DIFF_AF);
 }
 END_TEST
 
@@ -0,0 +1,147 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+
+#include <cpu.h>
+#include <pool.h>
+#include <z80.h>
+
+#include "pool_test.h"
+
+static struct z80_pool_t* pool;
+
+static void
+setup_pool(void)
+{
+    pool = z80_pool_create(16);
+    ck_assert_ptr_ne(NULL, pool);
+}
+
+static void
+teardown_pool(void)
+{
+    z80_pool_destroy(pool);
+}
+
+START_TEST(test_pool_create)
+{
+    ck_assert_int_eq(1, pool->arenas);
+    ck_assert(pool->slots >= 16);
+    ck_assert_uint_eq(0, pool->in_use);
+    ck_assert_uint_eq(0, pool->slot_size % 64);
+    ck_assert(pool->slot_size >= sizeof(struct z80_t));
+}
+END_TEST
+
+START_TEST(test_pool_recycle)
+{
+    struct z80_t* first = z80_pool_get(pool, NULL, 0, 0x00);
+    struct z80_t* again;
+
+    ck_assert_ptr_ne(NULL, first);
+    ck_assert_ptr_eq(pool, first->pool);
+    ck_assert_uint_eq(1, pool->in_use);
+    mem_write(&first->cpu, 0x8000, 0x12);
+    REG_A(first->cpu) = 0x34;
+    z80_free(first);
+    ck_assert_uint_eq(0, pool->in_use);
+
+    // The slot comes back clean.
+    again = z80_pool_get(pool, NULL, 0, 0x00);
+    ck_assert_ptr_eq(first, again);
+    ck_assert_uint_eq(0x00, REG_A(again->cpu));
+    ck_assert_uint_eq(0x00, mem_read(&again->cpu, 0x8000));
+    z80_free(again);
+}
+END_TEST
+
+START_TEST(test_pool_fill)
+{
+    struct z80_t* z80 = z80_pool_get(pool, NULL, 0, 0xFF);
+    struct z80_stats_t stats;
+
+    ck_assert_uint_eq(0xFF, mem_read(&z80->cpu, 0x0000));
+    ck_assert_uint_eq(0xFF, mem_read(&z80->cpu, 0xFFFF));
+    z80_stats(z80, &stats);
+    ck_assert_int_eq(0, stats.ram_pages);
+
+    // The written page keeps the fill pattern around the write.
+    mem_write(&z80->cpu, 0x4001, 0x00);
+    ck_assert_uint_eq(0xFF, mem_read(&z80->cpu, 0x4000));
+    ck_assert_uint_eq(0x00, mem_read(&z80->cpu, 0x4001));
+    z80_free(z80);
+
+    ck_assert_ptr_eq(NULL, z80_pool_get(pool, NULL, 0, 0x55));
+    ck_assert_uint_eq(0, pool->in_use);
+}
+END_TEST
+
+START_TEST(test_pool_grow)
+{
+    static struct z80_t* z80[4096];
+    size_t count = pool->slots + 10, i;
+
+    for (i = 0; i < count; i++) {
+        z80[i] = z80_pool_get(pool, NULL, 0, 0x00);
+        ck_assert_ptr_ne(NULL, z80[i]);
+    }
+    ck_assert_int_eq(2, pool->arenas);
+    ck_assert_uint_eq(count, pool->in_use);
+    for (i = 0; i < count; i++) {
+        z80_free(z80[i]);
+    }
+    ck_assert_uint_eq(0, pool->in_use);
+}
+END_TEST
+
+START_TEST(test_pool_fork)
+{
+    struct z80_t* parent = z80_pool_get(pool, NULL, 0, 0x00);
+    struct z80_t* child;
+
+    mem_write(&parent->cpu, 0x8000, 0x12);
+    child = z80_fork(parent);
+    ck_assert_ptr_eq(pool, child->pool);
+    ck_assert_uint_eq(2, pool->in_use);
+    ck_assert_uint_eq(0x12, mem_read(&child->cpu, 0x8000));
+
+    z80_free(parent);
+    z80_free(child);
+    ck_assert_uint_eq(0, pool->in_use);
+}
+END_TEST
+
+Suite*
+gensuite_pool(void)
+{
+    TCase* tc_pool = tcase_create("Instance pool");
+    tcase_add_checked_fixture(tc_pool, setup_pool, teardown_pool);
+    tcase_add_test(tc_pool, test_pool_create);
+    tcase_add_test(tc_pool, test_pool_recycle);
+    tcase_add_test(tc_pool, test_pool_fill);
+    tcase_add_test(tc_pool, test_pool_grow);
+    tcase_add_test(tc_pool, test_pool_fork);
+
+    Suite* s = suite_create("Instance pool");
+    suite_add_tcase(s, tc_pool);
+    return s;
+}
@@ -0,0 +1,222 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <stdio.h>          // tmpfile, fclose, rewind
+#include <string.h>         // memcmp, memcpy, memset
+
+#include <bus.h>
+#include <cpu.h>
+#include <replay.h>
+
+#include "replay_test.h"
+
+static struct cpu_t cpu, initial;
+static struct bus_t bus;
+static byte ram[0x10000], initial_ram[0x10000];
+static int port_reads, port_writes;
+
+// Memory mapped port that never returns the same value twice in a row.
+static byte
+port_read(void* ctx, word addr)
+{
+    port_reads++;
+    return port_reads * 7;
+}
+
+static void
+port_write(void* ctx, word addr, byte value)
+{
+    ck_assert_ptr_eq(&bus, ctx);
+    port_writes++;
+}
+
+/*
+ * Copies a port into memory:
+ *
+ * 0000 start:
+ *     LD B, 0
+ * loop:
+ *     LD A, (0xF000)
+ *     LD (HL), A
+ *     INC HL
+ *     DJNZ loop
+ *     JR start
+ * 0038:
+ *     JR start
+ * 0066:
+ *     JR start
+ */
+static void
+setup_replay(void)
+{
+    static const byte code[] = {
+        0x06, 0x00, 0x3A, 0x00, 0xF0, 0x77, 0x23, 0x10, 0xF9, 0x18, 0xF5
+    };
+    memset(ram, 0, sizeof(ram));
+    memcpy(ram, code, sizeof(code));
+    ram[0x38] = 0x18;
+    ram[0x39] = 0xC6;
+    ram[0x66] = 0x18;
+    ram[0x67] = 0x98;
+    bus_init(&bus, ram);
+    bus_map(&bus, 15, 1, NULL, NULL);
+    bus_handlers(&bus, 15, 1, port_read, port_write, &bus);
+
+    memset(&cpu, 0, sizeof(cpu));
+    cpu_init(&cpu, &bus);
+    REG_HL(cpu) = 0x9000;
+    SP(cpu) = 0x8000;
+    cpu.iff1 = cpu.iff2 = 1;
+    cpu.im = 1;
+    cpu.tstates = 1000;
+    port_reads = 0;
+    port_writes = 0;
+
+    memcpy(&initial, &cpu, sizeof(cpu));
+    memcpy(initial_ram, ram, sizeof(ram));
+}
+
+// Records a session with every kind of event.
+static FILE*
+record(void)
+{
+    FILE* file = tmpfile();
+    struct replay_t* replay;
+    int chunk;
+
+    ck_assert_ptr_ne(NULL, file);
+    replay = replay_record(&cpu, file);
+    ck_assert_ptr_ne(NULL, replay);
+    for (chunk = 0; chunk < 50; chunk++) {
+        ck_assert_int_eq(0, replay_run(replay, 1000 + (chunk + 1) * 10000));
+        if (chunk % 10 == 4) replay_irq(replay, 0xFF);
+        if (chunk % 5 == 2) replay_nmi(replay);
+        if (chunk % 3 == 0) replay_poke(replay, 0x0001, chunk);
+    }
+    ck_assert_uint_gt(replay->events, 5000);
+    ck_assert_int_eq(0, replay_close(replay));
+    ck_assert_ptr_eq(port_read, bus.page[15].on_read);
+    ck_assert_ptr_eq(port_write, bus.page[15].on_write);
+    ck_assert_ptr_eq(&bus, bus.page[15].ctx);
+    rewind(file);
+    return file;
+}
+
+START_TEST(test_replay_identical)
+{
+    static byte recorded_ram[0x10000];
+    struct cpu_t recorded;
+    struct replay_t* replay;
+    FILE* file = record();
+    int reads = port_reads;
+
+    memcpy(&recorded, &cpu, sizeof(cpu));
+    memcpy(recorded_ram, ram, sizeof(ram));
+
+    // Back to the start: the port is not read again.
+    memcpy(&cpu, &initial, sizeof(cpu));
+    memcpy(ram, initial_ram, sizeof(ram));
+    replay = replay_open(&cpu, file);
+    ck_assert_ptr_ne(NULL, replay);
+    ck_assert_int_eq(0, replay_run(replay, 1000 + 50 * 10000));
+    ck_assert_int_eq(REPLAY_NONE, replay->next.kind);
+    ck_assert_int_eq(0, replay_close(replay));
+    ck_assert_int_eq(reads, port_reads);
+
+    ck_assert_int_eq(0, memcmp(&recorded, &cpu, sizeof(cpu)));
+    ck_assert_int_eq(0, memcmp(recorded_ram, ram, sizeof(ram)));
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test_replay_writes)
+{
+    // Writes to a device are passed on while recording, not on replay.
+    struct replay_t* replay;
+    FILE* file;
+    int writes;
+
+    bus_map(&bus, 9, 1, NULL, NULL);
+    bus_handlers(&bus, 9, 1, NULL, port_write, &bus);
+    file = record();
+    writes = port_writes;
+    ck_assert_int_gt(writes, 0);
+
+    memcpy(&cpu, &initial, sizeof(cpu));
+    memcpy(ram, initial_ram, sizeof(ram));
+    replay = replay_open(&cpu, file);
+    ck_assert_ptr_ne(NULL, replay);
+    ck_assert_int_eq(0, replay_run(replay, 1000 + 50 * 10000));
+    ck_assert_int_eq(0, replay_close(replay));
+    ck_assert_int_eq(writes, port_writes);
+    ck_assert_ptr_eq(port_write, bus.page[9].on_write);
+    ck_assert_ptr_eq(NULL, bus.page[9].on_read);
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test_replay_desync)
+{
+    struct replay_t* replay;
+    FILE* file = record();
+
+    // Another starting point is refused.
+    memcpy(&cpu, &initial, sizeof(cpu));
+    memcpy(ram, initial_ram, sizeof(ram));
+    cpu.tstates = 0;
+    ck_assert_ptr_eq(NULL, replay_open(&cpu, file));
+
+    // A different loop count reads the port at other times.
+    rewind(file);
+    cpu.tstates = 1000;
+    ram[0x0001] = 0x10;
+    replay = replay_open(&cpu, file);
+    ck_assert_ptr_ne(NULL, replay);
+    ck_assert_int_eq(-1, replay_run(replay, 1000 + 50 * 10000));
+    ck_assert_int_eq(-1, replay_close(replay));
+    ck_assert_ptr_eq(port_read, bus.page[15].on_read);
+    ck_assert_ptr_eq(port_write, bus.page[15].on_write);
+    ck_assert_ptr_eq(&bus, bus.page[15].ctx);
+    fclose(file);
+
+    // Not a stream at all.
+    file = tmpfile();
+    fputs("not a replay", file);
+    rewind(file);
+    ck_assert_ptr_eq(NULL, replay_open(&cpu, file));
+    fclose(file);
+}
+END_TEST
+
+Suite*
+gensuite_replay(void)
+{
+    TCase* tc_replay = tcase_create("Replay");
+    tcase_add_checked_fixture(tc_replay, setup_replay, NULL);
+    tcase_add_test(tc_replay, test_replay_identical);
+    tcase_add_test(tc_replay, test_replay_writes);
+    tcase_add_test(tc_replay, test_replay_desync);
+
+    Suite* s = suite_create("Replay");
+    suite_add_tcase(s, tc_replay);
+    return s;
+}
@@ -0,0 +1,216 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <stdlib.h>         // rand, srand
+#include <string.h>         // memcpy, memset
+
+#include <bus.h>
+#include <cpu.h>
+#include <rewind.h>
+
+#include "rewind_test.h"
+
+static struct cpu_t cpu;
+static struct bus_t bus;
+static byte ram[0x10000], rom[MEM_PAGE_SIZE];
+
+static void
+setup_rewind(void)
+{
+    memset(ram, 0, sizeof(ram));
+    memset(rom, 0xC9, sizeof(rom));
+    memset(&cpu, 0, sizeof(cpu));
+    bus_init(&bus, ram);
+    cpu_init(&cpu, &bus);
+    bus_map(&bus, 0, 1, rom, NULL);
+}
+
+START_TEST(test_rewind_seek)
+{
+    struct rewind_t* rewind = rewind_create(&cpu, 1 << 20, 8);
+    ck_assert_ptr_ne(NULL, rewind);
+    ck_assert_int_eq(0, rewind_frames(rewind));
+    ck_assert_int_eq(-1, rewind_seek(rewind, 0));
+
+    // Frame 0.
+    PC(cpu) = 0x8000;
+    REG_HL(cpu) = 0x1111;
+    mem_write(&cpu, 0x4000, 0x11);
+    ck_assert_int_eq(0, rewind_capture(rewind));
+
+    // Frame 1.
+    PC(cpu) = 0x8010;
+    REG_HL(cpu) = 0x2222;
+    mem_write(&cpu, 0x4000, 0x22);
+    mem_write(&cpu, 0x9FFF, 0x23);
+    ck_assert_int_eq(0, rewind_capture(rewind));
+
+    // Frame 2.
+    PC(cpu) = 0x8020;
+    REG_HL(cpu) = 0x3333;
+    mem_write(&cpu, 0x4000, 0x33);
+    mem_write(&cpu, 0xC000, 0x34);
+    ck_assert_int_eq(0, rewind_capture(rewind));
+    ck_assert_int_eq(3, rewind_frames(rewind));
+
+    // Writes after the last frame are undone too.
+    mem_write(&cpu, 0x4000, 0x44);
+    mem_write(&cpu, 0x5000, 0x45);
+    ck_assert_int_eq(-1, rewind_seek(rewind, 3));
+    ck_assert_int_eq(0, rewind_seek(rewind, 1));
+    ck_assert_uint_eq(0x8010, PC(cpu));
+    ck_assert_uint_eq(0x2222, REG_HL(cpu));
+    ck_assert_ptr_eq(&bus, cpu.bus);
+    ck_assert_uint_eq(0x22, ram[0x4000]);
+    ck_assert_uint_eq(0x23, ram[0x9FFF]);
+    ck_assert_uint_eq(0x00, ram[0xC000]);
+    ck_assert_uint_eq(0x00, ram[0x5000]);
+    ck_assert_uint_eq(0xC9, mem_read(&cpu, 0x0000));
+    ck_assert_int_eq(2, rewind_frames(rewind));
+
+    // Recording goes on from the frame sought.
+    mem_write(&cpu, 0x4000, 0x55);
+    ck_assert_int_eq(0, rewind_capture(rewind));
+    ck_assert_int_eq(3, rewind_frames(rewind));
+    ck_assert_int_eq(0, rewind_seek(rewind, 2));
+    ck_assert_uint_eq(0x8000, PC(cpu));
+    ck_assert_uint_eq(0x11, ram[0x4000]);
+    ck_assert_uint_eq(0x00, ram[0x9FFF]);
+    ck_assert_int_eq(0, rewind_seek(rewind, 0));
+    ck_assert_int_eq(1, rewind_frames(rewind));
+    rewind_free(rewind);
+
+    // Writes after the buffer is freed take the fast path again.
+    ck_assert_ptr_eq(NULL, bus.dirty);
+    ck_assert_ptr_ne(NULL, bus.page[4].write);
+}
+END_TEST
+
+START_TEST(test_rewind_ring)
+{
+    // Room for a few frames where every page is rewritten with noise.
+    static byte history[24][4];
+    struct rewind_t* rewind = rewind_create(&cpu, 512 * 1024, 4);
+    int frame, i, frames;
+    ck_assert_ptr_ne(NULL, rewind);
+
+    srand(1);
+    for (frame = 0; frame < 24; frame++) {
+        for (i = MEM_PAGE_SIZE; i < 0x10000; i++) {
+            mem_write(&cpu, i, rand());
+        }
+        REG_BC(cpu) = frame;
+        for (i = 0; i < 4; i++) {
+            history[frame][i] = ram[0x1000 + 0x3FFF * i];
+        }
+        ck_assert_int_eq(0, rewind_capture(rewind));
+        frames = rewind_frames(rewind);
+        ck_assert_int_ge(frames, 1);
+        ck_assert_int_le(frames, frame + 1);
+    }
+
+    // Whole groups are dropped: the oldest frame left is a key frame.
+    frames = rewind_frames(rewind);
+    ck_assert_int_lt(frames, 24);
+    ck_assert_int_eq(0, (24 - frames) % 4);
+    ck_assert_int_eq(-1, rewind_seek(rewind, frames));
+    ck_assert_int_eq(0, rewind_seek(rewind, frames - 1));
+    frame = 24 - frames;
+    ck_assert_uint_eq(frame, REG_BC(cpu));
+    for (i = 0; i < 4; i++) {
+        ck_assert_uint_eq(history[frame][i], ram[0x1000 + 0x3FFF * i]);
+    }
+
+    // The ring keeps working after wrapping and truncating.
+    for (i = 0; i < 8; i++) {
+        mem_write(&cpu, 0x2000 + i, i);
+        ck_assert_int_eq(0, rewind_capture(rewind));
+    }
+    ck_assert_int_eq(0, rewind_seek(rewind, 3));
+    ck_assert_uint_eq(4, ram[0x2004]);
+    ck_assert_uint_eq(history[frame][1], ram[0x1000 + 0x3FFF]);
+    rewind_free(rewind);
+}
+END_TEST
+
+START_TEST(test_rewind_sparse)
+{
+    // Small changes take a small part of a page.
+    struct rewind_t* rewind = rewind_create(&cpu, 1 << 20, 1000);
+    size_t before;
+    ck_assert_ptr_ne(NULL, rewind);
+
+    // Blank pages of a key frame are empty blocks, only the ROM is stored.
+    ck_assert_int_eq(0, rewind_capture(rewind));
+    ck_assert_uint_lt(rewind->head, 2 * MEM_PAGE_SIZE);
+
+    // Pages written with the same bytes are empty blocks too.
+    before = rewind->head;
+    mem_write(&cpu, 0x4000, 0x00);
+    ck_assert_int_eq(0, rewind_capture(rewind));
+    ck_assert_uint_lt(rewind->head - before, 256);
+
+    before = rewind->head;
+    mem_write(&cpu, 0x4000, 0x01);
+    mem_write(&cpu, 0x4800, 0x02);
+    ck_assert_int_eq(0, rewind_capture(rewind));
+    ck_assert_uint_lt(rewind->head - before, 256);
+    ck_assert_int_eq(0, rewind_seek(rewind, 1));
+    ck_assert_uint_eq(0x00, ram[0x4000]);
+    ck_assert_uint_eq(0x00, ram[0x4800]);
+    rewind_free(rewind);
+}
+END_TEST
+
+START_TEST(test_rewind_trackers)
+{
+    // Other trackers of the bus see the memory brought back by a seek.
+    struct rewind_t* rewind = rewind_create(&cpu, 1 << 20, 8);
+    struct bus_dirty_t dirty;
+    ck_assert_ptr_ne(NULL, rewind);
+    ck_assert_int_eq(0, rewind_capture(rewind));
+    mem_write(&cpu, 0x5000, 0x55);
+    ck_assert_int_eq(0, rewind_capture(rewind));
+
+    bus_dirty_attach(&bus, &dirty, 0);
+    ck_assert_int_eq(0, rewind_seek(rewind, 1));
+    ck_assert_uint_eq(0x00, ram[0x5000]);
+    ck_assert_uint_ne(0, bus_dirty_fetch_pages(&dirty) & (1u << 5));
+    bus_dirty_detach(&bus, &dirty);
+    rewind_free(rewind);
+}
+END_TEST
+
+Suite*
+gensuite_rewind(void)
+{
+    TCase* tc_rewind = tcase_create("Rewind");
+    tcase_add_checked_fixture(tc_rewind, setup_rewind, NULL);
+    tcase_add_test(tc_rewind, test_rewind_seek);
+    tcase_add_test(tc_rewind, test_rewind_ring);
+    tcase_add_test(tc_rewind, test_rewind_sparse);
+    tcase_add_test(tc_rewind, test_rewind_trackers);
+
+    Suite* s = suite_create("Rewind");
+    suite_add_tcase(s, tc_rewind);
+    return s;
+}
@@ -0,0 +1,217 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <string.h>         // memset, memcmp
+
+#include <cpu.h>
+#include <opcodes.h>
+#include <romimage.h>
+
+#include "romimage_test.h"
+
+static const byte rom[] = {
+    0x06, 0x04,             // LD B, 4
+    0x21, 0x00, 0x80,       // LD HL, 0x8000
+    0x3E, 0x10,             // LD A, 0x10
+    0x77,                   // LD (HL), A
+    0x23,                   // INC HL
+    0x3C,                   // INC A
+    0x10, 0xFB,             // DJNZ -5
+    0x00                    // NOP
+};
+
+static struct cpu_t plain, mapped, other;
+static struct bus_t plain_bus, mapped_bus, other_bus;
+static byte plain_ram[0x10000], mapped_ram[0x10000], other_ram[0x10000];
+static byte rom_page[MEM_PAGE_SIZE], bank_page[MEM_PAGE_SIZE];
+static struct z80_rom_image_t* image;
+
+static void
+setup_image(void)
+{
+    memset(&plain, 0xFF, sizeof(struct cpu_t));
+    memset(plain_ram, 0xFF, sizeof(plain_ram));
+    bus_init(&plain_bus, plain_ram);
+    cpu_init(&plain, &plain_bus);
+    PC(plain) = 0;
+    plain.tstates = 0;
+    memcpy(plain_ram, rom, sizeof(rom));
+
+    // Both machines map the same ROM page, read-only.
+    memcpy(rom_page, plain_ram, MEM_PAGE_SIZE);
+    memcpy(&mapped, &plain, sizeof(struct cpu_t));
+    memcpy(mapped_ram, plain_ram, sizeof(plain_ram));
+    bus_init(&mapped_bus, mapped_ram);
+    bus_map(&mapped_bus, 0, 1, rom_page, NULL);
+    cpu_init(&mapped, &mapped_bus);
+    memcpy(&other, &plain, sizeof(struct cpu_t));
+    memcpy(other_ram, plain_ram, sizeof(plain_ram));
+    bus_init(&other_bus, other_ram);
+    bus_map(&other_bus, 0, 1, rom_page, NULL);
+    cpu_init(&other, &other_bus);
+
+    image = z80_rom_image_create(rom_page, 0x0000, sizeof(rom));
+    ck_assert_ptr_ne(NULL, image);
+}
+
+static void
+teardown_image(void)
+{
+    z80_rom_image_free(image);
+}
+
+START_TEST(test_image_entries)
+{
+    ck_assert_ptr_eq(opcode_table(0x06), image->entry[0].handler);
+    ck_assert_uint_eq(0, image->entry[0].op.x);
+    ck_assert_uint_eq(0, image->entry[0].op.y);
+    ck_assert_uint_eq(6, image->entry[0].op.z);
+    ck_assert_ptr_eq(opcode_table(0x77), image->entry[7].handler);
+    ck_assert_uint_eq(1, image->entry[7].op.x);
+    ck_assert_uint_eq(6, image->entry[7].op.y);
+    ck_assert_uint_eq(7, image->entry[7].op.z);
+}
+END_TEST
+
+START_TEST(test_image_same_result)
+{
+    int i;
+    ck_assert_int_eq(0, z80_rom_image_map(&mapped, image));
+    for (i = 0; i < 20; i++) {
+        execute_opcode(&plain);
+        execute_opcode(&mapped);
+        ck_assert_uint_eq(PC(plain), PC(mapped));
+    }
+    ck_assert_uint_eq(REG_AF(plain), REG_AF(mapped));
+    ck_assert_uint_eq(REG_BC(plain), REG_BC(mapped));
+    ck_assert_uint_eq(REG_HL(plain), REG_HL(mapped));
+    ck_assert_uint_eq(plain.tstates, mapped.tstates);
+    ck_assert_int_eq(0, memcmp(plain_ram + MEM_PAGE_SIZE,
+                mapped_ram + MEM_PAGE_SIZE, 0x10000 - MEM_PAGE_SIZE));
+}
+END_TEST
+
+START_TEST(test_image_shared)
+{
+    ck_assert_int_eq(0, z80_rom_image_map(&mapped, image));
+    ck_assert_int_eq(0, z80_rom_image_map(&other, image));
+    REG_B(other) = 0x00;
+
+    execute_opcode(&mapped);
+    execute_opcode(&other);
+    ck_assert_uint_eq(0x04, REG_B(mapped));
+    ck_assert_uint_eq(0x04, REG_B(other));
+}
+END_TEST
+
+START_TEST(test_image_outside_region)
+{
+    ck_assert_int_eq(0, z80_rom_image_map(&mapped, image));
+    mapped_ram[0x9000] = 0x3E; // LD A, 0x42
+    mapped_ram[0x9001] = 0x42;
+    PC(mapped) = 0x9000;
+    execute_opcode(&mapped);
+    ck_assert_uint_eq(0x42, REG_A(mapped));
+    ck_assert_uint_eq(0x9002, PC(mapped));
+}
+END_TEST
+
+START_TEST(test_image_map_checks)
+{
+    // Writable memory: the ROM could be overwritten under the image.
+    ck_assert_int_eq(-1, z80_rom_image_map(&plain, image));
+    ck_assert_ptr_eq(NULL, plain.rom);
+
+    // The same ROM bytes from other host memory are not enough either.
+    memcpy(bank_page, rom_page, MEM_PAGE_SIZE);
+    bus_map(&other_bus, 0, 1, bank_page, NULL);
+    ck_assert_int_eq(-1, z80_rom_image_map(&other, image));
+
+    // Host memory changed after the image was built.
+    rom_page[0] = 0x00;
+    ck_assert_int_eq(-1, z80_rom_image_map(&mapped, image));
+    rom_page[0] = rom[0];
+    ck_assert_int_eq(0, z80_rom_image_map(&mapped, image));
+    ck_assert_ptr_eq(image, mapped.rom);
+}
+END_TEST
+
+START_TEST(test_image_banked_out)
+{
+    ck_assert_int_eq(0, z80_rom_image_map(&mapped, image));
+    memset(bank_page, 0, MEM_PAGE_SIZE);
+    bank_page[0] = 0x3E; // LD A, 0x42
+    bank_page[1] = 0x42;
+    bus_map(&mapped_bus, 0, 1, bank_page, NULL);
+    execute_opcode(&mapped);
+    ck_assert_uint_eq(0x42, REG_A(mapped));
+    ck_assert_uint_eq(0x0002, PC(mapped));
+
+    // Mapped back in, the entries are used again.
+    bus_map(&mapped_bus, 0, 1, rom_page, NULL);
+    PC(mapped) = 0;
+    execute_opcode(&mapped);
+    ck_assert_uint_eq(0x04, REG_B(mapped));
+}
+END_TEST
+
+START_TEST(test_image_trapped_fetch)
+{
+    // Contended fetches go through the bus, as they do without the image.
+    static byte delay[100];
+    struct bus_contention_t contention = { NULL, sizeof(delay), { NULL } };
+    memset(delay, 3, sizeof(delay));
+    contention.delay[1] = delay;
+    ck_assert_int_eq(0, z80_rom_image_map(&mapped, image));
+    contention.clock = &plain.tstates;
+    bus_contention_attach(&plain_bus, &contention);
+    bus_contend(&plain_bus, 0, 1, 1);
+    contention.clock = &mapped.tstates;
+    bus_contention_attach(&mapped_bus, &contention);
+    bus_contend(&mapped_bus, 0, 1, 1);
+
+    PC(plain) = PC(mapped) = sizeof(rom) - 1; // NOP
+    execute_opcode(&mapped);
+    contention.clock = &plain.tstates;
+    execute_opcode(&plain);
+    ck_assert_int_eq(4 + 3, plain.tstates);
+    ck_assert_int_eq(plain.tstates, mapped.tstates);
+}
+END_TEST
+
+Suite*
+gensuite_romimage(void)
+{
+    TCase* tc_image = tcase_create("ROM image");
+    tcase_add_checked_fixture(tc_image, setup_image, teardown_image);
+    tcase_add_test(tc_image, test_image_entries);
+    tcase_add_test(tc_image, test_image_same_result);
+    tcase_add_test(tc_image, test_image_shared);
+    tcase_add_test(tc_image, test_image_outside_region);
+    tcase_add_test(tc_image, test_image_trapped_fetch);
+    tcase_add_test(tc_image, test_image_map_checks);
+    tcase_add_test(tc_image, test_image_banked_out);
+
+    Suite* s = suite_create("ROM image");
+    suite_add_tcase(s, tc_image);
+    return s;
+}
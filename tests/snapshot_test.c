@@ -0,0 +1,351 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <stdio.h>          // fmemopen, open_memstream
+#include <stdlib.h>         // free
+#include <string.h>         // memcmp, memcpy, memset
+
+#include <bus.h>
+#include <cpu.h>
+#include <snapshot.h>
+
+#include "snapshot_test.h"
+
+static struct cpu_t cpu, loaded;
+static struct bus_t bus, loaded_bus;
+static byte ram[0x10000], loaded_ram[0x10000];
+
+// Memory with runs the .Z80 RLE has to take care of.
+static void
+setup_snapshot(void)
+{
+    int i;
+    for (i = 0; i < 0x10000; i++) {
+        ram[i] = (i * 7) ^ (i >> 8);
+    }
+    memset(ram + 0x5000, 0x00, 300);        // Longer than a run
+    memset(ram + 0x6000, 0x11, 4);          // Too short for a run
+    memset(ram + 0x6100, 0xED, 2);          // Shortest ED run
+    ram[0x6200] = 0xED;                     // Single ED before a run
+    memset(ram + 0x6201, 0x22, 6);
+    ram[0x7FFF] = 0xED;                     // Single ED at the end of a bank
+    memset(ram + 0xC000, 0xED, 0x4000);     // Whole bank of ED
+
+    memset(&cpu, 0, sizeof(cpu));
+    cpu_init(&cpu, &bus);
+    bus_init(&bus, ram);
+    REG_AF(cpu) = 0x0102;
+    REG_BC(cpu) = 0x0304;
+    REG_DE(cpu) = 0x0506;
+    REG_HL(cpu) = 0x0708;
+    ALT_AF(cpu) = 0x090A;
+    ALT_BC(cpu) = 0x0B0C;
+    ALT_DE(cpu) = 0x0D0E;
+    ALT_HL(cpu) = 0x0F10;
+    IX(cpu) = 0x1112;
+    IY(cpu) = 0x1314;
+    SP(cpu) = 0x8000;
+    PC(cpu) = 0x9ABC;
+    cpu.i = 0x3F;
+    cpu.r = 0x85;
+    cpu.iff1 = 1;
+    cpu.iff2 = 1;
+    cpu.im = 1;
+
+    memset(loaded_ram, 0, sizeof(loaded_ram));
+    memset(&loaded, 0, sizeof(loaded));
+    cpu_init(&loaded, &loaded_bus);
+    bus_init(&loaded_bus, loaded_ram);
+}
+
+// Saves the CPU into a memory buffer, returned with its size.
+static char*
+save(int format, size_t* size)
+{
+    char* data = NULL;
+    FILE* file = open_memstream(&data, size);
+    ck_assert_ptr_ne(NULL, file);
+    ck_assert_int_eq(0, snapshot_save(&cpu, format, file));
+    fclose(file);
+    return data;
+}
+
+// Loads the first size bytes of a buffer into the second CPU.
+static int
+load(int format, const void* data, size_t size)
+{
+    FILE* file = fmemopen((void*) data, size, "rb");
+    int result;
+    ck_assert_ptr_ne(NULL, file);
+    result = snapshot_load(&loaded, format, file);
+    fclose(file);
+    return result;
+}
+
+static void
+check_registers(void)
+{
+    ck_assert_uint_eq(REG_AF(cpu), REG_AF(loaded));
+    ck_assert_uint_eq(REG_BC(cpu), REG_BC(loaded));
+    ck_assert_uint_eq(REG_DE(cpu), REG_DE(loaded));
+    ck_assert_uint_eq(REG_HL(cpu), REG_HL(loaded));
+    ck_assert_uint_eq(ALT_AF(cpu), ALT_AF(loaded));
+    ck_assert_uint_eq(ALT_BC(cpu), ALT_BC(loaded));
+    ck_assert_uint_eq(ALT_DE(cpu), ALT_DE(loaded));
+    ck_assert_uint_eq(ALT_HL(cpu), ALT_HL(loaded));
+    ck_assert_uint_eq(IX(cpu), IX(loaded));
+    ck_assert_uint_eq(IY(cpu), IY(loaded));
+    ck_assert_uint_eq(SP(cpu), SP(loaded));
+    ck_assert_uint_eq(PC(cpu), PC(loaded));
+    ck_assert_uint_eq(cpu.i, loaded.i);
+    ck_assert_uint_eq(cpu.r, loaded.r);
+    ck_assert_uint_eq(cpu.iff1, loaded.iff1);
+    ck_assert_uint_eq(cpu.iff2, loaded.iff2);
+    ck_assert_uint_eq(cpu.im, loaded.im);
+}
+
+START_TEST(test_snapshot_sna)
+{
+    size_t size;
+    char* data = save(SNAPSHOT_SNA, &size);
+    ck_assert_uint_eq(27 + 0xC000, size);
+    ck_assert_int_eq(0, load(SNAPSHOT_SNA, data, size));
+    check_registers();
+
+    // Everything but the pushed PC is the same, ROM is not touched.
+    ck_assert_uint_eq(0xBC, loaded_ram[0x7FFE]);
+    ck_assert_uint_eq(0x9A, loaded_ram[0x7FFF]);
+    ck_assert_int_eq(0, memcmp(ram + 0x4000, loaded_ram + 0x4000, 0x3FFE));
+    ck_assert_int_eq(0, memcmp(ram + 0x8000, loaded_ram + 0x8000, 0x8000));
+    ck_assert_uint_eq(0x00, loaded_ram[0x0000]);
+    free(data);
+
+    // The stack has to be in RAM.
+    SP(cpu) = 0x4001;
+    {
+        char* buffer = NULL;
+        FILE* file = open_memstream(&buffer, &size);
+        ck_assert_int_eq(-1, snapshot_save(&cpu, SNAPSHOT_SNA, file));
+        fclose(file);
+        free(buffer);
+    }
+}
+END_TEST
+
+START_TEST(test_snapshot_z80)
+{
+    size_t size;
+    char* data = save(SNAPSHOT_Z80, &size);
+
+    // The bank full of ED takes 65 runs.
+    ck_assert_uint_lt(size, 86 + 3 * (3 + 0x4000));
+    ck_assert_int_eq(0, load(SNAPSHOT_Z80, data, size));
+    check_registers();
+    ck_assert_int_eq(0, memcmp(ram + 0x4000, loaded_ram + 0x4000, 0xC000));
+    free(data);
+}
+END_TEST
+
+START_TEST(test_snapshot_szx)
+{
+    size_t size;
+    char* data;
+
+    cpu.tstates = 12345;
+    data = save(SNAPSHOT_SZX, &size);
+    ck_assert_int_eq(0, load(SNAPSHOT_SZX, data, size));
+    check_registers();
+    ck_assert_int_eq(12345, loaded.tstates);
+    ck_assert_int_eq(0, memcmp(ram + 0x4000, loaded_ram + 0x4000, 0xC000));
+    free(data);
+}
+END_TEST
+
+START_TEST(test_snapshot_z80_v1)
+{
+    byte header[30];
+    char* data = NULL;
+    size_t size, i;
+    FILE* file = open_memstream(&data, &size);
+
+    // PC = 0x8000, R = 0x81, compressed.
+    memset(header, 0, sizeof(header));
+    header[6] = 0x00;
+    header[7] = 0x80;
+    header[11] = 0x01;
+    header[12] = 0x21;
+    fwrite(header, 1, sizeof(header), file);
+    fwrite("\x12\xED\x34\xED\xED\xFD\x00", 1, 7, file);
+    for (i = 0; i < 382; i++) {
+        fwrite("\xED\xED\x80\x77", 1, 4, file);
+    }
+    fwrite("\x00\xED\xED\x00", 1, 4, file);
+    fclose(file);
+
+    ck_assert_int_eq(0, load(SNAPSHOT_Z80, data, size));
+    ck_assert_uint_eq(0x8000, PC(loaded));
+    ck_assert_uint_eq(0x81, loaded.r);
+    ck_assert_uint_eq(0x12, loaded_ram[0x4000]);
+    ck_assert_uint_eq(0xED, loaded_ram[0x4001]);
+    ck_assert_uint_eq(0x34, loaded_ram[0x4002]);
+    ck_assert_uint_eq(0x00, loaded_ram[0x40FF]);
+    ck_assert_uint_eq(0x77, loaded_ram[0x4100]);
+    ck_assert_uint_eq(0x77, loaded_ram[0xFFFF]);
+
+    // Without the end marker it loads too, with garbage it does not.
+    ck_assert_int_eq(0, load(SNAPSHOT_Z80, data, size - 4));
+    ck_assert_int_eq(-1, load(SNAPSHOT_Z80, data, size - 2));
+    free(data);
+
+    // Flags 0xFF mean 0x01: the memory is not compressed.
+    file = open_memstream(&data, &size);
+    header[12] = 0xFF;
+    fwrite(header, 1, sizeof(header), file);
+    for (i = 0; i < 0xC000; i++) {
+        putc(i & 0xFF, file);
+    }
+    fclose(file);
+    ck_assert_int_eq(0, load(SNAPSHOT_Z80, data, size));
+    ck_assert_uint_eq(0x81, loaded.r);
+    ck_assert_uint_eq(0x00, loaded_ram[0x4000]);
+    ck_assert_uint_eq(0xED, loaded_ram[0x40ED]);
+    ck_assert_uint_eq(0xFF, loaded_ram[0xFFFF]);
+    free(data);
+}
+END_TEST
+
+START_TEST(test_snapshot_szx_zlib)
+{
+    // 16 KB of 0x5A.
+    static const byte bank[] = {
+        0x78, 0xDA, 0xED, 0xC1, 0x31, 0x01, 0x00, 0x00, 0x00, 0xC2,
+        0xA0, 0x9E, 0xEB, 0x1F, 0xC4, 0x18, 0x3E, 0x40, 0x01, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x6F, 0x03, 0xB3, 0x1B, 0x81, 0x4B
+    };
+    byte ramp[11] = { 'R', 'A', 'M', 'P', 3 + sizeof(bank), 0, 0, 0,
+        0x01, 0x00, 0x02 };
+    size_t size, length;
+    char* data = save(SNAPSHOT_SZX, &size);
+    char* patched = malloc(size);
+
+    // Swap the second RAMP block, page 2, for a compressed one.
+    length = 8 + 8 + 37 + 11 + 0x4000;
+    memcpy(patched, data, length);
+    memcpy(patched + length, ramp, sizeof(ramp));
+    memcpy(patched + length + sizeof(ramp), bank, sizeof(bank));
+    memcpy(patched + length + sizeof(ramp) + sizeof(bank),
+            data + length + 11 + 0x4000, 11 + 0x4000);
+    length += sizeof(ramp) + sizeof(bank) + 11 + 0x4000;
+#ifdef ZETA80_ZLIB
+    ck_assert_int_eq(0, load(SNAPSHOT_SZX, patched, length));
+    ck_assert_uint_eq(0x5A, loaded_ram[0x8000]);
+    ck_assert_uint_eq(0x5A, loaded_ram[0xBFFF]);
+    ck_assert_int_eq(0, memcmp(ram + 0xC000, loaded_ram + 0xC000, 0x4000));
+
+    // The block has to inflate to 16 KB exactly.
+    patched[length - 11 - 0x4000 - 5] ^= 0xFF;
+    ck_assert_int_eq(-1, load(SNAPSHOT_SZX, patched, length));
+#else
+    ck_assert_int_eq(-1, load(SNAPSHOT_SZX, patched, length));
+#endif
+    free(patched);
+    free(data);
+}
+END_TEST
+
+START_TEST(test_snapshot_malformed)
+{
+    static const int formats[] = { SNAPSHOT_SNA, SNAPSHOT_Z80, SNAPSHOT_SZX };
+    size_t size;
+    char* data;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        data = save(formats[i], &size);
+        ck_assert_int_eq(-1, load(formats[i], data, 0));
+        ck_assert_int_eq(-1, load(formats[i], data, 20));
+        ck_assert_int_eq(-1, load(formats[i], data, size - 1));
+        free(data);
+        ck_assert_uint_eq(0x0000, PC(loaded));
+    }
+    ck_assert_int_eq(-1, load(-1, "", 0));
+
+    // Trailing data after a .SNA is probably a 128K snapshot.
+    data = save(SNAPSHOT_SNA, &size);
+    data = realloc(data, size + 1);
+    ck_assert_int_eq(-1, load(SNAPSHOT_SNA, data, size + 1));
+    free(data);
+
+    // 128K .Z80, and a run that does not fit in the bank.
+    data = save(SNAPSHOT_Z80, &size);
+    data[34] = 4;
+    ck_assert_int_eq(-1, load(SNAPSHOT_Z80, data, size));
+    data[34] = 0;
+    ck_assert_int_eq(0, load(SNAPSHOT_Z80, data, size));
+    data[size - 2] = 0xFF;
+    ck_assert_int_eq(-1, load(SNAPSHOT_Z80, data, size));
+    free(data);
+
+    // Wrong magic, 128K machine, duplicate registers.
+    PC(loaded) = 0x0000;
+    data = save(SNAPSHOT_SZX, &size);
+    data[0] = 'X';
+    ck_assert_int_eq(-1, load(SNAPSHOT_SZX, data, size));
+    data[0] = 'Z';
+    data[6] = 2;
+    ck_assert_int_eq(-1, load(SNAPSHOT_SZX, data, size));
+    data[6] = 1;
+    memcpy(data + 8 + 8 + 37, "Z80R", 4);
+    ck_assert_int_eq(-1, load(SNAPSHOT_SZX, data, size));
+    free(data);
+    ck_assert_uint_eq(0x0000, PC(loaded));
+}
+END_TEST
+
+START_TEST(test_snapshot_format)
+{
+    ck_assert_int_eq(SNAPSHOT_SNA, snapshot_format("game.sna"));
+    ck_assert_int_eq(SNAPSHOT_Z80, snapshot_format("dir.d/GAME.Z80"));
+    ck_assert_int_eq(SNAPSHOT_SZX, snapshot_format("game.szx"));
+    ck_assert_int_eq(-1, snapshot_format("game.tap"));
+    ck_assert_int_eq(-1, snapshot_format("game"));
+}
+END_TEST
+
+Suite*
+gensuite_snapshot(void)
+{
+    TCase* tc_snapshot = tcase_create("Snapshots");
+    tcase_add_checked_fixture(tc_snapshot, setup_snapshot, NULL);
+    tcase_add_test(tc_snapshot, test_snapshot_sna);
+    tcase_add_test(tc_snapshot, test_snapshot_z80);
+    tcase_add_test(tc_snapshot, test_snapshot_szx);
+    tcase_add_test(tc_snapshot, test_snapshot_z80_v1);
+    tcase_add_test(tc_snapshot, test_snapshot_szx_zlib);
+    tcase_add_test(tc_snapshot, test_snapshot_malformed);
+    tcase_add_test(tc_snapshot, test_snapshot_format);
+
+    Suite* s = suite_create("Snapshots");
+    suite_add_tcase(s, tc_snapshot);
+    return s;
+}
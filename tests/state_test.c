@@ -0,0 +1,249 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <fcntl.h>          // open
+#include <stddef.h>         // offsetof
+#include <stdlib.h>         // mkstemp
+#include <string.h>         // memset, strcpy
+#include <unistd.h>         // close, pread, pwrite, unlink
+
+#include <bus.h>
+#include <cpu.h>
+#include <state.h>
+#include <z80.h>
+
+#include "state_test.h"
+
+static char path[] = "/tmp/zeta80-state-XXXXXX";
+static struct cpu_t cpu, resumed;
+static struct bus_t bus, resumed_bus;
+static byte ram[0x10000], rom[0x1000];
+
+static byte
+port_read(void* ctx, word addr)
+{
+    return 0x42;
+}
+
+static void
+setup_state(void)
+{
+    int fd, i;
+    strcpy(path, "/tmp/zeta80-state-XXXXXX");
+    fd = mkstemp(path);
+    ck_assert_int_ne(-1, fd);
+    close(fd);
+
+    for (i = 0; i < 0x10000; i++) {
+        ram[i] = i ^ (i >> 8);
+    }
+    memset(rom, 0xC9, sizeof(rom));
+    memset(&cpu, 0, sizeof(cpu));
+    bus_init(&bus, ram);
+    cpu_init(&cpu, &bus);
+
+    // ROM at 0x0000, memory mapped I/O at 0xF000, contended RAM.
+    bus_map(&bus, 0, 1, rom, NULL);
+    bus_map(&bus, 15, 1, NULL, NULL);
+    bus_handlers(&bus, 15, 1, port_read, NULL, NULL);
+    bus_contend(&bus, 4, 4, 1);
+
+    REG_AF(cpu) = 0x1234;
+    ALT_HL(cpu) = 0x5678;
+    IY(cpu) = 0x9ABC;
+    PC(cpu) = 0x8000;
+    SP(cpu) = 0xEFFE;
+    cpu.i = 0x3F;
+    cpu.r = 0x7E;
+    cpu.iff1 = 1;
+    cpu.iff2 = 1;
+    cpu.im = 2;
+    cpu.tstates = 70000;
+
+    memset(&resumed, 0, sizeof(resumed));
+    bus_init(&resumed_bus, NULL);
+    cpu_init(&resumed, &resumed_bus);
+}
+
+static void
+teardown_state(void)
+{
+    unlink(path);
+}
+
+START_TEST(test_state_roundtrip)
+{
+    struct state_t* state;
+
+    ck_assert_int_eq(0, state_write(&cpu, path));
+    state = state_map(path);
+    ck_assert_ptr_ne(NULL, state);
+    ck_assert_uint_eq(STATE_PAGE_ROM, state->page[0].kind);
+    ck_assert_uint_eq(STATE_PAGE_RAM, state->page[1].kind);
+    ck_assert_uint_eq(STATE_PAGE_NONE, state->page[15].kind);
+    ck_assert_uint_eq(1, state->page[4].contention);
+    ck_assert_uint_eq(0, state->page[1].offset % MEM_PAGE_SIZE);
+    ck_assert_uint_eq(4096 + 15 * 4096, state->size);
+
+    state_resume(state, &resumed);
+    ck_assert_uint_eq(0x1234, REG_AF(resumed));
+    ck_assert_uint_eq(0x5678, ALT_HL(resumed));
+    ck_assert_uint_eq(0x9ABC, IY(resumed));
+    ck_assert_uint_eq(0x8000, PC(resumed));
+    ck_assert_uint_eq(0xEFFE, SP(resumed));
+    ck_assert_uint_eq(0x3F, resumed.i);
+    ck_assert_uint_eq(0x7E, resumed.r);
+    ck_assert_uint_eq(1, resumed.iff1);
+    ck_assert_uint_eq(1, resumed.iff2);
+    ck_assert_uint_eq(2, resumed.im);
+    ck_assert_int_eq(70000, resumed.tstates);
+    ck_assert_uint_eq(1, resumed_bus.page[5].contention);
+
+    // Memory is the mapping itself, no copy is made.
+    ck_assert_ptr_eq((byte*) state->mapping + state->page[1].offset,
+            resumed_bus.page[1].read);
+    ck_assert_uint_eq(0xC9, bus_read(&resumed_bus, 0x0000));
+    ck_assert_uint_eq(ram[0x1234], bus_read(&resumed_bus, 0x1234));
+    ck_assert_uint_eq(ram[0xEFFF], bus_read(&resumed_bus, 0xEFFF));
+    ck_assert_uint_eq(0xFF, bus_read(&resumed_bus, 0xF000));
+
+    // ROM stays read-only and the file does not see the writes.
+    bus_write(&resumed_bus, 0x0000, 0x00);
+    bus_write(&resumed_bus, 0x1234, 0xAA);
+    ck_assert_uint_eq(0xC9, bus_read(&resumed_bus, 0x0000));
+    ck_assert_uint_eq(0xAA, bus_read(&resumed_bus, 0x1234));
+    state_unmap(state);
+
+    state = state_map(path);
+    ck_assert_ptr_ne(NULL, state);
+    ck_assert_uint_eq(ram[0x1234],
+            ((byte*) state->mapping + state->page[1].offset)[0x234]);
+    state_unmap(state);
+}
+END_TEST
+
+START_TEST(test_state_invalid)
+{
+    struct state_header_t header;
+    uint64_t offset;
+    byte value;
+    int fd;
+
+    ck_assert_ptr_eq(NULL, state_map(path));
+    ck_assert_ptr_eq(NULL, state_map("/nonexistent/state"));
+    ck_assert_int_eq(0, state_write(&cpu, path));
+
+    // Wrong magic, version, truncated file.
+    fd = open(path, O_RDWR);
+    value = 'X';
+    ck_assert_int_eq(1, pwrite(fd, &value, 1, 0));
+    ck_assert_ptr_eq(NULL, state_map(path));
+    value = 'Z';
+    ck_assert_int_eq(1, pwrite(fd, &value, 1, 0));
+    value = STATE_VERSION + 1;
+    ck_assert_int_eq(1, pwrite(fd, &value, 1, 12));
+    ck_assert_ptr_eq(NULL, state_map(path));
+    value = STATE_VERSION;
+    ck_assert_int_eq(1, pwrite(fd, &value, 1, 12));
+
+    // Page offset that wraps around when the page size is added.
+    ck_assert_int_eq(sizeof(header), pread(fd, &header, sizeof(header), 0));
+    offset = UINT64_MAX & ~(uint64_t) MEM_PAGE_MASK;
+    ck_assert_int_eq(sizeof(offset), pwrite(fd, &offset, sizeof(offset),
+                header.dir_offset + sizeof(struct state_page_t)
+                + offsetof(struct state_page_t, offset)));
+    ck_assert_ptr_eq(NULL, state_map(path));
+
+    ck_assert_int_eq(0, ftruncate(fd, 8192));
+    ck_assert_ptr_eq(NULL, state_map(path));
+    close(fd);
+}
+END_TEST
+
+START_TEST(test_state_checkpoint)
+{
+    struct z80_t* z80 = z80_create(NULL, 0, 0x00);
+    struct z80_checkpoint_t* checkpoint;
+    struct state_t* state;
+
+    mem_write(&z80->cpu, 0x8000, 0x11);
+    PC(z80->cpu) = 0x1234;
+    checkpoint = z80_checkpoint(z80, path);
+    ck_assert_ptr_ne(NULL, checkpoint);
+
+    // The instance goes on while the checkpoint is written.
+    mem_write(&z80->cpu, 0x8000, 0x22);
+    PC(z80->cpu) = 0x5678;
+    ck_assert_int_eq(0, z80_checkpoint_wait(checkpoint));
+
+    state = state_map(path);
+    ck_assert_ptr_ne(NULL, state);
+    state_resume(state, &resumed);
+    ck_assert_uint_eq(0x1234, PC(resumed));
+    ck_assert_uint_eq(0x11, bus_read(&resumed_bus, 0x8000));
+    ck_assert_uint_eq(0x00, bus_read(&resumed_bus, 0x4000));
+    ck_assert_uint_eq(STATE_PAGE_RAM, state->page[4].kind);
+    state_unmap(state);
+
+    ck_assert_uint_eq(0x22, mem_read(&z80->cpu, 0x8000));
+    ck_assert_int_eq(1, atomic_load(&z80->ram[8]->refs));
+    z80_free(z80);
+
+    // Host memory of the caller is copied before the checkpoint returns.
+    z80 = z80_create(NULL, 0, 0x00);
+    memset(rom, 0x33, sizeof(rom));
+    bus_map(&z80->bus, 0xE, 1, rom, rom);
+    checkpoint = z80_checkpoint(z80, path);
+    ck_assert_ptr_ne(NULL, checkpoint);
+    mem_write(&z80->cpu, 0xE000, 0x44);
+    ck_assert_int_eq(0, z80_checkpoint_wait(checkpoint));
+    state = state_map(path);
+    ck_assert_ptr_ne(NULL, state);
+    state_resume(state, &resumed);
+    ck_assert_uint_eq(0x33, bus_read(&resumed_bus, 0xE000));
+    ck_assert_uint_eq(STATE_PAGE_RAM, state->page[0xE].kind);
+    state_unmap(state);
+    ck_assert_uint_eq(0x44, rom[0]);
+    z80_free(z80);
+
+    // Errors are reported by the wait.
+    z80 = z80_create(NULL, 0, 0x00);
+    checkpoint = z80_checkpoint(z80, "/nonexistent/state");
+    ck_assert_ptr_ne(NULL, checkpoint);
+    ck_assert_int_eq(-1, z80_checkpoint_wait(checkpoint));
+    z80_free(z80);
+}
+END_TEST
+
+Suite*
+gensuite_state(void)
+{
+    TCase* tc_state = tcase_create("State files");
+    tcase_add_checked_fixture(tc_state, setup_state, teardown_state);
+    tcase_add_test(tc_state, test_state_roundtrip);
+    tcase_add_test(tc_state, test_state_invalid);
+    tcase_add_test(tc_state, test_state_checkpoint);
+
+    Suite* s = suite_create("State files");
+    suite_add_tcase(s, tc_state);
+    return s;
+}
@@ -0,0 +1,294 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <string.h>         // memcmp, memcpy, memset
+
+#include <bus.h>
+#include <cpu.h>
+#include <opcodes.h>
+#include <system.h>
+
+#include "machine.h"
+#include "system_test.h"
+
+static struct machine_t machine[2], expected[2];
+
+static byte shared[MEM_PAGE_SIZE], expected_shared[MEM_PAGE_SIZE];
+static byte expected_latch;
+
+/*
+ * Both CPUs update a counter in shared memory at 0x8000 and log every
+ * value they store from 0x4000 up, so the logs depend on the order of
+ * every shared access:
+ *
+ * loop:                        loop:
+ *     LD A, (0x8000)               LD A, (0x8000)
+ *     INC A                        ADD A, A
+ *     LD (0x8000), A               LD (0x8000), A
+ *     LD (HL), A                   LD (HL), A
+ *     INC HL                       INC HL
+ *     JR loop                      NOP
+ *                                  JR loop
+ */
+static const byte counter_code[2][12] = {
+    { 0x3A, 0x00, 0x80, 0x3C, 0x32, 0x00, 0x80, 0x77, 0x23, 0x18, 0xF5 },
+    { 0x3A, 0x00, 0x80, 0x87, 0x32, 0x00, 0x80, 0x77, 0x23, 0x00,
+      0x18, 0xF4 },
+};
+
+/*
+ * CPU 0 counts into a latch at 0x9000, CPU 1 logs what it reads from the
+ * same latch at 0xA000:
+ *
+ * loop:                        loop:
+ *     INC A                        LD A, (0xA000)
+ *     LD (0x9000), A               LD (HL), A
+ *     JR loop                      INC HL
+ *                                  JR loop
+ */
+static const byte latch_code[2][8] = {
+    { 0x3C, 0x32, 0x00, 0x90, 0x18, 0xFA },
+    { 0x3A, 0x00, 0xA0, 0x77, 0x23, 0x18, 0xF9 },
+};
+
+// Private loop at 0x1000: INC B; JR -3
+static const byte private_code[] = { 0x04, 0x18, 0xFD };
+
+static void
+load(struct machine_t* m, const byte* code, size_t size)
+{
+    machine_init(m, code, size);
+    memcpy(m->ram + 0x1000, private_code, sizeof(private_code));
+    REG_HL(m->cpu) = 0x4000;
+}
+
+static void
+setup_system(void)
+{
+    int i;
+    memset(shared, 0, sizeof(shared));
+    memset(expected_shared, 0, sizeof(expected_shared));
+    shared[0] = expected_shared[0] = 1;
+    expected_latch = 0;
+    for (i = 0; i < 2; i++) {
+        load(&machine[i], counter_code[i], sizeof(counter_code[i]));
+        load(&expected[i], counter_code[i], sizeof(counter_code[i]));
+        bus_map(&expected[i].bus, 8, 1, expected_shared, expected_shared);
+    }
+}
+
+static byte
+latch_read(void* ctx, word addr)
+{
+    (void) ctx;
+    (void) addr;
+    return expected_latch;
+}
+
+static void
+latch_write(void* ctx, word addr, byte value)
+{
+    (void) ctx;
+    (void) addr;
+    expected_latch = value;
+}
+
+static void
+use_latch(void)
+{
+    int i;
+    expected_latch = 0;
+    for (i = 0; i < 2; i++) {
+        load(&machine[i], latch_code[i], sizeof(latch_code[i]));
+        load(&expected[i], latch_code[i], sizeof(latch_code[i]));
+    }
+    bus_map(&expected[0].bus, 9, 1, NULL, NULL);
+    bus_handlers(&expected[0].bus, 9, 1, latch_read, latch_write, NULL);
+    bus_map(&expected[1].bus, 10, 1, NULL, NULL);
+    bus_handlers(&expected[1].bus, 10, 1, latch_read, latch_write, NULL);
+}
+
+/*
+ * Reference: one instruction at a time, always from the CPU that is
+ * furthest behind, until both have reached the target.
+ */
+static void
+run_interleaved(long* clock, long target)
+{
+    for (;;) {
+        int i = clock[1] < clock[0] ? 1 : 0, before;
+        if (clock[i] >= target) return;
+        before = expected[i].cpu.tstates;
+        execute_opcode(&expected[i].cpu);
+        clock[i] += expected[i].cpu.tstates - before > 0
+            ? expected[i].cpu.tstates - before : 1;
+    }
+}
+
+static struct z80_system_t*
+create(int threaded, int min_quantum, int max_quantum)
+{
+    struct z80_system_t* system = z80_system_create(threaded, min_quantum,
+            max_quantum);
+    ck_assert_ptr_ne(NULL, system);
+    ck_assert_int_eq(0, z80_system_add(system, &machine[0].cpu));
+    ck_assert_int_eq(1, z80_system_add(system, &machine[1].cpu));
+    return system;
+}
+
+static void
+assert_matches(void)
+{
+    int i;
+    ck_assert_int_eq(0, memcmp(expected_shared, shared, sizeof(shared)));
+    for (i = 0; i < 2; i++) {
+        ck_assert_int_eq(0, memcmp(expected[i].ram + 0x4000,
+                    machine[i].ram + 0x4000, 0x1000));
+        ck_assert_uint_eq(REG_A(expected[i].cpu), REG_A(machine[i].cpu));
+        ck_assert_uint_eq(REG_HL(expected[i].cpu), REG_HL(machine[i].cpu));
+        ck_assert_uint_eq(PC(expected[i].cpu), PC(machine[i].cpu));
+        ck_assert_int_eq(expected[i].cpu.tstates, machine[i].cpu.tstates);
+    }
+}
+
+// Runs the counters in three calls and checks them against the reference.
+static void
+check_counters(int threaded, int min_quantum, int max_quantum)
+{
+    struct z80_system_t* system = create(threaded, min_quantum,
+            max_quantum);
+    long clock[2] = { 0, 0 };
+
+    ck_assert_int_eq(0, z80_system_share(system, 0, 8, 1, shared));
+    ck_assert_int_eq(0, z80_system_share(system, 1, 8, 1, shared));
+    ck_assert_int_eq(0, z80_system_run(system, 5000));
+    ck_assert_int_eq(0, z80_system_run(system, 777));
+    ck_assert_int_eq(0, z80_system_run(system, 6000));
+    run_interleaved(clock, 5000);
+    run_interleaved(clock, 5777);
+    run_interleaved(clock, 11777);
+    assert_matches();
+    ck_assert_uint_gt(system->handovers, 0);
+    z80_system_free(system);
+}
+
+START_TEST(test_system_shared)
+{
+    check_counters(0, 1, 1);
+    setup_system();
+    check_counters(0, 16, 4096);
+    setup_system();
+    check_counters(0, 5000, 5000);
+}
+END_TEST
+
+START_TEST(test_system_threaded)
+{
+    check_counters(1, 16, 4096);
+    setup_system();
+    check_counters(1, 3000, 3000);
+}
+END_TEST
+
+START_TEST(test_system_latch)
+{
+    int threaded;
+    for (threaded = 0; threaded < 2; threaded++) {
+        struct z80_system_t* system;
+        long clock[2] = { 0, 0 };
+
+        use_latch();
+        system = create(threaded, 32, 2048);
+        ck_assert_int_eq(0, z80_system_latch(system, 0, 0x9000, 3));
+        ck_assert_int_eq(0, z80_system_latch(system, 1, 0xA000, 3));
+        ck_assert_int_eq(0, z80_system_run(system, 8000));
+        run_interleaved(clock, 8000);
+        assert_matches();
+        // Unlatched addresses in a latched page are open bus.
+        ck_assert_uint_eq(0xFF, mem_read(&machine[1].cpu, 0xA001));
+        z80_system_free(system);
+    }
+}
+END_TEST
+
+START_TEST(test_system_quantum)
+{
+    struct z80_system_t* system = create(0, 64, 1024);
+    ck_assert_int_eq(0, z80_system_share(system, 0, 8, 1, shared));
+    ck_assert_int_eq(0, z80_system_share(system, 1, 8, 1, shared));
+
+    // The counters hand the shared page over all the time.
+    ck_assert_int_eq(0, z80_system_run(system, 10000));
+    ck_assert_int_eq(64, system->quantum);
+    ck_assert_uint_gt(system->quanta, 10000 / 1024);
+
+    // Left to run on their own, quanta grow back.
+    PC(machine[0].cpu) = 0x1000;
+    PC(machine[1].cpu) = 0x1000;
+    system->handovers = 0;
+    ck_assert_int_eq(0, z80_system_run(system, 10000));
+    ck_assert_int_eq(1024, system->quantum);
+    ck_assert_uint_eq(0, system->handovers);
+    z80_system_free(system);
+}
+END_TEST
+
+START_TEST(test_system_invalid)
+{
+    struct z80_system_t* system = create(0, 16, 64);
+    int i;
+
+    ck_assert_int_eq(-1, z80_system_share(system, 2, 8, 1, shared));
+    ck_assert_int_eq(-1, z80_system_share(system, 0, 15, 2, shared));
+    ck_assert_int_eq(-1, z80_system_share(system, 0, 8, 1, NULL));
+    ck_assert_int_eq(-1, z80_system_latch(system, 0, 0x9000,
+                SYSTEM_MAX_LATCHES));
+    for (i = 0; i < SYSTEM_MAX_LATCHES; i++) {
+        ck_assert_int_eq(0, z80_system_latch(system, 0, 0x9000 + i, i));
+    }
+    ck_assert_int_eq(-1, z80_system_latch(system, 0, 0x9100, 0));
+    for (i = 2; i < SYSTEM_MAX_CPUS; i++) {
+        ck_assert_int_eq(i, z80_system_add(system, &machine[0].cpu));
+    }
+    ck_assert_int_eq(-1, z80_system_add(system, &machine[0].cpu));
+    z80_system_free(system);
+
+    ck_assert_ptr_eq(NULL, z80_system_create(0, 0, 64));
+    ck_assert_ptr_eq(NULL, z80_system_create(0, 64, 16));
+}
+END_TEST
+
+Suite*
+gensuite_system(void)
+{
+    TCase* tc_system = tcase_create("System");
+    tcase_add_checked_fixture(tc_system, setup_system, NULL);
+    tcase_add_test(tc_system, test_system_shared);
+    tcase_add_test(tc_system, test_system_threaded);
+    tcase_add_test(tc_system, test_system_latch);
+    tcase_add_test(tc_system, test_system_quantum);
+    tcase_add_test(tc_system, test_system_invalid);
+
+    Suite* s = suite_create("System");
+    suite_add_tcase(s, tc_system);
+    return s;
+}
@@ -0,0 +1,191 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <string.h>         // memcmp, memcpy, memset
+
+#include <bus.h>
+#include <cpu.h>
+#include <opcodes.h>
+#include <txn.h>
+#include <z80.h>
+
+#include "txn_test.h"
+
+static struct cpu_t cpu;
+static struct bus_t bus;
+static byte ram[0x10000];
+
+static void
+setup_txn(void)
+{
+    int i;
+    for (i = 0; i < 0x10000; i++) {
+        ram[i] = i * 3;
+    }
+    bus_init(&bus, ram);
+    memset(&cpu, 0, sizeof(cpu));
+    cpu_init(&cpu, &bus);
+    PC(cpu) = 0x1000;
+    REG_HL(cpu) = 0x1234;
+}
+
+START_TEST(test_txn_rollback)
+{
+    static byte before[0x10000];
+    struct cpu_t saved;
+    struct z80_txn_t txn;
+
+    memcpy(before, ram, sizeof(ram));
+    memcpy(&saved, &cpu, sizeof(cpu));
+    ck_assert_int_eq(0, z80_txn_begin(&txn, &cpu));
+    ck_assert_ptr_eq(NULL, bus.page[8].write);
+
+    // The same byte written twice gets its first value back.
+    mem_write(&cpu, 0x8000, 0x11);
+    mem_write(&cpu, 0x8000, 0x22);
+    mem_write(&cpu, 0xFFFF, 0x33);
+    PC(cpu) = 0x2000;
+    REG_HL(cpu) = 0x5678;
+    cpu.tstates = 500;
+    ck_assert_uint_eq(3, txn.undo.count);
+
+    ck_assert_int_eq(0, z80_txn_rollback(&txn));
+    ck_assert_int_eq(0, memcmp(before, ram, sizeof(ram)));
+    ck_assert_int_eq(0, memcmp(&saved, &cpu, sizeof(cpu)));
+    ck_assert_ptr_eq(NULL, bus.undo);
+    ck_assert_ptr_eq(ram + 0x8000, bus.page[8].write);
+}
+END_TEST
+
+START_TEST(test_txn_commit)
+{
+    struct z80_txn_t txn, nested;
+    int i;
+
+    ck_assert_int_eq(0, z80_txn_begin(&txn, &cpu));
+    ck_assert_int_eq(-1, z80_txn_begin(&nested, &cpu));
+
+    // Enough writes to grow the log a few times.
+    for (i = 0; i < 10000; i++) {
+        mem_write(&cpu, 0x4000 + i, 0xAA);
+    }
+    REG_HL(cpu) = 0x5678;
+    ck_assert_uint_eq(10000, txn.undo.count);
+    z80_txn_commit(&txn);
+    ck_assert_uint_eq(0xAA, ram[0x4000 + 9999]);
+    ck_assert_uint_eq(0x5678, REG_HL(cpu));
+    ck_assert_ptr_eq(NULL, bus.undo);
+
+    // A new transaction can begin once the last one is closed.
+    ck_assert_int_eq(0, z80_txn_begin(&txn, &cpu));
+    mem_write(&cpu, 0x4000, 0x55);
+    ck_assert_int_eq(0, z80_txn_rollback(&txn));
+    ck_assert_uint_eq(0xAA, ram[0x4000]);
+}
+END_TEST
+
+START_TEST(test_txn_execute)
+{
+    // LD (HL), A; INC HL, run ahead and back.
+    struct bus_hash_t hash;
+    struct z80_txn_t txn;
+    uint64_t start;
+    int i;
+
+    ram[0x1000] = 0x77;
+    ram[0x1001] = 0x23;
+    ram[0x1002] = 0x18;
+    ram[0x1003] = 0xFC;
+    REG_A(cpu) = 0xEE;
+    bus_hash_attach(&bus, &hash);
+    start = z80_state_hash(&cpu);
+
+    ck_assert_int_eq(0, z80_txn_begin(&txn, &cpu));
+    for (i = 0; i < 300; i++) {
+        execute_opcode(&cpu);
+    }
+    ck_assert_uint_eq(0xEE, ram[0x1234]);
+    ck_assert_uint_ne(start, z80_state_hash(&cpu));
+    ck_assert_int_eq(0, z80_txn_rollback(&txn));
+    ck_assert_uint_eq(start, z80_state_hash(&cpu));
+    ck_assert_uint_eq(0x1000, PC(cpu));
+    bus_hash_detach(&bus);
+}
+END_TEST
+
+START_TEST(test_txn_fork)
+{
+    // Copy-on-write pages are undone in the private copy.
+    struct z80_t* parent = z80_create(NULL, 0, 0x00);
+    struct z80_t* child;
+    struct z80_txn_t txn;
+
+    mem_write(&parent->cpu, 0x8000, 0x11);
+    child = z80_fork(parent);
+    ck_assert_int_eq(0, z80_txn_begin(&txn, &child->cpu));
+    mem_write(&child->cpu, 0x8000, 0x22);
+    mem_write(&child->cpu, 0x9000, 0x33);
+    ck_assert_uint_eq(0x22, mem_read(&child->cpu, 0x8000));
+    ck_assert_int_eq(0, z80_txn_rollback(&txn));
+    ck_assert_uint_eq(0x11, mem_read(&child->cpu, 0x8000));
+    ck_assert_uint_eq(0x00, mem_read(&child->cpu, 0x9000));
+    ck_assert_uint_eq(0x11, mem_read(&parent->cpu, 0x8000));
+    z80_free(child);
+    z80_free(parent);
+}
+END_TEST
+
+START_TEST(test_txn_bank_switch)
+{
+    // Writes to a bank that was switched out are not written back.
+    static byte bank[2][MEM_PAGE_SIZE];
+    struct z80_txn_t txn;
+
+    memset(bank, 0xAA, sizeof(bank));
+    bus_map(&bus, 8, 1, bank[0], bank[0]);
+    ck_assert_int_eq(0, z80_txn_begin(&txn, &cpu));
+    mem_write(&cpu, 0x8000, 0x11);
+    mem_write(&cpu, 0x4000, 0x22);
+    bus_map(&bus, 8, 1, bank[1], bank[1]);
+    ck_assert_int_eq(-1, z80_txn_rollback(&txn));
+    ck_assert_uint_eq(0xAA, bank[1][0]);
+    ck_assert_uint_eq(0x11, bank[0][0]);
+    ck_assert_uint_eq((byte) (0x4000 * 3), ram[0x4000]);
+    ck_assert_ptr_eq(NULL, bus.undo);
+}
+END_TEST
+
+Suite*
+gensuite_txn(void)
+{
+    TCase* tc_txn = tcase_create("Transactions");
+    tcase_add_checked_fixture(tc_txn, setup_txn, NULL);
+    tcase_add_test(tc_txn, test_txn_rollback);
+    tcase_add_test(tc_txn, test_txn_commit);
+    tcase_add_test(tc_txn, test_txn_execute);
+    tcase_add_test(tc_txn, test_txn_fork);
+    tcase_add_test(tc_txn, test_txn_bank_switch);
+
+    Suite* s = suite_create("Transactions");
+    suite_add_tcase(s, tc_txn);
+    return s;
+}
@@ -0,0 +1,247 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <string.h>         // memset
+
+#include <cpu.h>
+#include <z180.h>
+
+#include "z180_test.h"
+
+static struct z180_t z180;
+static byte tx_data[2];
+
+static void
+setup_z180(void)
+{
+    memset(&z180, 0xFF, sizeof(struct z180_t));
+    z180_init(&z180);
+    PC(z180.cpu) = 0;
+    z180.cpu.tstates = 0;
+}
+
+static void
+teardown_z180(void)
+{
+    // No actually teardown.
+}
+
+static void
+record_tx(struct z180_t* z, int channel, byte value)
+{
+    tx_data[channel] = value;
+}
+
+START_TEST(test_mmu_reset_is_flat)
+{
+    ck_assert_uint_eq(0x00000, z180_translate(&z180, 0x0000));
+    ck_assert_uint_eq(0x0ABCD, z180_translate(&z180, 0xABCD));
+    ck_assert_uint_eq(0x0FFFF, z180_translate(&z180, 0xFFFF));
+}
+END_TEST
+
+START_TEST(test_mmu_bank_and_common)
+{
+    // Bank area at 0x4000, common area 1 at 0xC000.
+    z180_out0(&z180, Z180_CBAR, 0xC4);
+    z180_out0(&z180, Z180_BBR, 0x20);
+    z180_out0(&z180, Z180_CBR, 0xF0);
+
+    ck_assert_uint_eq(0x03FFF, z180_translate(&z180, 0x3FFF));
+    ck_assert_uint_eq(0x24000, z180_translate(&z180, 0x4000));
+    ck_assert_uint_eq(0x2BFFF, z180_translate(&z180, 0xBFFF));
+    ck_assert_uint_eq(0xFC000, z180_translate(&z180, 0xC000));
+    ck_assert_uint_eq(0xFFFFF, z180_translate(&z180, 0xFFFF));
+}
+END_TEST
+
+START_TEST(test_mmu_z80_opcodes)
+{
+    z180_out0(&z180, Z180_CBAR, 0xC4);
+    z180_out0(&z180, Z180_BBR, 0x20);
+    z180.phys[0] = 0x32; // LD (NN), A
+    z180.phys[1] = 0x34;
+    z180.phys[2] = 0x52;
+    REG_A(z180.cpu) = 0x55;
+
+    z180_execute_opcode(&z180);
+
+    ck_assert_uint_eq(0x55, z180.phys[0x25234]);
+    ck_assert_uint_eq(13, z180.cpu.tstates);
+}
+END_TEST
+
+START_TEST(test_MLT_BC)
+{
+    z180.phys[0] = 0xED;
+    z180.phys[1] = 0x4C;
+    REG_B(z180.cpu) = 200;
+    REG_C(z180.cpu) = 150;
+    z180_execute_opcode(&z180);
+    ck_assert_uint_eq(30000, REG_BC(z180.cpu));
+    ck_assert_uint_eq(2, PC(z180.cpu));
+    ck_assert_uint_eq(17, z180.cpu.tstates);
+}
+END_TEST
+
+START_TEST(test_TST_n)
+{
+    z180.phys[0] = 0xED;
+    z180.phys[1] = 0x64;
+    z180.phys[2] = 0x0F;
+    REG_A(z180.cpu) = 0xF0;
+    z180_execute_opcode(&z180);
+    ck_assert_uint_eq(0xF0, REG_A(z180.cpu));
+    ck_assert(FLAG_GET(z180.cpu, FLAG_Z));
+    ck_assert(FLAG_GET(z180.cpu, FLAG_H));
+    ck_assert(FLAG_GET(z180.cpu, FLAG_P));
+    ck_assert(!FLAG_GET(z180.cpu, FLAG_C));
+    ck_assert(!FLAG_GET(z180.cpu, FLAG_N));
+    ck_assert_uint_eq(3, PC(z180.cpu));
+    ck_assert_uint_eq(9, z180.cpu.tstates);
+}
+END_TEST
+
+START_TEST(test_TST_iHL)
+{
+    z180.phys[0] = 0xED;
+    z180.phys[1] = 0x34;
+    z180.phys[0x8000] = 0x81;
+    REG_HL(z180.cpu) = 0x8000;
+    REG_A(z180.cpu) = 0x80;
+    z180_execute_opcode(&z180);
+    ck_assert(FLAG_GET(z180.cpu, FLAG_S));
+    ck_assert(!FLAG_GET(z180.cpu, FLAG_Z));
+    ck_assert(!FLAG_GET(z180.cpu, FLAG_P));
+    ck_assert_uint_eq(10, z180.cpu.tstates);
+}
+END_TEST
+
+START_TEST(test_OUT0_IN0)
+{
+    z180.phys[0] = 0xED; // OUT0 (0x32), B
+    z180.phys[1] = 0x01;
+    z180.phys[2] = Z180_DCNTL;
+    z180.phys[3] = 0xED; // IN0 E, (0x32)
+    z180.phys[4] = 0x18;
+    z180.phys[5] = Z180_DCNTL;
+    REG_B(z180.cpu) = 0x12;
+
+    z180_execute_opcode(&z180);
+    ck_assert_uint_eq(0x12, z180.io[Z180_DCNTL]);
+    ck_assert_uint_eq(13, z180.cpu.tstates);
+
+    z180_execute_opcode(&z180);
+    ck_assert_uint_eq(0x12, REG_E(z180.cpu));
+    ck_assert_uint_eq(6, PC(z180.cpu));
+    ck_assert_uint_eq(25, z180.cpu.tstates);
+}
+END_TEST
+
+START_TEST(test_dma_burst_memory)
+{
+    int i;
+    for (i = 0; i < 0x100; i++) {
+        z180.phys[0x10000 + i] = i;
+    }
+    z180_out0(&z180, Z180_SAR0L, 0x00);
+    z180_out0(&z180, Z180_SAR0L + 1, 0x00);
+    z180_out0(&z180, Z180_SAR0L + 2, 0x01);
+    z180_out0(&z180, Z180_DAR0L, 0x00);
+    z180_out0(&z180, Z180_DAR0L + 1, 0x00);
+    z180_out0(&z180, Z180_DAR0L + 2, 0x08);
+    z180_out0(&z180, Z180_BCR0L, 0x00);
+    z180_out0(&z180, Z180_BCR0L + 1, 0x01);
+    z180_out0(&z180, Z180_DMODE, 0x02); // Memory to memory, burst
+    z180_out0(&z180, Z180_DSTAT, Z180_DSTAT_DE0 | Z180_DSTAT_DWE1);
+
+    for (i = 0; i < 0x100; i++) {
+        ck_assert_uint_eq(i, z180.phys[0x80000 + i]);
+    }
+    ck_assert_uint_eq(0, z180.io[Z180_DSTAT] & Z180_DSTAT_DE0);
+    ck_assert_uint_eq(0x00, z180.io[Z180_BCR0L + 1]);
+    ck_assert_uint_eq(0x01, z180.io[Z180_SAR0L + 1]);
+    ck_assert_uint_eq(0x01, z180.io[Z180_DAR0L + 1]);
+    ck_assert_uint_eq(0x100 * 6, z180.cpu.tstates);
+}
+END_TEST
+
+START_TEST(test_dma_overlapping_fill)
+{
+    // Copying forward onto itself replicates the first byte.
+    z180.phys[0x1000] = 0xAA;
+    z180_out0(&z180, Z180_SAR0L, 0x00);
+    z180_out0(&z180, Z180_SAR0L + 1, 0x10);
+    z180_out0(&z180, Z180_SAR0L + 2, 0x00);
+    z180_out0(&z180, Z180_DAR0L, 0x01);
+    z180_out0(&z180, Z180_DAR0L + 1, 0x10);
+    z180_out0(&z180, Z180_DAR0L + 2, 0x00);
+    z180_out0(&z180, Z180_BCR0L, 0x10);
+    z180_out0(&z180, Z180_BCR0L + 1, 0x00);
+    z180_out0(&z180, Z180_DMODE, 0x02);
+    z180_out0(&z180, Z180_DSTAT, Z180_DSTAT_DE0 | Z180_DSTAT_DWE1);
+
+    ck_assert_uint_eq(0xAA, z180.phys[0x1010]);
+}
+END_TEST
+
+START_TEST(test_asci)
+{
+    z180.tx = record_tx;
+    z180_out0(&z180, Z180_TDR1, 0x42);
+    ck_assert_uint_eq(0x42, tx_data[1]);
+
+    z180_asci_receive(&z180, 0, 0x33);
+    ck_assert(z180.io[Z180_STAT0] & Z180_STAT_RDRF);
+    ck_assert_uint_eq(0x33, z180_in0(&z180, Z180_RDR0));
+    ck_assert(!(z180.io[Z180_STAT0] & Z180_STAT_RDRF));
+}
+END_TEST
+
+Suite*
+gensuite_z180(void)
+{
+    TCase* tc_mmu = tcase_create("MMU");
+    tcase_add_checked_fixture(tc_mmu, setup_z180, teardown_z180);
+    tcase_add_test(tc_mmu, test_mmu_reset_is_flat);
+    tcase_add_test(tc_mmu, test_mmu_bank_and_common);
+    tcase_add_test(tc_mmu, test_mmu_z80_opcodes);
+
+    TCase* tc_opcodes = tcase_create("Extensions");
+    tcase_add_checked_fixture(tc_opcodes, setup_z180, teardown_z180);
+    tcase_add_test(tc_opcodes, test_MLT_BC);
+    tcase_add_test(tc_opcodes, test_TST_n);
+    tcase_add_test(tc_opcodes, test_TST_iHL);
+    tcase_add_test(tc_opcodes, test_OUT0_IN0);
+
+    TCase* tc_peripherals = tcase_create("Peripherals");
+    tcase_add_checked_fixture(tc_peripherals, setup_z180, teardown_z180);
+    tcase_add_test(tc_peripherals, test_dma_burst_memory);
+    tcase_add_test(tc_peripherals, test_dma_overlapping_fill);
+    tcase_add_test(tc_peripherals, test_asci);
+
+    Suite* s = suite_create("Z180");
+    suite_add_tcase(s, tc_mmu);
+    suite_add_tcase(s, tc_opcodes);
+    suite_add_tcase(s, tc_peripherals);
+    return s;
+}
@@ -0,0 +1,443 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+#include <check.h>
+#include <stdio.h>          // fopen, fwrite
+#include <stdlib.h>         // mkstemp
+#include <string.h>         // memset
+#include <unistd.h>         // close, unlink
+
+#include <cpu.h>
+#include <opcodes.h>
+#include <z80.h>
+
+#include "z80_test.h"
+
+static char rom_path[] = "/tmp/zeta80-rom-XXXXXX";
+static struct z80_rom_file_t* rom;
+
+// 6 KB ROM: it takes two pages, the second one half empty.
+static void
+setup_rom(void)
+{
+    static byte data[0x1800];
+    int fd = mkstemp(rom_path);
+    FILE* file;
+
+    memset(data, 0xC9, sizeof(data));
+    data[0] = 0x3E;             // LD A, 0x42
+    data[1] = 0x42;
+    data[2] = 0x32;             // LD (0x8000), A
+    data[3] = 0x00;
+    data[4] = 0x80;
+    ck_assert_int_ne(-1, fd);
+    file = fdopen(fd, "wb");
+    ck_assert_int_eq(1, fwrite(data, sizeof(data), 1, file));
+    fclose(file);
+
+    rom = z80_rom_open(rom_path);
+    ck_assert_ptr_ne(NULL, rom);
+}
+
+static void
+teardown_rom(void)
+{
+    z80_rom_close(rom);
+    unlink(rom_path);
+    strcpy(rom_path, "/tmp/zeta80-rom-XXXXXX");
+}
+
+START_TEST(test_rom_open)
+{
+    ck_assert_uint_eq(0x1800, rom->size);
+    ck_assert_int_eq(2, rom->pages);
+    ck_assert_uint_eq(0x3E, rom->data[0]);
+    ck_assert_uint_eq(0x00, rom->data[0x1FFF]);
+}
+END_TEST
+
+START_TEST(test_rom_missing)
+{
+    ck_assert_ptr_eq(NULL, z80_rom_open("/nonexistent/zeta80.rom"));
+}
+END_TEST
+
+START_TEST(test_instance_lazy_ram)
+{
+    struct z80_t* z80 = z80_create(NULL, 0, 0x00);
+    struct z80_stats_t stats;
+
+    ck_assert_ptr_ne(NULL, z80);
+    z80_stats(z80, &stats);
+    ck_assert_int_eq(0, stats.ram_pages);
+    ck_assert_uint_eq(sizeof(struct z80_t), stats.resident);
+    ck_assert_uint_eq(0x00, mem_read(&z80->cpu, 0x1234));
+
+    mem_write(&z80->cpu, 0x1234, 0x56);
+    mem_write(&z80->cpu, 0x1235, 0x78);
+    ck_assert_uint_eq(0x56, mem_read(&z80->cpu, 0x1234));
+    ck_assert_uint_eq(0x78, mem_read(&z80->cpu, 0x1235));
+    z80_stats(z80, &stats);
+    ck_assert_int_eq(1, stats.ram_pages);
+    ck_assert_uint_eq(sizeof(struct z80_t) + MEM_PAGE_SIZE, stats.resident);
+    z80_free(z80);
+}
+END_TEST
+
+START_TEST(test_instance_rom)
+{
+    struct z80_t* z80 = z80_create(rom, 0x0000, 0x00);
+    struct z80_stats_t stats;
+
+    ck_assert_ptr_ne(NULL, z80);
+    execute_opcode(&z80->cpu);
+    execute_opcode(&z80->cpu);
+    ck_assert_uint_eq(0x42, mem_read(&z80->cpu, 0x8000));
+
+    // ROM is read-only, and the padding page too.
+    mem_write(&z80->cpu, 0x0000, 0x00);
+    mem_write(&z80->cpu, 0x1F00, 0x12);
+    ck_assert_uint_eq(0x3E, mem_read(&z80->cpu, 0x0000));
+    ck_assert_uint_eq(0x00, mem_read(&z80->cpu, 0x1F00));
+
+    z80_stats(z80, &stats);
+    ck_assert_int_eq(2, stats.rom_pages);
+    ck_assert_int_eq(1, stats.ram_pages);
+    z80_free(z80);
+}
+END_TEST
+
+START_TEST(test_instance_shared_rom)
+{
+    struct z80_t* instances[1000];
+    struct z80_stats_t stats;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        instances[i] = z80_create(rom, 0x4000, 0x00);
+        ck_assert_ptr_ne(NULL, instances[i]);
+        mem_write(&instances[i]->cpu, 0xC000, i);
+    }
+    // Every instance reads the ROM from the same host memory.
+    ck_assert_ptr_eq(instances[0]->bus.page[4].read,
+            instances[999]->bus.page[4].read);
+    ck_assert_uint_eq(0x3E, mem_read(&instances[999]->cpu, 0x4000));
+    ck_assert_uint_eq(999 & 0xFF, mem_read(&instances[999]->cpu, 0xC000));
+
+    z80_stats(instances[0], &stats);
+    ck_assert_int_eq(1, stats.ram_pages);
+    for (i = 0; i < 1000; i++) {
+        z80_free(instances[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_instance_bad_base)
+{
+    ck_assert_ptr_eq(NULL, z80_create(rom, 0x0100, 0x00));
+    ck_assert_ptr_eq(NULL, z80_create(rom, 0xF000, 0x00));
+}
+END_TEST
+
+START_TEST(test_fork_shares_pages)
+{
+    struct z80_t* parent = z80_create(rom, 0x0000, 0x00);
+    struct z80_t* child;
+    struct z80_stats_t stats;
+
+    mem_write(&parent->cpu, 0x8000, 0x11);
+    mem_write(&parent->cpu, 0x9000, 0x22);
+    REG_BC(parent->cpu) = 0x1234;
+
+    child = z80_fork(parent);
+    ck_assert_ptr_ne(NULL, child);
+    ck_assert_ptr_eq(&child->bus, child->cpu.bus);
+    ck_assert_uint_eq(0x1234, REG_BC(child->cpu));
+    ck_assert_ptr_eq(parent->ram[8], child->ram[8]);
+    ck_assert_uint_eq(0x11, mem_read(&child->cpu, 0x8000));
+
+    z80_stats(child, &stats);
+    ck_assert_int_eq(2, stats.ram_pages);
+    ck_assert_int_eq(2, stats.shared_pages);
+    ck_assert_uint_eq(sizeof(struct z80_t) + MEM_PAGE_SIZE, stats.resident);
+
+    z80_free(child);
+    z80_free(parent);
+}
+END_TEST
+
+START_TEST(test_fork_copy_on_write)
+{
+    struct z80_t* parent = z80_create(NULL, 0, 0x00);
+    struct z80_t* child;
+    struct z80_stats_t stats;
+
+    mem_write(&parent->cpu, 0x8000, 0x11);
+    child = z80_fork(parent);
+
+    // Only the page that is written is copied.
+    mem_write(&child->cpu, 0x8001, 0x99);
+    ck_assert_ptr_ne(parent->ram[8], child->ram[8]);
+    ck_assert_uint_eq(0x11, mem_read(&child->cpu, 0x8000));
+    ck_assert_uint_eq(0x99, mem_read(&child->cpu, 0x8001));
+    ck_assert_uint_eq(0x00, mem_read(&parent->cpu, 0x8001));
+
+    // The parent is the only owner of its page again: no copy is made.
+    z80_stats(parent, &stats);
+    ck_assert_int_eq(0, stats.shared_pages);
+    {
+        struct z80_page_t* page = parent->ram[8];
+        mem_write(&parent->cpu, 0x8002, 0x77);
+        ck_assert_ptr_eq(page, parent->ram[8]);
+    }
+    ck_assert_uint_eq(0x00, mem_read(&child->cpu, 0x8002));
+
+    // Pages that were never written stay unallocated in both.
+    mem_write(&child->cpu, 0x4000, 0x55);
+    ck_assert_ptr_eq(NULL, parent->ram[4]);
+    ck_assert_uint_eq(0x00, mem_read(&parent->cpu, 0x4000));
+
+    z80_free(parent);
+    ck_assert_uint_eq(0x11, mem_read(&child->cpu, 0x8000));
+    z80_free(child);
+}
+END_TEST
+
+START_TEST(test_fork_chain)
+{
+    struct z80_t* a = z80_create(NULL, 0, 0x00);
+    struct z80_t* b;
+    struct z80_t* c;
+    int i;
+
+    // LD A, 0x05; LD (0x8000), A; NOP
+    mem_write(&a->cpu, 0x0000, 0x3E);
+    mem_write(&a->cpu, 0x0001, 0x05);
+    mem_write(&a->cpu, 0x0002, 0x32);
+    mem_write(&a->cpu, 0x0003, 0x00);
+    mem_write(&a->cpu, 0x0004, 0x80);
+    b = z80_fork(a);
+    c = z80_fork(b);
+    ck_assert_int_eq(3, atomic_load(&a->ram[0]->refs));
+
+    for (i = 0; i < 2; i++) {
+        execute_opcode(&c->cpu);
+    }
+    ck_assert_uint_eq(0x05, mem_read(&c->cpu, 0x8000));
+    ck_assert_uint_eq(0x00, mem_read(&a->cpu, 0x8000));
+    ck_assert_uint_eq(0x00, mem_read(&b->cpu, 0x8000));
+    ck_assert_uint_eq(0x0000, PC(b->cpu));
+
+    z80_free(b);
+    ck_assert_int_eq(2, atomic_load(&a->ram[0]->refs));
+    z80_free(a);
+    z80_free(c);
+}
+END_TEST
+
+START_TEST(test_baseline_reset)
+{
+    struct z80_t* z80 = z80_create(NULL, 0, 0x00);
+    struct z80_page_t* page;
+
+    mem_write(&z80->cpu, 0x8000, 0x11);
+    REG_A(z80->cpu) = 0x42;
+    ck_assert_int_eq(0, z80_set_baseline(z80));
+
+    mem_write(&z80->cpu, 0x8000, 0x22);
+    mem_write(&z80->cpu, 0x8FFF, 0x33);
+    mem_write(&z80->cpu, 0x4000, 0x44);
+    REG_A(z80->cpu) = 0x00;
+    PC(z80->cpu) = 0x1234;
+    page = z80->ram[8];
+
+    z80_reset_to_baseline(z80);
+    ck_assert_uint_eq(0x42, REG_A(z80->cpu));
+    ck_assert_uint_eq(0x0000, PC(z80->cpu));
+    ck_assert_uint_eq(0x11, mem_read(&z80->cpu, 0x8000));
+    ck_assert_uint_eq(0x00, mem_read(&z80->cpu, 0x8FFF));
+    ck_assert_uint_eq(0x00, mem_read(&z80->cpu, 0x4000));
+
+    // The working copy is kept and only its dirty lines are restored.
+    ck_assert_ptr_eq(page, z80->ram[8]);
+    mem_write(&z80->cpu, 0x8001, 0x55);
+    z80_reset_to_baseline(z80);
+    ck_assert_ptr_eq(page, z80->ram[8]);
+    ck_assert_uint_eq(0x11, mem_read(&z80->cpu, 0x8000));
+    ck_assert_uint_eq(0x00, mem_read(&z80->cpu, 0x8001));
+    z80_free(z80);
+}
+END_TEST
+
+START_TEST(test_baseline_host)
+{
+    // Host memory that is not RAM of the instance is restored too.
+    static byte nvram[MEM_PAGE_SIZE];
+    struct z80_t* z80 = z80_create(NULL, 0, 0x00);
+    struct bus_dirty_t dirty;
+
+    memset(nvram, 0x5A, sizeof(nvram));
+    bus_map(&z80->bus, 0xE, 1, nvram, nvram);
+    ck_assert_int_eq(0, z80_set_baseline(z80));
+    bus_dirty_attach(&z80->bus, &dirty, 1);
+    mem_write(&z80->cpu, 0xE000, 0x11);
+    mem_write(&z80->cpu, 0xEFFF, 0x22);
+    bus_dirty_fetch_pages(&dirty);
+    bus_dirty_fetch_lines(&dirty, 0xE);
+
+    z80_reset_to_baseline(z80);
+    ck_assert_uint_eq(0x5A, nvram[0x000]);
+    ck_assert_uint_eq(0x5A, nvram[0xFFF]);
+    ck_assert_uint_eq(1u << 0xE, bus_dirty_fetch_pages(&dirty));
+    ck_assert_uint_eq(0x8000000000000001ull,
+            bus_dirty_fetch_lines(&dirty, 0xE));
+
+    // Once remapped, the page is left alone.
+    mem_write(&z80->cpu, 0xE000, 0x33);
+    bus_map(&z80->bus, 0xE, 1, NULL, NULL);
+    z80_reset_to_baseline(z80);
+    ck_assert_uint_eq(0x33, nvram[0x000]);
+    bus_dirty_detach(&z80->bus, &dirty);
+    z80_free(z80);
+}
+END_TEST
+
+START_TEST(test_baseline_fill)
+{
+    struct z80_t* z80 = z80_create(NULL, 0, 0xFF);
+
+    ck_assert_int_eq(0, z80_set_baseline(z80));
+    mem_write(&z80->cpu, 0xC000, 0x00);
+    z80_reset_to_baseline(z80);
+    ck_assert_uint_eq(0xFF, mem_read(&z80->cpu, 0xC000));
+
+    // A second baseline replaces the first one.
+    mem_write(&z80->cpu, 0xC000, 0x12);
+    ck_assert_int_eq(0, z80_set_baseline(z80));
+    mem_write(&z80->cpu, 0xC000, 0x34);
+    z80_reset_to_baseline(z80);
+    ck_assert_uint_eq(0x12, mem_read(&z80->cpu, 0xC000));
+
+    z80_clear_baseline(z80);
+    ck_assert_ptr_eq(NULL, z80->baseline);
+    z80_free(z80);
+}
+END_TEST
+
+START_TEST(test_baseline_fork)
+{
+    struct z80_t* parent = z80_create(NULL, 0, 0x00);
+    struct z80_t* child;
+
+    mem_write(&parent->cpu, 0x8000, 0x11);
+    ck_assert_int_eq(0, z80_set_baseline(parent));
+    mem_write(&parent->cpu, 0x8000, 0x22);
+    child = z80_fork(parent);
+    ck_assert_ptr_eq(NULL, child->baseline);
+
+    // The parent page is shared with the child, so it is swapped back.
+    z80_reset_to_baseline(parent);
+    ck_assert_uint_eq(0x11, mem_read(&parent->cpu, 0x8000));
+    ck_assert_uint_eq(0x22, mem_read(&child->cpu, 0x8000));
+
+    mem_write(&parent->cpu, 0x8000, 0x33);
+    ck_assert_uint_eq(0x22, mem_read(&child->cpu, 0x8000));
+    z80_reset_to_baseline(parent);
+    ck_assert_uint_eq(0x11, mem_read(&parent->cpu, 0x8000));
+
+    z80_free(parent);
+    ck_assert_uint_eq(0x22, mem_read(&child->cpu, 0x8000));
+    z80_free(child);
+}
+END_TEST
+
+START_TEST(test_baseline_hash)
+{
+    struct z80_t* z80 = z80_create(NULL, 0, 0x00);
+    struct z80_t* replica;
+    struct bus_hash_t hash, replica_hash;
+    uint64_t initial, baseline;
+
+    // Copy-on-write faults keep the hash in step.
+    bus_hash_attach(&z80->bus, &hash);
+    initial = z80_state_hash(&z80->cpu);
+    mem_write(&z80->cpu, 0x8000, 0x11);
+    mem_write(&z80->cpu, 0x8001, 0x00);
+    ck_assert_uint_ne(initial, z80_state_hash(&z80->cpu));
+    mem_write(&z80->cpu, 0x8000, 0x00);
+    ck_assert_uint_eq(initial, z80_state_hash(&z80->cpu));
+
+    // Resetting to the baseline brings its hash back.
+    mem_write(&z80->cpu, 0x8000, 0x11);
+    PC(z80->cpu) = 0x8000;
+    ck_assert_int_eq(0, z80_set_baseline(z80));
+    baseline = z80_state_hash(&z80->cpu);
+    mem_write(&z80->cpu, 0x8000, 0x22);
+    mem_write(&z80->cpu, 0x9000, 0x33);
+    PC(z80->cpu) = 0x9000;
+    ck_assert_uint_ne(baseline, z80_state_hash(&z80->cpu));
+    z80_reset_to_baseline(z80);
+    ck_assert_uint_eq(baseline, z80_state_hash(&z80->cpu));
+
+    // Replicas that run the same writes agree, and tell a desync apart.
+    replica = z80_fork(z80);
+    bus_hash_attach(&replica->bus, &replica_hash);
+    ck_assert_uint_eq(baseline, z80_state_hash(&replica->cpu));
+    mem_write(&z80->cpu, 0xA000, 0x44);
+    mem_write(&replica->cpu, 0xA000, 0x44);
+    ck_assert_uint_eq(z80_state_hash(&z80->cpu),
+            z80_state_hash(&replica->cpu));
+    mem_write(&replica->cpu, 0xA001, 0x01);
+    ck_assert_uint_ne(z80_state_hash(&z80->cpu),
+            z80_state_hash(&replica->cpu));
+
+    z80_free(replica);
+    z80_free(z80);
+}
+END_TEST
+
+Suite*
+gensuite_z80(void)
+{
+    TCase* tc_instance = tcase_create("Instances");
+    tcase_add_checked_fixture(tc_instance, setup_rom, teardown_rom);
+    tcase_add_test(tc_instance, test_rom_open);
+    tcase_add_test(tc_instance, test_rom_missing);
+    tcase_add_test(tc_instance, test_instance_lazy_ram);
+    tcase_add_test(tc_instance, test_instance_rom);
+    tcase_add_test(tc_instance, test_instance_shared_rom);
+    tcase_add_test(tc_instance, test_instance_bad_base);
+    tcase_add_test(tc_instance, test_fork_shares_pages);
+    tcase_add_test(tc_instance, test_fork_copy_on_write);
+    tcase_add_test(tc_instance, test_fork_chain);
+
+    TCase* tc_baseline = tcase_create("Baselines");
+    tcase_add_test(tc_baseline, test_baseline_reset);
+    tcase_add_test(tc_baseline, test_baseline_host);
+    tcase_add_test(tc_baseline, test_baseline_fill);
+    tcase_add_test(tc_baseline, test_baseline_fork);
+    tcase_add_test(tc_baseline, test_baseline_hash);
+
+    Suite* s = suite_create("Z80 instances");
+    suite_add_tcase(s, tc_instance);
+    suite_add_tcase(s, tc_baseline);
+    return s;
+}
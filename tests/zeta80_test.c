@@ -21,14 +21,54 @@
 
 #include <check.h>
 
+#include "aot_test.h"
+#include "batch_test.h"
+#include "bus_test.h"
+#include "codecache_test.h"
 #include "cpu_test.h"
+#include "decode_test.h"
+#include "diff_test.h"
+#include "executor_test.h"
+#include "idiom_test.h"
+#include "nvram_test.h"
+#include "observer_test.h"
 #include "opcodes_test.h"
+#include "pool_test.h"
+#include "replay_test.h"
+#include "rewind_test.h"
+#include "romimage_test.h"
+#include "snapshot_test.h"
+#include "state_test.h"
+#include "system_test.h"
+#include "txn_test.h"
+#include "z180_test.h"
+#include "z80_test.h"
 
 int
 main(int argc, char** argv)
 {
     SRunner* suite_runner = srunner_create(gensuite_cpu());
+    srunner_add_suite(suite_runner, gensuite_bus());
+    srunner_add_suite(suite_runner, gensuite_aot());
+    srunner_add_suite(suite_runner, gensuite_batch());
+    srunner_add_suite(suite_runner, gensuite_decode());
+    srunner_add_suite(suite_runner, gensuite_diff());
+    srunner_add_suite(suite_runner, gensuite_executor());
+    srunner_add_suite(suite_runner, gensuite_codecache());
+    srunner_add_suite(suite_runner, gensuite_idiom());
+    srunner_add_suite(suite_runner, gensuite_nvram());
+    srunner_add_suite(suite_runner, gensuite_observer());
     srunner_add_suite(suite_runner, gensuite_opcodes());
+    srunner_add_suite(suite_runner, gensuite_pool());
+    srunner_add_suite(suite_runner, gensuite_replay());
+    srunner_add_suite(suite_runner, gensuite_rewind());
+    srunner_add_suite(suite_runner, gensuite_romimage());
+    srunner_add_suite(suite_runner, gensuite_snapshot());
+    srunner_add_suite(suite_runner, gensuite_state());
+    srunner_add_suite(suite_runner, gensuite_system());
+    srunner_add_suite(suite_runner, gensuite_txn());
+    srunner_add_suite(suite_runner, gensuite_z180());
+    srunner_add_suite(suite_runner, gensuite_z80());
 
     srunner_run_all(suite_runner, CK_NORMAL);
     int failed = srunner_ntests_failed(suite_runner);
@@ -0,0 +1,457 @@
+/*
+ * This file is part of the zeta80 emulation library.
+ * Copyright (c) 2015, Dani Rodríguez
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the project's author nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ */
+
+/*
+ * zeta80-aot: ahead of time translator for fixed ROM images.
+ *
+ * The control flow graph is recovered by walking the code from the entry
+ * points given on the command line plus the RST and NMI vectors. Each
+ * basic block is emitted as a C function that calls the helpers of alu.h
+ * the interpreter uses, immediates and jump targets turned into constants
+ * and T-states added in bulk. Registers, memory and tstates are exact at
+ * every memory access and when the block returns; PC only when it returns.
+ * Opcodes are not fetched, so accesses to the ROM itself (contention on
+ * code fetches, read handlers on ROM pages) are not reproduced.
+ *
+ * The generated file exports two functions:
+ *
+ *   int  <prefix>_step(struct cpu_t* cpu)
+ *        Runs the block at PC and returns 1, or interprets a single
+ *        instruction and returns 0 if PC is not the start of a block.
+ *
+ *   void <prefix>_run(struct cpu_t* cpu, int tstates)
+ *        Calls <prefix>_step until cpu->tstates reaches the given value.
+ *
+ * Only instructions that the interpreter handles through its opcode tables
+ * are translated. Prefixed opcodes, the x = 3 table, indirect jumps and any
+ * code the analysis did not reach are left to the interpreter. The ROM is
+ * assumed not to be modified while running.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>         // getopt
+
+#include <decode.h>
+
+#define MAX_ENTRIES 64
+
+static byte rom[0x10000];
+static long rom_size;
+static word rom_base;
+
+static byte leader[0x10000];    // A block starts here
+static byte visited[0x10000];   // An instruction starts here
+static word worklist[0x10000];
+static int worklist_len;
+
+static int
+in_rom(word addr)
+{
+    return (word) (addr - rom_base) < rom_size;
+}
+
+static int
+decode_at(word addr, struct insn_t* insn)
+{
+    long offset = (word) (addr - rom_base);
+    return decode_insn(&rom[offset], rom_size - offset, addr, insn);
+}
+
+// Whether the instruction can be run by a translated block.
+static int
+translatable(const struct insn_t* insn)
+{
+    return insn->prefix == 0 && (insn->opcode >> 6) != 3;
+}
+
+static void
+add_leader(word addr)
+{
+    leader[addr] = 1;
+    if (in_rom(addr) && !visited[addr] && worklist_len < 0x10000) {
+        worklist[worklist_len++] = addr;
+    }
+}
+
+/*
+ * Walks every instruction reachable from the worklist, marking where
+ * instructions start and where basic blocks start.
+ */
+static void
+explore(void)
+{
+    struct insn_t insn;
+
+    while (worklist_len > 0) {
+        word addr = worklist[--worklist_len];
+
+        while (in_rom(addr) && !visited[addr] && decode_at(addr, &insn)) {
+            word next = addr + insn.length;
+            visited[addr] = 1;
+
+            if (insn.flow == FLOW_NEXT) {
+                if (!translatable(&insn) || (in_rom(next) && visited[next])) {
+                    leader[next] = 1;
+                }
+                addr = next;
+                continue;
+            }
+
+            if (insn.flow == FLOW_JUMP || insn.flow == FLOW_CALL) {
+                add_leader(insn.target);
+            }
+            if (insn.cond || insn.flow == FLOW_CALL
+                    || insn.flow == FLOW_HALT) {
+                add_leader(next);
+            }
+            break;
+        }
+    }
+}
+
+/*
+ * Operand names for the generated code, indexed by the fields of the
+ * opcode. Index 6 of r8 is the memory operand [HL], see get_r and set_r.
+ */
+static const char* const r8[8] = {
+    "REG_B(*cpu)", "REG_C(*cpu)", "REG_D(*cpu)", "REG_E(*cpu)",
+    "REG_H(*cpu)", "REG_L(*cpu)", NULL, "REG_A(*cpu)"
+};
+static const char* const rp[4] = {
+    "REG_BC(*cpu)", "REG_DE(*cpu)", "REG_HL(*cpu)", "SP(*cpu)"
+};
+static const char* const cc[4] = {
+    "GET_FLAG(REG_F(*cpu), FLAG_Z) == 0", "GET_FLAG(REG_F(*cpu), FLAG_Z) != 0",
+    "GET_FLAG(REG_F(*cpu), FLAG_C) == 0", "GET_FLAG(REG_F(*cpu), FLAG_C) != 0"
+};
+
+static const char*
+get_r(int index)
+{
+    return index == 6 ? "mem_read_at(cpu, 4, REG_HL(*cpu))" : r8[index];
+}
+
+static void
+set_r(FILE* out, int index, const char* value, int at)
+{
+    if (index == 6) {
+        fprintf(out, "        mem_write_at(cpu, %d, REG_HL(*cpu), %s);\n",
+                at, value);
+    } else {
+        fprintf(out, "        %s = %s;\n", r8[index], value);
+    }
+}
+
+// Whether the instruction reads or writes memory other than its operands.
+static int
+touches_memory(const struct insn_t* insn)
+{
+    int x = insn->opcode >> 6, y = (insn->opcode >> 3) & 7;
+    int z = insn->opcode & 7;
+    switch (x) {
+        case 0: return z == 2 || (z >= 4 && z <= 6 && y == 6);
+        case 1: return insn->opcode != 0x76 && (y == 6 || z == 6);
+        default: return z == 6 && y <= 2;
+    }
+}
+
+/*
+ * Emits the statements of a straight line instruction: calls to the same
+ * helpers the interpreter runs, see alu.h, with the operands taken from
+ * the ROM already. PC and tstates are left alone. Returns the T-states the
+ * interpreter counts for it, which for the opcodes it does not implement
+ * yet is 0.
+ */
+static int
+emit_insn(FILE* out, const struct insn_t* insn, const byte* code)
+{
+    int x = insn->opcode >> 6, y = (insn->opcode >> 3) & 7;
+    int z = insn->opcode & 7, p = y >> 1, q = y & 1;
+    word nn = insn->length == 3 ? code[1] | (code[2] << 8) : 0;
+    char value[64];
+
+    if (x == 1) {
+        if (insn->opcode == 0x76) return 0;     // HALT
+        set_r(out, y, get_r(z), 4);
+        return (y == 6 || z == 6) ? 7 : 4;
+    }
+    if (x == 2) {
+        if (y > 2) return 0;                    // SBC, AND, XOR, OR, CP
+        if (y == 2) {
+            fprintf(out, "        alu_sub(cpu, %s);\n", get_r(z));
+        } else {
+            fprintf(out, "        alu_add(cpu, %s, %d);\n", get_r(z), y);
+        }
+        return z == 6 ? 7 : 4;
+    }
+
+    switch (z) {
+        case 0:
+            if (y == 1) fprintf(out, "        alu_ex_af(cpu);\n");
+            return 4;                           // NOP, EX AF, AF'
+        case 1:
+            if (q == 0) {
+                fprintf(out, "        %s = 0x%04X;\n", rp[p], nn);
+                return 10;
+            }
+            fprintf(out, "        alu_add_hl(cpu, %s);\n", rp[p]);
+            return 11;
+        case 2:
+            switch (y) {
+                case 0:
+                    fprintf(out, "        mem_write_at(cpu, 4, REG_BC(*cpu), REG_A(*cpu));\n");
+                    return 7;
+                case 1:
+                    fprintf(out, "        REG_A(*cpu) = mem_read_at(cpu, 4, REG_BC(*cpu));\n");
+                    return 7;
+                case 2:
+                    fprintf(out, "        mem_write_at(cpu, 4, REG_DE(*cpu), REG_A(*cpu));\n");
+                    return 7;
+                case 3:
+                    fprintf(out, "        REG_A(*cpu) = mem_read_at(cpu, 4, REG_DE(*cpu));\n");
+                    return 7;
+                case 4:
+                    fprintf(out, "        mem_write16(cpu, 10, 0x%04X, REG_HL(*cpu));\n", nn);
+                    return 16;
+                case 5:
+                    fprintf(out, "        REG_HL(*cpu) = mem_read16(cpu, 10, 0x%04X);\n", nn);
+                    return 16;
+                case 6:
+                    fprintf(out, "        mem_write_at(cpu, 10, 0x%04X, REG_A(*cpu));\n", nn);
+                    return 13;
+                default:
+                    fprintf(out, "        REG_A(*cpu) = mem_read_at(cpu, 10, 0x%04X);\n", nn);
+                    return 13;
+            }
+        case 3:
+            fprintf(out, "        %s%s;\n", rp[p], q ? "--" : "++");
+            return 6;
+        case 4:
+        case 5:
+            snprintf(value, sizeof(value), "alu_%s(cpu, %s)",
+                    z == 4 ? "inc" : "dec", get_r(y));
+            set_r(out, y, value, 8);
+            return y == 6 ? 11 : 4;
+        case 6:
+            snprintf(value, sizeof(value), "0x%02X", code[1]);
+            set_r(out, y, value, 7);
+            return 7;
+        default:
+            if (y == 4) return 0;               // DAA
+            if (y < 4) {
+                fprintf(out, "        alu_rotate(cpu, %d);\n", y);
+            } else {
+                fprintf(out, "        alu_flags(cpu, %d);\n", y);
+            }
+            return 4;
+    }
+}
+
+/*
+ * Emits a block. T-states are added as a constant for runs of register
+ * only instructions, and brought up to date before every instruction that
+ * touches memory, so memory handlers and contention see the same counter
+ * as with the interpreter. PC is only set when the block exits.
+ */
+static int
+emit_block(FILE* out, const char* prefix, word start)
+{
+    struct insn_t insn;
+    word addr = start;
+    int count = 0, pending = 0, jumped = 0, i;
+
+    fprintf(out, "static void\n%s_%04X(struct cpu_t* cpu)\n{\n",
+            prefix, start);
+    while (decode_at(addr, &insn) && translatable(&insn)) {
+        const byte* code = &rom[(word) (addr - rom_base)];
+        word next = addr + insn.length;
+        int y = (insn.opcode >> 3) & 7;
+
+        fprintf(out, "    //");
+        for (i = 0; i < insn.length; i++) {
+            fprintf(out, " %02X", code[i]);
+        }
+        fputc('\n', out);
+        count++;
+        addr = next;
+
+        if (insn.flow == FLOW_JUMP) {
+            // DJNZ d, JR d, JR cc, d: always the last of the block.
+            if (pending) fprintf(out, "    cpu->tstates += %d;\n", pending);
+            pending = 0;
+            if (y == 3) {
+                fprintf(out, "    PC(*cpu) = 0x%04X;\n", insn.target);
+                fprintf(out, "    cpu->tstates += 12;\n");
+            } else {
+                fprintf(out, "    if (%s) {\n",
+                        y == 2 ? "--REG_B(*cpu) != 0" : cc[y - 4]);
+                fprintf(out, "        PC(*cpu) = 0x%04X;\n", insn.target);
+                fprintf(out, "        cpu->tstates += %d;\n",
+                        y == 2 ? 13 : 12);
+                fprintf(out, "    } else {\n");
+                fprintf(out, "        PC(*cpu) = 0x%04X;\n", next);
+                fprintf(out, "        cpu->tstates += %d;\n",
+                        y == 2 ? 8 : 7);
+                fprintf(out, "    }\n");
+            }
+            jumped = 1;
+            break;
+        }
+
+        if (touches_memory(&insn) && pending) {
+            fprintf(out, "    cpu->tstates += %d;\n", pending);
+            pending = 0;
+        }
+        fprintf(out, "    {\n");
+        pending += emit_insn(out, &insn, code);
+        fprintf(out, "    }\n");
+
+        if (insn.flow != FLOW_NEXT || !in_rom(addr) || leader[addr]
+                || !visited[addr]) {
+            break;
+        }
+    }
+    if (!jumped) {
+        // Falls through to the next block, or to the interpreter.
+        if (pending) fprintf(out, "    cpu->tstates += %d;\n", pending);
+        fprintf(out, "    PC(*cpu) = 0x%04X;\n", addr);
+    }
+    fprintf(out, "}\n\n");
+    return count;
+}
+
+static void
+emit(FILE* out, const char* prefix, const char* source)
+{
+    struct insn_t insn;
+    int blocks = 0, insns = 0;
+    long i;
+
+    fprintf(out, "/*\n * Generated by zeta80-aot from %s. Do not edit.\n */\n\n",
+            source);
+    fprintf(out, "#include <alu.h>\n#include <cpu.h>\n#include <opcodes.h>\n\n");
+
+    for (i = 0; i < rom_size; i++) {
+        word addr = rom_base + i;
+        if (leader[addr] && visited[addr] && decode_at(addr, &insn)
+                && translatable(&insn)) {
+            insns += emit_block(out, prefix, addr);
+            blocks++;
+        }
+    }
+
+    fprintf(out, "int\n%s_step(struct cpu_t* cpu)\n{\n", prefix);
+    fprintf(out, "    switch (PC(*cpu)) {\n");
+    for (i = 0; i < rom_size; i++) {
+        word addr = rom_base + i;
+        if (leader[addr] && visited[addr] && decode_at(addr, &insn)
+                && translatable(&insn)) {
+            fprintf(out, "        case 0x%04X: %s_%04X(cpu); return 1;\n",
+                    addr, prefix, addr);
+        }
+    }
+    fprintf(out, "        default: execute_opcode(cpu); return 0;\n");
+    fprintf(out, "    }\n}\n\n");
+
+    fprintf(out, "void\n%s_run(struct cpu_t* cpu, int tstates)\n{\n", prefix);
+    fprintf(out, "    while (cpu->tstates < tstates) {\n");
+    fprintf(out, "        %s_step(cpu);\n", prefix);
+    fprintf(out, "    }\n}\n");
+
+    fprintf(stderr, "zeta80-aot: %d blocks, %d instructions translated\n",
+            blocks, insns);
+}
+
+static void
+usage(const char* argv0)
+{
+    fprintf(stderr, "Usage: %s [-b base] [-e entry]... [-p prefix] "
+            "[-o output.c] rom.bin\n", argv0);
+    fprintf(stderr, "  -b base    address where the ROM is mapped (0)\n");
+    fprintf(stderr, "  -e entry   extra entry point, can be repeated\n");
+    fprintf(stderr, "  -p prefix  prefix for generated functions (aot)\n");
+    fprintf(stderr, "  -o output  output file (stdout)\n");
+}
+
+int
+main(int argc, char** argv)
+{
+    const char* prefix = "aot";
+    const char* output = NULL;
+    word entries[MAX_ENTRIES];
+    int nentries = 0, opt, i;
+    FILE* file;
+
+    while ((opt = getopt(argc, argv, "b:e:p:o:h")) != -1) {
+        switch (opt) {
+            case 'b':
+                rom_base = strtol(optarg, NULL, 0);
+                break;
+            case 'e':
+                if (nentries < MAX_ENTRIES) {
+                    entries[nentries++] = strtol(optarg, NULL, 0);
+                }
+                break;
+            case 'p':
+                prefix = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    file = fopen(argv[optind], "rb");
+    if (!file) {
+        perror(argv[optind]);
+        return 1;
+    }
+    rom_size = fread(rom, 1, sizeof(rom) - rom_base, file);
+    fclose(file);
+
+    // Reset and NMI vectors are always entry points when they are in ROM.
+    for (i = 0; i <= 0x38; i += 8) {
+        add_leader(i);
+    }
+    add_leader(0x66);
+    for (i = 0; i < nentries; i++) {
+        add_leader(entries[i]);
+    }
+    explore();
+
+    file = output ? fopen(output, "w") : stdout;
+    if (!file) {
+        perror(output);
+        return 1;
+    }
+    emit(file, prefix, argv[optind]);
+    if (output) fclose(file);
+    return 0;
+}